@@ -57,6 +57,11 @@ int8_t embedDBInitIndex(embedDBState *state);
 int8_t embedDBInitIndexFromFile(embedDBState *state);
 int8_t embedDBInitVarData(embedDBState *state);
 int8_t embedDBInitVarDataFromFile(embedDBState *state);
+int8_t embedDBInitSecondaryIndex(embedDBState *state);
+int8_t embedDBInitSecondaryIndexFromFile(embedDBState *state);
+int8_t embedDBSecondaryIndexPage(embedDBState *state, void *page, id_t pageNum);
+int8_t embedDBSecondaryIteratorNextSegment(embedDBState *state, embedDBSecondaryIterator *it);
+int8_t embedDBPutRecord(embedDBState *state, void *key, void *data);
 int8_t shiftRecordLevelConsistencyBlocks(embedDBState *state);
 void embedDBInitSplineFromFile(embedDBState *state);
 int32_t getMaxError(embedDBState *state, void *buffer);
@@ -65,6 +70,11 @@ int8_t embedDBSetupVarDataStream(embedDBState *state, void *key, embedDBVarDataS
 uint32_t cleanSpline(embedDBState *state, uint32_t minPageNumber);
 void readToWriteBuf(embedDBState *state);
 void readToWriteBufVar(embedDBState *state);
+void embedDBBloomAdd(embedDBState *state, void *bloom, int8_t column, void *value);
+int8_t bloomContains(uint8_t *bloom, uint8_t *query, int8_t size);
+uint16_t embedDBSearchNodeLowerBound(embedDBState *state, void *buffer, void *key);
+void embedDBPageBounds(embedDBState *state, void *key, uint32_t *first, uint32_t *last, uint32_t *location);
+int8_t embedDBFindLowerBoundPage(embedDBState *state, void *key, uint32_t *pageId);
 
 void printBitmap(char *bm) {
     for (int8_t i = 0; i <= 7; i++) {
@@ -85,6 +95,40 @@ int8_t bitmapOverlap(uint8_t *bm1, uint8_t *bm2, int8_t size) {
     return 0;
 }
 
+/**
+ * @brief	Determine if every bit set in the query Bloom filter is also set in the page Bloom filter
+ * @return	1 if the page may contain the queried value, else 0
+ */
+int8_t bloomContains(uint8_t *bloom, uint8_t *query, int8_t size) {
+    for (int8_t i = 0; i < size; i++)
+        if ((bloom[i] & query[i]) != query[i])
+            return 0;
+
+    return 1;
+}
+
+/**
+ * @brief	Sets the bits for a column value in a Bloom filter.
+ * 			Uses FNV-1a seeded with the column index and double hashing to derive the bit positions.
+ * @param	state	embedDB algorithm state structure
+ * @param	bloom	Bloom filter of state->bloomFilterSize bytes
+ * @param	column	Index of the Bloom filter column the value belongs to
+ * @param	value	Pointer to the column value
+ */
+void embedDBBloomAdd(embedDBState *state, void *bloom, int8_t column, void *value) {
+    uint32_t hash = 2166136261u ^ (uint32_t)column;
+    for (uint8_t i = 0; i < state->bloomColumnSizes[column]; i++) {
+        hash ^= ((uint8_t *)value)[i];
+        hash *= 16777619u;
+    }
+    uint32_t step = ((hash >> 17) | (hash << 15)) | 1;
+    uint32_t numBits = (uint32_t)state->bloomFilterSize * 8;
+    for (uint8_t i = 0; i < state->numBloomHashes; i++) {
+        uint32_t bit = (hash + i * step) % numBits;
+        ((uint8_t *)bloom)[bit / 8] |= (uint8_t)(1 << (bit % 8));
+    }
+}
+
 void initBufferPage(embedDBState *state, int pageNum) {
     /* Initialize page */
     uint16_t i = 0;
@@ -109,6 +153,11 @@ void initBufferPage(embedDBState *state, int pageNum) {
         for (i = 0; i < state->dataSize; i++) {
             ((int8_t *)min)[i] = 1;
         }
+
+        /* Without min/max values the initialization above can overlap the Bloom filter */
+        if (pageNum == EMBEDDB_DATA_WRITE_BUFFER && EMBEDDB_USING_BLOOM(state->parameters)) {
+            memset(EMBEDDB_GET_BLOOM(buf, state), 0, state->bloomFilterSize);
+        }
     }
 }
 
@@ -138,6 +187,8 @@ void *embedDBGetMaxKey(embedDBState *state, void *buffer) {
  * @return  Return 0 if success. Non-zero value if error.
  */
 int8_t embedDBInit(embedDBState *state, size_t indexMaxError) {
+    state->ruleEngine = NULL;
+
     if (state->keySize > 8) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Key size is too large. Max key size is 8 bytes.\n");
@@ -187,8 +238,38 @@ int8_t embedDBInit(embedDBState *state, size_t indexMaxError) {
         state->headerSize += state->bitmapSize;
     }
 
+    /* The min/max values are at a fixed offset. A bitmap smaller than 8 bytes leaves a gap before them, otherwise the records would overwrite them */
     if (EMBEDDB_USING_MAX_MIN(state->parameters))
-        state->headerSize += state->keySize * 2 + state->dataSize * 2;
+        state->headerSize = max(state->headerSize, EMBEDDB_MIN_OFFSET) + state->keySize * 2 + state->dataSize * 2;
+
+    /* Bloom filter goes after the bitmap, or after the min/max values when they are used */
+    if (EMBEDDB_USING_BLOOM(state->parameters)) {
+        if (!EMBEDDB_USING_INDEX(state->parameters)) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Bloom filters are stored in the index and require EMBEDDB_USE_INDEX.\n");
+#endif
+            return -1;
+        }
+        if (state->bloomFilterSize <= 0 || state->bloomFilterSize > 32 || state->numBloomHashes == 0 ||
+            state->numBloomColumns == 0 || state->numBloomColumns > EMBEDDB_MAX_BLOOM_COLUMNS) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Bloom filter size must be between 1 and 32 bytes with at least one hash and between 1 and %d columns.\n", EMBEDDB_MAX_BLOOM_COLUMNS);
+#endif
+            return -1;
+        }
+        for (uint8_t i = 0; i < state->numBloomColumns; i++) {
+            if (state->bloomColumnSizes[i] == 0 || state->bloomColumnOffsets[i] + state->bloomColumnSizes[i] > state->dataSize) {
+#ifdef PRINT_ERRORS
+                printf("ERROR: Bloom filter column %d is outside of the record data.\n", i);
+#endif
+                return -1;
+            }
+        }
+        state->bloomFilterOffset = EMBEDDB_USING_MAX_MIN(state->parameters) ? EMBEDDB_MIN_OFFSET + state->keySize * 2 + state->dataSize * 2 : state->headerSize;
+        state->headerSize = state->bloomFilterOffset + state->bloomFilterSize;
+    } else {
+        state->bloomFilterSize = 0;
+    }
 
     /* Flags to show that these values have not been initalized with actual data yet */
     state->bufferedPageId = -1;
@@ -251,6 +332,23 @@ int8_t embedDBInit(embedDBState *state, size_t indexMaxError) {
         return indexInitResult;
     }
 
+    /* Allocate file and buffers for the secondary index */
+    if (EMBEDDB_USING_SECONDARY_INDEX(state->parameters)) {
+        if (state->bufferSizeInBlocks < EMBEDDB_SECONDARY_INDEX_READ_BUFFER(state->parameters) + 1) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: embedDB using a secondary index requires two more page buffers than it would use without it.\n");
+#endif
+            return -1;
+        }
+        int8_t secondaryIndexInitResult = embedDBInitSecondaryIndex(state);
+        if (secondaryIndexInitResult != 0) {
+            return secondaryIndexInitResult;
+        }
+    } else {
+        state->secondaryIndexFile = NULL;
+        state->numSecondaryIndexPages = 0;
+    }
+
     /* Allocate file and buffer for variable data */
     int8_t varDataInitResult = 0;
     if (EMBEDDB_USING_VDATA(state->parameters)) {
@@ -277,6 +375,7 @@ int8_t embedDBInitData(embedDBState *state) {
     state->nextDataPageId = 0;
     state->numAvailDataPages = state->numDataPages;
     state->minDataPageId = 0;
+    state->minFullDataPageId = 0;
 
     if (state->dataFile == NULL) {
 #ifdef PRINT_ERRORS
@@ -400,6 +499,8 @@ int8_t embedDBInitDataFromFile(embedDBState *state) {
     }
 
     state->nextDataPageId = maxLogicalPageId + 1;
+    /* Any recovered page may have been flushed before it was full */
+    state->minFullDataPageId = state->nextDataPageId;
     readPage(state, physicalPageIDOfSmallestData);
     memcpy(&(state->minDataPageId), buffer, sizeof(id_t));
     state->numAvailDataPages = state->numDataPages + state->minDataPageId - maxLogicalPageId - 1;
@@ -572,6 +673,8 @@ int8_t embedDBInitDataFromFileWithRecordLevelConsistency(embedDBState *state) {
     }
 
     state->nextDataPageId = maxLogicalPageId + 1;
+    /* Any recovered page may have been flushed before it was full */
+    state->minFullDataPageId = state->nextDataPageId;
     readPage(state, physicalPageIDOfSmallestData);
     memcpy(&(state->minDataPageId), buffer, sizeof(id_t));
     state->numAvailDataPages = state->numDataPages + state->minDataPageId - maxLogicalPageId - 1 - (2 * blockSize);
@@ -601,7 +704,8 @@ int8_t embedDBInitIndex(embedDBState *state) {
     /* Setup index file. */
 
     /* 4 for id, 2 for count, 2 unused, 4 for minKey (pageId), 4 for maxKey (pageId) */
-    state->maxIdxRecordsPerPage = (state->pageSize - 16) / state->bitmapSize;
+    /* Each index record is the page bitmap followed by the page Bloom filter (if used) */
+    state->maxIdxRecordsPerPage = (state->pageSize - 16) / (state->bitmapSize + state->bloomFilterSize);
 
     /* Allocate third page of buffer as index output page */
     initBufferPage(state, EMBEDDB_INDEX_WRITE_BUFFER);
@@ -694,6 +798,102 @@ int8_t embedDBInitIndexFromFile(embedDBState *state) {
     return 0;
 }
 
+int8_t embedDBInitSecondaryIndex(embedDBState *state) {
+    if (state->secondaryIndexSize <= 0 || state->secondaryIndexSize > 8 || state->secondaryIndexOffset + state->secondaryIndexSize > state->dataSize || state->compareSecondaryIndex == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Secondary index column must be at most 8 bytes, inside of the record data and have a comparator\n");
+#endif
+        return -1;
+    }
+
+    /* Same header as index pages: 4 for id, 2 for count, 2 unused, 4 for first data page id, 4 for last data page id */
+    /* Each entry is a column value followed by the id of a data page containing it */
+    state->maxSecondaryIndexRecordsPerPage = (state->pageSize - EMBEDDB_IDX_HEADER_SIZE) / (state->secondaryIndexSize + sizeof(id_t));
+    if (state->maxSecondaryIndexRecordsPerPage < state->maxRecordsPerPage) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: The secondary index entries of a full data page must fit on one secondary index page\n");
+#endif
+        return -1;
+    }
+
+    if (state->numSecondaryIndexPages < state->eraseSizeInPages * 2 || state->numSecondaryIndexPages % state->eraseSizeInPages != 0) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Secondary index space must be a multiple of erase block size and at least two erase blocks\n");
+#endif
+        return -1;
+    }
+
+    if (state->secondaryIndexFile == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: No secondary index file provided!\n");
+#endif
+        return -1;
+    }
+
+    memset((int8_t *)state->buffer + state->pageSize * EMBEDDB_SECONDARY_INDEX_WRITE_BUFFER(state->parameters), 0, state->pageSize);
+    state->bufferedSecondaryIndexPageId = -1;
+    state->nextSecondaryIndexPageId = 0;
+    state->minSecondaryIndexPageId = 0;
+    state->numAvailSecondaryIndexPages = state->numSecondaryIndexPages;
+
+    if (!EMBEDDB_RESETING_DATA(state->parameters)) {
+        int8_t openStatus = state->fileInterface->open(state->secondaryIndexFile, EMBEDDB_FILE_MODE_R_PLUS_B);
+        if (openStatus) {
+            return embedDBInitSecondaryIndexFromFile(state);
+        }
+    }
+
+    int8_t openStatus = state->fileInterface->open(state->secondaryIndexFile, EMBEDDB_FILE_MODE_W_PLUS_B);
+    if (!openStatus) {
+#ifdef PRINT_ERRORS
+        printf("Error: Can't open secondary index file!\n");
+#endif
+        return -1;
+    }
+
+    return 0;
+}
+
+int8_t embedDBInitSecondaryIndexFromFile(embedDBState *state) {
+    id_t logicalPageId = 0;
+    id_t maxLogicalPageId = 0;
+    id_t physicalPageId = 0;
+
+    /* This will become zero if there is no more to read */
+    int8_t moreToRead = !(readSecondaryIndexPage(state, physicalPageId));
+
+    bool haveWrappedInMemory = false;
+    uint32_t count = 0;
+    void *buffer = (int8_t *)state->buffer + state->pageSize * EMBEDDB_SECONDARY_INDEX_READ_BUFFER(state->parameters);
+
+    while (moreToRead && count < state->numSecondaryIndexPages) {
+        memcpy(&logicalPageId, buffer, sizeof(id_t));
+        if (count == 0 || logicalPageId == maxLogicalPageId + 1) {
+            maxLogicalPageId = logicalPageId;
+            physicalPageId++;
+            moreToRead = !(readSecondaryIndexPage(state, physicalPageId));
+            count++;
+        } else {
+            haveWrappedInMemory = logicalPageId == maxLogicalPageId - state->numSecondaryIndexPages + 1;
+            break;
+        }
+    }
+
+    if (count == 0)
+        return 0;
+
+    state->nextSecondaryIndexPageId = maxLogicalPageId + 1;
+    id_t physicalPageIdOfSmallestData = 0;
+    if (haveWrappedInMemory) {
+        physicalPageIdOfSmallestData = logicalPageId % state->numSecondaryIndexPages;
+    }
+    readSecondaryIndexPage(state, physicalPageIdOfSmallestData);
+    memcpy(&(state->minSecondaryIndexPageId), buffer, sizeof(id_t));
+    state->numAvailSecondaryIndexPages = state->numSecondaryIndexPages + state->minSecondaryIndexPageId - maxLogicalPageId - 1;
+
+    return 0;
+}
+
 int8_t embedDBInitVarData(embedDBState *state) {
     // Initialize variable data outpt buffer
     initBufferPage(state, EMBEDDB_VAR_WRITE_BUFFER(state->parameters));
@@ -867,6 +1067,8 @@ void embedDBPrintInit(embedDBState *state) {
     printf("Buffer size: %d  Page size: %d\n", state->bufferSizeInBlocks, state->pageSize);
     printf("Key size: %d Data size: %d %sRecord size: %d\n", state->keySize, state->dataSize, EMBEDDB_USING_VDATA(state->parameters) ? "Variable data pointer size: 4 " : "", state->recordSize);
     printf("Use index: %d  Max/min: %d Sum: %d Bmap: %d\n", EMBEDDB_USING_INDEX(state->parameters), EMBEDDB_USING_MAX_MIN(state->parameters), EMBEDDB_USING_SUM(state->parameters), EMBEDDB_USING_BMAP(state->parameters));
+    if (EMBEDDB_USING_BLOOM(state->parameters))
+        printf("Bloom filter size: %d  Hashes: %d  Columns: %d\n", state->bloomFilterSize, state->numBloomHashes, state->numBloomColumns);
     printf("Header size: %d  Records per page: %d\n", state->headerSize, state->maxRecordsPerPage);
 }
 
@@ -1003,6 +1205,18 @@ void indexPage(embedDBState *state, uint32_t pageNumber) {
  * @return	Return 0 if success. Non-zero value if error.
  */
 int8_t embedDBPut(embedDBState *state, void *key, void *data) {
+#ifdef EMBEDDB_RULE_THREAD
+    /* The rule worker thread may be reading storage */
+    int8_t locked = lockActiveRules(state);
+    int8_t result = embedDBPutRecord(state, key, data);
+    unlockActiveRules(state, locked);
+    return result;
+#else
+    return embedDBPutRecord(state, key, data);
+#endif
+}
+
+int8_t embedDBPutRecord(embedDBState *state, void *key, void *data) {
     /* Copy record into block */
 
     count_t count = EMBEDDB_GET_COUNT(state->buffer);
@@ -1050,8 +1264,10 @@ int8_t embedDBPut(embedDBState *state, void *key, void *data) {
             EMBEDDB_INC_COUNT(buf);
 
             /* Copy record onto index page */
+            int8_t *idxRecord = (int8_t *)buf + EMBEDDB_IDX_HEADER_SIZE + (state->bitmapSize + state->bloomFilterSize) * idxcount;
             void *bm = EMBEDDB_GET_BITMAP(state->buffer);
-            memcpy((void *)((int8_t *)buf + EMBEDDB_IDX_HEADER_SIZE + state->bitmapSize * idxcount), bm, state->bitmapSize);
+            memcpy(idxRecord, bm, state->bitmapSize);
+            memcpy(idxRecord + state->bitmapSize, EMBEDDB_GET_BLOOM(state->buffer, state), state->bloomFilterSize);
         }
 
         updateMaxiumError(state, state->buffer);
@@ -1114,6 +1330,14 @@ int8_t embedDBPut(embedDBState *state, void *key, void *data) {
         state->updateBitmap(data, bm);
     }
 
+    if (EMBEDDB_USING_BLOOM(state->parameters)) {
+        /* Update Bloom filter with each filtered column */
+        void *bloom = EMBEDDB_GET_BLOOM(state->buffer, state);
+        for (uint8_t i = 0; i < state->numBloomColumns; i++) {
+            embedDBBloomAdd(state, bloom, i, (int8_t *)data + state->bloomColumnOffsets[i]);
+        }
+    }
+
     /* If using record level consistency, we need to immediately write the updated page to storage */
     if (EMBEDDB_USING_RECORD_LEVEL_CONSISTENCY(state->parameters)) {
         /* Need to move record level consistency pointers if on a block boundary */
@@ -1124,7 +1348,11 @@ int8_t embedDBPut(embedDBState *state, void *key, void *data) {
         return writeTemporaryPage(state, state->buffer);
     }
     if(state->rules != NULL && state->rules[0] != NULL){
-        executeRules(state, key, data);
+        if (EMBEDDB_USING_ASYNC_RULES(state->parameters)) {
+            enqueueRuleRecord(state, key, data);
+        } else {
+            executeRules(state, key, data);
+        }
     }
 
     return 0;
@@ -1462,19 +1690,19 @@ int8_t searchBuffer(embedDBState *state, void *buffer, void *key, void *data) {
 }
 
 /**
- * @brief	Given a key, returns data associated with key.
- * 			Note: Space for data must be already allocated.
- * 			Data is copied from database into data buffer.
+ * @brief	Given a key, returns a pointer to the data associated with key without copying it.
+ * 			The pointer is into the read or write page buffer and is valid until the next call on this state.
  * @param	state	embedDB algorithm state structure
  * @param	key		Key for record
- * @param	data	Pre-allocated memory to copy data for record
- * @return	Return 0 if success. Returns -2 if requested key is less than the minimum stored key. Non-zero value if error.
+ * @param	data	Return variable for a pointer to the data of the record
+ * @return	Return 0 if success. Non-zero value if error.
  */
-int8_t embedDBGet(embedDBState *state, void *key, void *data) {
+int8_t embedDBGetRef(embedDBState *state, void *key, const void **data) {
     void *outputBuffer = state->buffer;
     if (state->nextDataPageId == 0) {
-        int8_t success = searchBuffer(state, outputBuffer, key, data);
-        if (success != NO_RECORD_FOUND) {
+        id_t nextId = EMBEDDB_GET_COUNT(outputBuffer) == 0 ? NO_RECORD_FOUND : embedDBSearchNode(state, outputBuffer, key, 0);
+        if (nextId != NO_RECORD_FOUND) {
+            *data = (int8_t *)outputBuffer + state->headerSize + state->recordSize * nextId + state->keySize;
             return 0;
         }
         return -1;
@@ -1484,7 +1712,6 @@ int8_t embedDBGet(embedDBState *state, void *key, void *data) {
     memcpy(&thisKey, key, state->keySize);
 
     void *buf = (int8_t *)state->buffer + state->pageSize;
-    int16_t numReads = 0;
 
     // if write buffer is not empty
     if ((EMBEDDB_GET_COUNT(outputBuffer) != 0)) {
@@ -1499,7 +1726,11 @@ int8_t embedDBGet(embedDBState *state, void *key, void *data) {
 
         // if key >= buffer's min, check buffer
         if (thisKey >= bufMinKey) {
-            return (searchBuffer(state, outputBuffer, key, data) != NO_RECORD_FOUND) ? 0 : NO_RECORD_FOUND;
+            id_t nextId = embedDBSearchNode(state, outputBuffer, key, 0);
+            if (nextId == NO_RECORD_FOUND)
+                return NO_RECORD_FOUND;
+            *data = (int8_t *)outputBuffer + state->headerSize + state->recordSize * nextId + state->keySize;
+            return 0;
         }
     }
 
@@ -1523,13 +1754,30 @@ int8_t embedDBGet(embedDBState *state, void *key, void *data) {
 
     if (nextId != -1) {
         /* Key found */
-        memcpy(data, (void *)((int8_t *)buf + state->headerSize + state->recordSize * nextId + state->keySize), state->dataSize);
+        *data = (int8_t *)buf + state->headerSize + state->recordSize * nextId + state->keySize;
         return 0;
     }
     // Key not found
     return -1;
 }
 
+/**
+ * @brief	Given a key, returns data associated with key.
+ * 			Note: Space for data must be already allocated.
+ * 			Data is copied from database into data buffer.
+ * @param	state	embedDB algorithm state structure
+ * @param	key		Key for record
+ * @param	data	Pre-allocated memory to copy data for record
+ * @return	Return 0 if success. Returns -2 if requested key is less than the minimum stored key. Non-zero value if error.
+ */
+int8_t embedDBGet(embedDBState *state, void *key, void *data) {
+    const void *dataRef;
+    int8_t result = embedDBGetRef(state, key, &dataRef);
+    if (result == 0)
+        memcpy(data, dataRef, state->dataSize);
+    return result;
+}
+
 /**
  * @brief	Given a key, returns data associated with key.
  * 			Data is copied from database into data buffer.
@@ -1586,226 +1834,1284 @@ int8_t embedDBGetVar(embedDBState *state, void *key, void *data, embedDBVarDataS
 }
 
 /**
- * @brief	Initialize iterator on embedDB structure.
- * @param	state	embedDB algorithm state structure
- * @param	it		embedDB iterator state structure
+ * @brief	Copies the key and data of a record on a page into the return variables.
+ * @param	state		embedDB algorithm state structure
+ * @param	buffer		Pointer to in-memory buffer holding the page
+ * @param	recordNum	Record number on the page
+ * @param	key			Return variable for the key. May be NULL.
+ * @param	data		Return variable for the data. May be NULL.
  */
-void embedDBInitIterator(embedDBState *state, embedDBIterator *it) {
-    /* Build query bitmap (if used) */
-    it->queryBitmap = NULL;
-    if (EMBEDDB_USING_BMAP(state->parameters)) {
-        /* Verify that bitmap index is useful (must have set either min or max data value) */
-        if (it->minData != NULL || it->maxData != NULL) {
-            it->queryBitmap = calloc(1, state->bitmapSize);
-            state->buildBitmapFromRange(it->minData, it->maxData, it->queryBitmap);
+void embedDBCopyRecord(embedDBState *state, void *buffer, id_t recordNum, void *key, void *data) {
+    int8_t *record = (int8_t *)buffer + state->headerSize + state->recordSize * recordNum;
+    if (key != NULL)
+        memcpy(key, record, state->keySize);
+    if (data != NULL)
+        memcpy(data, record + state->keySize, state->dataSize);
+}
+
+/**
+ * @brief	Finds the record with the largest key that is <= key, such as the value at or before a time.
+ * 			Reads the data page predicted by the spline, and the page after it if the key is in the gap between them.
+ * @param	state		embedDB algorithm state structure
+ * @param	key			Key to search for
+ * @param	foundKey	Return variable for the key of the record. May be NULL.
+ * @param	data		Pre-allocated memory to copy data for record. May be NULL.
+ * @return	Return 0 if success. -1 if no stored key is <= key or on error.
+ */
+int8_t embedDBGetFloor(embedDBState *state, void *key, void *foundKey, void *data) {
+    void *writeBuf = (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+    if (EMBEDDB_GET_COUNT(writeBuf) != 0 && state->compareKey(key, embedDBGetMinKey(state, writeBuf)) >= 0) {
+        embedDBCopyRecord(state, writeBuf, embedDBSearchNode(state, writeBuf, key, 1), foundKey, data);
+        return 0;
+    }
+
+    if (state->nextDataPageId == state->minDataPageId)
+        return NO_RECORD_FOUND;
+
+    uint32_t first, last, location;
+    embedDBPageBounds(state, key, &first, &last, &location);
+    uint32_t boundFirst = first, boundLast = last;
+
+    /* Find the last page whose smallest key is <= key. The floor on each such page is copied out when the page is
+       read, so the page does not have to be read again once the search moves past it. */
+    void *buf = (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize;
+    int8_t found = 0;
+    uint32_t middle = location;
+    while (1) {
+        while (first <= last) {
+            if (readPage(state, middle % state->numDataPages) != 0)
+                return -1;
+            if (state->compareKey(embedDBGetMinKey(state, buf), key) > 0) {
+                if (middle == first)
+                    break;
+                last = middle - 1;
+            } else {
+                embedDBCopyRecord(state, buf, embedDBSearchNode(state, buf, key, 1), foundKey, data);
+                found = 1;
+                if (state->compareKey(embedDBGetMaxKey(state, buf), key) >= 0)
+                    return 0;
+                first = middle + 1;
+                if (middle == location) {
+                    /* The key is after the predicted page, so the next page most likely starts after it */
+                    middle = first;
+                    continue;
+                }
+            }
+            middle = first + (last - first) / 2;
+        }
+
+        if (!found && boundFirst > state->minDataPageId) {
+            /* Every page in the bounds starts after the key, continue with the pages before them */
+            first = state->minDataPageId;
+            last = boundFirst - 1;
+            boundFirst = first;
+        } else if (found && first > boundLast && boundLast + 1 < state->nextDataPageId) {
+            /* Every page in the bounds starts before the key, continue with the pages after them */
+            first = boundLast + 1;
+            last = state->nextDataPageId - 1;
+            boundLast = last;
+        } else {
+            return found ? 0 : NO_RECORD_FOUND;
         }
+        middle = location = first;
     }
+}
 
-#ifdef PRINT_ERRORS
-    if (!EMBEDDB_USING_BMAP(state->parameters)) {
-        printf("WARN: Iterator not using index. If this is not intended, ensure that the embedDBState is using a bitmap and was initialized with an index file\n");
-    } else if (!EMBEDDB_USING_INDEX(state->parameters)) {
-        printf("WARN: Iterator not using index to full extent. If this is not intended, ensure that the embedDBState was initialized with an index file\n");
+/**
+ * @brief	Finds the record with the smallest key that is >= key, such as the first reading at or after a time.
+ * 			Reads one data page, or none if the record is in the write buffer.
+ * @param	state		embedDB algorithm state structure
+ * @param	key			Key to search for
+ * @param	foundKey	Return variable for the key of the record. May be NULL.
+ * @param	data		Pre-allocated memory to copy data for record. May be NULL.
+ * @return	Return 0 if success. -1 if no stored key is >= key or on error.
+ */
+int8_t embedDBGetCeil(embedDBState *state, void *key, void *foundKey, void *data) {
+    void *writeBuf = (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+    count_t bufferCount = EMBEDDB_GET_COUNT(writeBuf);
+    /* Stored pages only hold keys smaller than those of the write buffer */
+    if (bufferCount == 0 || state->compareKey(key, embedDBGetMinKey(state, writeBuf)) <= 0) {
+        void *buf = (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize;
+        uint32_t pageId;
+        int8_t found = embedDBFindLowerBoundPage(state, key, &pageId);
+        if (found == -1)
+            return -1;
+        if (found == 0) {
+            embedDBCopyRecord(state, buf, embedDBSearchNodeLowerBound(state, buf, key), foundKey, data);
+            return 0;
+        }
     }
-#endif
 
-    /* Determine which data page should be the first examined if there is a min key and that we have spline points */
-    if (state->spl->count != 0 && it->minKey != NULL && !(EMBEDDB_USING_BINARY_SEARCH(state->parameters))) {
-        /* Spline search */
-        uint32_t location, lowbound, highbound = 0;
-        splineFind(state->spl, it->minKey, state->compareKey, &location, &lowbound, &highbound);
+    uint16_t recordNum = embedDBSearchNodeLowerBound(state, writeBuf, key);
+    if (recordNum >= bufferCount)
+        return NO_RECORD_FOUND;
+    embedDBCopyRecord(state, writeBuf, recordNum, foundKey, data);
+    return 0;
+}
 
-        // Use the low bound as the start for our search
-        it->nextDataPage = max(lowbound, state->minDataPageId);
+/**
+ * @brief	Finds the position of the first record with a key >= key, or > key if after is set. Reads at most the
+ * 			data page holding the position.
+ * @param	state		embedDB algorithm state structure
+ * @param	key			Key to search for
+ * @param	after		1 to skip a record equal to key
+ * @param	pageId		Return variable for the logical page id. The write buffer is page nextDataPageId.
+ * @param	recordNum	Return variable for the record number on the page
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBKeyPosition(embedDBState *state, void *key, int8_t after, uint32_t *pageId, uint32_t *recordNum) {
+    void *buf = (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+    if (EMBEDDB_GET_COUNT(buf) != 0 && state->compareKey(key, embedDBGetMinKey(state, buf)) >= 0) {
+        *pageId = state->nextDataPageId;
     } else {
-        it->nextDataPage = state->minDataPageId;
+        int8_t found = embedDBFindLowerBoundPage(state, key, pageId);
+        if (found == -1)
+            return -1;
+        if (found == 1) {
+            /* Every stored key is smaller, so the position is the start of the write buffer */
+            *pageId = state->nextDataPageId;
+            *recordNum = 0;
+            return 0;
+        }
+        buf = (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize;
     }
-    it->nextDataRec = 0;
+
+    *recordNum = embedDBSearchNodeLowerBound(state, buf, key);
+    if (after && *recordNum < EMBEDDB_GET_COUNT(buf) &&
+        state->compareKey((int8_t *)buf + state->headerSize + state->recordSize * *recordNum, key) == 0) {
+        (*recordNum)++;
+    }
+    return 0;
 }
 
 /**
- * @brief	Close iterator after use.
- * @param	it		embedDB iterator structure
+ * @brief	Estimates the number of records stored before key by interpolating between the spline points.
+ * 			Does not read storage. Keys in the range of the write buffer are counted exactly.
+ * @param	state	embedDB algorithm state structure
+ * @param	key		Key to estimate the position of
+ * @return	Estimated number of records before key
  */
-void embedDBCloseIterator(embedDBIterator *it) {
-    if (it->queryBitmap != NULL) {
-        free(it->queryBitmap);
+double embedDBEstimateKeyPosition(embedDBState *state, void *key) {
+    void *writeBuf = (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+    count_t bufferCount = EMBEDDB_GET_COUNT(writeBuf);
+    double storedRecords = (double)(state->nextDataPageId - state->minDataPageId) * state->maxRecordsPerPage;
+    if (bufferCount != 0 && state->compareKey(key, embedDBGetMinKey(state, writeBuf)) >= 0)
+        return storedRecords + embedDBSearchNodeLowerBound(state, writeBuf, key);
+
+    /* Find the first spline point with a key larger than key */
+    spline *spl = state->spl;
+    size_t first = 0, last = spl->count;
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        if (state->compareKey(splinePointLocation(spl, middle), key) <= 0) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
     }
+    if (first == 0)
+        return 0;
+
+    /* Spline points are the smallest key of a page, so interpolating gives a fractional page */
+    uint64_t keyVal = 0, downKey = 0, upKey = 0;
+    uint32_t downPage = 0, upPage = 0;
+    void *down = splinePointLocation(spl, first - 1);
+    memcpy(&keyVal, key, state->keySize);
+    memcpy(&downKey, down, state->keySize);
+    memcpy(&downPage, (int8_t *)down + state->keySize, sizeof(uint32_t));
+    double page;
+    if (first < spl->count || bufferCount != 0) {
+        void *up = first < spl->count ? splinePointLocation(spl, first) : embedDBGetMinKey(state, writeBuf);
+        memcpy(&upKey, up, state->keySize);
+        if (first < spl->count) {
+            memcpy(&upPage, (int8_t *)up + state->keySize, sizeof(uint32_t));
+        } else {
+            upPage = state->nextDataPageId;
+        }
+        page = downPage + (double)(keyVal - downKey) * (upPage - downPage) / (double)(upKey - downKey);
+    } else {
+        /* The largest stored key is not known without reading the last page, so assume the middle of it */
+        page = downPage + 0.5;
+    }
+
+    double position = (page - state->minDataPageId) * state->maxRecordsPerPage;
+    if (position < 0)
+        return 0;
+    return position > storedRecords ? storedRecords : position;
 }
 
 /**
- * @brief	Flushes output buffer.
- * @param	state	algorithm state structure
- * @returns 0 if successul and a non-zero value otherwise
+ * @brief	Counts the records with a key in [minKey, maxKey] without reading the records in between.
+ * 			EMBEDDB_COUNT_EXACT finds the position of both keys, which reads the two boundary pages. Pages below
+ * 			minFullDataPageId may have been written by embedDBFlush before they filled up, so the header of each of
+ * 			those in the range is read for its record count. All other pages are full.
+ * 			EMBEDDB_COUNT_ESTIMATE interpolates the positions from the spline, does not read storage, and assumes that
+ * 			all pages are full. It falls back to an exact count if there is no spline (EMBEDDB_USE_BINARY_SEARCH).
+ * @param	state	embedDB algorithm state structure
+ * @param	minKey	Smallest key to count. NULL to start at the oldest record.
+ * @param	maxKey	Largest key to count. NULL to end at the newest record.
+ * @param	mode	EMBEDDB_COUNT_EXACT or EMBEDDB_COUNT_ESTIMATE
+ * @param	count	Return variable for the number of records
+ * @return	Return 0 if success. Non-zero value if error.
  */
-int8_t embedDBFlushVar(embedDBState *state) {
-    /* Check if we actually have any variable data in the buffer */
-    if (state->currentVarLoc % state->pageSize == state->variableDataHeaderSize) {
+int8_t embedDBCountRange(embedDBState *state, void *minKey, void *maxKey, int8_t mode, uint32_t *count) {
+    *count = 0;
+    if (minKey != NULL && maxKey != NULL && state->compareKey(minKey, maxKey) > 0)
+        return 0;
+
+    if (mode == EMBEDDB_COUNT_ESTIMATE && !EMBEDDB_USING_BINARY_SEARCH(state->parameters) && state->spl->count != 0) {
+        void *writeBuf = (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+        double lower = minKey == NULL ? 0 : embedDBEstimateKeyPosition(state, minKey);
+        double upper = (double)(state->nextDataPageId - state->minDataPageId) * state->maxRecordsPerPage + EMBEDDB_GET_COUNT(writeBuf);
+        if (maxKey != NULL) {
+            /* Include a record equal to maxKey */
+            upper = embedDBEstimateKeyPosition(state, maxKey) + 1;
+        }
+        if (upper > lower)
+            *count = (uint32_t)(upper - lower + 0.5);
         return 0;
     }
 
-    // only flush variable buffer
-    id_t writeResult = writeVariablePage(state, (int8_t *)state->buffer + EMBEDDB_VAR_WRITE_BUFFER(state->parameters) * state->pageSize);
-    if (writeResult == -1) {
-#ifdef PRINT_ERRORS
-        printf("Failed to write variable data page during embedDBFlushVar.");
-#endif
+    uint32_t lowerPage = state->minDataPageId, lowerRecord = 0;
+    if (minKey != NULL && embedDBKeyPosition(state, minKey, 0, &lowerPage, &lowerRecord) != 0)
+        return -1;
+
+    uint32_t upperPage = state->nextDataPageId;
+    uint32_t upperRecord = EMBEDDB_GET_COUNT((int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize);
+    if (maxKey != NULL && embedDBKeyPosition(state, maxKey, 1, &upperPage, &upperRecord) != 0)
         return -1;
+
+    uint64_t lower = (uint64_t)(lowerPage - state->minDataPageId) * state->maxRecordsPerPage + lowerRecord;
+    uint64_t upper = (uint64_t)(upperPage - state->minDataPageId) * state->maxRecordsPerPage + upperRecord;
+
+    /* Take off the missing records of pages before upperPage that may be partly filled */
+    void *buf = (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize;
+    uint32_t lastPage = upperPage < state->minFullDataPageId ? upperPage : state->minFullDataPageId;
+    for (uint32_t page = lowerPage; page < lastPage; page++) {
+        if (readPage(state, page % state->numDataPages) != 0)
+            return -1;
+        upper -= state->maxRecordsPerPage - EMBEDDB_GET_COUNT(buf);
     }
 
-    state->fileInterface->flush(state->varFile);
-    // init new buffer
-    initBufferPage(state, EMBEDDB_VAR_WRITE_BUFFER(state->parameters));
-    // determine how many bytes are left
-    int temp = state->pageSize - (state->currentVarLoc % state->pageSize);
-    // create new offset
-    state->currentVarLoc += temp + state->variableDataHeaderSize;
+    if (upper > lower)
+        *count = (uint32_t)(upper - lower);
     return 0;
 }
 
 /**
- * @brief	Flushes output buffer.
- * @param	state	algorithm state structure
- * @returns 0 if successul and a non-zero value otherwise
+ * @brief	Shared setup of forward and reverse iterators.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure with isReverse set
  */
-int8_t embedDBFlush(embedDBState *state) {
-    // As the first buffer is the data write buffer, no address change is required
-    int8_t *buffer = (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
-    if (EMBEDDB_GET_COUNT(buffer) < 1)
-        return 0;
+void embedDBSetupIterator(embedDBState *state, embedDBIterator *it) {
+    /* No Bloom filter probe until one is set with embedDBIteratorSetBloomProbe */
+    it->queryBloomFilter = NULL;
+    it->bloomValue = NULL;
+    it->bloomColumn = -1;
 
-    id_t pageNum = writePage(state, buffer);
-    if (pageNum == -1) {
-#ifdef PRINT_ERRORS
-        printf("Failed to write page during embedDBFlush.");
-#endif
-        return -1;
-    }
+    it->queryBitmap = NULL;
 
-    state->fileInterface->flush(state->dataFile);
+    /* No stored page has been read yet, so the seek of a reverse iterator does not reuse the read buffer */
+    it->nextDataPage = state->nextDataPageId;
+    it->nextDataRec = EMBEDDB_ITERATOR_PAGE_UNREAD;
 
-    indexPage(state, pageNum);
+#ifdef PRINT_ERRORS
+    if (!EMBEDDB_USING_BMAP(state->parameters)) {
+        printf("WARN: Iterator not using index. If this is not intended, ensure that the embedDBState is using a bitmap and was initialized with an index file\n");
+    } else if (!EMBEDDB_USING_INDEX(state->parameters)) {
+        printf("WARN: Iterator not using index to full extent. If this is not intended, ensure that the embedDBState was initialized with an index file\n");
+    }
+#endif
+
+    embedDBIteratorUpdateBounds(state, it);
+}
+
+/**
+ * @brief	Initialize iterator on embedDB structure.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure
+ */
+void embedDBInitIterator(embedDBState *state, embedDBIterator *it) {
+    it->isReverse = 0;
+    embedDBSetupIterator(state, it);
+}
+
+/**
+ * @brief	Initialize an iterator that returns records newest first with embedDBPrev. It starts from the
+ * 			write buffer, or from the page holding maxKey, and walks backwards until minKey.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure
+ */
+void embedDBInitReverseIterator(embedDBState *state, embedDBIterator *it) {
+    it->isReverse = 1;
+    embedDBSetupIterator(state, it);
+}
+
+/**
+ * @brief	Recomputes the query bitmap, the Bloom filter probe and the first data page of an initialized iterator after
+ * 			its minKey, maxKey, minData or maxData, or the values they point to, were changed. Restarts the iterator.
+ * 			The query bitmap and Bloom filter are rebuilt in place, so restarting does not allocate once they exist.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure (already initialized)
+ */
+void embedDBIteratorUpdateBounds(embedDBState *state, embedDBIterator *it) {
+    /* Build query bitmap (if used). Verify that bitmap index is useful (must have set either min or max data value) */
+    if (EMBEDDB_USING_BMAP(state->parameters) && (it->minData != NULL || it->maxData != NULL)) {
+        if (it->queryBitmap == NULL) {
+            it->queryBitmap = malloc(state->bitmapSize);
+        }
+        if (it->queryBitmap != NULL) {
+            memset(it->queryBitmap, 0, state->bitmapSize);
+            state->buildBitmapFromRange(it->minData, it->maxData, it->queryBitmap);
+        }
+    } else if (it->queryBitmap != NULL) {
+        free(it->queryBitmap);
+        it->queryBitmap = NULL;
+    }
+
+    /* The probed value may have changed */
+    if (it->queryBloomFilter != NULL) {
+        memset(it->queryBloomFilter, 0, state->bloomFilterSize);
+        embedDBBloomAdd(state, it->queryBloomFilter, it->bloomColumn, it->bloomValue);
+    }
+
+    /* Reverse iterators start from the page holding maxKey, or the write buffer, and read it from the end */
+    if (it->isReverse) {
+        if (it->maxKey == NULL || embedDBIteratorSeek(state, it, it->maxKey) != 0) {
+            it->nextDataPage = state->nextDataPageId;
+            it->nextDataRec = EMBEDDB_ITERATOR_PAGE_UNREAD;
+        }
+        return;
+    }
+
+    /* Determine which data page should be the first examined if there is a min key and that we have spline points */
+    if (!EMBEDDB_USING_BINARY_SEARCH(state->parameters) && state->spl->count != 0 && it->minKey != NULL) {
+        /* Spline search */
+        uint32_t location, lowbound, highbound = 0;
+        splineFind(state->spl, it->minKey, state->compareKey, &location, &lowbound, &highbound);
+
+        // Use the low bound as the start for our search
+        it->nextDataPage = max(lowbound, state->minDataPageId);
+    } else {
+        it->nextDataPage = state->minDataPageId;
+    }
+    it->nextDataRec = 0;
+}
+
+/**
+ * @brief	Finds the first record on a data page whose key is greater than or equal to key.
+ * @param	state	embedDB algorithm state structure
+ * @param	buffer	Pointer to in-memory buffer holding the page
+ * @param	key		Key to search for
+ * @return	Record number of the first record >= key, or the page's record count if every key is smaller
+ */
+uint16_t embedDBSearchNodeLowerBound(embedDBState *state, void *buffer, void *key) {
+    int32_t first = 0, last = EMBEDDB_GET_COUNT(buffer);
+    while (first < last) {
+        int32_t middle = (first + last) / 2;
+        if (state->compareKey((int8_t *)buffer + state->headerSize + state->recordSize * middle, key) < 0) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    return (uint16_t)first;
+}
+
+/**
+ * @brief	Bounds the stored data pages that can hold a key with the spline. All stored pages are used with
+ * 			EMBEDDB_USE_BINARY_SEARCH or an empty spline. There must be at least one stored page.
+ * @param	state		embedDB algorithm state structure
+ * @param	key			Key to search for
+ * @param	first		Return variable for the first page of the bounds
+ * @param	last		Return variable for the last page of the bounds
+ * @param	location	Return variable for the page predicted to hold the key, within the bounds
+ */
+void embedDBPageBounds(embedDBState *state, void *key, uint32_t *first, uint32_t *last, uint32_t *location) {
+    *first = state->minDataPageId;
+    *last = state->nextDataPageId - 1;
+    if (EMBEDDB_USING_BINARY_SEARCH(state->parameters) || state->spl->count == 0) {
+        *location = *first + (*last - *first) / 2;
+        return;
+    }
+
+    uint32_t lowbound, highbound;
+    splineFind(state->spl, key, state->compareKey, location, &lowbound, &highbound);
+    if (highbound < *first) {
+        /* Key is before all stored records */
+        *last = *first;
+    } else {
+        *first = min(max(lowbound, *first), *last);
+        *last = min(highbound, *last);
+    }
+    *location = min(max(*location, *first), *last);
+}
+
+/**
+ * @brief	Reads the first stored data page whose largest key is >= key into the data read buffer. The pages are
+ * 			bounded with the spline (unless EMBEDDB_USE_BINARY_SEARCH is set) and then binary searched, so keys
+ * 			that fall in a gap between two pages find the page after the gap.
+ * @param	state	embedDB algorithm state structure
+ * @param	key		Key to search for
+ * @param	pageId	Return variable for the logical page id of the page
+ * @return	Return 0 if the page was found. 1 if there are no stored pages or every stored key is smaller than key. -1 if error.
+ */
+int8_t embedDBFindLowerBoundPage(embedDBState *state, void *key, uint32_t *pageId) {
+    if (state->nextDataPageId == state->minDataPageId)
+        return 1;
+
+    uint32_t first, last, location;
+    embedDBPageBounds(state, key, &first, &last, &location);
+
+    /* Find the first page whose largest key is >= key, starting with the page predicted by the spline */
+    void *buf = (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize;
+    uint32_t middle = location;
+    while (1) {
+        while (first < last) {
+            if (readPage(state, middle % state->numDataPages) != 0)
+                return -1;
+            if (state->compareKey(embedDBGetMaxKey(state, buf), key) < 0) {
+                first = middle + 1;
+            } else if (middle == location && state->compareKey(embedDBGetMinKey(state, buf), key) <= 0) {
+                /* The predicted page holds the key */
+                *pageId = middle;
+                return 0;
+            } else {
+                last = middle;
+            }
+            middle = first + (last - first) / 2;
+        }
+        if (first == last) {
+            if (readPage(state, first % state->numDataPages) != 0)
+                return -1;
+            if (state->compareKey(embedDBGetMaxKey(state, buf), key) >= 0)
+                break;
+            first++;
+        }
+
+        /* Every page in the bounds is smaller than the key, continue with the pages after them */
+        if (first >= state->nextDataPageId)
+            return 1;
+        last = state->nextDataPageId - 1;
+        middle = location = first;
+    }
+
+    *pageId = first;
+    return 0;
+}
+
+/**
+ * @brief	Moves an initialized iterator without reinitializing it. The next call to embedDBNext returns the first matching
+ * 			record with a key >= key. For an iterator initialized with embedDBInitReverseIterator, the next call to
+ * 			embedDBPrev returns the last matching record with a key <= key. If the page the iterator is on holds the key,
+ * 			it is reused without reading storage. Otherwise the page is located with the spline (or binary search when
+ * 			EMBEDDB_USE_BINARY_SEARCH is set), so pages between the current position and the key are not read.
+ * 			The iterator's filters and bitmap are unchanged.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure (already initialized)
+ * @param	key		Key to move to. Keys outside the iterator's minKey and maxKey seek to the nearest bound.
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBIteratorSeek(embedDBState *state, embedDBIterator *it, void *key) {
+    if (it->minKey != NULL && state->compareKey(key, it->minKey) < 0) {
+        key = it->minKey;
+    }
+    if (it->isReverse && it->maxKey != NULL && state->compareKey(key, it->maxKey) > 0) {
+        key = it->maxKey;
+    }
+
+    /* Reuse the stored page the iterator is on if it is still loaded and holds the key */
+    uint32_t pageId, recordNum;
+    void *buf = (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize;
+    if (it->nextDataPage >= state->minDataPageId && it->nextDataPage < state->nextDataPageId &&
+        state->bufferedPageId == it->nextDataPage % state->numDataPages && EMBEDDB_GET_COUNT(buf) != 0 &&
+        state->compareKey(embedDBGetMinKey(state, buf), key) <= 0 && state->compareKey(embedDBGetMaxKey(state, buf), key) >= 0) {
+        pageId = it->nextDataPage;
+        recordNum = embedDBSearchNodeLowerBound(state, buf, key);
+        if (it->isReverse && state->compareKey((int8_t *)buf + state->headerSize + state->recordSize * recordNum, key) == 0)
+            recordNum++;
+    } else if (embedDBKeyPosition(state, key, it->isReverse, &pageId, &recordNum) != 0) {
+        return -1;
+    }
+
+    it->nextDataPage = pageId;
+    it->nextDataRec = recordNum;
+    if (!it->isReverse || recordNum > 0)
+        return 0;
+
+    /* A reverse iterator returns the records before the position, which start with the last record of the previous page */
+    if (pageId > state->minDataPageId) {
+        it->nextDataPage = pageId - 1;
+        it->nextDataRec = EMBEDDB_ITERATOR_PAGE_UNREAD;
+    }
+    return 0;
+}
+
+/**
+ * @brief	Moves an initialized iterator so that embedDBNext returns the last n records stored, oldest first.
+ * 			The position is computed from the record count of the write buffer and the records per page, so no
+ * 			page is read and the keys do not need to be dense. Stored pages are assumed to be full. A page written
+ * 			by embedDBFlush before it filled up holds fewer records, and then fewer than n records follow the position.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure (already initialized with embedDBInitIterator)
+ * @param	n		Number of most recent records to return. If fewer are stored, the iterator starts at the oldest record.
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBIteratorSeekLast(embedDBState *state, embedDBIterator *it, uint32_t n) {
+    if (it->isReverse) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: embedDBIteratorSeekLast requires an iterator initialized with embedDBInitIterator\n");
+#endif
+        return -1;
+    }
+
+    /* The newest records are in the write buffer */
+    void *writeBuf = (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+    uint32_t bufferCount = EMBEDDB_GET_COUNT(writeBuf);
+    if (n <= bufferCount) {
+        it->nextDataPage = state->nextDataPageId;
+        it->nextDataRec = (uint16_t)(bufferCount - n);
+        return 0;
+    }
+
+    /* The rest are on the pages before it */
+    uint32_t remaining = n - bufferCount;
+    uint32_t pagesBack = (remaining + state->maxRecordsPerPage - 1) / state->maxRecordsPerPage;
+    if (pagesBack > state->nextDataPageId - state->minDataPageId) {
+        it->nextDataPage = state->minDataPageId;
+        it->nextDataRec = 0;
+        return 0;
+    }
+    it->nextDataPage = state->nextDataPageId - pagesBack;
+    it->nextDataRec = (uint16_t)(pagesBack * state->maxRecordsPerPage - remaining);
+    return 0;
+}
+
+/**
+ * @brief	Return the next record of a downsampled read. Returns the next matching record like embedDBNext, then moves the
+ * 			iterator with embedDBIteratorSeek to the first key >= that record's key + stride. Pages that do not hold a
+ * 			sample are not read, so the I/O grows with the number of samples instead of the number of records.
+ * 			Keys are treated as unsigned integers for the stride, as in the spline.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure initialized with embedDBInitIterator
+ * @param	stride	Smallest key difference between two returned records. To return about n records from a range, use (maxKey - minKey) / n.
+ * 					A stride of 0 is treated as 1, so every record is returned.
+ * @param	key		Return variable for the key (Pre-allocated)
+ * @param	data	Return variable for the data (Pre-allocated)
+ * @return	1 if a record was returned, 0 if there are no more records.
+ */
+int8_t embedDBNextSample(embedDBState *state, embedDBIterator *it, uint64_t stride, void *key, void *data) {
+    if (!embedDBNext(state, it, key, data))
+        return 0;
+
+    /* A stride of 0 would seek back to the record just returned */
+    if (stride == 0)
+        stride = 1;
+
+    uint64_t keyVal = 0, maxKeyVal = state->keySize >= 8 ? UINT64_MAX : (((uint64_t)1 << (8 * state->keySize)) - 1);
+    memcpy(&keyVal, key, state->keySize);
+    if (stride > maxKeyVal - keyVal) {
+        /* The target key would wrap around, so no key can follow at this distance. End the iteration after this record. */
+        it->nextDataPage = state->nextDataPageId + 1;
+        return 1;
+    }
+    uint64_t target = keyVal + stride;
+    if (embedDBIteratorSeek(state, it, &target) != 0) {
+        it->nextDataPage = state->nextDataPageId + 1;
+    }
+    return 1;
+}
+
+/**
+ * @brief	Initialize an iterator over several key ranges. Overlapping ranges are merged, and the records of all ranges
+ * 			are returned in key order by embedDBNextMultiRange. Each range is found with embedDBIteratorSeek, so pages
+ * 			between ranges are not read and a page shared by neighbouring ranges is read once.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		Multi-range iterator with ranges, numRanges, minData and maxData set
+ * @return	Return 0 if success. Non-zero value if error, such as ranges that are not sorted.
+ */
+int8_t embedDBInitMultiRangeIterator(embedDBState *state, embedDBMultiRangeIterator *it) {
+    uint8_t keySize = state->keySize;
+    it->mergedRanges = NULL;
+    it->numMerged = 0;
+    it->range = 0;
+    it->it.minKey = NULL;
+    it->it.maxKey = NULL;
+    it->it.minData = it->minData;
+    it->it.maxData = it->maxData;
+
+    if (it->numRanges > 0) {
+        it->mergedRanges = malloc((size_t)it->numRanges * 2 * keySize);
+        if (it->mergedRanges == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to allocate the ranges of a multi-range iterator\n");
+#endif
+            return -1;
+        }
+    }
+
+    for (uint32_t i = 0; i < it->numRanges; i++) {
+        int8_t *minKey = (int8_t *)it->ranges + (size_t)i * 2 * keySize;
+        int8_t *maxKey = minKey + keySize;
+        int8_t *last = it->numMerged > 0 ? (int8_t *)it->mergedRanges + (size_t)(it->numMerged - 1) * 2 * keySize : NULL;
+        if (state->compareKey(minKey, maxKey) > 0 || (it->numMerged > 0 && state->compareKey(minKey, last) < 0)) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: The ranges of a multi-range iterator must be sorted by their smallest key\n");
+#endif
+            free(it->mergedRanges);
+            it->mergedRanges = NULL;
+            return -1;
+        }
+
+        /* Extend the last range if this one overlaps it */
+        if (it->numMerged > 0 && state->compareKey(minKey, last + keySize) <= 0) {
+            if (state->compareKey(maxKey, last + keySize) > 0)
+                memcpy(last + keySize, maxKey, keySize);
+            continue;
+        }
+        memcpy((int8_t *)it->mergedRanges + (size_t)it->numMerged * 2 * keySize, minKey, 2 * keySize);
+        it->numMerged++;
+    }
+
+    if (it->numMerged > 0) {
+        it->it.minKey = it->mergedRanges;
+        it->it.maxKey = (int8_t *)it->mergedRanges + keySize;
+    }
+    embedDBInitIterator(state, &it->it);
+    if (it->numMerged > 0 && embedDBIteratorSeek(state, &it->it, it->it.minKey) != 0) {
+        embedDBCloseMultiRangeIterator(it);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief	Return the next record in any of the ranges of a multi-range iterator.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		Multi-range iterator initialized with embedDBInitMultiRangeIterator
+ * @param	key		Return variable for the key (Pre-allocated)
+ * @param	data	Return variable for the data (Pre-allocated)
+ * @return	1 if a record was returned, 0 if there are no more records.
+ */
+int8_t embedDBNextMultiRange(embedDBState *state, embedDBMultiRangeIterator *it, void *key, void *data) {
+    while (it->range < it->numMerged) {
+        if (embedDBNext(state, &it->it, key, data))
+            return 1;
+
+        /* The range is done, move the iterator to the start of the next one */
+        if (++it->range >= it->numMerged)
+            break;
+        it->it.minKey = (int8_t *)it->mergedRanges + (size_t)it->range * 2 * state->keySize;
+        it->it.maxKey = (int8_t *)it->it.minKey + state->keySize;
+        if (embedDBIteratorSeek(state, &it->it, it->it.minKey) != 0)
+            return 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief	Close a multi-range iterator after use.
+ * @param	it		Multi-range iterator
+ */
+void embedDBCloseMultiRangeIterator(embedDBMultiRangeIterator *it) {
+    embedDBCloseIterator(&it->it);
+    free(it->mergedRanges);
+    it->mergedRanges = NULL;
+}
+
+/**
+ * @brief	Close iterator after use.
+ * @param	it		embedDB iterator structure
+ */
+void embedDBCloseIterator(embedDBIterator *it) {
+    if (it->queryBitmap != NULL) {
+        free(it->queryBitmap);
+    }
+    if (it->queryBloomFilter != NULL) {
+        free(it->queryBloomFilter);
+        it->queryBloomFilter = NULL;
+    }
+}
+
+/**
+ * @brief	Restricts an initialized iterator to records where a Bloom filter column equals a value.
+ * 			Data pages whose Bloom filter cannot contain the value are skipped without being read.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure (already initialized)
+ * @param	column	Index of the column in bloomColumnOffsets/bloomColumnSizes
+ * @param	value	Value to match. Must remain valid while the iterator is in use.
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBIteratorSetBloomProbe(embedDBState *state, embedDBIterator *it, int8_t column, void *value) {
+    if (!EMBEDDB_USING_BLOOM(state->parameters) || column < 0 || column >= state->numBloomColumns || value == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Bloom filter probe requires EMBEDDB_USE_BLOOM and a valid Bloom filter column\n");
+#endif
+        return -1;
+    }
+
+    if (it->queryBloomFilter == NULL) {
+        it->queryBloomFilter = malloc(state->bloomFilterSize);
+        if (it->queryBloomFilter == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to allocate Bloom filter for iterator\n");
+#endif
+            return -1;
+        }
+    }
+    memset(it->queryBloomFilter, 0, state->bloomFilterSize);
+    embedDBBloomAdd(state, it->queryBloomFilter, column, value);
+    it->bloomValue = value;
+    it->bloomColumn = column;
+    return 0;
+}
+
+/**
+ * @brief	Flushes output buffer.
+ * @param	state	algorithm state structure
+ * @returns 0 if successul and a non-zero value otherwise
+ */
+int8_t embedDBFlushVar(embedDBState *state) {
+    /* Check if we actually have any variable data in the buffer */
+    if (state->currentVarLoc % state->pageSize == state->variableDataHeaderSize) {
+        return 0;
+    }
+
+    // only flush variable buffer
+    id_t writeResult = writeVariablePage(state, (int8_t *)state->buffer + EMBEDDB_VAR_WRITE_BUFFER(state->parameters) * state->pageSize);
+    if (writeResult == -1) {
+#ifdef PRINT_ERRORS
+        printf("Failed to write variable data page during embedDBFlushVar.");
+#endif
+        return -1;
+    }
+
+    state->fileInterface->flush(state->varFile);
+    // init new buffer
+    initBufferPage(state, EMBEDDB_VAR_WRITE_BUFFER(state->parameters));
+    // determine how many bytes are left
+    int temp = state->pageSize - (state->currentVarLoc % state->pageSize);
+    // create new offset
+    state->currentVarLoc += temp + state->variableDataHeaderSize;
+    return 0;
+}
+
+/**
+ * @brief	Flushes output buffer.
+ * @param	state	algorithm state structure
+ * @returns 0 if successul and a non-zero value otherwise
+ */
+int8_t embedDBFlush(embedDBState *state) {
+    // As the first buffer is the data write buffer, no address change is required
+    int8_t *buffer = (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+    if (EMBEDDB_GET_COUNT(buffer) < 1)
+        return 0;
+
+    id_t pageNum = writePage(state, buffer);
+    if (pageNum == -1) {
+#ifdef PRINT_ERRORS
+        printf("Failed to write page during embedDBFlush.");
+#endif
+        return -1;
+    }
+
+    state->fileInterface->flush(state->dataFile);
+
+    if (EMBEDDB_GET_COUNT(buffer) < state->maxRecordsPerPage)
+        state->minFullDataPageId = pageNum + 1;
+
+    indexPage(state, pageNum);
+
+    if (EMBEDDB_USING_INDEX(state->parameters)) {
+        void *buf = (int8_t *)state->buffer + state->pageSize * (EMBEDDB_INDEX_WRITE_BUFFER);
+        count_t idxcount = EMBEDDB_GET_COUNT(buf);
+        EMBEDDB_INC_COUNT(buf);
+
+        /* Copy record onto index page */
+        int8_t *idxRecord = (int8_t *)buf + EMBEDDB_IDX_HEADER_SIZE + (state->bitmapSize + state->bloomFilterSize) * idxcount;
+        void *bm = EMBEDDB_GET_BITMAP(state->buffer);
+        memcpy(idxRecord, bm, state->bitmapSize);
+        memcpy(idxRecord + state->bitmapSize, EMBEDDB_GET_BLOOM(state->buffer, state), state->bloomFilterSize);
+
+        id_t writeResult = writeIndexPage(state, buf);
+        if (writeResult == -1) {
+#ifdef PRINT_ERRORS
+            printf("Failed to write index page during embedDBFlush.");
+#endif
+            return -1;
+        }
+
+        state->fileInterface->flush(state->indexFile);
+
+        /* Reinitialize buffer */
+        initBufferPage(state, EMBEDDB_INDEX_WRITE_BUFFER);
+    }
+
+    if (EMBEDDB_USING_SECONDARY_INDEX(state->parameters)) {
+        /* Save the current sorted run even though it is not full */
+        void *run = (int8_t *)state->buffer + state->pageSize * EMBEDDB_SECONDARY_INDEX_WRITE_BUFFER(state->parameters);
+        if (EMBEDDB_GET_COUNT(run) > 0) {
+            if (writeSecondaryIndexPage(state, run) == -1) {
+#ifdef PRINT_ERRORS
+                printf("Failed to write secondary index page during embedDBFlush.");
+#endif
+                return -1;
+            }
+            state->fileInterface->flush(state->secondaryIndexFile);
+            memset(run, 0, state->pageSize);
+        }
+    }
+
+    /* Reinitialize buffer */
+    initBufferPage(state, EMBEDDB_DATA_WRITE_BUFFER);
+
+    // Flush var data page
+    if (EMBEDDB_USING_VDATA(state->parameters)) {
+        int8_t varFlushResult = embedDBFlushVar(state);
+        if (varFlushResult != 0) {
+#ifdef PRINT_ERRORS
+            printf("Failed to flush variable data page");
+#endif
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief	Uses the index (or the Bloom filter in the header of the write buffer) to check if the next
+ * 			data page of an iterator can be skipped without reading it.
+ * @param	state			embedDB algorithm state structure
+ * @param	it				embedDB iterator state structure
+ * @param	searchWriteBuf	1 if the page is the write buffer
+ * @return	1 if the page has no records for the query, 0 if it must be read, -1 if the index could not be read
+ */
+int8_t embedDBIteratorSkipPage(embedDBState *state, embedDBIterator *it, int8_t searchWriteBuf) {
+    if (it->queryBitmap == NULL && it->queryBloomFilter == NULL)
+        return 0;
+
+    if (searchWriteBuf) {
+        // The write buffer has no index record yet, but its header holds the Bloom filter
+        return it->queryBloomFilter != NULL && !bloomContains(EMBEDDB_GET_BLOOM(state->buffer, state), it->queryBloomFilter, state->bloomFilterSize);
+    }
+
+    // Find what index page determines if we should read the data page
+    uint32_t indexPage = it->nextDataPage / state->maxIdxRecordsPerPage;
+    uint16_t indexRec = it->nextDataPage % state->maxIdxRecordsPerPage;
+
+    // If the index page that contains this data page doesn't exist, we must read the data page regardless cause we don't have the index saved for it
+    if (state->indexFile == NULL || indexPage < state->minIndexPageId || indexPage >= state->nextIdxPageId)
+        return 0;
+
+    if (readIndexPage(state, indexPage % state->numIndexPages) != 0) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to read index page %i (%i)\n", indexPage, indexPage % state->numIndexPages);
+#endif
+        return -1;
+    }
+
+    // Get bitmap for data page in question
+    void *indexBM = (int8_t *)state->buffer + EMBEDDB_INDEX_READ_BUFFER * state->pageSize + EMBEDDB_IDX_HEADER_SIZE + indexRec * (state->bitmapSize + state->bloomFilterSize);
+
+    // Determine if we should read the data page
+    return (it->queryBitmap != NULL && !bitmapOverlap(it->queryBitmap, indexBM, state->bitmapSize)) ||
+           (it->queryBloomFilter != NULL && !bloomContains((uint8_t *)indexBM + state->bitmapSize, it->queryBloomFilter, state->bloomFilterSize));
+}
+
+/**
+ * @brief	Return pointers to the next key and data for iterator without copying the record.
+ * 			The pointers are into the read or write page buffer and are valid until the next call on this state.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure
+ * @param	key		Return variable for a pointer to the key
+ * @param	data	Return variable for a pointer to the data
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBNextRef(embedDBState *state, embedDBIterator *it, const void **key, const void **data) {
+    int searchWriteBuf = 0;
+    while (1) {
+        if (it->nextDataPage > state->nextDataPageId) {
+            return 0;
+        }
+        if (it->nextDataPage == state->nextDataPageId) {
+            searchWriteBuf = 1;
+        }
+
+        // If we are just starting to read a new page, check if the query bitmap or Bloom filter probe rules it out
+        if (it->nextDataRec == 0) {
+            int8_t skip = embedDBIteratorSkipPage(state, it, searchWriteBuf);
+            if (skip == -1)
+                return 0;
+            if (skip) {
+                // The write buffer is the last page
+                if (searchWriteBuf)
+                    return 0;
+                // Do not read this data page, try the next one
+                it->nextDataPage++;
+                continue;
+            }
+        }
+
+        if (searchWriteBuf == 0 && readPage(state, it->nextDataPage % state->numDataPages) != 0) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to read data page %i (%i)\n", it->nextDataPage, it->nextDataPage % state->numDataPages);
+#endif
+            return 0;
+        }
+
+        // Keep reading record until we find one that matches the query
+        int8_t *buf = searchWriteBuf == 0 ? (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize : (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+        uint32_t pageRecordCount = EMBEDDB_GET_COUNT(buf);
+
+        // Skip the records of the page if the min/max data values in its header are outside the data range
+        if (it->nextDataRec == 0 && pageRecordCount > 0 && EMBEDDB_MAX_MIN_INTACT(state) &&
+            ((it->minData != NULL && state->compareData(EMBEDDB_GET_MAX_DATA(buf, state), it->minData) < 0) ||
+             (it->maxData != NULL && state->compareData(EMBEDDB_GET_MIN_DATA(buf, state), it->maxData) > 0))) {
+            it->nextDataRec = pageRecordCount;
+        }
+        while (it->nextDataRec < pageRecordCount) {
+            // Get record
+            int8_t *recordKey = buf + state->headerSize + it->nextDataRec * state->recordSize;
+            int8_t *recordData = recordKey + state->keySize;
+            it->nextDataRec++;
+
+            // Check record
+            if (it->minKey != NULL && state->compareKey(recordKey, it->minKey) < 0)
+                continue;
+            if (it->maxKey != NULL && state->compareKey(recordKey, it->maxKey) > 0)
+                return 0;
+            if (it->minData != NULL && state->compareData(recordData, it->minData) < 0)
+                continue;
+            if (it->maxData != NULL && state->compareData(recordData, it->maxData) > 0)
+                continue;
+            if (it->bloomValue != NULL && memcmp(recordData + state->bloomColumnOffsets[it->bloomColumn], it->bloomValue, state->bloomColumnSizes[it->bloomColumn]) != 0)
+                continue;
+
+            // If we make it here, the record matches the query
+            *key = recordKey;
+            *data = recordData;
+            return 1;
+        }
+
+        // Finished reading through whole data page and didn't find a match
+        it->nextDataPage++;
+        it->nextDataRec = 0;
+
+        // Try next data page by looping back to top
+    }
+}
+
+/**
+ * @brief	Return next key, data pair for iterator.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure
+ * @param	key		Return variable for key (Pre-allocated)
+ * @param	data	Return variable for data (Pre-allocated)
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBNext(embedDBState *state, embedDBIterator *it, void *key, void *data) {
+    const void *keyRef, *dataRef;
+    if (!embedDBNextRef(state, it, &keyRef, &dataRef))
+        return 0;
+    memcpy(key, keyRef, state->keySize);
+    memcpy(data, dataRef, state->dataSize);
+    return 1;
+}
 
-    if (EMBEDDB_USING_INDEX(state->parameters)) {
-        void *buf = (int8_t *)state->buffer + state->pageSize * (EMBEDDB_INDEX_WRITE_BUFFER);
-        count_t idxcount = EMBEDDB_GET_COUNT(buf);
-        EMBEDDB_INC_COUNT(buf);
+/**
+ * @brief	Return pointers to the previous key and data for a reverse iterator without copying the record.
+ * 			The pointers are into the read or write page buffer and are valid until the next call on this state.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure initialized with embedDBInitReverseIterator
+ * @param	key		Return variable for a pointer to the key
+ * @param	data	Return variable for a pointer to the data
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBPrevRef(embedDBState *state, embedDBIterator *it, const void **key, const void **data) {
+    while (1) {
+        int8_t searchWriteBuf = it->nextDataPage == state->nextDataPageId;
 
-        /* Copy record onto index page */
-        void *bm = EMBEDDB_GET_BITMAP(state->buffer);
-        memcpy((void *)((int8_t *)buf + EMBEDDB_IDX_HEADER_SIZE + state->bitmapSize * idxcount), bm, state->bitmapSize);
+        // Older pages may have been overwritten since the iterator was positioned
+        if (!searchWriteBuf && (it->nextDataPage < state->minDataPageId || it->nextDataPage > state->nextDataPageId)) {
+            return 0;
+        }
 
-        id_t writeResult = writeIndexPage(state, buf);
-        if (writeResult == -1) {
+        int8_t *buf = searchWriteBuf == 0 ? (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize : (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+        int8_t skip = 0;
+        if (it->nextDataRec == EMBEDDB_ITERATOR_PAGE_UNREAD) {
+            // Starting a new page, check if the query bitmap or Bloom filter probe rules it out
+            skip = embedDBIteratorSkipPage(state, it, searchWriteBuf);
+            if (skip == -1)
+                return 0;
+            it->nextDataRec = 0;
+        } else if (it->nextDataRec == 0) {
+            skip = 1;
+        }
+
+        if (!skip) {
+            if (searchWriteBuf == 0 && readPage(state, it->nextDataPage % state->numDataPages) != 0) {
 #ifdef PRINT_ERRORS
-            printf("Failed to write index page during embedDBFlush.");
+                printf("ERROR: Failed to read data page %i (%i)\n", it->nextDataPage, it->nextDataPage % state->numDataPages);
 #endif
-            return -1;
+                return 0;
+            }
+
+            // The page was just read, so start from its last record
+            if (it->nextDataRec == 0) {
+                it->nextDataRec = EMBEDDB_GET_COUNT(buf);
+
+                // Skip the records of the page if the min/max data values in its header are outside the data range
+                if (it->nextDataRec > 0 && EMBEDDB_MAX_MIN_INTACT(state) &&
+                    ((it->minData != NULL && state->compareData(EMBEDDB_GET_MAX_DATA(buf, state), it->minData) < 0) ||
+                     (it->maxData != NULL && state->compareData(EMBEDDB_GET_MIN_DATA(buf, state), it->maxData) > 0))) {
+                    it->nextDataRec = 0;
+                }
+            }
         }
 
-        state->fileInterface->flush(state->indexFile);
+        while (it->nextDataRec > 0) {
+            // Get record
+            it->nextDataRec--;
+            int8_t *recordKey = buf + state->headerSize + it->nextDataRec * state->recordSize;
+            int8_t *recordData = recordKey + state->keySize;
 
-        /* Reinitialize buffer */
-        initBufferPage(state, EMBEDDB_INDEX_WRITE_BUFFER);
-    }
+            // Check record
+            if (it->maxKey != NULL && state->compareKey(recordKey, it->maxKey) > 0)
+                continue;
+            if (it->minKey != NULL && state->compareKey(recordKey, it->minKey) < 0) {
+                // Every earlier record has a smaller key
+                it->nextDataPage = state->minDataPageId;
+                it->nextDataRec = 0;
+                return 0;
+            }
+            if (it->minData != NULL && state->compareData(recordData, it->minData) < 0)
+                continue;
+            if (it->maxData != NULL && state->compareData(recordData, it->maxData) > 0)
+                continue;
+            if (it->bloomValue != NULL && memcmp(recordData + state->bloomColumnOffsets[it->bloomColumn], it->bloomValue, state->bloomColumnSizes[it->bloomColumn]) != 0)
+                continue;
 
-    /* Reinitialize buffer */
-    initBufferPage(state, EMBEDDB_DATA_WRITE_BUFFER);
+            // If we make it here, the record matches the query
+            *key = recordKey;
+            *data = recordData;
+            return 1;
+        }
 
-    // Flush var data page
-    if (EMBEDDB_USING_VDATA(state->parameters)) {
-        int8_t varFlushResult = embedDBFlushVar(state);
-        if (varFlushResult != 0) {
-#ifdef PRINT_ERRORS
-            printf("Failed to flush variable data page");
-#endif
-            return -1;
+        // Finished reading through whole data page and didn't find a match, try the page before it
+        if (it->nextDataPage <= state->minDataPageId) {
+            return 0;
         }
+        it->nextDataPage--;
+        it->nextDataRec = EMBEDDB_ITERATOR_PAGE_UNREAD;
     }
-    return 0;
 }
 
 /**
- * @brief	Return next key, data pair for iterator.
+ * @brief	Return previous key, data pair for a reverse iterator. Records are returned in decreasing key order.
  * @param	state	embedDB algorithm state structure
- * @param	it		embedDB iterator state structure
+ * @param	it		embedDB iterator state structure initialized with embedDBInitReverseIterator
  * @param	key		Return variable for key (Pre-allocated)
  * @param	data	Return variable for data (Pre-allocated)
  * @return	1 if successful, 0 if no more records
  */
-int8_t embedDBNext(embedDBState *state, embedDBIterator *it, void *key, void *data) {
-    int searchWriteBuf = 0;
-    while (1) {
-        if (it->nextDataPage > state->nextDataPageId) {
-            return 0;
-        }
-        if (it->nextDataPage == state->nextDataPageId) {
-            searchWriteBuf = 1;
-        }
+int8_t embedDBPrev(embedDBState *state, embedDBIterator *it, void *key, void *data) {
+    const void *keyRef, *dataRef;
+    if (!embedDBPrevRef(state, it, &keyRef, &dataRef))
+        return 0;
+    memcpy(key, keyRef, state->keySize);
+    memcpy(data, dataRef, state->dataSize);
+    return 1;
+}
+
+/**
+ * @brief	Initialize an iterator that uses the secondary index to find records whose
+ * 			secondary index column is within [minValue, maxValue].
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB secondary iterator structure with minValue and maxValue set
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBInitSecondaryIterator(embedDBState *state, embedDBSecondaryIterator *it) {
+    it->runPages = NULL;
+    if (!EMBEDDB_USING_SECONDARY_INDEX(state->parameters)) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: embedDBInitSecondaryIterator called when not using a secondary index\n");
+#endif
+        return -1;
+    }
+
+    /* A run never covers more data pages than it has entries */
+    it->runPages = calloc(1, (state->maxSecondaryIndexRecordsPerPage + 7) / 8);
+    if (it->runPages == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to allocate secondary iterator\n");
+#endif
+        return -1;
+    }
+
+    it->nextDataPage = state->minDataPageId;
+    it->nextDataRec = 0;
+    it->nextIndexPage = state->minSecondaryIndexPageId;
+    it->segmentEnd = it->nextDataPage;
+    it->runStartPage = 0;
+    it->useRunPages = 0;
+    return 0;
+}
 
-        // If we are just starting to read a new page and we have a query bitmap
-        if (it->nextDataRec == 0 && it->queryBitmap != NULL) {
-            // Find what index page determines if we should read the data page
-            uint32_t indexPage = it->nextDataPage / state->maxIdxRecordsPerPage;
-            uint16_t indexRec = it->nextDataPage % state->maxIdxRecordsPerPage;
+/**
+ * @brief	Close secondary index iterator after use.
+ * @param	it		embedDB secondary iterator structure
+ */
+void embedDBCloseSecondaryIterator(embedDBSecondaryIterator *it) {
+    if (it->runPages != NULL) {
+        free(it->runPages);
+        it->runPages = NULL;
+    }
+}
 
-            if (state->indexFile != NULL && indexPage >= state->minIndexPageId && indexPage < state->nextIdxPageId) {
-                // If the index page that contains this data page exists, else we must read the data page regardless cause we don't have the index saved for it
+/**
+ * @brief	Moves a secondary iterator to the next span of data pages. A span is either covered by a
+ * 			sorted run, in which case only pages with a matching value are flagged, or is not indexed
+ * 			(old runs erased, pages written before a restart, the write buffer) and has to be scanned.
+ * @return	1 if there is another span, 0 if all data pages have been read
+ */
+int8_t embedDBSecondaryIteratorNextSegment(embedDBState *state, embedDBSecondaryIterator *it) {
+    id_t cursor = max(it->nextDataPage, state->minDataPageId);
+    if (cursor > state->nextDataPageId)
+        return 0;
 
-                if (readIndexPage(state, indexPage % state->numIndexPages) != 0) {
+    it->nextDataPage = cursor;
+    it->nextDataRec = 0;
+    it->useRunPages = 0;
+
+    int8_t valueSize = state->secondaryIndexSize;
+    int8_t entrySize = valueSize + sizeof(id_t);
+    while (cursor < state->nextDataPageId && it->nextIndexPage <= state->nextSecondaryIndexPageId) {
+        if (it->nextIndexPage < state->minSecondaryIndexPageId)
+            it->nextIndexPage = state->minSecondaryIndexPageId;
+
+        /* Runs are read from file, the newest one is still in the write buffer */
+        int8_t *run;
+        if (it->nextIndexPage == state->nextSecondaryIndexPageId) {
+            run = (int8_t *)state->buffer + state->pageSize * EMBEDDB_SECONDARY_INDEX_WRITE_BUFFER(state->parameters);
+            if (EMBEDDB_GET_COUNT(run) == 0)
+                break;
+        } else {
+            if (readSecondaryIndexPage(state, it->nextIndexPage % state->numSecondaryIndexPages) != 0) {
 #ifdef PRINT_ERRORS
-                    printf("ERROR: Failed to read index page %i (%i)\n", indexPage, indexPage % state->numIndexPages);
+                printf("ERROR: Failed to read secondary index page %i\n", it->nextIndexPage);
 #endif
-                    return 0;
-                }
+                return 0;
+            }
+            run = (int8_t *)state->buffer + state->pageSize * EMBEDDB_SECONDARY_INDEX_READ_BUFFER(state->parameters);
+        }
+
+        id_t firstPage, lastPage;
+        memcpy(&firstPage, run + 8, sizeof(id_t));
+        memcpy(&lastPage, run + 12, sizeof(id_t));
+        if (lastPage < cursor) {
+            it->nextIndexPage++;
+            continue;
+        }
+        if (firstPage > cursor) {
+            /* Pages before this run are not indexed */
+            it->segmentEnd = firstPage;
+            return 1;
+        }
+        if (lastPage - firstPage >= state->maxSecondaryIndexRecordsPerPage)
+            break;
 
-                // Get bitmap for data page in question
-                void *indexBM = (int8_t *)state->buffer + EMBEDDB_INDEX_READ_BUFFER * state->pageSize + EMBEDDB_IDX_HEADER_SIZE + indexRec * state->bitmapSize;
+        /* Flag the pages with a value in range, starting from the first entry >= minValue */
+        count_t count = EMBEDDB_GET_COUNT(run);
+        int8_t *entries = run + EMBEDDB_IDX_HEADER_SIZE;
+        int16_t low = 0, high = count;
+        while (it->minValue != NULL && low < high) {
+            int16_t mid = (low + high) / 2;
+            if (state->compareSecondaryIndex(entries + mid * entrySize, it->minValue) < 0)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        memset(it->runPages, 0, (state->maxSecondaryIndexRecordsPerPage + 7) / 8);
+        for (int16_t i = low; i < count; i++) {
+            if (it->maxValue != NULL && state->compareSecondaryIndex(entries + i * entrySize, it->maxValue) > 0)
+                break;
+            id_t pageId;
+            memcpy(&pageId, entries + i * entrySize + valueSize, sizeof(id_t));
+            pageId -= firstPage;
+            it->runPages[pageId / 8] |= (uint8_t)(1 << (pageId % 8));
+        }
 
-                // Determine if we should read the data page
-                if (!bitmapOverlap(it->queryBitmap, indexBM, state->bitmapSize)) {
-                    // Do not read this data page, try the next one
-                    it->nextDataPage++;
-                    continue;
-                }
+        it->runStartPage = firstPage;
+        it->useRunPages = 1;
+        it->segmentEnd = lastPage + 1;
+        it->nextIndexPage++;
+        return 1;
+    }
+
+    /* Rest of the data, including the write buffer, is not indexed */
+    it->segmentEnd = state->nextDataPageId + 1;
+    return 1;
+}
+
+/**
+ * @brief	Return next key, data pair for a secondary index iterator. Records are returned in key order.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB secondary iterator structure
+ * @param	key		Return variable for key (Pre-allocated)
+ * @param	data	Return variable for data (Pre-allocated)
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBNextSecondary(embedDBState *state, embedDBSecondaryIterator *it, void *key, void *data) {
+    while (1) {
+        if (it->nextDataPage >= it->segmentEnd) {
+            if (!embedDBSecondaryIteratorNextSegment(state, it))
+                return 0;
+            continue;
+        }
+
+        if (it->nextDataPage > state->nextDataPageId)
+            return 0;
+
+        // Skip pages of the run that have no value in range
+        if (it->nextDataRec == 0 && it->useRunPages) {
+            id_t runPage = it->nextDataPage - it->runStartPage;
+            if ((it->runPages[runPage / 8] & (1 << (runPage % 8))) == 0) {
+                it->nextDataPage++;
+                continue;
             }
         }
 
-        if (searchWriteBuf == 0 && readPage(state, it->nextDataPage % state->numDataPages) != 0) {
+        int8_t *buf;
+        if (it->nextDataPage == state->nextDataPageId) {
+            buf = (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+        } else {
+            if (readPage(state, it->nextDataPage % state->numDataPages) != 0) {
 #ifdef PRINT_ERRORS
-            printf("ERROR: Failed to read data page %i (%i)\n", it->nextDataPage, it->nextDataPage % state->numDataPages);
+                printf("ERROR: Failed to read data page %i (%i)\n", it->nextDataPage, it->nextDataPage % state->numDataPages);
 #endif
-            return 0;
+                return 0;
+            }
+            buf = (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize;
         }
 
-        // Keep reading record until we find one that matches the query
-        int8_t *buf = searchWriteBuf == 0 ? (int8_t *)state->buffer + EMBEDDB_DATA_READ_BUFFER * state->pageSize : (int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
-        uint32_t pageRecordCount = EMBEDDB_GET_COUNT(buf);
+        count_t pageRecordCount = EMBEDDB_GET_COUNT(buf);
         while (it->nextDataRec < pageRecordCount) {
-            // Get record
-            memcpy(key, buf + state->headerSize + it->nextDataRec * state->recordSize, state->keySize);
-            memcpy(data, buf + state->headerSize + it->nextDataRec * state->recordSize + state->keySize, state->dataSize);
+            int8_t *record = buf + state->headerSize + it->nextDataRec * state->recordSize;
+            void *value = record + state->keySize + state->secondaryIndexOffset;
             it->nextDataRec++;
 
-            // Check record
-            if (it->minKey != NULL && state->compareKey(key, it->minKey) < 0)
-                continue;
-            if (it->maxKey != NULL && state->compareKey(key, it->maxKey) > 0)
-                return 0;
-            if (it->minData != NULL && state->compareData(data, it->minData) < 0)
+            if (it->minValue != NULL && state->compareSecondaryIndex(value, it->minValue) < 0)
                 continue;
-            if (it->maxData != NULL && state->compareData(data, it->maxData) > 0)
+            if (it->maxValue != NULL && state->compareSecondaryIndex(value, it->maxValue) > 0)
                 continue;
 
-            // If we make it here, the record matches the query
+            memcpy(key, record, state->keySize);
+            memcpy(data, record + state->keySize, state->dataSize);
             return 1;
         }
 
-        // Finished reading through whole data page and didn't find a match
         it->nextDataPage++;
         it->nextDataRec = 0;
-
-        // Try next data page by looping back to top
     }
 }
 
@@ -1832,8 +3138,8 @@ int8_t embedDBNextVar(embedDBState *state, embedDBIterator *it, void *key, void
         return 0;
     }
 
-    void *outputBuffer = (int8_t *)state->buffer;
-    if (it->nextDataPage == 0 && (EMBEDDB_GET_COUNT(outputBuffer) > 0)) {
+    // Records of the write buffer are copied to the read buffer, where embedDBSetupVarDataStream looks for them
+    if (it->nextDataPage == state->nextDataPageId) {
         readToWriteBuf(state);
         embedDBFlushVar(state);
     }
@@ -1853,6 +3159,48 @@ int8_t embedDBNextVar(embedDBState *state, embedDBIterator *it, void *key, void
     return 0;
 }
 
+/**
+ * @brief	Return previous key, data, variable data set for a reverse iterator
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure initialized with embedDBInitReverseIterator
+ * @param	key		Return variable for key (Pre-allocated)
+ * @param	data	Return variable for data (Pre-allocated)
+ * @param	varData	Return variable for variable data as a embedDBVarDataStream (Unallocated). Returns NULL if no variable data. **Be sure to free the stream after you are done with it**
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBPrevVar(embedDBState *state, embedDBIterator *it, void *key, void *data, embedDBVarDataStream **varData) {
+    if (!EMBEDDB_USING_VDATA(state->parameters)) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: embedDBPrevVar called when not using variable data\n");
+#endif
+        return 0;
+    }
+
+    // ensure record exists
+    if (!embedDBPrev(state, it, key, data)) {
+        return 0;
+    }
+
+    // Records of the write buffer are copied to the read buffer, where embedDBSetupVarDataStream looks for them
+    if (it->nextDataPage == state->nextDataPageId) {
+        readToWriteBuf(state);
+        embedDBFlushVar(state);
+    }
+
+    // embedDBPrev leaves nextDataRec on the record it returned
+    int8_t setupResult = embedDBSetupVarDataStream(state, key, varData, it->nextDataRec);
+    switch (setupResult) {
+        case 0:
+        case 1:
+            return 1;
+        case 2:
+        case 3:
+            return 0;
+    }
+
+    return 0;
+}
+
 /**
  * @brief Setup varDataStream object to return the variable data for a record
  * @param	state	embedDB algorithm state structure
@@ -2039,9 +3387,91 @@ id_t writePage(embedDBState *state, void *buffer) {
     state->numAvailDataPages--;
     state->numWrites++;
 
+    /* Add the values on the page to the secondary index */
+    if (EMBEDDB_USING_SECONDARY_INDEX(state->parameters) && embedDBSecondaryIndexPage(state, buffer, pageNum) != 0) {
+#ifdef PRINT_ERRORS
+        printf("Failed to add data page %i to the secondary index\n", pageNum);
+#endif
+        return -1;
+    }
+
     return pageNum;
 }
 
+/**
+ * @brief	Adds the distinct secondary index column values of a data page to the sorted run in the
+ * 			secondary index write buffer. The run is written out first if the page does not fit in it,
+ * 			so a data page is always covered by exactly one run.
+ * @param	state	embedDB algorithm state structure
+ * @param	page	Buffer holding the data page that was written
+ * @param	pageNum	Logical page id of the data page
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBSecondaryIndexPage(embedDBState *state, void *page, id_t pageNum) {
+    int8_t valueSize = state->secondaryIndexSize;
+    int8_t entrySize = valueSize + sizeof(id_t);
+    count_t count = EMBEDDB_GET_COUNT(page);
+
+    /* Sort the distinct values of the page using the read buffer as scratch space */
+    int8_t *values = (int8_t *)state->buffer + state->pageSize * EMBEDDB_SECONDARY_INDEX_READ_BUFFER(state->parameters);
+    state->bufferedSecondaryIndexPageId = -1;
+    int16_t numValues = 0;
+    for (count_t i = 0; i < count; i++) {
+        void *value = (int8_t *)page + state->headerSize + i * state->recordSize + state->keySize + state->secondaryIndexOffset;
+        int16_t low = 0, high = numValues;
+        int8_t found = 0;
+        while (low < high) {
+            int16_t mid = (low + high) / 2;
+            int8_t compare = state->compareSecondaryIndex(values + mid * valueSize, value);
+            if (compare < 0) {
+                low = mid + 1;
+            } else if (compare > 0) {
+                high = mid;
+            } else {
+                found = 1;
+                break;
+            }
+        }
+        if (found)
+            continue;
+        memmove(values + (low + 1) * valueSize, values + low * valueSize, (numValues - low) * valueSize);
+        memcpy(values + low * valueSize, value, valueSize);
+        numValues++;
+    }
+
+    int8_t *run = (int8_t *)state->buffer + state->pageSize * EMBEDDB_SECONDARY_INDEX_WRITE_BUFFER(state->parameters);
+    count_t runCount = EMBEDDB_GET_COUNT(run);
+    if (runCount + numValues > state->maxSecondaryIndexRecordsPerPage) {
+        if (writeSecondaryIndexPage(state, run) == -1)
+            return -1;
+        memset(run, 0, state->pageSize);
+        runCount = 0;
+    }
+
+    if (runCount == 0)
+        memcpy(run + 8, &pageNum, sizeof(id_t));
+    memcpy(run + 12, &pageNum, sizeof(id_t));
+
+    /* Merge from the back. This page is the newest so it goes after existing entries with the same value. */
+    int8_t *entries = run + EMBEDDB_IDX_HEADER_SIZE;
+    int16_t runIdx = runCount - 1, valueIdx = numValues - 1, outIdx = runCount + numValues - 1;
+    while (valueIdx >= 0) {
+        if (runIdx >= 0 && state->compareSecondaryIndex(entries + runIdx * entrySize, values + valueIdx * valueSize) > 0) {
+            memmove(entries + outIdx * entrySize, entries + runIdx * entrySize, entrySize);
+            runIdx--;
+        } else {
+            memcpy(entries + outIdx * entrySize, values + valueIdx * valueSize, valueSize);
+            memcpy(entries + outIdx * entrySize + valueSize, &pageNum, sizeof(id_t));
+            valueIdx--;
+        }
+        outIdx--;
+    }
+
+    count_t newCount = runCount + numValues;
+    memcpy(run + EMBEDDB_COUNT_OFFSET, &newCount, sizeof(count_t));
+    return 0;
+}
+
 int8_t writeTemporaryPage(embedDBState *state, void *buffer) {
     if (state->dataFile == NULL) {
 #ifdef PRINT_ERRORS
@@ -2167,6 +3597,52 @@ id_t writeIndexPage(embedDBState *state, void *buffer) {
     return pageNum;
 }
 
+/**
+ * @brief	Writes secondary index page in buffer to storage. Returns page number.
+ * @param	state	embedDB algorithm state structure
+ * @param	buffer	Buffer holding the secondary index page
+ * @return	Return page number if success, -1 if error.
+ */
+id_t writeSecondaryIndexPage(embedDBState *state, void *buffer) {
+    if (state->secondaryIndexFile == NULL)
+        return -1;
+
+    /* Always writes to next page number. Returned to user. */
+    id_t pageNum = state->nextSecondaryIndexPageId++;
+    id_t physicalPageNumber = pageNum % state->numSecondaryIndexPages;
+
+    /* Setup page number in header */
+    memcpy(buffer, &(pageNum), sizeof(id_t));
+
+    if (state->numAvailSecondaryIndexPages <= 0) {
+        // Erase secondary index pages to make room for new page
+        int8_t eraseResult = state->fileInterface->erase(physicalPageNumber, physicalPageNumber + state->eraseSizeInPages, state->pageSize, state->secondaryIndexFile);
+        if (eraseResult != 1) {
+#ifdef PRINT_ERRORS
+            printf("Failed to erase secondary index page: %i (%i)\n", pageNum, physicalPageNumber);
+#endif
+            return -1;
+        }
+        state->numAvailSecondaryIndexPages += state->eraseSizeInPages;
+        state->minSecondaryIndexPageId += state->eraseSizeInPages;
+    }
+
+    int32_t val = state->fileInterface->write(buffer, physicalPageNumber, state->pageSize, state->secondaryIndexFile);
+    if (val == 0) {
+#ifdef PRINT_ERRORS
+        printf("Failed to write secondary index page: %i (%i)\n", pageNum, physicalPageNumber);
+#endif
+        return -1;
+    }
+
+    state->numAvailSecondaryIndexPages--;
+    state->numIdxWrites++;
+    if (state->bufferedSecondaryIndexPageId == physicalPageNumber)
+        state->bufferedSecondaryIndexPageId = -1;
+
+    return pageNum;
+}
+
 /**
  * @brief	Writes variable data page in buffer to storage. Returns page number.
  * @param	state	embedDB algorithm state structure
@@ -2234,6 +3710,8 @@ void readToWriteBuf(embedDBState *state) {
     void *writeBuf = (int8_t *)state->buffer + state->pageSize * EMBEDDB_DATA_WRITE_BUFFER;
     // copy write buffer to the read buffer.
     memcpy(readBuf, writeBuf, state->pageSize);
+    // the read buffer no longer holds a stored page
+    state->bufferedPageId = -1;
 }
 
 /**
@@ -2299,6 +3777,30 @@ int8_t readIndexPage(embedDBState *state, id_t pageNum) {
     return 0;
 }
 
+/**
+ * @brief	Reads given secondary index page from storage.
+ * @param	state	embedDB algorithm state structure
+ * @param	pageNum	Page number to read
+ * @return	Return 0 if success, -1 if error.
+ */
+int8_t readSecondaryIndexPage(embedDBState *state, id_t pageNum) {
+    /* Check if page is currently in buffer */
+    if (pageNum == state->bufferedSecondaryIndexPageId) {
+        state->bufferHits++;
+        return 0;
+    }
+
+    void *buf = (int8_t *)state->buffer + state->pageSize * EMBEDDB_SECONDARY_INDEX_READ_BUFFER(state->parameters);
+
+    /* Page is not in buffer. Read from storage. */
+    if (0 == state->fileInterface->read(buf, pageNum, state->pageSize, state->secondaryIndexFile))
+        return -1;
+
+    state->numIdxReads++;
+    state->bufferedSecondaryIndexPageId = pageNum;
+    return 0;
+}
+
 /**
  * @brief	Reads given variable data page from storage
  * @param 	state 	embedDB algorithm state structure
@@ -2352,6 +3854,10 @@ void embedDBClose(embedDBState *state) {
     if (state->varFile != NULL) {
         state->fileInterface->close(state->varFile);
     }
+    if (state->secondaryIndexFile != NULL) {
+        state->fileInterface->close(state->secondaryIndexFile);
+    }
+    freeActiveRuleEngine(state);
     if (!EMBEDDB_USING_BINARY_SEARCH(state->parameters)) {
         splineClose(state->spl);
         free(state->spl);
@@ -63,6 +63,9 @@ typedef uint16_t count_t;
 #define EMBEDDB_RECORD_LEVEL_CONSISTENCY 64
 #define EMBEDDB_USE_BINARY_SEARCH 128
 #define EMBEDDB_DISABLE_SPLINE_CLEAN 256
+#define EMBEDDB_USE_BLOOM 512
+#define EMBEDDB_USE_SECONDARY_INDEX 1024
+#define EMBEDDB_ASYNC_RULES 2048
 
 #define EMBEDDB_USING_INDEX(x) ((x & EMBEDDB_USE_INDEX) > 0 ? 1 : 0)
 #define EMBEDDB_USING_MAX_MIN(x) ((x & EMBEDDB_USE_MAX_MIN) > 0 ? 1 : 0)
@@ -73,6 +76,12 @@ typedef uint16_t count_t;
 #define EMBEDDB_USING_BINARY_SEARCH(x) ((x & EMBEDDB_USE_BINARY_SEARCH) > 0 ? 1 : 0)
 #define EMBEDDB_DISABLED_SPLINE_CLEAN(x) ((x & EMBEDDB_DISABLE_SPLINE_CLEAN) > 0 ? 1 : 0)
 #define EMBEDDB_RESETING_DATA(x) ((x & EMBEDDB_RESET_DATA) > 0 ? 1 : 0)
+#define EMBEDDB_USING_BLOOM(x) ((x & EMBEDDB_USE_BLOOM) > 0 ? 1 : 0)
+#define EMBEDDB_USING_SECONDARY_INDEX(x) ((x & EMBEDDB_USE_SECONDARY_INDEX) > 0 ? 1 : 0)
+#define EMBEDDB_USING_ASYNC_RULES(x) ((x & EMBEDDB_ASYNC_RULES) > 0 ? 1 : 0)
+
+/* Maximum number of data columns that can be hashed into the per-page Bloom filter */
+#define EMBEDDB_MAX_BLOOM_COLUMNS 4
 
 /* Offsets with header */
 #define EMBEDDB_COUNT_OFFSET 4
@@ -100,6 +109,7 @@ typedef uint16_t count_t;
 #define EMBEDDB_INC_COUNT(x) *((count_t *)((int8_t *)x + EMBEDDB_COUNT_OFFSET)) = *((count_t *)((int8_t *)x + EMBEDDB_COUNT_OFFSET)) + 1
 
 #define EMBEDDB_GET_BITMAP(x) ((void *)((int8_t *)x + EMBEDDB_BITMAP_OFFSET))
+#define EMBEDDB_GET_BLOOM(x, y) ((void *)((int8_t *)x + y->bloomFilterOffset))
 
 #define EMBEDDB_GET_MIN_KEY(x) ((void *)((int8_t *)x + EMBEDDB_MIN_OFFSET))
 #define EMBEDDB_GET_MAX_KEY(x, y) ((void *)((int8_t *)x + EMBEDDB_MIN_OFFSET + y->keySize))
@@ -107,12 +117,17 @@ typedef uint16_t count_t;
 #define EMBEDDB_GET_MIN_DATA(x, y) ((void *)((int8_t *)x + EMBEDDB_MIN_OFFSET + y->keySize * 2))
 #define EMBEDDB_GET_MAX_DATA(x, y) ((void *)((int8_t *)x + EMBEDDB_MIN_OFFSET + y->keySize * 2 + y->dataSize))
 
+/* A bitmap larger than 8 bytes overlaps the min/max values, so they are not reliable */
+#define EMBEDDB_MAX_MIN_INTACT(y) (EMBEDDB_USING_MAX_MIN(y->parameters) && (!EMBEDDB_USING_INDEX(y->parameters) || EMBEDDB_BITMAP_OFFSET + y->bitmapSize <= EMBEDDB_MIN_OFFSET))
+
 #define EMBEDDB_DATA_WRITE_BUFFER 0
 #define EMBEDDB_DATA_READ_BUFFER 1
 #define EMBEDDB_INDEX_WRITE_BUFFER 2
 #define EMBEDDB_INDEX_READ_BUFFER 3
 #define EMBEDDB_VAR_WRITE_BUFFER(x) ((x & EMBEDDB_USE_INDEX) ? 4 : 2)
 #define EMBEDDB_VAR_READ_BUFFER(x) ((x & EMBEDDB_USE_INDEX) ? 5 : 3)
+#define EMBEDDB_SECONDARY_INDEX_WRITE_BUFFER(x) (2 + 2 * EMBEDDB_USING_INDEX(x) + 2 * EMBEDDB_USING_VDATA(x))
+#define EMBEDDB_SECONDARY_INDEX_READ_BUFFER(x) (3 + 2 * EMBEDDB_USING_INDEX(x) + 2 * EMBEDDB_USING_VDATA(x))
 
 #define EMBEDDB_FILE_MODE_W_PLUS_B 0  // Open file as read/write, creates file if doesn't exist, overwrites if it does. aka "w+b"
 #define EMBEDDB_FILE_MODE_R_PLUS_B 1  // Open file as read/write, file must exist, keeps data if it does. aka "r+b"
@@ -150,6 +165,10 @@ typedef uint16_t count_t;
 #define NO_RECORD_FOUND -1
 #define RECORD_FOUND 0
 
+/* Modes of embedDBCountRange */
+#define EMBEDDB_COUNT_EXACT 0
+#define EMBEDDB_COUNT_ESTIMATE 1
+
 /**
  * @brief	An interface for embedDB to read/write to any storage medium at the page level of granularity
  */
@@ -210,20 +229,26 @@ typedef struct {
     void *dataFile;                                                       /* File for storing data records. */
     void *indexFile;                                                      /* File for storing index records. */
     void *varFile;                                                        /* File for storing variable length data. */
+    void *secondaryIndexFile;                                             /* File for storing the secondary index on a data column. */
     embedDBFileInterface *fileInterface;                                  /* Interface to the file storage */
     uint32_t numDataPages;                                                /* The number of pages will use for storing fixed records*/
     uint32_t numIndexPages;                                               /* The number of pages will use for storing the data index */
     uint32_t numVarPages;                                                 /* The number of pages will use for storing variable data */
+    uint32_t numSecondaryIndexPages;                                      /* The number of pages will use for storing the secondary index */
     count_t eraseSizeInPages;                                             /* Erase size in pages */
     uint32_t numAvailDataPages;                                           /* Number of writable data pages left before needing to delete */
     uint32_t numAvailIndexPages;                                          /* Number of writable index pages left before needing to delete */
     uint32_t numAvailVarPages;                                            /* Number of writable var pages left before needing to delete */
+    uint32_t numAvailSecondaryIndexPages;                                 /* Number of writable secondary index pages left before needing to delete */
     uint32_t minDataPageId;                                               /* Lowest logical data page id that is saved on file */
+    id_t minFullDataPageId;                                               /* Data pages with a lower logical id may hold fewer than maxRecordsPerPage records */
     uint32_t minIndexPageId;                                              /* Lowest logical index page id that is saved on file */
     uint64_t minVarRecordId;                                              /* Minimum record id that we still have variable data for */
+    uint32_t minSecondaryIndexPageId;                                     /* Lowest logical secondary index page id that is saved on file */
     id_t nextDataPageId;                                                  /* Next logical page id. Page id is an incrementing value and may not always be same as physical page id. */
     id_t nextIdxPageId;                                                   /* Next logical page id for index. Page id is an incrementing value and may not always be same as physical page id. */
     id_t nextVarPageId;                                                   /* Page number of next var page to be written */
+    id_t nextSecondaryIndexPageId;                                        /* Next logical page id for the secondary index */
     uint32_t nextRLCPhysicalPageLocation;                                 /* Physical page number for the location for the next record-level-consistency page */
     uint32_t rlcPhysicalStartingPage;                                     /* Physical page number for the starting page of the record-level consistnecy pages */
     id_t currentVarLoc;                                                   /* Current variable address offset to write at (bytes from beginning of file) */
@@ -248,6 +273,16 @@ typedef struct {
     void (*buildBitmapFromRange)(void *minData, void *maxData, void *bm); /* Given a record, builds bitmap based on its data (key) value */
     void (*updateBitmap)(void *data, void *bm);                           /* Given a record, updates bitmap based on its data (key) value */
     int8_t (*inBitmap)(void *data, void *bm);                             /* Returns 1 if data (key) value is a valid value given the bitmap */
+    int8_t bloomFilterSize;                                               /* Size of the per-page Bloom filter in bytes (only used with EMBEDDB_USE_BLOOM) */
+    int8_t bloomFilterOffset;                                             /* Offset of the Bloom filter in the data page header (calculated during init()) */
+    uint8_t numBloomHashes;                                               /* Number of bits set in the Bloom filter for each value */
+    uint8_t numBloomColumns;                                              /* Number of data columns added to the Bloom filter */
+    uint8_t bloomColumnOffsets[EMBEDDB_MAX_BLOOM_COLUMNS];                /* Byte offset of each Bloom filter column from the start of the data */
+    uint8_t bloomColumnSizes[EMBEDDB_MAX_BLOOM_COLUMNS];                  /* Size in bytes of each Bloom filter column */
+    uint8_t secondaryIndexOffset;                                         /* Byte offset of the secondary index column from the start of the data */
+    int8_t secondaryIndexSize;                                            /* Size in bytes of the secondary index column (max 8) */
+    count_t maxSecondaryIndexRecordsPerPage;                              /* Maximum value/page entries per secondary index page */
+    int8_t (*compareSecondaryIndex)(void *a, void *b);                    /* Function that compares two values of the secondary index column */
     uint64_t maxKey;                                                      /* Maximum key */
     int32_t maxError;                                                     /* Maximum key error */
     id_t numWrites;                                                       /* Number of page writes */
@@ -258,9 +293,12 @@ typedef struct {
     id_t bufferedPageId;                                                  /* Page id currently in read buffer */
     id_t bufferedIndexPageId;                                             /* Index page id currently in index read buffer */
     id_t bufferedVarPage;                                                 /* Variable page id currently in variable read buffer */
+    id_t bufferedSecondaryIndexPageId;                                    /* Secondary index page id currently in secondary index read buffer */
     uint8_t recordHasVarData;                                             /* Internal flag to signal that the record currently being written has var data */
     struct activeRule** rules;                                          /* Array of active rules */
     uint32_t numRules;                                                    /* Number of active rules */
+    void *ruleEngine;                                                     /* Shared window state of the active rules */
+    uint32_t ruleQueueLength;                                             /* Number of records the rule queue holds when using EMBEDDB_ASYNC_RULES */
 } embedDBState;
 
 
@@ -272,8 +310,38 @@ typedef struct {
     void *minData;
     void *maxData;
     void *queryBitmap;
+    void *queryBloomFilter; /* Bloom filter bits of the equality probe, NULL if there is no probe */
+    void *bloomValue;       /* Value the probed Bloom filter column must be equal to */
+    int8_t bloomColumn;     /* Index of the probed Bloom filter column */
+    int8_t isReverse;       /* 1 if the iterator returns records newest first with embedDBPrev */
 } embedDBIterator;
 
+/* Value of nextDataRec for a reverse iterator that has not read its current page yet */
+#define EMBEDDB_ITERATOR_PAGE_UNREAD UINT16_MAX
+
+typedef struct {
+    void *ranges;         /* Smallest and largest key of each range, one after the other, sorted by smallest key */
+    uint32_t numRanges;   /* Number of ranges in ranges */
+    void *minData;        /* Smallest data value to return, NULL for no lower bound */
+    void *maxData;        /* Largest data value to return, NULL for no upper bound */
+    void *mergedRanges;   /* Ranges after overlapping ranges are merged */
+    uint32_t numMerged;   /* Number of ranges in mergedRanges */
+    uint32_t range;       /* Merged range being read */
+    embedDBIterator it;   /* Iterator over the range being read */
+} embedDBMultiRangeIterator;
+
+typedef struct {
+    void *minValue;      /* Smallest value of the secondary index column to return, NULL for no lower bound */
+    void *maxValue;      /* Largest value of the secondary index column to return, NULL for no upper bound */
+    id_t nextDataPage;   /* Next data page that the iterator should read */
+    uint16_t nextDataRec; /* Next record on the data page that the iterator should read */
+    id_t nextIndexPage;  /* Next secondary index page (sorted run) to load */
+    id_t segmentEnd;     /* First data page after the segment being read */
+    id_t runStartPage;   /* First data page covered by the loaded run */
+    uint8_t useRunPages; /* 1 if only pages flagged in runPages are read in this segment */
+    uint8_t *runPages;   /* One bit per data page of the loaded run, set if the page has a matching value */
+} embedDBSecondaryIterator;
+
 typedef struct {
     uint32_t totalBytes; /* Total number of bytes in the stream */
     uint32_t bytesRead;  /* Number of bytes read so far */
@@ -339,6 +407,16 @@ int8_t embedDBPutVar(embedDBState *state, void *key, void *data, void *variableD
  */
 int8_t embedDBGet(embedDBState *state, void *key, void *data);
 
+/**
+ * @brief	Given a key, returns a pointer to the data associated with key without copying it.
+ * 			The pointer is into the read or write page buffer and is valid until the next call on this state.
+ * @param	state	embedDB algorithm state structure
+ * @param	key		Key for record
+ * @param	data	Return variable for a pointer to the data of the record
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBGetRef(embedDBState *state, void *key, const void **data);
+
 /**
  * @brief	Given a key, returns data associated with key.
  * 			Data is copied from database into data buffer.
@@ -352,6 +430,40 @@ int8_t embedDBGet(embedDBState *state, void *key, void *data);
  */
 int8_t embedDBGetVar(embedDBState *state, void *key, void *data, embedDBVarDataStream **varData);
 
+/**
+ * @brief	Finds the record with the largest key that is <= key, such as the value at or before a time.
+ * @param	state		embedDB algorithm state structure
+ * @param	key			Key to search for
+ * @param	foundKey	Return variable for the key of the record. May be NULL.
+ * @param	data		Pre-allocated memory to copy data for record. May be NULL.
+ * @return	Return 0 if success. -1 if no stored key is <= key or on error.
+ */
+int8_t embedDBGetFloor(embedDBState *state, void *key, void *foundKey, void *data);
+
+/**
+ * @brief	Finds the record with the smallest key that is >= key, such as the first reading at or after a time.
+ * @param	state		embedDB algorithm state structure
+ * @param	key			Key to search for
+ * @param	foundKey	Return variable for the key of the record. May be NULL.
+ * @param	data		Pre-allocated memory to copy data for record. May be NULL.
+ * @return	Return 0 if success. -1 if no stored key is >= key or on error.
+ */
+int8_t embedDBGetCeil(embedDBState *state, void *key, void *foundKey, void *data);
+
+/**
+ * @brief	Counts the records with a key in [minKey, maxKey] without reading the records in between.
+ * 			EMBEDDB_COUNT_EXACT reads the two boundary pages and the header of each page in the range that may
+ * 			have been flushed while partly filled. EMBEDDB_COUNT_ESTIMATE interpolates with the spline, does not
+ * 			read storage, and assumes that all pages are full.
+ * @param	state	embedDB algorithm state structure
+ * @param	minKey	Smallest key to count. NULL to start at the oldest record.
+ * @param	maxKey	Largest key to count. NULL to end at the newest record.
+ * @param	mode	EMBEDDB_COUNT_EXACT or EMBEDDB_COUNT_ESTIMATE
+ * @param	count	Return variable for the number of records
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBCountRange(embedDBState *state, void *minKey, void *maxKey, int8_t mode, uint32_t *count);
+
 /**
  * @brief	Initialize iterator on embedDB structure.
  * @param	state	embedDB algorithm state structure
@@ -359,6 +471,95 @@ int8_t embedDBGetVar(embedDBState *state, void *key, void *data, embedDBVarDataS
  */
 void embedDBInitIterator(embedDBState *state, embedDBIterator *it);
 
+/**
+ * @brief	Initialize an iterator that returns records newest first with embedDBPrev. It starts from the
+ * 			write buffer, or from the page holding maxKey, and walks backwards until minKey.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure
+ */
+void embedDBInitReverseIterator(embedDBState *state, embedDBIterator *it);
+
+/**
+ * @brief	Recomputes the query bitmap, the Bloom filter probe and the first data page of an initialized iterator after
+ * 			its minKey, maxKey, minData or maxData, or the values they point to, were changed. Restarts the iterator
+ * 			without allocating once its query bitmap exists.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure (already initialized)
+ */
+void embedDBIteratorUpdateBounds(embedDBState *state, embedDBIterator *it);
+
+/**
+ * @brief	Moves an initialized iterator without reinitializing it. The next call to embedDBNext returns the first matching
+ * 			record with a key >= key, or for a reverse iterator the next call to embedDBPrev returns the last matching record
+ * 			with a key <= key. The current page is reused if it holds the key, and pages between the current position and
+ * 			the key are not read. The iterator's filters and bitmap are unchanged.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure (already initialized)
+ * @param	key		Key to move to. Keys outside the iterator's minKey and maxKey seek to the nearest bound.
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBIteratorSeek(embedDBState *state, embedDBIterator *it, void *key);
+
+/**
+ * @brief	Moves an initialized iterator so that embedDBNext returns the last n records stored, oldest first.
+ * 			The position is computed from the record counts without reading storage or comparing keys.
+ * 			Stored pages are assumed to be full, so fewer records follow if pages were flushed while partly filled.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure (already initialized with embedDBInitIterator)
+ * @param	n		Number of most recent records to return
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBIteratorSeekLast(embedDBState *state, embedDBIterator *it, uint32_t n);
+
+/**
+ * @brief	Return the next record of a downsampled read: the next matching record, after which the iterator moves to the
+ * 			first key >= that record's key + stride without reading the pages in between.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure initialized with embedDBInitIterator
+ * @param	stride	Smallest key difference between two returned records. 0 is treated as 1.
+ * @param	key		Return variable for the key (Pre-allocated)
+ * @param	data	Return variable for the data (Pre-allocated)
+ * @return	1 if a record was returned, 0 if there are no more records.
+ */
+int8_t embedDBNextSample(embedDBState *state, embedDBIterator *it, uint64_t stride, void *key, void *data);
+
+/**
+ * @brief	Initialize an iterator over several key ranges. Overlapping ranges are merged, and the records of all ranges
+ * 			are returned in key order by embedDBNextMultiRange. Each range is found with embedDBIteratorSeek, so pages
+ * 			between ranges are not read and a page shared by neighbouring ranges is read once.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		Multi-range iterator with ranges, numRanges, minData and maxData set
+ * @return	Return 0 if success. Non-zero value if error, such as ranges that are not sorted.
+ */
+int8_t embedDBInitMultiRangeIterator(embedDBState *state, embedDBMultiRangeIterator *it);
+
+/**
+ * @brief	Return the next record in any of the ranges of a multi-range iterator.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		Multi-range iterator initialized with embedDBInitMultiRangeIterator
+ * @param	key		Return variable for the key (Pre-allocated)
+ * @param	data	Return variable for the data (Pre-allocated)
+ * @return	1 if a record was returned, 0 if there are no more records.
+ */
+int8_t embedDBNextMultiRange(embedDBState *state, embedDBMultiRangeIterator *it, void *key, void *data);
+
+/**
+ * @brief	Close a multi-range iterator after use.
+ * @param	it		Multi-range iterator
+ */
+void embedDBCloseMultiRangeIterator(embedDBMultiRangeIterator *it);
+
+/**
+ * @brief	Restricts an initialized iterator to records where a Bloom filter column equals a value.
+ * 			Data pages whose Bloom filter cannot contain the value are skipped without being read.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure (already initialized)
+ * @param	column	Index of the column in bloomColumnOffsets/bloomColumnSizes
+ * @param	value	Value to match. Must remain valid while the iterator is in use.
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBIteratorSetBloomProbe(embedDBState *state, embedDBIterator *it, int8_t column, void *value);
+
 /**
  * @brief	Close iterator after use.
  * @param	it		embedDB iterator structure
@@ -375,6 +576,63 @@ void embedDBCloseIterator(embedDBIterator *it);
  */
 int8_t embedDBNext(embedDBState *state, embedDBIterator *it, void *key, void *data);
 
+/**
+ * @brief	Return pointers to the next key and data for iterator without copying the record.
+ * 			The pointers are into the read or write page buffer and are valid until the next call on this state.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure
+ * @param	key		Return variable for a pointer to the key
+ * @param	data	Return variable for a pointer to the data
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBNextRef(embedDBState *state, embedDBIterator *it, const void **key, const void **data);
+
+/**
+ * @brief	Return previous key, data pair for a reverse iterator. Records are returned in decreasing key order.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure initialized with embedDBInitReverseIterator
+ * @param	key		Return variable for key (Pre-allocated)
+ * @param	data	Return variable for data (Pre-allocated)
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBPrev(embedDBState *state, embedDBIterator *it, void *key, void *data);
+
+/**
+ * @brief	Return pointers to the previous key and data for a reverse iterator without copying the record.
+ * 			The pointers are into the read or write page buffer and are valid until the next call on this state.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure initialized with embedDBInitReverseIterator
+ * @param	key		Return variable for a pointer to the key
+ * @param	data	Return variable for a pointer to the data
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBPrevRef(embedDBState *state, embedDBIterator *it, const void **key, const void **data);
+
+/**
+ * @brief	Initialize an iterator that uses the secondary index to find records whose
+ * 			secondary index column is within [minValue, maxValue].
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB secondary iterator structure with minValue and maxValue set
+ * @return	Return 0 if success. Non-zero value if error.
+ */
+int8_t embedDBInitSecondaryIterator(embedDBState *state, embedDBSecondaryIterator *it);
+
+/**
+ * @brief	Return next key, data pair for a secondary index iterator. Records are returned in key order.
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB secondary iterator structure
+ * @param	key		Return variable for key (Pre-allocated)
+ * @param	data	Return variable for data (Pre-allocated)
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBNextSecondary(embedDBState *state, embedDBSecondaryIterator *it, void *key, void *data);
+
+/**
+ * @brief	Close secondary index iterator after use.
+ * @param	it		embedDB secondary iterator structure
+ */
+void embedDBCloseSecondaryIterator(embedDBSecondaryIterator *it);
+
 /**
  * @brief	Return next key, data, variable data set for iterator
  * @param	state	embedDB algorithm state structure
@@ -386,6 +644,17 @@ int8_t embedDBNext(embedDBState *state, embedDBIterator *it, void *key, void *da
  */
 int8_t embedDBNextVar(embedDBState *state, embedDBIterator *it, void *key, void *data, embedDBVarDataStream **varData);
 
+/**
+ * @brief	Return previous key, data, variable data set for a reverse iterator
+ * @param	state	embedDB algorithm state structure
+ * @param	it		embedDB iterator state structure initialized with embedDBInitReverseIterator
+ * @param	key		Return variable for key (Pre-allocated)
+ * @param	data	Return variable for data (Pre-allocated)
+ * @param	varData	Return variable for variable data as a embedDBVarDataStream (Unallocated). Returns NULL if no variable data. **Be sure to free the stream after you are done with it**
+ * @return	1 if successful, 0 if no more records
+ */
+int8_t embedDBPrevVar(embedDBState *state, embedDBIterator *it, void *key, void *data, embedDBVarDataStream **varData);
+
 /**
  * @brief	Reads data from variable data stream into the given buffer.
  * @param	state	embedDB algorithm state structure
@@ -426,6 +695,14 @@ int8_t readPage(embedDBState *state, id_t pageNum);
  */
 int8_t readIndexPage(embedDBState *state, id_t pageNum);
 
+/**
+ * @brief	Reads given secondary index page from storage.
+ * @param	state	embedDB algorithm state structure
+ * @param	pageNum	Physical page number to read
+ * @return	Return 0 if success, -1 if error.
+ */
+int8_t readSecondaryIndexPage(embedDBState *state, id_t pageNum);
+
 /**
  * @brief	Reads given variable data page from storage
  * @param 	state 	embedDB algorithm state structure
@@ -450,6 +727,14 @@ id_t writePage(embedDBState *state, void *buffer);
  */
 id_t writeIndexPage(embedDBState *state, void *buffer);
 
+/**
+ * @brief	Writes secondary index page in buffer to storage. Returns page number.
+ * @param	state	embedDB algorithm state structure
+ * @param	buffer	Buffer holding the secondary index page
+ * @return	Return page number if success, -1 if error.
+ */
+id_t writeSecondaryIndexPage(embedDBState *state, void *buffer);
+
 /**
  * @brief	Writes variable data page in buffer to storage. Returns page number.
  * @param	state	embedDB algorithm state structure
@@ -1,5 +1,112 @@
 #include "activeRules.h"
 
+#ifdef EMBEDDB_RULE_THREAD
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#define RULE_ATOMIC _Atomic
+#define RULE_LOAD_ACQUIRE(x) atomic_load_explicit(&(x), memory_order_acquire)
+#define RULE_STORE_RELEASE(x, v) atomic_store_explicit(&(x), (v), memory_order_release)
+#else
+#define RULE_ATOMIC volatile
+#define RULE_LOAD_ACQUIRE(x) (x)
+#define RULE_STORE_RELEASE(x, v) ((x) = (v))
+#endif
+
+#define RULE_WINDOW_INITIAL_CAPACITY 16
+#define RULE_QUEUE_DEFAULT_LENGTH 16
+#define RULE_WORKER_BATCH 32
+
+struct ruleWindowGroup;
+
+/**
+ * @brief Aggregate state of one rule in a window group. AVG keeps a running sum and MIN/MAX keep a monotonic
+ * deque of ring slots with the best candidate first, so each insert costs O(1) amortized.
+ */
+struct ruleAggregate {
+    activeRule *rule;
+    struct ruleWindowGroup *group;
+    int8_t valueSize;      /* Size of the rule column */
+    int8_t isSigned;       /* If the rule column is signed */
+    uint16_t dataOffset;   /* Offset of the rule column in the record data */
+    double sum;            /* Sum of the values in the window */
+    uint32_t *deque;       /* Ring slots of the candidate min or max values */
+    uint32_t dequeHead;
+    uint32_t dequeSize;
+    uint32_t count;        /* Records found by the last scan if the window is not in memory */
+    int8_t scanResult[8];  /* Min or max found by the last scan if the window is not in memory */
+};
+
+/**
+ * @brief Rules with the same window length and where range share one window. Its records are kept once,
+ * in key order, and each insert updates the aggregates of every rule in the group. The window holds the records
+ * in the where range among the last numLast records, so records are evicted by position instead of by key.
+ */
+struct ruleWindowGroup {
+    uint64_t numLast;      /* Window length in records */
+    void *minData;         /* Where range of the rules */
+    void *maxData;
+    uint32_t capacity;     /* Number of records the ring can hold, grows up to numLast */
+    uint32_t head;         /* Ring slot of the oldest record */
+    uint32_t size;         /* Number of records in the window */
+    uint64_t numRecords;   /* Records seen by the window, including those outside the where range. Position of the next record. */
+    uint64_t *positions;   /* Position of each record. NULL if the window did not fit in memory and is scanned on each insert. */
+    int8_t *records;       /* Data of each record */
+    uint16_t numMembers;
+    struct ruleAggregate *members;
+};
+
+/* Configuration of a rule when the groups were built, used to detect changes to the rules */
+struct ruleSnapshot {
+    activeRule *rule;
+    ActiveQueryType type;
+    uint8_t colNum;
+    bool enabled;
+    uint64_t numLast;
+    void *minData;
+    void *maxData;
+    void *window;
+};
+
+/**
+ * @brief Single-producer/single-consumer queue of inserted records waiting for rule evaluation. Each entry is a flag
+ * byte followed by the key and data. Only embedDBPut advances tail and only the consumer advances head.
+ */
+struct ruleQueue {
+    uint32_t capacity;
+    uint16_t entrySize;
+    int8_t *entries;
+    RULE_ATOMIC uint32_t head;   /* Number of records taken from the queue */
+    RULE_ATOMIC uint32_t tail;   /* Number of records put in the queue */
+    uint32_t highWaterMark;      /* Largest depth seen */
+    uint32_t dropped;            /* Records that were not evaluated because the queue was full */
+    int8_t resyncNext;           /* Set by the producer after a drop, the next entry rebuilds the windows */
+};
+
+/* Memory for the operators of a rule that is evaluated with a query. Larger trees fall back to malloc. */
+#ifndef EMBEDDB_RULE_ARENA_SIZE
+#define EMBEDDB_RULE_ARENA_SIZE 1024
+#endif
+
+struct ruleEngine {
+    uint32_t numRules;
+    struct ruleSnapshot *rules;
+    uint32_t numGroups;
+    struct ruleWindowGroup *groups;
+    int8_t rebuild;              /* Windows must be rebuilt from storage on the next record */
+    struct ruleQueue queue;
+    embedDBArena arena;          /* Operators of rules evaluated with a query are allocated from arenaMemory */
+    uint8_t arenaMemory[EMBEDDB_RULE_ARENA_SIZE];
+#ifdef EMBEDDB_RULE_THREAD
+    pthread_mutex_t lock;        /* Held while the worker reads storage and while embedDBPut writes it */
+    pthread_t worker;
+    RULE_ATOMIC int8_t workerRunning;
+#endif
+};
+
+/* Entry flag telling the consumer that records before this one were dropped */
+#define RULE_QUEUE_RESYNC 1
+
 activeRule* IF(activeRule *rule, uint8_t colNum, ActiveQueryType type) {
     rule->type = type;
     rule->colNum = colNum;
@@ -50,18 +157,530 @@ activeRule* createActiveRule(embedDBSchema *schema, void* context) {
         rule->where = where;
         rule->then = then;
         rule->enabled = true; // Default to enabled
+        rule->window = NULL;
     }
     return rule;
 }
 
+void freeActiveRule(activeRule** rule) {
+    if (rule == NULL || *rule == NULL)
+        return;
+    embedDBFreeSchema(&(*rule)->schema);
+    free(*rule);
+    *rule = NULL;
+}
+
+void resetActiveRuleWindow(activeRule* rule) {
+    rule->window = NULL;
+}
+
+static uint64_t ruleNumLast(embedDBState* state, activeRule* rule) {
+    return state->keySize == 4 ? *(uint32_t*)rule->numLastEntries : *(uint64_t*)rule->numLastEntries;
+}
+
+static double ruleValueAsDouble(ColumnType colType, const void* value) {
+    switch (colType) {
+        case embedDB_COLUMN_INT32: {
+            int32_t val;
+            memcpy(&val, value, sizeof(int32_t));
+            return val;
+        }
+        case embedDB_COLUMN_UINT32: {
+            uint32_t val;
+            memcpy(&val, value, sizeof(uint32_t));
+            return val;
+        }
+        case embedDB_COLUMN_INT64: {
+            int64_t val;
+            memcpy(&val, value, sizeof(int64_t));
+            return (double)val;
+        }
+        case embedDB_COLUMN_UINT64: {
+            uint64_t val;
+            memcpy(&val, value, sizeof(uint64_t));
+            return (double)val;
+        }
+        case embedDB_COLUMN_FLOAT: {
+            float val;
+            memcpy(&val, value, sizeof(float));
+            return val;
+        }
+        case embedDB_COLUMN_DOUBLE: {
+            double val;
+            memcpy(&val, value, sizeof(double));
+            return val;
+        }
+        default:
+            return 0;
+    }
+}
+
+/* Only the built in aggregates over a non-empty window are kept incrementally */
+static int8_t ruleUsesWindow(embedDBState* state, activeRule* rule) {
+    if (!rule->enabled || rule->numLastEntries == NULL || ruleNumLast(state, rule) == 0)
+        return 0;
+    int columnSize = abs(rule->schema->columnSizes[rule->colNum]);
+    if (rule->type == GET_AVG)
+        return 1;
+    return (rule->type == GET_MAX || rule->type == GET_MIN) && (columnSize == 4 || columnSize == 8);
+}
+
+static int8_t sameWhereValue(embedDBState* state, void* a, void* b) {
+    if (a == NULL || b == NULL)
+        return a == b;
+    return a == b || state->compareData(a, b) == 0;
+}
+
+static int8_t ruleWhereMatches(embedDBState* state, struct ruleWindowGroup* group, void* data) {
+    if (group->minData != NULL && state->compareData(data, group->minData) < 0)
+        return 0;
+    if (group->maxData != NULL && state->compareData(data, group->maxData) > 0)
+        return 0;
+    return 1;
+}
+
+/* True if key is the newest stored record. It is then always in the write buffer, as embedDBPut writes a full buffer before adding to it. */
+static int8_t ruleKeyIsNewest(embedDBState* state, void* key) {
+    int8_t* writeBuf = (int8_t*)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize;
+    count_t count = EMBEDDB_GET_COUNT(writeBuf);
+    if (count == 0)
+        return 0;
+    return state->compareKey(writeBuf + state->headerSize + (count - 1) * state->recordSize, key) == 0;
+}
 
+/**
+ * @brief Initializes a forward iterator on the last numLast records that end at key, without assuming dense keys.
+ * Records outside the iterator's data range are counted too. If key is the newest record the start is found with
+ * embedDBIteratorSeekLast without reading storage. Otherwise newer records are already stored, as when rules run
+ * asynchronously, and the key of the first record is found by reading backwards from key.
+ * @param bounds Storage for the first and last key of the window, 2 * keySize bytes, that must stay valid while the iterator is used
+ */
+static void initRuleWindowIterator(embedDBState* state, embedDBIterator* it, uint64_t numLast, void* key, void* bounds) {
+    it->minKey = NULL;
+    it->maxKey = NULL;
+    if (ruleKeyIsNewest(state, key)) {
+        embedDBInitIterator(state, it);
+        embedDBIteratorSeekLast(state, it, numLast > UINT32_MAX ? UINT32_MAX : (uint32_t)numLast);
+        return;
+    }
 
+    int8_t* minKey = (int8_t*)bounds;
+    int8_t* maxKey = minKey + state->keySize;
+    memcpy(minKey, key, state->keySize);
+    memcpy(maxKey, key, state->keySize);
+    embedDBIterator reverse;
+    reverse.minKey = NULL;
+    reverse.maxKey = maxKey;
+    reverse.minData = NULL;
+    reverse.maxData = NULL;
+    embedDBInitReverseIterator(state, &reverse);
+    const void *recordKey, *recordData;
+    for (uint64_t count = 0; count < numLast && embedDBPrevRef(state, &reverse, &recordKey, &recordData); count++)
+        memcpy(minKey, recordKey, state->keySize);
+    embedDBCloseIterator(&reverse);
+
+    it->minKey = minKey;
+    it->maxKey = maxKey;
+    embedDBInitIterator(state, it);
+}
+
+/* Releases the ring of a group. The group is scanned from storage from then on. */
+static void freeRuleGroupWindow(struct ruleWindowGroup* group) {
+    free(group->positions);
+    free(group->records);
+    group->positions = NULL;
+    group->records = NULL;
+    for (uint16_t i = 0; i < group->numMembers; i++) {
+        free(group->members[i].deque);
+        group->members[i].deque = NULL;
+    }
+}
+
+static void freeRuleGroups(struct ruleEngine* engine) {
+    for (uint32_t i = 0; i < engine->numGroups; i++) {
+        freeRuleGroupWindow(&engine->groups[i]);
+        free(engine->groups[i].members);
+    }
+    free(engine->groups);
+    engine->groups = NULL;
+    engine->numGroups = 0;
+}
+
+void freeActiveRuleEngine(embedDBState* state) {
+    struct ruleEngine* engine = (struct ruleEngine*)state->ruleEngine;
+    if (engine == NULL)
+        return;
+#ifdef EMBEDDB_RULE_THREAD
+    embedDBStopRuleWorker(state);
+    pthread_mutex_destroy(&engine->lock);
+#endif
+    freeRuleGroups(engine);
+    free(engine->rules);
+    free(engine->queue.entries);
+    free(engine);
+    state->ruleEngine = NULL;
+}
+
+static struct ruleEngine* getRuleEngine(embedDBState* state) {
+    struct ruleEngine* engine = (struct ruleEngine*)state->ruleEngine;
+    if (engine != NULL)
+        return engine;
+    engine = (struct ruleEngine*)calloc(1, sizeof(struct ruleEngine));
+    if (engine == NULL)
+        return NULL;
+#ifdef EMBEDDB_RULE_THREAD
+    if (pthread_mutex_init(&engine->lock, NULL) != 0) {
+        free(engine);
+        return NULL;
+    }
+#endif
+    embedDBArenaInit(&engine->arena, engine->arenaMemory, sizeof(engine->arenaMemory));
+    state->ruleEngine = engine;
+    return engine;
+}
+
+#ifdef EMBEDDB_RULE_THREAD
+int8_t lockActiveRules(embedDBState* state) {
+    struct ruleEngine* engine = (struct ruleEngine*)state->ruleEngine;
+    if (engine == NULL || !RULE_LOAD_ACQUIRE(engine->workerRunning))
+        return 0;
+    pthread_mutex_lock(&engine->lock);
+    return 1;
+}
+
+void unlockActiveRules(embedDBState* state, int8_t locked) {
+    if (locked)
+        pthread_mutex_unlock(&((struct ruleEngine*)state->ruleEngine)->lock);
+}
+
+/* Storage is only locked while the worker thread is running, rules evaluated on the inserting thread never wait */
+#define LOCK_RULE_STORAGE(state, locked) ((locked) = lockActiveRules(state))
+#define UNLOCK_RULE_STORAGE(state, locked) unlockActiveRules(state, locked)
+#else
+#define LOCK_RULE_STORAGE(state, locked) ((locked) = 0)
+#define UNLOCK_RULE_STORAGE(state, locked) ((void)(locked))
+#endif
+
+/* Resizes the ring to newCapacity records, moving the oldest record to slot 0 */
+static int8_t resizeRuleGroupWindow(embedDBState* state, struct ruleWindowGroup* group, uint32_t newCapacity) {
+    uint64_t* positions = (uint64_t*)malloc((size_t)newCapacity * sizeof(uint64_t));
+    int8_t* records = (int8_t*)malloc((size_t)newCapacity * state->dataSize);
+    if (positions == NULL || records == NULL) {
+        free(positions);
+        free(records);
+        return -1;
+    }
+    for (uint16_t m = 0; m < group->numMembers; m++) {
+        struct ruleAggregate* member = &group->members[m];
+        if (member->rule->type == GET_AVG)
+            continue;
+        uint32_t* deque = (uint32_t*)malloc((size_t)newCapacity * sizeof(uint32_t));
+        if (deque == NULL) {
+            free(positions);
+            free(records);
+            return -1;
+        }
+        for (uint32_t i = 0; i < member->dequeSize; i++) {
+            uint32_t slot = member->deque[(member->dequeHead + i) % group->capacity];
+            deque[i] = (slot + group->capacity - group->head) % group->capacity;
+        }
+        free(member->deque);
+        member->deque = deque;
+        member->dequeHead = 0;
+    }
+    for (uint32_t i = 0; i < group->size; i++) {
+        uint32_t slot = (group->head + i) % group->capacity;
+        positions[i] = group->positions[slot];
+        memcpy(records + i * state->dataSize, group->records + slot * state->dataSize, state->dataSize);
+    }
+    free(group->positions);
+    free(group->records);
+    group->positions = positions;
+    group->records = records;
+    group->capacity = newCapacity;
+    group->head = 0;
+    return 0;
+}
+
+static int8_t pushRuleGroupWindow(embedDBState* state, struct ruleWindowGroup* group, uint64_t position, void* data) {
+    if (group->size == group->capacity) {
+        uint64_t newCapacity = (uint64_t)group->capacity * 2;
+        if (newCapacity > group->numLast)
+            newCapacity = group->numLast;
+        if (newCapacity > UINT32_MAX / sizeof(uint64_t) || resizeRuleGroupWindow(state, group, (uint32_t)newCapacity) != 0)
+            return -1;
+    }
+
+    uint32_t slot = (group->head + group->size) % group->capacity;
+    int8_t* record = group->records + slot * state->dataSize;
+    group->positions[slot] = position;
+    memcpy(record, data, state->dataSize);
+    group->size++;
+
+    for (uint16_t m = 0; m < group->numMembers; m++) {
+        struct ruleAggregate* member = &group->members[m];
+        void* value = record + member->dataOffset;
+        if (member->rule->type == GET_AVG) {
+            member->sum += ruleValueAsDouble(member->rule->schema->columnTypes[member->rule->colNum], value);
+            continue;
+        }
+
+        /* Drop candidates that can never be the result again */
+        uint8_t operation = member->rule->type == GET_MAX ? SELECT_LTE : SELECT_GTE;
+        while (member->dequeSize > 0) {
+            uint32_t last = member->deque[(member->dequeHead + member->dequeSize - 1) % group->capacity];
+            if (!compare(group->records + last * state->dataSize + member->dataOffset, operation, value, member->isSigned, member->valueSize))
+                break;
+            member->dequeSize--;
+        }
+        member->deque[(member->dequeHead + member->dequeSize) % group->capacity] = slot;
+        member->dequeSize++;
+    }
+    return 0;
+}
+
+/* Removes the records that are numLast or more records older than the record at position */
+static void evictRuleGroupWindow(embedDBState* state, struct ruleWindowGroup* group, uint64_t position) {
+    while (group->size > 0 && position - group->positions[group->head] >= group->numLast) {
+        int8_t* record = group->records + group->head * state->dataSize;
+        for (uint16_t m = 0; m < group->numMembers; m++) {
+            struct ruleAggregate* member = &group->members[m];
+            if (member->rule->type == GET_AVG) {
+                member->sum -= ruleValueAsDouble(member->rule->schema->columnTypes[member->rule->colNum], record + member->dataOffset);
+            } else if (member->dequeSize > 0 && member->deque[member->dequeHead] == group->head) {
+                member->dequeHead = (member->dequeHead + 1) % group->capacity;
+                member->dequeSize--;
+            }
+        }
+        group->head = (group->head + 1) % group->capacity;
+        group->size--;
+
+        /* Recompute the sums once per pass over the ring so floating point error does not build up */
+        if (group->head == 0) {
+            for (uint16_t m = 0; m < group->numMembers; m++) {
+                struct ruleAggregate* member = &group->members[m];
+                if (member->rule->type != GET_AVG)
+                    continue;
+                member->sum = 0;
+                for (uint32_t i = 0; i < group->size; i++)
+                    member->sum += ruleValueAsDouble(member->rule->schema->columnTypes[member->rule->colNum], group->records + i * state->dataSize + member->dataOffset);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Reads the last numLast records up to key from storage in one pass, updating the aggregates of all rules in the group.
+ * If the window is in memory the records are added to it, otherwise the scan results are kept in each rule's aggregate.
+ */
+static int8_t scanRuleGroup(embedDBState* state, struct ruleWindowGroup* group, void* key) {
+    void* data = malloc(state->dataSize + 3 * state->keySize);
+    if (data == NULL)
+        return -1;
+    void* recordKey = (int8_t*)data + state->dataSize;
+
+    for (uint16_t m = 0; m < group->numMembers; m++) {
+        group->members[m].sum = 0;
+        group->members[m].count = 0;
+    }
+
+    /* A window in memory counts the records outside the where range too, so they are not filtered by the iterator */
+    embedDBIterator it;
+    it.minData = group->positions != NULL ? NULL : group->minData;
+    it.maxData = group->positions != NULL ? NULL : group->maxData;
+    initRuleWindowIterator(state, &it, group->numLast, key, (int8_t*)recordKey + state->keySize);
+
+    int8_t result = 0;
+    group->numRecords = 0;
+    while (embedDBNext(state, &it, recordKey, data)) {
+        if (group->positions != NULL) {
+            uint64_t position = group->numRecords++;
+            if (ruleWhereMatches(state, group, data) && pushRuleGroupWindow(state, group, position, data) != 0) {
+                result = -1;
+                break;
+            }
+            continue;
+        }
+        for (uint16_t m = 0; m < group->numMembers; m++) {
+            struct ruleAggregate* member = &group->members[m];
+            void* value = (int8_t*)data + member->dataOffset;
+            member->count++;
+            if (member->rule->type == GET_AVG) {
+                member->sum += ruleValueAsDouble(member->rule->schema->columnTypes[member->rule->colNum], value);
+            } else if (member->count == 1 || compare(value, member->rule->type == GET_MAX ? SELECT_GT : SELECT_LT, member->scanResult, member->isSigned, member->valueSize)) {
+                memcpy(member->scanResult, value, member->valueSize);
+            }
+        }
+    }
+    embedDBCloseIterator(&it);
+    free(data);
+    return result;
+}
+
+/* Allocates the ring of a group and fills it from storage. Leaves the group to be scanned on each insert if it does not fit. */
+static void seedRuleGroupWindow(embedDBState* state, struct ruleWindowGroup* group, void* key) {
+    group->capacity = group->numLast < RULE_WINDOW_INITIAL_CAPACITY ? (uint32_t)group->numLast : RULE_WINDOW_INITIAL_CAPACITY;
+    group->positions = (uint64_t*)malloc((size_t)group->capacity * sizeof(uint64_t));
+    group->records = (int8_t*)malloc((size_t)group->capacity * state->dataSize);
+    int8_t ok = group->positions != NULL && group->records != NULL;
+    for (uint16_t m = 0; ok && m < group->numMembers; m++) {
+        if (group->members[m].rule->type == GET_AVG)
+            continue;
+        group->members[m].deque = (uint32_t*)malloc((size_t)group->capacity * sizeof(uint32_t));
+        ok = group->members[m].deque != NULL;
+    }
+
+    if (!ok || scanRuleGroup(state, group, key) != 0)
+        freeRuleGroupWindow(group);
+}
+
+static uint64_t ruleSnapshotNumLast(embedDBState* state, activeRule* rule) {
+    if (rule->type == GET_CUSTOM || rule->numLastEntries == NULL)
+        return 0;
+    return ruleNumLast(state, rule);
+}
+
+static int8_t ruleEngineChanged(embedDBState* state, struct ruleEngine* engine) {
+    if (engine->numRules != state->numRules)
+        return 1;
+    for (uint32_t i = 0; i < state->numRules; i++) {
+        struct ruleSnapshot* snapshot = &engine->rules[i];
+        activeRule* rule = state->rules[i];
+        if (snapshot->rule != rule || snapshot->type != rule->type || snapshot->colNum != rule->colNum || snapshot->enabled != rule->enabled ||
+            snapshot->minData != rule->minData || snapshot->maxData != rule->maxData || snapshot->window != rule->window ||
+            snapshot->numLast != ruleSnapshotNumLast(state, rule))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Groups the rules by window length and where range and builds each group's window from storage,
+ * including the record that was just inserted.
+ */
+static int8_t buildRuleEngine(embedDBState* state, struct ruleEngine* engine, void* key) {
+    freeRuleGroups(engine);
+    free(engine->rules);
+    engine->numRules = 0;
+    engine->rules = (struct ruleSnapshot*)malloc(state->numRules * sizeof(struct ruleSnapshot));
+    engine->groups = (struct ruleWindowGroup*)calloc(state->numRules, sizeof(struct ruleWindowGroup));
+    if (engine->rules == NULL || engine->groups == NULL) {
+        free(engine->rules);
+        free(engine->groups);
+        engine->rules = NULL;
+        engine->groups = NULL;
+        return -1;
+    }
+
+    /* Assign rules to groups, using the snapshot window as the group index until members are allocated */
+    for (uint32_t i = 0; i < state->numRules; i++) {
+        activeRule* rule = state->rules[i];
+        struct ruleSnapshot* snapshot = &engine->rules[i];
+        snapshot->rule = rule;
+        snapshot->type = rule->type;
+        snapshot->colNum = rule->colNum;
+        snapshot->enabled = rule->enabled;
+        snapshot->minData = rule->minData;
+        snapshot->maxData = rule->maxData;
+        snapshot->numLast = ruleSnapshotNumLast(state, rule);
+        snapshot->window = NULL;
+        rule->window = NULL;
+        if (!ruleUsesWindow(state, rule))
+            continue;
+
+        uint32_t g = 0;
+        while (g < engine->numGroups && !(engine->groups[g].numLast == snapshot->numLast &&
+                                          sameWhereValue(state, engine->groups[g].minData, rule->minData) &&
+                                          sameWhereValue(state, engine->groups[g].maxData, rule->maxData)))
+            g++;
+        if (g == engine->numGroups) {
+            engine->groups[g].numLast = snapshot->numLast;
+            engine->groups[g].minData = rule->minData;
+            engine->groups[g].maxData = rule->maxData;
+            engine->numGroups++;
+        }
+        engine->groups[g].numMembers++;
+        snapshot->window = (void*)(uintptr_t)(g + 1);
+    }
+    engine->numRules = state->numRules;
+
+    for (uint32_t g = 0; g < engine->numGroups; g++) {
+        struct ruleWindowGroup* group = &engine->groups[g];
+        group->members = (struct ruleAggregate*)calloc(group->numMembers, sizeof(struct ruleAggregate));
+        if (group->members == NULL) {
+            engine->numGroups = g;
+            freeRuleGroups(engine);
+            engine->numRules = 0;
+            return -1;
+        }
+        group->numMembers = 0;
+    }
+
+    for (uint32_t i = 0; i < state->numRules; i++) {
+        struct ruleSnapshot* snapshot = &engine->rules[i];
+        if (snapshot->window == NULL)
+            continue;
+        struct ruleWindowGroup* group = &engine->groups[(uintptr_t)snapshot->window - 1];
+        struct ruleAggregate* member = &group->members[group->numMembers++];
+        activeRule* rule = state->rules[i];
+        int8_t colSize = rule->schema->columnSizes[rule->colNum];
+        member->rule = rule;
+        member->group = group;
+        member->valueSize = abs(colSize);
+        member->isSigned = embedDB_IS_COL_SIGNED(colSize);
+        member->dataOffset = getColOffsetFromSchema(rule->schema, rule->colNum) - state->keySize;
+        snapshot->window = member;
+        rule->window = member;
+    }
+
+    for (uint32_t g = 0; g < engine->numGroups; g++)
+        seedRuleGroupWindow(state, &engine->groups[g], key);
+    return 0;
+}
 
 void executeRules(embedDBState* state, void *key, void *data) {
+    struct ruleEngine* engine = getRuleEngine(state);
+    if (engine == NULL) {
+        /* Every rule scans storage on its own */
+        for (uint32_t i = 0; i < state->numRules; i++)
+            state->rules[i]->window = NULL;
+    }
+
+    /* Slide each distinct window once, no matter how many rules use it */
+    int8_t locked;
+    if (engine != NULL) {
+        LOCK_RULE_STORAGE(state, locked);
+        if (engine->rebuild || ruleEngineChanged(state, engine)) {
+            engine->rebuild = 0;
+            buildRuleEngine(state, engine, key);
+        } else {
+            for (uint32_t g = 0; g < engine->numGroups; g++) {
+                struct ruleWindowGroup* group = &engine->groups[g];
+                if (group->positions == NULL)
+                    continue;
+                uint64_t position = group->numRecords++;
+                evictRuleGroupWindow(state, group, position);
+                if (ruleWhereMatches(state, group, data) && pushRuleGroupWindow(state, group, position, data) != 0)
+                    freeRuleGroupWindow(group);
+            }
+        }
+        for (uint32_t g = 0; g < engine->numGroups; g++) {
+            struct ruleWindowGroup* group = &engine->groups[g];
+            if (group->positions == NULL)
+                scanRuleGroup(state, group, key);
+        }
+        UNLOCK_RULE_STORAGE(state, locked);
+    }
+
     for (int i = 0; i < state->numRules; i++) {
         if(state->rules[i]->enabled == false) {
             continue; // Skip disabled rules
         }
+        /* Custom rules and rules without a window read storage */
+        int8_t readsStorage = state->rules[i]->window == NULL;
+        if (readsStorage) {
+            LOCK_RULE_STORAGE(state, locked);
+        }
         switch (state->rules[i]->type) {
             case GET_AVG:
                 handleGetAvg(state, state->rules[i], key, data);
@@ -76,12 +695,159 @@ void executeRules(embedDBState* state, void *key, void *data) {
             default:
                 printf("ERROR: Unsupported rule type\n");
         }
-    
+        if (readsStorage) {
+            UNLOCK_RULE_STORAGE(state, locked);
+        }
+    }
+}
+
+static int8_t allocateRuleQueue(embedDBState* state, struct ruleQueue* queue) {
+    if (queue->entries != NULL)
+        return 0;
+    queue->capacity = state->ruleQueueLength > 0 ? state->ruleQueueLength : RULE_QUEUE_DEFAULT_LENGTH;
+    queue->entrySize = 1 + state->keySize + state->dataSize;
+    queue->entries = (int8_t*)malloc((size_t)queue->capacity * queue->entrySize);
+    if (queue->entries == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to allocate the active rule queue\n");
+#endif
+        return -1;
+    }
+    return 0;
+}
+
+int8_t enqueueRuleRecord(embedDBState* state, void* key, void* data) {
+    struct ruleEngine* engine = getRuleEngine(state);
+    if (engine == NULL || allocateRuleQueue(state, &engine->queue) != 0)
+        return -1;
+
+    struct ruleQueue* queue = &engine->queue;
+
+    uint32_t tail = queue->tail;
+    uint32_t depth = tail - RULE_LOAD_ACQUIRE(queue->head);
+    if (depth >= queue->capacity) {
+        /* The record is stored, only its rule evaluation is skipped. The windows no longer match storage. */
+        queue->dropped++;
+        queue->resyncNext = 1;
+        return 1;
+    }
+
+    int8_t* entry = queue->entries + (tail % queue->capacity) * queue->entrySize;
+    entry[0] = queue->resyncNext ? RULE_QUEUE_RESYNC : 0;
+    memcpy(entry + 1, key, state->keySize);
+    memcpy(entry + 1 + state->keySize, data, state->dataSize);
+    queue->resyncNext = 0;
+    RULE_STORE_RELEASE(queue->tail, tail + 1);
+
+    if (depth + 1 > queue->highWaterMark)
+        queue->highWaterMark = depth + 1;
+    return 0;
+}
+
+uint32_t embedDBProcessRules(embedDBState* state, uint32_t budget) {
+    struct ruleEngine* engine = (struct ruleEngine*)state->ruleEngine;
+    if (engine == NULL || engine->queue.entries == NULL)
+        return 0;
+
+    /* A budget of 0 evaluates everything that is queued */
+    if (budget == 0)
+        budget = UINT32_MAX;
+
+    struct ruleQueue* queue = &engine->queue;
+    uint32_t processed = 0;
+    while (processed < budget) {
+        uint32_t head = queue->head;
+        if (head == RULE_LOAD_ACQUIRE(queue->tail))
+            break;
+
+        int8_t* entry = queue->entries + (head % queue->capacity) * queue->entrySize;
+        if (entry[0] & RULE_QUEUE_RESYNC)
+            engine->rebuild = 1;
+        if (state->rules != NULL && state->numRules > 0)
+            executeRules(state, entry + 1, entry + 1 + state->keySize);
+
+        RULE_STORE_RELEASE(queue->head, head + 1);
+        processed++;
+    }
+    return processed;
+}
+
+void embedDBGetRuleQueueStats(embedDBState* state, embedDBRuleQueueStats* stats) {
+    struct ruleEngine* engine = (struct ruleEngine*)state->ruleEngine;
+    if (engine == NULL) {
+        stats->depth = 0;
+        stats->highWaterMark = 0;
+        stats->dropped = 0;
+        return;
+    }
+    stats->depth = RULE_LOAD_ACQUIRE(engine->queue.tail) - RULE_LOAD_ACQUIRE(engine->queue.head);
+    stats->highWaterMark = engine->queue.highWaterMark;
+    stats->dropped = engine->queue.dropped;
+}
+
+#ifdef EMBEDDB_RULE_THREAD
+static void* ruleWorker(void* arg) {
+    embedDBState* state = (embedDBState*)arg;
+    struct ruleEngine* engine = (struct ruleEngine*)state->ruleEngine;
+    while (RULE_LOAD_ACQUIRE(engine->workerRunning)) {
+        if (embedDBProcessRules(state, RULE_WORKER_BATCH) == 0) {
+            struct timespec pause = {0, 100000};
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+int8_t embedDBStartRuleWorker(embedDBState* state) {
+    if (!EMBEDDB_USING_ASYNC_RULES(state->parameters)) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: The active rule worker requires EMBEDDB_ASYNC_RULES\n");
+#endif
+        return -1;
+    }
+    /* The queue is allocated before the worker starts reading it */
+    struct ruleEngine* engine = getRuleEngine(state);
+    if (engine == NULL || RULE_LOAD_ACQUIRE(engine->workerRunning) || allocateRuleQueue(state, &engine->queue) != 0)
+        return -1;
+
+    RULE_STORE_RELEASE(engine->workerRunning, 1);
+    if (pthread_create(&engine->worker, NULL, ruleWorker, state) != 0) {
+        RULE_STORE_RELEASE(engine->workerRunning, 0);
+        return -1;
     }
+    return 0;
+}
+
+void embedDBStopRuleWorker(embedDBState* state) {
+    struct ruleEngine* engine = (struct ruleEngine*)state->ruleEngine;
+    if (engine == NULL || !RULE_LOAD_ACQUIRE(engine->workerRunning))
+        return;
+    RULE_STORE_RELEASE(engine->workerRunning, 0);
+    pthread_join(engine->worker, NULL);
+
+    /* Evaluate what is left on this thread */
+    while (embedDBProcessRules(state, UINT32_MAX) > 0) {
+    }
+}
+#endif
+
+/* Makes the operators of a rule query allocate from the arena of the rule engine */
+static embedDBArena* beginRuleQuery(embedDBState* state) {
+    struct ruleEngine* engine = (struct ruleEngine*)state->ruleEngine;
+    return embedDBUseArena(engine != NULL ? &engine->arena : NULL);
+}
+
+/* Releases the operators of a rule query at once and restores the arena that was in use */
+static void endRuleQuery(embedDBState* state, embedDBArena* previous) {
+    struct ruleEngine* engine = (struct ruleEngine*)state->ruleEngine;
+    embedDBUseArena(previous);
+    if (engine != NULL)
+        embedDBArenaRelease(&engine->arena);
 }
 
 float GetAvg(embedDBState *state, activeRule *rule, void *key) {
     void** allocatedValues;
+    embedDBArena* previous = beginRuleQuery(state);
     embedDBOperator* op = createOperator(state, rule, &allocatedValues, key);
 
     void* recordBuffer = op->recordBuffer;
@@ -93,14 +859,16 @@ float GetAvg(embedDBState *state, activeRule *rule, void *key) {
     embedDBFreeOperatorRecursive(&op);
     recordBuffer = NULL;
     for (int i = 0; i < 2; i++) {
-        free(allocatedValues[i]);
+        embedDBFree(allocatedValues[i]);
     }
-    free(allocatedValues);
+    embedDBFree(allocatedValues);
+    endRuleQuery(state, previous);
     return avg;
 }
 
 int32_t GetMinMax32(embedDBState *state, activeRule *rule, void *key) {
     void** allocatedValues;
+    embedDBArena* previous = beginRuleQuery(state);
     embedDBOperator* op = createOperator(state, rule, &allocatedValues, key);
 
     void* recordBuffer = op->recordBuffer;
@@ -112,14 +880,16 @@ int32_t GetMinMax32(embedDBState *state, activeRule *rule, void *key) {
     embedDBFreeOperatorRecursive(&op);
     recordBuffer = NULL;
     for (int i = 0; i < 2; i++) {
-        free(allocatedValues[i]);
+        embedDBFree(allocatedValues[i]);
     }
-    free(allocatedValues);
+    embedDBFree(allocatedValues);
+    endRuleQuery(state, previous);
     return minmax;
 }
 
 int64_t GetMinMax64(embedDBState *state, activeRule *rule, void *key) {
     void** allocatedValues;
+    embedDBArena* previous = beginRuleQuery(state);
     embedDBOperator* op = createOperator(state, rule, &allocatedValues, key);
 
     void* recordBuffer = op->recordBuffer;
@@ -131,37 +901,24 @@ int64_t GetMinMax64(embedDBState *state, activeRule *rule, void *key) {
     embedDBFreeOperatorRecursive(&op);
     recordBuffer = NULL;
     for (int i = 0; i < 2; i++) {
-        free(allocatedValues[i]);
+        embedDBFree(allocatedValues[i]);
     }
-    free(allocatedValues);
+    embedDBFree(allocatedValues);
+    endRuleQuery(state, previous);
     return minmax;
 }
 
 embedDBOperator* createOperator(embedDBState *state, activeRule * rule, void*** allocatedValues, void *key) {
-    embedDBIterator* it = (embedDBIterator*)malloc(sizeof(embedDBIterator));
-    if(state->keySize == 4){
-        uint32_t minKeyVal = *(uint32_t*)key - (*(uint32_t*)rule->numLastEntries - 1);
-        uint32_t *minKeyPtr = (uint32_t *)malloc(sizeof(uint32_t));
-        if (minKeyPtr != NULL) {
-            *minKeyPtr = minKeyVal;
-            it->minKey = minKeyPtr;
-        }
-    }else if(state->keySize == 8){
-        uint64_t minKeyVal = *(uint64_t*)key - (*(uint64_t*)rule->numLastEntries - 1);
-        uint64_t *minKeyPtr = (uint64_t *)malloc(sizeof(uint64_t));
-        if (minKeyPtr != NULL) {
-            *minKeyPtr = minKeyVal;
-            it->minKey = minKeyPtr;
-        }
-    }else{
+    if (state->keySize != 4 && state->keySize != 8) {
         printf("ERROR: Unsupported key size\n");
         return NULL;
     }
-    
-    it->maxKey = NULL;
+
+    /* The bounds of the window are kept after the iterator, so they are freed with it */
+    embedDBIterator* it = (embedDBIterator*)embedDBMalloc(sizeof(embedDBIterator) + 2 * state->keySize);
     it->minData = rule->minData;
     it->maxData = rule->maxData;
-    embedDBInitIterator(state, it);
+    initRuleWindowIterator(state, it, ruleNumLast(state, rule), key, it + 1);
 
     embedDBOperator* scanOp = createTableScanOperator(state, it, rule->schema);
 
@@ -181,14 +938,14 @@ embedDBOperator* createOperator(embedDBState *state, activeRule * rule, void***
             printf("ERROR: Unsupported rule type\n");
     }
 
-    embedDBAggregateFunc* aggFuncs = (embedDBAggregateFunc*)malloc(1*sizeof(embedDBAggregateFunc));
+    embedDBAggregateFunc* aggFuncs = (embedDBAggregateFunc*)embedDBMalloc(1*sizeof(embedDBAggregateFunc));
     aggFuncs[0] = *aggFunc;
     embedDBOperator* aggOp = createAggregateOperator(scanOp, groupFunction, aggFuncs, 1);
     aggOp->init(aggOp);
 
-    free(aggFunc);
+    embedDBFree(aggFunc);
 
-    *allocatedValues = (void**)malloc(2 * sizeof(void*));
+    *allocatedValues = (void**)embedDBMalloc(2 * sizeof(void*));
     ((void**)*allocatedValues)[0] = it;
     ((void**)*allocatedValues)[1] = aggFuncs;
 
@@ -228,23 +985,54 @@ void executeComparison(activeRule* rule, void *aggregateValue, Comparator compar
 }
 
 void handleGetAvg(embedDBState *state, activeRule *rule, void* key, void *data) {
-    float avg = GetAvg(state, rule, key);
+    struct ruleAggregate* member = (struct ruleAggregate*)rule->window;
+    if (member == NULL) {
+        float avg = GetAvg(state, rule, key);
+        executeComparison(rule, &avg, floatComparator, data);
+        return;
+    }
+    uint32_t count = member->group->positions != NULL ? member->group->size : member->count;
+    if (count == 0) {
+        return; // No records in the window
+    }
+    float avg = (float)(member->sum / count);
     executeComparison(rule, &avg, floatComparator, data);
 }
 
 void handleGetMinMax(embedDBState *state, activeRule *rule, void* key, void *data) {
     int columnSize = abs(rule->schema->columnSizes[rule->colNum]);
+    if (columnSize != 4 && columnSize != 8) {
+        printf("ERROR: Unsupported column size\n");
+        return;
+    }
+
+    struct ruleAggregate* member = (struct ruleAggregate*)rule->window;
+    void* value = NULL;
+    if (member != NULL) {
+        struct ruleWindowGroup* group = member->group;
+        if (group->positions != NULL && member->dequeSize > 0)
+            value = group->records + member->deque[member->dequeHead] * state->dataSize + member->dataOffset;
+        else if (group->positions == NULL && member->count > 0)
+            value = member->scanResult;
+        else
+            return; // No records in the window
+    }
 
     if (columnSize == 4) { // 32-bit integer
-        int32_t minmax = GetMinMax32(state, rule, key);
+        int32_t minmax;
+        if (value != NULL)
+            memcpy(&minmax, value, sizeof(int32_t));
+        else
+            minmax = GetMinMax32(state, rule, key);
         executeComparison(rule, &minmax, int32Comparator, data);
     } 
-    else if (columnSize == 8) { // 64-bit integer
-        int64_t minmax = GetMinMax64(state, rule, key);
+    else { // 64-bit integer
+        int64_t minmax;
+        if (value != NULL)
+            memcpy(&minmax, value, sizeof(int64_t));
+        else
+            minmax = GetMinMax64(state, rule, key);
         executeComparison(rule, &minmax, int64Comparator, data);
-    } 
-    else {
-        printf("ERROR: Unsupported column size\n");
     }
 }
 
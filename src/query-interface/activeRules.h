@@ -61,6 +61,7 @@ typedef struct activeRule {
     void* maxData;              /**< Maximum data value */
 
     bool enabled;           /**< Flag to indicate if the rule is enabled */
+    void* window;           /**< Window state of the rule, managed by executeRules */
 
     struct activeRule* (*IF)(struct activeRule *rule, uint8_t colNum, ActiveQueryType type);
     struct activeRule* (*IFCustom)(struct activeRule *rule, uint8_t colNum, void* (*executeCustom)(struct activeRule *rule, void *key), CustomReturnType returnType);
@@ -138,9 +139,94 @@ activeRule* then(activeRule *rule, void (*callback)(void* aggregateValue, void*
  */
 activeRule* createActiveRule(embedDBSchema *schema, void* context);
 
+/**
+ * @brief Frees an activeRule created by createActiveRule and its window state.
+ * @param rule Pointer to the activeRule pointer. Is set to NULL.
+ */
+void freeActiveRule(activeRule** rule);
+
+/**
+ * @brief Discards the window state of a rule. The windows are rebuilt from storage the next time rules are executed.
+ * Changes to the rules array or to a rule's settings are detected automatically. Call this after changing the values
+ * that a rule's minData or maxData point to.
+ * @param rule Pointer to the activeRule.
+ */
+void resetActiveRuleWindow(activeRule* rule);
+
+/**
+ * @brief Counters of the queue used with EMBEDDB_ASYNC_RULES.
+ */
+typedef struct {
+    uint32_t depth;          /**< Records waiting for rule evaluation */
+    uint32_t highWaterMark;  /**< Largest depth seen */
+    uint32_t dropped;        /**< Records not evaluated because the queue was full */
+} embedDBRuleQueueStats;
+
+/**
+ * @brief Queues an inserted record for rule evaluation. Called by embedDBPut when using EMBEDDB_ASYNC_RULES.
+ * Must only be called from the inserting thread. If the queue is full the record is not evaluated and the
+ * windows are rebuilt from storage at the next queued record.
+ * @param state Pointer to the embedDBState.
+ * @param key Pointer to the key.
+ * @param data Pointer to the data.
+ * @return 0 if queued, 1 if the queue was full, -1 on allocation failure.
+ */
+int8_t enqueueRuleRecord(embedDBState *state, void *key, void *data);
+
+/**
+ * @brief Evaluates the rules for up to budget queued records, oldest first. Used as a periodic tick when
+ * using EMBEDDB_ASYNC_RULES without the worker thread.
+ * @param state Pointer to the embedDBState.
+ * @param budget Maximum number of records to evaluate, 0 for every queued record.
+ * @return Number of records evaluated.
+ */
+uint32_t embedDBProcessRules(embedDBState *state, uint32_t budget);
+
+/**
+ * @brief Returns the depth, high-water mark and dropped count of the rule queue.
+ * @param state Pointer to the embedDBState.
+ * @param stats Return variable for the counters.
+ */
+void embedDBGetRuleQueueStats(embedDBState *state, embedDBRuleQueueStats *stats);
+
+#ifdef EMBEDDB_RULE_THREAD
+/**
+ * @brief Starts a thread that evaluates queued records. Requires EMBEDDB_ASYNC_RULES. While it runs, other calls
+ * that read the state from the application, other than embedDBPut, must be made between lockActiveRules and unlockActiveRules.
+ * @param state Pointer to the embedDBState.
+ * @return 0 if the thread was started, -1 otherwise.
+ */
+int8_t embedDBStartRuleWorker(embedDBState *state);
+
+/**
+ * @brief Stops the rule worker thread and evaluates the records still queued on the calling thread.
+ * @param state Pointer to the embedDBState.
+ */
+void embedDBStopRuleWorker(embedDBState *state);
+
+/**
+ * @brief Locks the state against the rule worker while it is running.
+ * @return 1 if the lock was taken and must be passed to unlockActiveRules.
+ */
+int8_t lockActiveRules(embedDBState *state);
+
+/**
+ * @brief Releases the lock taken by lockActiveRules.
+ */
+void unlockActiveRules(embedDBState *state, int8_t locked);
+#endif
+
+/**
+ * @brief Frees the window state that executeRules keeps for the rules of a state. Called by embedDBClose.
+ * @param state Pointer to the embedDBState.
+ */
+void freeActiveRuleEngine(embedDBState *state);
+
 /**
  * @brief Inserts a record, performs a rule on that record and the last n specified records (numLastEntries), 
  * compares rule result with threshold, and calls callback function if comparison returns true.
+ * Rules with the same window length and where range share one window, so storage is only read and each
+ * record is only added once per distinct window, not once per rule.
  * @param rule Pointer to the activeRule.
  * @param key Pointer to the key.
  * @param data Pointer to the data.
@@ -228,8 +314,9 @@ void executeComparison(activeRule* rule, void *value, Comparator comparator, voi
 /**
  * @brief Handles the average value retrieval and comparison for a active rule.
  *
- * This function retrieves the average value for the last n specified records (numLastEntries) including current value and
- * performs a comparison using the executeComparison function.
+ * This function slides the rule's window to the current record, keeping a running sum and count so each call is O(1) amortized,
+ * and performs a comparison using the executeComparison function. The window is built from storage the first time the rule runs.
+ * If the window cannot be allocated, the average is computed by scanning the last n records (numLastEntries) with GetAvg.
  *
  * @param rule Pointer to the activeRule structure.
  * @param key Pointer to the key for the current record.
@@ -239,8 +326,9 @@ void handleGetAvg(embedDBState *state, activeRule* rule, void* key, void *data);
 /**
  * @brief Handles the minimum or maximum value retrieval and comparison for a active rule.
  *
- * This function retrieves the minimum or maximum value of the last n specified records (numLastEntries) including current value 
- * performs a comparison using the executeComparison function.
+ * This function slides the rule's window to the current record, keeping a monotonic deque of candidate values so each call is O(1) amortized,
+ * and performs a comparison using the executeComparison function. If the window cannot be allocated, the value is computed by
+ * scanning the last n records (numLastEntries) with GetMinMax32 or GetMinMax64.
  *
  * @param rule Pointer to the activeRule structure.
  * @param key Pointer to the key for the current record.
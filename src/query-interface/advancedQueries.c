@@ -35,6 +35,7 @@
 
 #include "advancedQueries.h"
 
+#include <embedDBUtility.h>
 #include <string.h>
 
 #if defined(ARDUINO)
@@ -122,6 +123,12 @@ int8_t exec(embedDBOperator* op) {
     return op->next(op);
 }
 
+int8_t nextSelection(embedDBOperator* op);
+uint16_t nextBatch(embedDBOperator* op, embedDBBatch* batch);
+void addBatchToAggregate(embedDBAggregateFunc* func, embedDBSchema* inputSchema, embedDBBatch* batch, uint16_t start, uint16_t end);
+uint16_t getAggregateStateBytes(embedDBAggregateFunc* func, void** bytes);
+void avgAdd(struct embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, const void* record);
+
 void initTableScan(embedDBOperator* op) {
     if (op->input != NULL) {
 #ifdef PRINT_ERRORS
@@ -156,17 +163,6 @@ void initTableScan(embedDBOperator* op) {
 #endif
         return;
     }
-
-    // Init buffer
-    if (op->recordBuffer == NULL) {
-        op->recordBuffer = createBufferFromSchema(op->schema);
-        if (op->recordBuffer == NULL) {
-#ifdef PRINT_ERRORS
-            printf("ERROR: Failed to allocate buffer for TableScan operator\n");
-#endif
-            return;
-        }
-    }
 }
 
 int8_t nextTableScan(embedDBOperator* op) {
@@ -178,24 +174,101 @@ int8_t nextTableScan(embedDBOperator* op) {
         return 0;
     }
 
-    // Get next record
+    // Get next record. The key is followed by the data in the page as in the schema, so the record is returned in place
     embedDBState* state = (embedDBState*)(((void**)op->state)[0]);
     embedDBIterator* it = (embedDBIterator*)(((void**)op->state)[1]);
-    if (!embedDBNext(state, it, op->recordBuffer, (int8_t*)op->recordBuffer + state->keySize)) {
+    const void *key, *data;
+    int8_t hasRecord = it->isReverse ? embedDBPrevRef(state, it, &key, &data) : embedDBNextRef(state, it, &key, &data);
+    if (!hasRecord) {
         return 0;
     }
 
+    void* copy = ((void**)op->state)[2];
+    if (copy != NULL) {
+        memcpy(copy, key, state->recordSize);
+        op->recordBuffer = copy;
+    } else {
+        op->recordBuffer = (void*)key;
+    }
     return 1;
 }
 
+uint16_t nextBatchTableScan(embedDBOperator* op, embedDBBatch* batch) {
+    embedDBState* state = (embedDBState*)(((void**)op->state)[0]);
+    embedDBIterator* it = (embedDBIterator*)(((void**)op->state)[1]);
+
+    // Copy records straight from the page into the batch, the key is followed by the data as in the schema.
+    // Only the schema's columns are copied, so the variable data pointer after the data of a record is left out.
+    int8_t* record = batch->records;
+    const void *key, *data;
+    batch->count = 0;
+    while (batch->count < batch->capacity && (it->isReverse ? embedDBPrevRef(state, it, &key, &data) : embedDBNextRef(state, it, &key, &data))) {
+        memcpy(record, key, batch->recordSize);
+        batch->selection[batch->count] = batch->count;
+        batch->count++;
+        record += batch->recordSize;
+    }
+    batch->numSelected = batch->count;
+    return batch->numSelected;
+}
+
+/**
+ * @brief	Gives a table scan's iterator back the bounds and Bloom filter probe it had when the scan was created. Selections
+ * 			push pointers to their own values into the iterator, which are freed with the selections.
+ */
+void restoreScanIterator(void** scanState) {
+    embedDBState* state = (embedDBState*)scanState[0];
+    embedDBIterator* it = (embedDBIterator*)scanState[1];
+    it->minKey = scanState[3];
+    it->maxKey = scanState[4];
+    it->minData = scanState[5];
+    it->maxData = scanState[6];
+    if (scanState[7] == NULL && it->bloomValue != NULL) {
+        free(it->queryBloomFilter);
+        it->queryBloomFilter = NULL;
+        it->bloomValue = NULL;
+    }
+    embedDBIteratorUpdateBounds(state, it);
+}
+
 void closeTableScan(embedDBOperator* op) {
+    restoreScanIterator(op->state);
     embedDBFreeSchema(&op->schema);
-    free(op->recordBuffer);
+    // The record buffer points into the page buffer of the table unless records are copied
+    embedDBFree(((void**)op->state)[2]);
     op->recordBuffer = NULL;
-    free(op->state);
+    embedDBFree(op->state);
     op->state = NULL;
 }
 
+/**
+ * @brief	Finds the table read by the table scan at the bottom of an operator's input chain
+ * @return	The state of the table, or NULL if there is no table scan
+ */
+embedDBState* getScanTable(embedDBOperator* op) {
+    while (op != NULL && op->next != nextTableScan) {
+        op = op->input;
+    }
+    return op == NULL ? NULL : (embedDBState*)(((void**)op->state)[0]);
+}
+
+/**
+ * @brief	Table scans return records in place in the page buffer of their table. When both inputs of a join read the same
+ * 			table, reading one input replaces the page the other input's record is in, so a scan input copies its records instead
+ */
+void copySharedScanRecords(embedDBOperator* input1, embedDBOperator* input2) {
+    embedDBOperator* inputs[2] = {input1, input2};
+    for (int8_t i = 0; i < 2; i++) {
+        embedDBOperator* scan = inputs[i];
+        if (scan->next != nextTableScan || ((void**)scan->state)[2] != NULL)
+            continue;
+        embedDBState* table = (embedDBState*)(((void**)scan->state)[0]);
+        if (getScanTable(inputs[1 - i]) == table) {
+            ((void**)scan->state)[2] = embedDBMalloc(table->recordSize);
+        }
+    }
+}
+
 /**
  * @brief	Used as the bottom operator that will read records from the database
  * @param	state		The state associated with the database to read from
@@ -211,7 +284,7 @@ embedDBOperator* createTableScanOperator(embedDBState* state, embedDBIterator* i
         return NULL;
     }
 
-    embedDBOperator* op = malloc(sizeof(embedDBOperator));
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
     if (op == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: malloc failed while creating TableScan operator\n");
@@ -219,15 +292,23 @@ embedDBOperator* createTableScanOperator(embedDBState* state, embedDBIterator* i
         return NULL;
     }
 
-    op->state = malloc(2 * sizeof(void*));
+    // The state, the iterator, a copy of the record if the page buffer is shared, and the iterator's own minKey, maxKey,
+    // minData, maxData and Bloom filter probe. Selections push tighter bounds into the iterator, which are put back from these
+    op->state = embedDBCalloc(8, sizeof(void*));
     if (op->state == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: malloc failed while creating TableScan operator\n");
 #endif
         return NULL;
     }
-    memcpy(op->state, &state, sizeof(void*));
-    memcpy((int8_t*)op->state + sizeof(void*), &it, sizeof(void*));
+    void** scanState = op->state;
+    scanState[0] = state;
+    scanState[1] = it;
+    scanState[3] = it->minKey;
+    scanState[4] = it->maxKey;
+    scanState[5] = it->minData;
+    scanState[6] = it->maxData;
+    scanState[7] = it->bloomValue;
 
     op->schema = copySchema(baseSchema);
     op->input = NULL;
@@ -240,6 +321,90 @@ embedDBOperator* createTableScanOperator(embedDBState* state, embedDBIterator* i
     return op;
 }
 
+int8_t nextSecondaryIndexScan(embedDBOperator* op) {
+    // The secondary iterator copies the key and the data, which follow each other in the record as in the schema
+    embedDBState* state = (embedDBState*)(((void**)op->state)[0]);
+    embedDBSecondaryIterator* it = (embedDBSecondaryIterator*)(((void**)op->state)[1]);
+    return embedDBNextSecondary(state, it, op->recordBuffer, (int8_t*)op->recordBuffer + state->keySize);
+}
+
+void initSecondaryIndexScan(embedDBOperator* op) {
+    // The state starts with the table and the iterator like a table scan's, so the schema is checked the same way
+    initTableScan(op);
+
+    if (op->recordBuffer == NULL) {
+        op->recordBuffer = createBufferFromSchema(op->schema);
+        if (op->recordBuffer == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to allocate buffer for SecondaryIndexScan operator\n");
+#endif
+            return;
+        }
+    }
+}
+
+void closeSecondaryIndexScan(embedDBOperator* op) {
+    embedDBFreeSchema(&op->schema);
+    embedDBFree(op->recordBuffer);
+    op->recordBuffer = NULL;
+    embedDBFree(op->state);
+    op->state = NULL;
+}
+
+/**
+ * @brief	Used as the bottom operator to read the records whose secondary index column is in the range of a secondary iterator.
+ * 			Records are returned in key order.
+ * @param	state		The state associated with the database to read from, using EMBEDDB_USE_SECONDARY_INDEX
+ * @param	it			An initialized secondary iterator with the range of values to read
+ * @param	baseSchema	The schema of the database being read from
+ */
+embedDBOperator* createSecondaryIndexScanOperator(embedDBState* state, embedDBSecondaryIterator* it, embedDBSchema* baseSchema) {
+    if (state == NULL || it == NULL || baseSchema == NULL || !EMBEDDB_USING_SECONDARY_INDEX(state->parameters)) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: SecondaryIndexScan operator needs a state with a secondary index, an iterator and a schema\n");
+#endif
+        return NULL;
+    }
+
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
+    if (op == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: malloc failed while creating SecondaryIndexScan operator\n");
+#endif
+        return NULL;
+    }
+
+    op->state = embedDBCalloc(2, sizeof(void*));
+    if (op->state == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: malloc failed while creating SecondaryIndexScan operator\n");
+#endif
+        return NULL;
+    }
+    ((void**)op->state)[0] = state;
+    ((void**)op->state)[1] = it;
+
+    op->schema = copySchema(baseSchema);
+    op->input = NULL;
+    op->recordBuffer = NULL;
+
+    op->init = initSecondaryIndexScan;
+    op->next = nextSecondaryIndexScan;
+    op->close = closeSecondaryIndexScan;
+
+    return op;
+}
+
+/**
+ * @brief	A private struct to hold the state of the projection operator
+ */
+struct projectionInfo {
+    uint8_t numCols;          // Number of projected columns
+    uint8_t* cols;            // Indexes of the projected columns in the input
+    uint16_t* srcOffsets;     // Offset of each projected column in the input record
+    embedDBBatch* inputBatch; // Batch read from the input when producing batches
+};
+
 void initProjection(embedDBOperator* op) {
     if (op->input == NULL) {
 #ifdef PRINT_ERRORS
@@ -252,13 +417,18 @@ void initProjection(embedDBOperator* op) {
     op->input->init(op->input);
 
     // Get state
-    uint8_t numCols = *(uint8_t*)op->state;
-    uint8_t* cols = (uint8_t*)op->state + 1;
-    const embedDBSchema* inputSchema = op->input->schema;
+    struct projectionInfo* info = op->state;
+    uint8_t numCols = info->numCols;
+    uint8_t* cols = info->cols;
+    embedDBSchema* inputSchema = op->input->schema;
+
+    for (uint8_t i = 0; i < numCols; i++) {
+        info->srcOffsets[i] = getColOffsetFromSchema(inputSchema, cols[i]);
+    }
 
     // Init output schema
     if (op->schema == NULL) {
-        op->schema = malloc(sizeof(embedDBSchema));
+        op->schema = embedDBMalloc(sizeof(embedDBSchema));
         if (op->schema == NULL) {
 #ifdef PRINT_ERRORS
             printf("ERROR: Failed to allocate space for projection schema\n");
@@ -266,8 +436,8 @@ void initProjection(embedDBOperator* op) {
             return;
         }
         op->schema->numCols = numCols;
-        op->schema->columnSizes = malloc(numCols * sizeof(int8_t));
-        op->schema->columnTypes = malloc(numCols * sizeof(ColumnType));
+        op->schema->columnSizes = embedDBMalloc(numCols * sizeof(int8_t));
+        op->schema->columnTypes = embedDBMalloc(numCols * sizeof(ColumnType));
         if (op->schema->columnSizes == NULL || op->schema->columnTypes == NULL) {
 #ifdef PRINT_ERRORS
             printf("ERROR: Failed to allocate space for projection while building schema\n");
@@ -293,34 +463,67 @@ void initProjection(embedDBOperator* op) {
     }
 }
 
-int8_t nextProjection(embedDBOperator* op) {
-    uint8_t numCols = *(uint8_t*)op->state;
-    uint8_t* cols = (uint8_t*)op->state + 1;
-    embedDBSchema* inputSchema = op->input->schema;
+/**
+ * @brief	Copies the projected columns of an input record into an output record
+ */
+void projectRecord(embedDBOperator* op, const void* inputRecord, void* outputRecord) {
+    struct projectionInfo* info = op->state;
+    uint16_t curColPos = 0;
+    for (uint8_t colIdx = 0; colIdx < info->numCols; colIdx++) {
+        uint8_t colSize = abs(op->schema->columnSizes[colIdx]);
+        memcpy((int8_t*)outputRecord + curColPos, (const int8_t*)inputRecord + info->srcOffsets[colIdx], colSize);
+        curColPos += colSize;
+    }
+}
 
+int8_t nextProjection(embedDBOperator* op) {
     // Get next record
     if (op->input->next(op->input)) {
-        uint16_t curColPos = 0;
-        for (uint8_t colIdx = 0; colIdx < numCols; colIdx++) {
-            uint8_t col = cols[colIdx];
-            uint8_t colSize = abs(inputSchema->columnSizes[col]);
-            uint16_t srcColPos = getColOffsetFromSchema(inputSchema, col);
-            memcpy((int8_t*)op->recordBuffer + curColPos, (int8_t*)op->input->recordBuffer + srcColPos, colSize);
-            curColPos += colSize;
-        }
+        projectRecord(op, op->input->recordBuffer, op->recordBuffer);
         return 1;
     } else {
         return 0;
     }
 }
 
+uint16_t nextBatchProjection(embedDBOperator* op, embedDBBatch* batch) {
+    struct projectionInfo* info = op->state;
+
+    // The input batch is always fully consumed, so it can be replaced if the capacity changes
+    if (info->inputBatch != NULL && info->inputBatch->capacity != batch->capacity) {
+        embedDBFreeBatch(&info->inputBatch);
+    }
+    if (info->inputBatch == NULL) {
+        info->inputBatch = createBatchFromSchema(op->input->schema, batch->capacity);
+        if (info->inputBatch == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to allocate input batch for projection operator\n");
+#endif
+            return 0;
+        }
+    }
+
+    embedDBBatch* input = info->inputBatch;
+    batch->count = nextBatch(op->input, input);
+    int8_t* record = batch->records;
+    for (uint16_t i = 0; i < batch->count; i++) {
+        projectRecord(op, EMBEDDB_BATCH_RECORD(input, i), record);
+        batch->selection[i] = i;
+        record += batch->recordSize;
+    }
+    batch->numSelected = batch->count;
+    return batch->numSelected;
+}
+
 void closeProjection(embedDBOperator* op) {
     op->input->close(op->input);
 
+    embedDBFreeBatch(&((struct projectionInfo*)op->state)->inputBatch);
+
     embedDBFreeSchema(&op->schema);
-    free(op->state);
+    embedDBFree(op->state);
     op->state = NULL;
-    free(op->recordBuffer);
+    embedDBFree(op->recordBuffer);
     op->recordBuffer = NULL;
 }
 
@@ -331,18 +534,21 @@ void closeProjection(embedDBOperator* op) {
  * @param	cols	The indexes of the columns to be outputted. Zero indexed. Column indexes must be strictly increasing i.e. columns must stay in the same order, can only remove columns from input
  */
 embedDBOperator* createProjectionOperator(embedDBOperator* input, uint8_t numCols, uint8_t* cols) {
-    // Create state
-    uint8_t* state = malloc(numCols + 1);
+    // Create state, the column arrays are stored after the struct
+    struct projectionInfo* state = embedDBMalloc(sizeof(struct projectionInfo) + numCols * (sizeof(uint16_t) + sizeof(uint8_t)));
     if (state == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: malloc failed while creating Projection operator\n");
 #endif
         return NULL;
     }
-    state[0] = numCols;
-    memcpy(state + 1, cols, numCols);
+    state->numCols = numCols;
+    state->srcOffsets = (uint16_t*)(state + 1);
+    state->cols = (uint8_t*)(state->srcOffsets + numCols);
+    memcpy(state->cols, cols, numCols);
+    state->inputBatch = NULL;
 
-    embedDBOperator* op = malloc(sizeof(embedDBOperator));
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
     if (op == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: malloc failed while creating Projection operator\n");
@@ -361,12 +567,235 @@ embedDBOperator* createProjectionOperator(embedDBOperator* input, uint8_t numCol
     return op;
 }
 
-struct selectionInfo {
-    int8_t colNum;
+struct selectionPredicate;
+
+/**
+ * @brief	Evaluates one predicate on the value of its column
+ * @return	0 or 1 to indicate if the predicate is true
+ */
+typedef int8_t (*selectionKernel)(const void* value, const struct selectionPredicate* predicate);
+
+struct selectionPredicate {
+    uint8_t colNum;
     int8_t operation;
     void* compVal;
+    uint16_t colPos;        // Offset of the column in the input record, set by init
+    int8_t colSize;         // Size of the column in bytes, set by init
+    int8_t isSigned;        // Whether the column is signed, set by init
+    selectionKernel kernel; // Comparison specialized for the column's type, width and the operation, set by init
+};
+
+struct selectionInfo {
+    uint16_t recordSize;                     // Size of an input record, set by init
+    void* values;                            // Copies of the predicates' values that compVal points to, set by init
+    int8_t isDisjunction;                    // Is a record selected when any predicate is true, rather than all of them
+    uint8_t pushDown;                        // EMBEDDB_PUSH_DOWN_ flags of the iterator bounds the predicates may be pushed into
+    uint8_t numPredicates;                   // Number of predicates
+    struct selectionPredicate predicates[];  // Predicates, evaluated in order until the result is known
 };
 
+/**
+ * @brief	Kernels for columns that are a C type. Values are copied out since records are not aligned
+ */
+#define EMBEDDB_SELECTION_KERNEL(name, type, op)                                       \
+    int8_t name(const void* value, const struct selectionPredicate* predicate) {       \
+        type a, b;                                                                     \
+        memcpy(&a, value, sizeof(type));                                               \
+        memcpy(&b, predicate->compVal, sizeof(type));                                  \
+        return a op b;                                                                 \
+    }
+
+/* Defines a kernel for each operation and a table of them indexed by the SELECT_ constants */
+#define EMBEDDB_SELECTION_KERNELS(name, type)                                                                              \
+    EMBEDDB_SELECTION_KERNEL(select##name##GT, type, >)                                                                    \
+    EMBEDDB_SELECTION_KERNEL(select##name##LT, type, <)                                                                    \
+    EMBEDDB_SELECTION_KERNEL(select##name##GTE, type, >=)                                                                  \
+    EMBEDDB_SELECTION_KERNEL(select##name##LTE, type, <=)                                                                  \
+    EMBEDDB_SELECTION_KERNEL(select##name##EQ, type, ==)                                                                   \
+    EMBEDDB_SELECTION_KERNEL(select##name##NEQ, type, !=)                                                                  \
+    const selectionKernel select##name##Kernels[] = {select##name##GT, select##name##LT, select##name##GTE, select##name##LTE, \
+                                                     select##name##EQ, select##name##NEQ};
+
+EMBEDDB_SELECTION_KERNELS(Int8, int8_t)
+EMBEDDB_SELECTION_KERNELS(UInt8, uint8_t)
+EMBEDDB_SELECTION_KERNELS(Int16, int16_t)
+EMBEDDB_SELECTION_KERNELS(UInt16, uint16_t)
+EMBEDDB_SELECTION_KERNELS(Int32, int32_t)
+EMBEDDB_SELECTION_KERNELS(UInt32, uint32_t)
+EMBEDDB_SELECTION_KERNELS(Int64, int64_t)
+EMBEDDB_SELECTION_KERNELS(UInt64, uint64_t)
+EMBEDDB_SELECTION_KERNELS(Float, float)
+EMBEDDB_SELECTION_KERNELS(Double, double)
+
+/**
+ * @brief	Kernel for integer columns of any other width
+ */
+int8_t selectBytes(const void* value, const struct selectionPredicate* predicate) {
+    return compare((void*)value, predicate->operation, predicate->compVal, predicate->isSigned, predicate->colSize);
+}
+
+/**
+ * @brief	Picks the kernel of a predicate from the type and width of its column
+ */
+selectionKernel getSelectionKernel(struct selectionPredicate* predicate, ColumnType type) {
+    if (predicate->operation < SELECT_GT || predicate->operation > SELECT_NEQ) {
+        return selectBytes;
+    }
+    if (type == embedDB_COLUMN_FLOAT && predicate->colSize == sizeof(float)) {
+        return selectFloatKernels[predicate->operation];
+    }
+    if (type == embedDB_COLUMN_DOUBLE && predicate->colSize == sizeof(double)) {
+        return selectDoubleKernels[predicate->operation];
+    }
+    switch (predicate->colSize) {
+        case 1:
+            return (predicate->isSigned ? selectInt8Kernels : selectUInt8Kernels)[predicate->operation];
+        case 2:
+            return (predicate->isSigned ? selectInt16Kernels : selectUInt16Kernels)[predicate->operation];
+        case 4:
+            return (predicate->isSigned ? selectInt32Kernels : selectUInt32Kernels)[predicate->operation];
+        case 8:
+            return (predicate->isSigned ? selectInt64Kernels : selectUInt64Kernels)[predicate->operation];
+        default:
+            return selectBytes;
+    }
+}
+
+/**
+ * @brief	Evaluates the predicates of a selection on a record, stopping at the first one that decides the result
+ * @return	0 or 1 to indicate if the record is selected
+ */
+int8_t isRecordSelected(struct selectionInfo* state, const void* record) {
+    for (uint8_t i = 0; i < state->numPredicates; i++) {
+        struct selectionPredicate* predicate = state->predicates + i;
+        if (predicate->kernel((const int8_t*)record + predicate->colPos, predicate) == state->isDisjunction) {
+            return state->isDisjunction;
+        }
+    }
+    return !state->isDisjunction;
+}
+
+/**
+ * @brief	Finds the table scan below a selection, looking through other selections since they don't change the records' layout
+ * @return	The table scan operator, or NULL if there is another operator in between
+ */
+embedDBOperator* getPushDownScan(embedDBOperator* op) {
+    embedDBOperator* input = op->input;
+    while (input != NULL && input->next == nextSelection) {
+        input = input->input;
+    }
+    if (input == NULL || input->next != nextTableScan || input->schema == NULL)
+        return NULL;
+    return input;
+}
+
+/**
+ * @brief	If the predicate is an equality test on a Bloom filter column of a table scan,
+ * 			sets the probe on the scan's iterator so data pages that cannot contain the value are skipped
+ */
+void pushDownBloomProbe(struct selectionPredicate* predicate, embedDBOperator* scan) {
+    if (predicate->operation != SELECT_EQ || predicate->colNum < 1)
+        return;
+
+    embedDBState* state = (embedDBState*)(((void**)scan->state)[0]);
+    embedDBIterator* it = (embedDBIterator*)(((void**)scan->state)[1]);
+    if (!EMBEDDB_USING_BLOOM(state->parameters) || it->bloomValue != NULL)
+        return;
+
+    // Floating point columns can compare equal with different bytes (0.0 and -0.0)
+    ColumnType type = scan->schema->columnTypes[predicate->colNum];
+    if (type == embedDB_COLUMN_FLOAT || type == embedDB_COLUMN_DOUBLE)
+        return;
+
+    uint16_t offset = getColOffsetFromSchema(scan->schema, predicate->colNum) - state->keySize;
+    uint8_t size = abs(scan->schema->columnSizes[predicate->colNum]);
+    for (int8_t i = 0; i < state->numBloomColumns; i++) {
+        if (state->bloomColumnOffsets[i] == offset && state->bloomColumnSizes[i] == size) {
+            embedDBIteratorSetBloomProbe(state, it, i, predicate->compVal);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief	Checks that compareData is the utility comparator for the type and size of the first data column of a table
+ * 			scan, so minData and maxData mean the same as a predicate on that column. Other comparators cannot be checked.
+ */
+int8_t isDataComparatorForColumn(embedDBState* state, embedDBSchema* schema) {
+    if (schema->numCols < 2)
+        return 0;
+
+    int8_t colSize = schema->columnSizes[1];
+    switch (schema->columnTypes[1]) {
+        case embedDB_COLUMN_INT32:
+            return colSize == -4 && state->compareData == int32Comparator;
+        case embedDB_COLUMN_INT64:
+            return colSize == -8 && state->compareData == int64Comparator;
+        case embedDB_COLUMN_FLOAT:
+            return abs(colSize) == 4 && state->compareData == floatComparator;
+        case embedDB_COLUMN_DOUBLE:
+            return abs(colSize) == 8 && state->compareData == doubleComparator;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief	Pushes a predicate on the key or on the first data column into the minKey/maxKey or minData/maxData of the
+ * 			table scan's iterator, so the spline, bitmap index and page headers can skip data. Bounds already on the iterator
+ * 			are only replaced by tighter ones. The iterator bounds are inclusive, so the selection still checks every record.
+ */
+void pushDownRange(struct selectionPredicate* predicate, embedDBOperator* scan) {
+    if (predicate->operation == SELECT_NEQ || predicate->colNum > 1)
+        return;
+
+    embedDBState* state = (embedDBState*)(((void**)scan->state)[0]);
+    embedDBIterator* it = (embedDBIterator*)(((void**)scan->state)[1]);
+    if (predicate->colNum == 1 && !isDataComparatorForColumn(state, scan->schema))
+        return;
+
+    // Iterators compare data values with compareData, which reads the first data column
+    int8_t (*compareFunc)(void* a, void* b) = predicate->colNum == 0 ? state->compareKey : state->compareData;
+    void** minBound = predicate->colNum == 0 ? &it->minKey : &it->minData;
+    void** maxBound = predicate->colNum == 0 ? &it->maxKey : &it->maxData;
+
+    int8_t updated = 0;
+    if (predicate->operation == SELECT_GT || predicate->operation == SELECT_GTE || predicate->operation == SELECT_EQ) {
+        if (*minBound == NULL || compareFunc(predicate->compVal, *minBound) > 0) {
+            *minBound = predicate->compVal;
+            updated = 1;
+        }
+    }
+    if (predicate->operation == SELECT_LT || predicate->operation == SELECT_LTE || predicate->operation == SELECT_EQ) {
+        if (*maxBound == NULL || compareFunc(predicate->compVal, *maxBound) < 0) {
+            *maxBound = predicate->compVal;
+            updated = 1;
+        }
+    }
+
+    if (updated) {
+        embedDBIteratorUpdateBounds(state, it);
+    }
+}
+
+/**
+ * @brief	Lets the table scan's iterator skip pages and records when possible. Only predicates that every selected record
+ * 			meets can be pushed down
+ */
+void pushDownSelection(embedDBOperator* op) {
+    struct selectionInfo* info = op->state;
+    embedDBOperator* scan = getPushDownScan(op);
+    if (scan != NULL && (!info->isDisjunction || info->numPredicates == 1)) {
+        for (uint8_t i = 0; i < info->numPredicates; i++) {
+            struct selectionPredicate* predicate = info->predicates + i;
+            if (info->pushDown & (predicate->colNum == 0 ? EMBEDDB_PUSH_DOWN_KEYS : EMBEDDB_PUSH_DOWN_DATA))
+                pushDownRange(predicate, scan);
+            if (info->pushDown & EMBEDDB_PUSH_DOWN_BLOOM)
+                pushDownBloomProbe(predicate, scan);
+        }
+    }
+}
+
 void initSelection(embedDBOperator* op) {
     if (op->input == NULL) {
 #ifdef PRINT_ERRORS
@@ -378,6 +807,46 @@ void initSelection(embedDBOperator* op) {
     // Init input
     op->input->init(op->input);
 
+    // Pick the kernel of each predicate once, rather than checking the column for each record
+    struct selectionInfo* info = op->state;
+    embedDBSchema* inputSchema = op->input->schema;
+    info->recordSize = getRecordSizeFromSchema(inputSchema);
+    uint16_t valuesSize = 0;
+    for (uint8_t i = 0; i < info->numPredicates; i++) {
+        struct selectionPredicate* predicate = info->predicates + i;
+        if (predicate->colNum >= inputSchema->numCols) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Selection column is not in the input schema\n");
+#endif
+            return;
+        }
+        predicate->colPos = getColOffsetFromSchema(inputSchema, predicate->colNum);
+        predicate->colSize = inputSchema->columnSizes[predicate->colNum];
+        predicate->isSigned = embedDB_IS_COL_SIGNED(predicate->colSize);
+        predicate->colSize = abs(predicate->colSize);
+        predicate->kernel = getSelectionKernel(predicate, inputSchema->columnTypes[predicate->colNum]);
+        valuesSize += predicate->colSize;
+    }
+
+    // Copy the values so they can be rebound without writing to the caller's memory
+    if (info->values == NULL) {
+        info->values = embedDBMalloc(valuesSize);
+        if (info->values == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing Selection operator\n");
+#endif
+            return;
+        }
+        int8_t* value = info->values;
+        for (uint8_t i = 0; i < info->numPredicates; i++) {
+            memcpy(value, info->predicates[i].compVal, info->predicates[i].colSize);
+            info->predicates[i].compVal = value;
+            value += info->predicates[i].colSize;
+        }
+    }
+
+    pushDownSelection(op);
+
     // Init output schema
     if (op->schema == NULL) {
         op->schema = copySchema(op->input->schema);
@@ -396,23 +865,11 @@ void initSelection(embedDBOperator* op) {
 }
 
 int8_t nextSelection(embedDBOperator* op) {
-    embedDBSchema* schema = op->input->schema;
     struct selectionInfo* state = op->state;
 
-    int8_t colNum = state->colNum;
-    uint16_t colPos = getColOffsetFromSchema(schema, colNum);
-    int8_t operation = state->operation;
-    int8_t colSize = schema->columnSizes[colNum];
-    int8_t isSigned = 0;
-    if (colSize < 0) {
-        colSize = -colSize;
-        isSigned = 1;
-    }
-
     while (op->input->next(op->input)) {
-        void* colData = (int8_t*)op->input->recordBuffer + colPos;
-        if (compare(colData, operation, state->compVal, isSigned, colSize)) {
-            memcpy(op->recordBuffer, op->input->recordBuffer, getRecordSizeFromSchema(op->schema));
+        if (isRecordSelected(state, op->input->recordBuffer)) {
+            memcpy(op->recordBuffer, op->input->recordBuffer, state->recordSize);
             return 1;
         }
     }
@@ -420,36 +877,71 @@ int8_t nextSelection(embedDBOperator* op) {
     return 0;
 }
 
+uint16_t nextBatchSelection(embedDBOperator* op, embedDBBatch* batch) {
+    struct selectionInfo* state = op->state;
+
+    // Filter the input batch in place by shrinking its selection vector
+    while (nextBatch(op->input, batch)) {
+        uint16_t numSelected = 0;
+        for (uint16_t i = 0; i < batch->numSelected; i++) {
+            if (isRecordSelected(state, EMBEDDB_BATCH_RECORD(batch, i))) {
+                batch->selection[numSelected++] = batch->selection[i];
+            }
+        }
+        batch->numSelected = numSelected;
+        if (numSelected > 0) {
+            return numSelected;
+        }
+    }
+
+    return 0;
+}
+
 void closeSelection(embedDBOperator* op) {
     op->input->close(op->input);
 
     embedDBFreeSchema(&op->schema);
-    free(op->state);
+    embedDBFree(((struct selectionInfo*)op->state)->values);
+    embedDBFree(op->state);
     op->state = NULL;
-    free(op->recordBuffer);
+    embedDBFree(op->recordBuffer);
     op->recordBuffer = NULL;
 }
 
 /**
- * @brief	Creates an operator that selects records based on simple selection rules
- * @param	input		The operator that this operator can pull records from
- * @param	colNum		The index (zero-indexed) of the column base the select on
- * @param	operation	A constant representing which comparison operation to perform. (e.g. SELECT_GT, SELECT_EQ, etc)
- * @param	compVal		A pointer to the value to compare with. Make sure the size of this is the same number of bytes as is described in the schema
+ * @brief	Creates an operator that selects records that meet all, or any, of several predicates in one pass
+ * @param	input			The operator that this operator can pull records from
+ * @param	predicates		The predicates, which are copied. Their values are copied when the operator is initialized. Put the most
+ * 							selective first, since evaluation stops once the result is known
+ * @param	numPredicates	The number of predicates
+ * @param	combine			EMBEDDB_SELECT_AND to select records that meet every predicate, EMBEDDB_SELECT_OR for records that meet any of them
  */
-embedDBOperator* createSelectionOperator(embedDBOperator* input, int8_t colNum, int8_t operation, void* compVal) {
-    struct selectionInfo* state = malloc(sizeof(struct selectionInfo));
+embedDBOperator* createPredicateSelectionOperator(embedDBOperator* input, embedDBPredicate* predicates, uint8_t numPredicates, int8_t combine) {
+    if (predicates == NULL || numPredicates == 0) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Selection operator needs at least one predicate\n");
+#endif
+        return NULL;
+    }
+    struct selectionInfo* state = embedDBMalloc(sizeof(struct selectionInfo) + numPredicates * sizeof(struct selectionPredicate));
     if (state == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to malloc while creating Selection operator\n");
 #endif
         return NULL;
     }
-    state->colNum = colNum;
-    state->operation = operation;
-    memcpy(&state->compVal, &compVal, sizeof(void*));
+    state->values = NULL;
+    state->isDisjunction = combine == EMBEDDB_SELECT_OR;
+    state->pushDown = EMBEDDB_PUSH_DOWN_ALL;
+    state->numPredicates = numPredicates;
+    for (uint8_t i = 0; i < numPredicates; i++) {
+        state->predicates[i].colNum = predicates[i].colNum;
+        state->predicates[i].operation = predicates[i].operation;
+        state->predicates[i].compVal = predicates[i].value;
+        state->predicates[i].kernel = selectBytes;
+    }
 
-    embedDBOperator* op = malloc(sizeof(embedDBOperator));
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
     if (op == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to malloc while creating Selection operator\n");
@@ -468,34 +960,194 @@ embedDBOperator* createSelectionOperator(embedDBOperator* input, int8_t colNum,
 }
 
 /**
- * @brief	A private struct to hold the state of the aggregate operator
+ * @brief	Creates an operator that selects records based on simple selection rules
+ * @param	input		The operator that this operator can pull records from
+ * @param	colNum		The index (zero-indexed) of the column base the select on
+ * @param	operation	A constant representing which comparison operation to perform. (e.g. SELECT_GT, SELECT_EQ, etc)
+ * @param	compVal		A pointer to the value to compare with, copied when the operator is initialized. Make sure the size of this is the same number of bytes as is described in the schema
  */
-struct aggregateInfo {
-    int8_t (*groupfunc)(const void* lastRecord, const void* record);  // Function that determins if both records are in the same group
-    embedDBAggregateFunc* functions;                                  // An array of aggregate functions
-    uint32_t functionsLength;                                         // The length of the functions array
-    void* lastRecordBuffer;                                           // Buffer for the last record read by input->next
-    uint16_t bufferSize;                                              // Size of the input buffer (and lastRecordBuffer)
-    int8_t isLastRecordUsable;                                        // Is the data in lastRecordBuffer usable for checking if the recently read record is in the same group? Is set to 0 at start, and also after the last record
-};
+embedDBOperator* createSelectionOperator(embedDBOperator* input, int8_t colNum, int8_t operation, void* compVal) {
+    embedDBPredicate predicate = {(uint8_t)colNum, operation, compVal};
+    return createPredicateSelectionOperator(input, &predicate, 1, EMBEDDB_SELECT_AND);
+}
 
-void initAggregate(embedDBOperator* op) {
-    if (op->input == NULL) {
+/**
+ * @brief	Chooses which bounds of the table scan's iterator the predicates of a selection are pushed into. All of them are by default.
+ * 			Takes effect when the operator is initialized or reset.
+ * @param	op			A selection operator
+ * @param	pushDown	EMBEDDB_PUSH_DOWN_KEYS, EMBEDDB_PUSH_DOWN_DATA and EMBEDDB_PUSH_DOWN_BLOOM combined with |, or EMBEDDB_PUSH_DOWN_NONE
+ * @return	0 if success, -1 if the operator is not a selection
+ */
+int8_t embedDBSetSelectionPushDown(embedDBOperator* op, uint8_t pushDown) {
+    if (op == NULL || op->next != nextSelection || op->state == NULL) {
 #ifdef PRINT_ERRORS
-        printf("ERROR: Aggregate operator needs an input operator\n");
+        printf("ERROR: Only the push down of a selection operator can be set\n");
 #endif
-        return;
+        return -1;
     }
+    ((struct selectionInfo*)op->state)->pushDown = pushDown;
+    return 0;
+}
 
-    // Init input
-    op->input->init(op->input);
-
-    struct aggregateInfo* state = op->state;
-    state->isLastRecordUsable = 0;
-
-    // Init output schema
-    if (op->schema == NULL) {
-        op->schema = malloc(sizeof(embedDBSchema));
+/**
+ * @brief	Allocates a batch for records with the given schema
+ * @param	schema		The schema of the records, usually the output schema of the operator the batch is read from
+ * @param	capacity	Maximum number of records in the batch
+ */
+embedDBBatch* createBatchFromSchema(embedDBSchema* schema, uint16_t capacity) {
+    embedDBBatch* batch = embedDBMalloc(sizeof(embedDBBatch));
+    if (batch == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating batch\n");
+#endif
+        return NULL;
+    }
+    batch->capacity = capacity;
+    batch->count = 0;
+    batch->numSelected = 0;
+    batch->recordSize = getRecordSizeFromSchema(schema);
+    batch->records = embedDBMalloc((size_t)capacity * batch->recordSize);
+    batch->selection = embedDBMalloc(capacity * sizeof(uint16_t));
+    if (batch->records == NULL || batch->selection == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating batch\n");
+#endif
+        embedDBFreeBatch(&batch);
+        return NULL;
+    }
+    return batch;
+}
+
+/**
+ * @brief	Frees a batch and sets the pointer to NULL
+ */
+void embedDBFreeBatch(embedDBBatch** batch) {
+    if (*batch == NULL)
+        return;
+    embedDBFree((*batch)->records);
+    embedDBFree((*batch)->selection);
+    embedDBFree(*batch);
+    *batch = NULL;
+}
+
+/**
+ * @brief	Fills a batch by calling next on an operator that has no batch implementation
+ */
+uint16_t nextBatchRecords(embedDBOperator* op, embedDBBatch* batch) {
+    int8_t* record = batch->records;
+    batch->count = 0;
+    while (batch->count < batch->capacity && op->next(op)) {
+        memcpy(record, op->recordBuffer, batch->recordSize);
+        batch->selection[batch->count] = batch->count;
+        batch->count++;
+        record += batch->recordSize;
+    }
+    batch->numSelected = batch->count;
+    return batch->numSelected;
+}
+
+/**
+ * @brief	Fills a batch from an operator, using the batch implementation of the pre-built operators when there is one
+ * @return	The number of selected records, 0 if the operator has no more records
+ */
+uint16_t nextBatch(embedDBOperator* op, embedDBBatch* batch) {
+    if (op->next == nextTableScan) {
+        return nextBatchTableScan(op, batch);
+    } else if (op->next == nextSelection) {
+        return nextBatchSelection(op, batch);
+    } else if (op->next == nextProjection) {
+        return nextBatchProjection(op, batch);
+    }
+    return nextBatchRecords(op, batch);
+}
+
+/**
+ * @brief	Whether the records of an operator are produced in batches all the way down to the table scan
+ */
+int8_t supportsBatch(embedDBOperator* op) {
+    if (op->next == nextTableScan) {
+        return 1;
+    } else if (op->next == nextSelection || op->next == nextProjection) {
+        return supportsBatch(op->input);
+    }
+    return 0;
+}
+
+/**
+ * @brief	Extract the next batch of records from an operator
+ * @param	op		An initialized operator
+ * @param	batch	A batch created with the output schema of @c op
+ * @return	The number of selected records in the batch, 0 if there are no more rows to return
+ */
+uint16_t execBatch(embedDBOperator* op, embedDBBatch* batch) {
+    if (batch == NULL || op->schema == NULL || batch->recordSize != getRecordSizeFromSchema(op->schema)) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: The batch must be created with the output schema of the operator\n");
+#endif
+        return 0;
+    }
+    return nextBatch(op, batch);
+}
+
+/**
+ * @brief	Copies one column of the selected records of a batch into a column vector
+ * @return	The number of values copied
+ */
+uint16_t embedDBBatchGetColumn(embedDBBatch* batch, embedDBSchema* schema, uint8_t colNum, void* column) {
+    uint16_t colPos = getColOffsetFromSchema(schema, colNum);
+    uint8_t colSize = abs(schema->columnSizes[colNum]);
+    int8_t* value = column;
+    for (uint16_t i = 0; i < batch->numSelected; i++) {
+        memcpy(value, (int8_t*)EMBEDDB_BATCH_RECORD(batch, i) + colPos, colSize);
+        value += colSize;
+    }
+    return batch->numSelected;
+}
+
+/**
+ * @brief	A private struct to hold the state of the aggregate operator
+ */
+struct aggregateInfo {
+    int8_t (*groupfunc)(const void* lastRecord, const void* record);  // Function that determins if both records are in the same group
+    embedDBAggregateFunc* functions;                                  // An array of aggregate functions
+    uint32_t functionsLength;                                         // The length of the functions array
+    void* lastRecordBuffer;                                           // Buffer for the last record read by input->next
+    uint16_t bufferSize;                                              // Size of the input buffer (and lastRecordBuffer)
+    int8_t isLastRecordUsable;                                        // Is the data in lastRecordBuffer usable for checking if the recently read record is in the same group? Is set to 0 at start, and also after the last record
+    embedDBBatch* inputBatch;                                         // Batch read from the input when it can produce batches, otherwise NULL
+    uint16_t batchPos;                                                // Index of the next selected record of inputBatch to add to a group
+};
+
+/**
+ * @brief	Type of the output column of an aggregate function. Averages are floating point, other functions are integers of their column size.
+ */
+ColumnType getAggregateColumnType(embedDBAggregateFunc* function) {
+    int8_t colSize = function->colSize;
+    if (function->add == avgAdd) {
+        return colSize == 8 ? embedDB_COLUMN_DOUBLE : embedDB_COLUMN_FLOAT;
+    } else if (abs(colSize) == 8) {
+        return embedDB_IS_COL_SIGNED(colSize) ? embedDB_COLUMN_INT64 : embedDB_COLUMN_UINT64;
+    }
+    return embedDB_IS_COL_SIGNED(colSize) ? embedDB_COLUMN_INT32 : embedDB_COLUMN_UINT32;
+}
+
+void initAggregate(embedDBOperator* op) {
+    if (op->input == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Aggregate operator needs an input operator\n");
+#endif
+        return;
+    }
+
+    // Init input
+    op->input->init(op->input);
+
+    struct aggregateInfo* state = op->state;
+    state->isLastRecordUsable = 0;
+
+    // Init output schema
+    if (op->schema == NULL) {
+        op->schema = embedDBMalloc(sizeof(embedDBSchema));
         if (op->schema == NULL) {
 #ifdef PRINT_ERRORS
             printf("ERROR: Failed to malloc while initializing aggregate operator\n");
@@ -503,8 +1155,8 @@ void initAggregate(embedDBOperator* op) {
             return;
         }
         op->schema->numCols = state->functionsLength;
-        op->schema->columnSizes = malloc(state->functionsLength);
-        op->schema->columnTypes = malloc(state->functionsLength);
+        op->schema->columnSizes = embedDBMalloc(state->functionsLength);
+        op->schema->columnTypes = embedDBMalloc(state->functionsLength * sizeof(ColumnType));
         if (op->schema->columnSizes == NULL || op->schema->columnTypes == NULL) {
 #ifdef PRINT_ERRORS
             printf("ERROR: Failed to malloc while initializing aggregate operator\n");
@@ -513,6 +1165,7 @@ void initAggregate(embedDBOperator* op) {
         }
         for (uint8_t i = 0; i < state->functionsLength; i++) {
             op->schema->columnSizes[i] = state->functions[i].colSize;
+            op->schema->columnTypes[i] = getAggregateColumnType(&state->functions[i]);
             state->functions[i].colNum = i;
         }
     }
@@ -529,7 +1182,7 @@ void initAggregate(embedDBOperator* op) {
         }
     }
     if (state->lastRecordBuffer == NULL) {
-        state->lastRecordBuffer = malloc(state->bufferSize);
+        state->lastRecordBuffer = embedDBMalloc(state->bufferSize);
         if (state->lastRecordBuffer == NULL) {
 #ifdef PRINT_ERRORS
             printf("ERROR: Failed to malloc while initializing aggregate operator\n");
@@ -537,12 +1190,93 @@ void initAggregate(embedDBOperator* op) {
             return;
         }
     }
+
+    // Read the input in batches when it supports it. If the batch can't be allocated, records are read one at a time
+    if (state->inputBatch == NULL && EMBEDDB_BATCH_SIZE > 0 && supportsBatch(op->input)) {
+        state->inputBatch = createBatchFromSchema(op->input->schema, EMBEDDB_BATCH_SIZE);
+    }
+    if (state->inputBatch != NULL) {
+        state->inputBatch->count = 0;
+        state->inputBatch->numSelected = 0;
+    }
+    state->batchPos = 0;
+}
+
+/**
+ * @brief	Finds the next group by reading batches from the input. Runs of records in the same group are added to each aggregate function at once
+ */
+int8_t nextAggregateBatch(embedDBOperator* op) {
+    struct aggregateInfo* state = op->state;
+    embedDBOperator* input = op->input;
+    embedDBBatch* batch = state->inputBatch;
+
+    // Reset each operator
+    for (int i = 0; i < state->functionsLength; i++) {
+        if (state->functions[i].reset != NULL) {
+            state->functions[i].reset(state->functions + i, input->schema);
+        }
+    }
+
+    // The first record of the group is the next unread record of the batch
+    const void* lastRecord = NULL;
+    int8_t recordsInGroup = 0;
+    int8_t groupEnded = 0;
+    while (!groupEnded) {
+        if (state->batchPos >= batch->numSelected) {
+            // Keep the last record of the group before its batch is overwritten
+            if (lastRecord != NULL) {
+                memcpy(state->lastRecordBuffer, lastRecord, state->bufferSize);
+                lastRecord = state->lastRecordBuffer;
+            }
+            state->batchPos = 0;
+            if (!nextBatch(input, batch)) {
+                break;
+            }
+        }
+
+        // Find the run of records that belong to this group
+        uint16_t start = state->batchPos, end = start;
+        while (end < batch->numSelected) {
+            const void* record = EMBEDDB_BATCH_RECORD(batch, end);
+            if (lastRecord != NULL && !state->groupfunc(lastRecord, record)) {
+                groupEnded = 1;
+                break;
+            }
+            lastRecord = record;
+            end++;
+        }
+
+        if (end > start) {
+            recordsInGroup = 1;
+            for (int i = 0; i < state->functionsLength; i++) {
+                addBatchToAggregate(state->functions + i, input->schema, batch, start, end);
+            }
+        }
+        state->batchPos = end;
+    }
+
+    if (!recordsInGroup) {
+        return 0;
+    }
+
+    // Perform final compute on all functions
+    for (int i = 0; i < state->functionsLength; i++) {
+        if (state->functions[i].compute != NULL) {
+            state->functions[i].compute(state->functions + i, op->schema, op->recordBuffer, lastRecord);
+        }
+    }
+
+    return 1;
 }
 
 int8_t nextAggregate(embedDBOperator* op) {
     struct aggregateInfo* state = op->state;
     embedDBOperator* input = op->input;
 
+    if (state->inputBatch != NULL) {
+        return nextAggregateBatch(op);
+    }
+
     // Reset each operator
     for (int i = 0; i < state->functionsLength; i++) {
         if (state->functions[i].reset != NULL) {
@@ -598,226 +1332,2050 @@ int8_t nextAggregate(embedDBOperator* op) {
         }
     }
 
-    // Put last read record into lastRecordBuffer
-    memcpy(state->lastRecordBuffer, input->recordBuffer, state->bufferSize);
+    // Put last read record into lastRecordBuffer
+    memcpy(state->lastRecordBuffer, input->recordBuffer, state->bufferSize);
+
+    return 1;
+}
+
+void closeAggregate(embedDBOperator* op) {
+    op->input->close(op->input);
+    op->input = NULL;
+    embedDBFreeSchema(&op->schema);
+    embedDBFree(((struct aggregateInfo*)op->state)->lastRecordBuffer);
+    embedDBFreeBatch(&((struct aggregateInfo*)op->state)->inputBatch);
+    embedDBFree(op->state);
+    op->state = NULL;
+    embedDBFree(op->recordBuffer);
+    op->recordBuffer = NULL;
+}
+
+/**
+ * @brief	Creates an operator that will find groups and preform aggregate functions over each group.
+ * @param	input			The operator that this operator can pull records from
+ * @param	groupfunc		A function that returns whether or not the @c record is part of the same group as the @c lastRecord. Assumes that records in groups are always next to each other and sorted when read in (i.e. Groups need to be 1122333, not 13213213)
+ * @param	functions		An array of aggregate functions, each of which will be updated with each record read from the iterator
+ * @param	functionsLength			The number of embedDBAggregateFuncs in @c functions
+ */
+embedDBOperator* createAggregateOperator(embedDBOperator* input, int8_t (*groupfunc)(const void* lastRecord, const void* record), embedDBAggregateFunc* functions, uint32_t functionsLength) {
+    struct aggregateInfo* state = embedDBMalloc(sizeof(struct aggregateInfo));
+    if (state == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating aggregate operator\n");
+#endif
+        return NULL;
+    }
+
+    state->groupfunc = groupfunc;
+    state->functions = functions;
+    state->functionsLength = functionsLength;
+    state->lastRecordBuffer = NULL;
+    state->inputBatch = NULL;
+    state->batchPos = 0;
+
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
+    if (op == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating aggregate operator\n");
+#endif
+        return NULL;
+    }
+
+    op->state = state;
+    op->input = input;
+    op->schema = NULL;
+    op->recordBuffer = NULL;
+    op->init = initAggregate;
+    op->next = nextAggregate;
+    op->close = closeAggregate;
+
+    return op;
+}
+
+/**
+ * @brief	A private struct to hold the state of the hash aggregate operator
+ */
+struct hashAggregateInfo {
+    uint8_t groupColNum;                  // Column that determines the group of a record
+    embedDBAggregateFunc* functions;      // An array of aggregate functions
+    uint32_t functionsLength;             // The length of the functions array
+    int8_t* memory;                       // Caller-allocated space for the page buffers and the hash table
+    uint32_t memorySize;                  // Size of memory in bytes
+    embedDBFileInterface* fileInterface;  // Interface used to spill records, or NULL if spilling is disabled
+    void* scratchFile;                    // File that spilled records are written to
+    uint32_t pageSize;                    // Size of the pages of scratchFile
+    uint16_t groupColPos;                 // Byte offset of the group column in an input record
+    uint8_t groupColSize;                 // Size of the group column in bytes
+    uint16_t recordSize;                  // Size of an input record
+    uint16_t entrySize;                   // Size of a hash table entry: a used flag, the group value and the state of each function
+    int8_t* table;                        // Start of the hash table in memory
+    uint32_t numSlots;                    // Number of entries of the hash table
+    uint32_t maxGroups;                   // Number of groups kept in the table before records are spilled
+    uint32_t numGroups;                   // Number of groups in the table
+    uint32_t nextSlot;                    // Next entry of the table to output
+    int8_t isTableBuilt;                  // Has the current pass been read into the table
+    int8_t isReadingInput;                // Does the current pass read from the input operator, rather than from the scratch file
+    uint32_t passStartPage;               // First page of the scratch file read by the current pass
+    uint32_t passEndPage;                 // Page after the last page of the scratch file read by the current pass
+    uint32_t nextSpillPage;               // Next page of the scratch file to write
+    uint16_t spillPageCount;              // Number of records in the spill page buffer
+    int8_t isFileOpen;                    // Was the scratch file opened by init
+};
+
+#define EMBEDDB_HASH_AGGREGATE_PAGE_HEADER_SIZE 2
+
+void initHashAggregate(embedDBOperator* op) {
+    if (op->input == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Hash aggregate operator needs an input operator\n");
+#endif
+        return;
+    }
+
+    // Init input
+    op->input->init(op->input);
+
+    struct hashAggregateInfo* state = op->state;
+    embedDBSchema* inputSchema = op->input->schema;
+    if (state->groupColNum >= inputSchema->numCols) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Hash aggregate group column is not in the input schema\n");
+#endif
+        return;
+    }
+    state->groupColPos = getColOffsetFromSchema(inputSchema, state->groupColNum);
+    state->groupColSize = abs(inputSchema->columnSizes[state->groupColNum]);
+    state->recordSize = getRecordSizeFromSchema(inputSchema);
+
+    // Each entry saves the state of every function for its group
+    state->entrySize = 1 + state->groupColSize;
+    for (uint32_t i = 0; i < state->functionsLength; i++) {
+        void* bytes;
+        uint16_t size = getAggregateStateBytes(state->functions + i, &bytes);
+        if (size == 0) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Hash aggregate only supports the built-in count, sum, min, max and avg functions\n");
+#endif
+            return;
+        }
+        state->entrySize += size;
+    }
+
+    // The read and write page buffers come first, the rest of the memory holds the hash table
+    uint32_t pageBufferSize = state->fileInterface != NULL ? 2 * state->pageSize : 0;
+    if (state->fileInterface != NULL && state->pageSize < EMBEDDB_HASH_AGGREGATE_PAGE_HEADER_SIZE + state->recordSize) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Hash aggregate scratch file pages are too small to hold a record\n");
+#endif
+        return;
+    }
+    state->table = state->memory + pageBufferSize;
+    state->numSlots = state->memorySize > pageBufferSize ? (state->memorySize - pageBufferSize) / state->entrySize : 0;
+    state->maxGroups = state->numSlots * 3 / 4;
+    if (state->maxGroups == 0) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Hash aggregate memory is too small to hold a group\n");
+#endif
+        return;
+    }
+    if (state->fileInterface != NULL && !state->fileInterface->open(state->scratchFile, EMBEDDB_FILE_MODE_W_PLUS_B)) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to open hash aggregate scratch file\n");
+#endif
+        state->maxGroups = 0;
+        return;
+    }
+    state->isFileOpen = state->fileInterface != NULL;
+    state->isTableBuilt = 0;
+    state->isReadingInput = 1;
+    state->passStartPage = 0;
+    state->passEndPage = 0;
+    state->nextSpillPage = 0;
+
+    // Init output schema. The group column is followed by the result of each function
+    if (op->schema == NULL) {
+        op->schema = embedDBMalloc(sizeof(embedDBSchema));
+        if (op->schema == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing hash aggregate operator\n");
+#endif
+            return;
+        }
+        op->schema->numCols = state->functionsLength + 1;
+        op->schema->columnSizes = embedDBMalloc(op->schema->numCols);
+        op->schema->columnTypes = embedDBMalloc(op->schema->numCols * sizeof(ColumnType));
+        if (op->schema->columnSizes == NULL || op->schema->columnTypes == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing hash aggregate operator\n");
+#endif
+            return;
+        }
+        op->schema->columnSizes[0] = inputSchema->columnSizes[state->groupColNum];
+        op->schema->columnTypes[0] = inputSchema->columnTypes[state->groupColNum];
+        for (uint8_t i = 0; i < state->functionsLength; i++) {
+            op->schema->columnSizes[i + 1] = state->functions[i].colSize;
+            op->schema->columnTypes[i + 1] = getAggregateColumnType(&state->functions[i]);
+            state->functions[i].colNum = i + 1;
+        }
+    }
+
+    if (op->recordBuffer == NULL) {
+        op->recordBuffer = createBufferFromSchema(op->schema);
+        if (op->recordBuffer == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing hash aggregate operator\n");
+#endif
+            return;
+        }
+    }
+}
+
+/**
+ * @brief	FNV-1a hash of a column value
+ */
+uint32_t hashColumnValue(const void* value, uint8_t size) {
+    uint32_t hash = 2166136261u;
+    for (uint8_t i = 0; i < size; i++) {
+        hash = (hash ^ ((const uint8_t*)value)[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief	Copies the saved state of each function of a group into the functions (@c load = 1), or the state of the functions into the group (@c load = 0)
+ */
+void hashAggregateSwapState(struct hashAggregateInfo* state, int8_t* entry, int8_t load) {
+    int8_t* entryState = entry + 1 + state->groupColSize;
+    for (uint32_t i = 0; i < state->functionsLength; i++) {
+        void* bytes;
+        uint16_t size = getAggregateStateBytes(state->functions + i, &bytes);
+        if (load) {
+            memcpy(bytes, entryState, size);
+        } else {
+            memcpy(entryState, bytes, size);
+        }
+        entryState += size;
+    }
+}
+
+/**
+ * @brief	Writes a record whose group is not in the hash table to the scratch file, to be aggregated in a later pass
+ * @return	1 if the record was saved, 0 if it could not be
+ */
+int8_t hashAggregateSpill(struct hashAggregateInfo* state, const void* record) {
+    if (state->fileInterface == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Hash aggregate memory is full and no scratch file was provided\n");
+#endif
+        return 0;
+    }
+    int8_t* writeBuffer = state->memory + state->pageSize;
+    memcpy(writeBuffer + EMBEDDB_HASH_AGGREGATE_PAGE_HEADER_SIZE + state->spillPageCount * state->recordSize, record, state->recordSize);
+    state->spillPageCount++;
+    if (EMBEDDB_HASH_AGGREGATE_PAGE_HEADER_SIZE + (state->spillPageCount + 1) * state->recordSize > state->pageSize) {
+        memcpy(writeBuffer, &state->spillPageCount, sizeof(uint16_t));
+        if (!state->fileInterface->write(writeBuffer, state->nextSpillPage, state->pageSize, state->scratchFile)) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to write hash aggregate scratch page %lu\n", (unsigned long)state->nextSpillPage);
+#endif
+            return 0;
+        }
+        state->nextSpillPage++;
+        state->spillPageCount = 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief	Adds a record to the group in the hash table with the same group value. Spills the record if its group is not in the table and the table is full
+ * @return	1 if the record was added or spilled, 0 on error
+ */
+int8_t hashAggregateAdd(struct hashAggregateInfo* state, embedDBSchema* inputSchema, const void* record) {
+    const int8_t* value = (const int8_t*)record + state->groupColPos;
+    uint32_t slot = hashColumnValue(value, state->groupColSize) % state->numSlots;
+    int8_t* entry = state->table + slot * state->entrySize;
+
+    // Linear probing. The table is never full, so an empty entry is always found
+    while (entry[0] && memcmp(entry + 1, value, state->groupColSize) != 0) {
+        slot = slot + 1 == state->numSlots ? 0 : slot + 1;
+        entry = state->table + slot * state->entrySize;
+    }
+
+    if (entry[0]) {
+        hashAggregateSwapState(state, entry, 1);
+    } else if (state->numGroups < state->maxGroups) {
+        entry[0] = 1;
+        memcpy(entry + 1, value, state->groupColSize);
+        state->numGroups++;
+        for (uint32_t i = 0; i < state->functionsLength; i++) {
+            state->functions[i].reset(state->functions + i, inputSchema);
+        }
+    } else {
+        return hashAggregateSpill(state, record);
+    }
+
+    for (uint32_t i = 0; i < state->functionsLength; i++) {
+        state->functions[i].add(state->functions + i, inputSchema, record);
+    }
+    hashAggregateSwapState(state, entry, 0);
+    return 1;
+}
+
+/**
+ * @brief	Reads the records of a pass into an empty hash table. The first pass reads the input operator, later passes read the records spilled by the previous pass
+ * @return	1 if success, 0 on error
+ */
+int8_t buildHashAggregateTable(embedDBOperator* op) {
+    struct hashAggregateInfo* state = op->state;
+    embedDBSchema* inputSchema = op->input->schema;
+
+    memset(state->table, 0, state->numSlots * state->entrySize);
+    state->numGroups = 0;
+    state->nextSlot = 0;
+    state->spillPageCount = 0;
+    uint32_t spillStartPage = state->nextSpillPage;
+
+    if (state->isReadingInput) {
+        while (op->input->next(op->input)) {
+            if (!hashAggregateAdd(state, inputSchema, op->input->recordBuffer)) {
+                return 0;
+            }
+        }
+    } else {
+        int8_t* readBuffer = state->memory;
+        for (uint32_t page = state->passStartPage; page < state->passEndPage; page++) {
+            if (!state->fileInterface->read(readBuffer, page, state->pageSize, state->scratchFile)) {
+#ifdef PRINT_ERRORS
+                printf("ERROR: Failed to read hash aggregate scratch page %lu\n", (unsigned long)page);
+#endif
+                return 0;
+            }
+            uint16_t count;
+            memcpy(&count, readBuffer, sizeof(uint16_t));
+            for (uint16_t i = 0; i < count; i++) {
+                if (!hashAggregateAdd(state, inputSchema, readBuffer + EMBEDDB_HASH_AGGREGATE_PAGE_HEADER_SIZE + i * state->recordSize)) {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    // Write the last partially filled spill page
+    if (state->spillPageCount > 0) {
+        int8_t* writeBuffer = state->memory + state->pageSize;
+        memcpy(writeBuffer, &state->spillPageCount, sizeof(uint16_t));
+        if (!state->fileInterface->write(writeBuffer, state->nextSpillPage, state->pageSize, state->scratchFile)) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to write hash aggregate scratch page %lu\n", (unsigned long)state->nextSpillPage);
+#endif
+            return 0;
+        }
+        state->nextSpillPage++;
+    }
+
+    // The next pass reads the records spilled by this one
+    state->isReadingInput = 0;
+    state->passStartPage = spillStartPage;
+    state->passEndPage = state->nextSpillPage;
+    return 1;
+}
+
+int8_t nextHashAggregate(embedDBOperator* op) {
+    struct hashAggregateInfo* state = op->state;
+    if (state->table == NULL || state->maxGroups == 0) {
+        return 0;
+    }
+
+    while (1) {
+        if (!state->isTableBuilt) {
+            if (!state->isReadingInput && state->passStartPage == state->passEndPage) {
+                return 0;
+            }
+            if (!buildHashAggregateTable(op)) {
+                return 0;
+            }
+            state->isTableBuilt = 1;
+        }
+
+        // Output the next group of the table
+        while (state->nextSlot < state->numSlots) {
+            int8_t* entry = state->table + state->nextSlot * state->entrySize;
+            state->nextSlot++;
+            if (!entry[0]) {
+                continue;
+            }
+            memcpy(op->recordBuffer, entry + 1, state->groupColSize);
+            hashAggregateSwapState(state, entry, 1);
+            for (uint32_t i = 0; i < state->functionsLength; i++) {
+                state->functions[i].compute(state->functions + i, op->schema, op->recordBuffer, NULL);
+            }
+            return 1;
+        }
+        state->isTableBuilt = 0;
+    }
+}
+
+void closeHashAggregate(embedDBOperator* op) {
+    struct hashAggregateInfo* state = op->state;
+    op->input->close(op->input);
+    if (state->isFileOpen) {
+        state->fileInterface->close(state->scratchFile);
+    }
+    embedDBFreeSchema(&op->schema);
+    embedDBFree(op->state);
+    op->state = NULL;
+    embedDBFree(op->recordBuffer);
+    op->recordBuffer = NULL;
+}
+
+/**
+ * @brief	Creates an operator that groups records by the value of one column with a hash table, so the records of a group do not need to be next to each other.
+ * 			Outputs one record per group, in no particular order, with the group value followed by the result of each aggregate function.
+ * 			When the table is full, records of new groups are spilled to a scratch file and aggregated in later passes.
+ * @param	input			The operator that this operator can pull records from
+ * @param	groupColNum		Zero-indexed column whose value determines the group of a record
+ * @param	functions		An array of the built-in count, sum, min, max or avg aggregate functions
+ * @param	functionsLength	The number of embedDBAggregateFuncs in @c functions
+ * @param	memory			Caller-allocated space for the hash table and, if spilling, two page buffers. Must stay valid until the operator is closed
+ * @param	memorySize		Size of @c memory in bytes
+ * @param	fileInterface	Interface used to write spilled records. NULL disables spilling
+ * @param	scratchFile		File that spilled records are written to. Its contents are overwritten
+ * @param	pageSize		Size of the pages written to @c scratchFile
+ */
+embedDBOperator* createHashAggregateOperator(embedDBOperator* input, uint8_t groupColNum, embedDBAggregateFunc* functions, uint32_t functionsLength, void* memory, uint32_t memorySize, embedDBFileInterface* fileInterface, void* scratchFile, uint32_t pageSize) {
+    if (memory == NULL || (fileInterface != NULL && scratchFile == NULL)) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Hash aggregate operator needs memory, and a scratch file if it uses a file interface\n");
+#endif
+        return NULL;
+    }
+
+    struct hashAggregateInfo* state = embedDBMalloc(sizeof(struct hashAggregateInfo));
+    if (state == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating hash aggregate operator\n");
+#endif
+        return NULL;
+    }
+    state->groupColNum = groupColNum;
+    state->functions = functions;
+    state->functionsLength = functionsLength;
+    state->memory = memory;
+    state->memorySize = memorySize;
+    state->fileInterface = fileInterface;
+    state->scratchFile = scratchFile;
+    state->pageSize = pageSize;
+    state->table = NULL;
+    state->maxGroups = 0;
+    state->isFileOpen = 0;
+
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
+    if (op == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating hash aggregate operator\n");
+#endif
+        embedDBFree(state);
+        return NULL;
+    }
+
+    op->state = state;
+    op->input = input;
+    op->schema = NULL;
+    op->recordBuffer = NULL;
+    op->init = initHashAggregate;
+    op->next = nextHashAggregate;
+    op->close = closeHashAggregate;
+
+    return op;
+}
+
+/**
+ * @brief	A sorted run of records on the scratch file that is being merged
+ */
+struct sortRun {
+    uint32_t nextPage;  // Next page of the run to read
+    uint32_t endPage;   // Page after the last page of the run
+    int8_t* page;       // Buffer holding the current page of the run
+    uint16_t count;     // Number of records in the current page
+    uint16_t nextRec;   // Next record of the current page
+};
+
+/**
+ * @brief	A private struct to hold the state of the sort operator
+ */
+struct sortInfo {
+    uint8_t colNum;                       // Column to sort by
+    int8_t direction;                     // EMBEDDB_SORT_ASC or EMBEDDB_SORT_DESC
+    int8_t* memory;                       // Caller-allocated space for records and page buffers
+    uint32_t memorySize;                  // Size of memory in bytes
+    embedDBFileInterface* fileInterface;  // Interface used to write sorted runs, or NULL if spilling is disabled
+    void* scratchFile;                    // File that sorted runs are written to
+    uint32_t pageSize;                    // Size of the pages of scratchFile
+    uint32_t numPages;                    // Number of pages in memory, which is the most runs that can be merged at once
+    uint16_t colPos;                      // Byte offset of the sort column in a record
+    int8_t colSize;                       // Size of the sort column, negative if signed
+    ColumnType colType;                   // Type of the sort column
+    uint16_t recordSize;                  // Size of a record
+    uint16_t recordsPerPage;              // Number of records in a page of scratchFile
+    uint32_t* runStarts;                  // First page of each run. Runs are stored one after the other
+    uint32_t numRuns;                     // Number of runs written to scratchFile
+    uint32_t nextPage;                    // Next page of scratchFile to write
+    uint32_t runCapacity;                 // Number of entries allocated in runStarts
+    uint32_t firstRun;                    // First run that has not been merged into a later run
+    struct sortRun* runs;                 // Runs being merged, one per page of memory
+    uint32_t numMergeRuns;                // Number of runs in the final merge
+    uint32_t numRecords;                  // Number of records sorted in memory when there are no runs
+    uint32_t nextRecord;                  // Next record to output when there are no runs
+    int8_t isSorted;                      // Has the input been sorted
+    int8_t isValid;                       // Was the operator initialized without errors
+    int8_t isFileOpen;                    // Was the scratch file opened by init
+};
+
+#define EMBEDDB_SORT_PAGE_HEADER_SIZE 2
+
+void initSort(embedDBOperator* op) {
+    if (op->input == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Sort operator needs an input operator\n");
+#endif
+        return;
+    }
+
+    // Init input
+    op->input->init(op->input);
+
+    struct sortInfo* state = op->state;
+    embedDBSchema* inputSchema = op->input->schema;
+    if (state->colNum >= inputSchema->numCols) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Sort column is not in the input schema\n");
+#endif
+        return;
+    }
+    state->colPos = getColOffsetFromSchema(inputSchema, state->colNum);
+    state->colSize = inputSchema->columnSizes[state->colNum];
+    state->colType = inputSchema->columnTypes[state->colNum];
+    state->recordSize = getRecordSizeFromSchema(inputSchema);
+    state->numRuns = 0;
+    state->nextPage = 0;
+    state->firstRun = 0;
+    state->numMergeRuns = 0;
+    state->isSorted = 0;
+
+    if (state->fileInterface != NULL) {
+        // Merging needs an output page and at least two input pages
+        state->numPages = state->memorySize / state->pageSize;
+        state->recordsPerPage = (state->pageSize - EMBEDDB_SORT_PAGE_HEADER_SIZE) / state->recordSize;
+        if (state->numPages < 3 || state->recordsPerPage == 0) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Sort operator needs at least three pages of memory that can each hold a record\n");
+#endif
+            return;
+        }
+        if (state->runs == NULL) {
+            state->runs = embedDBMalloc(state->numPages * sizeof(struct sortRun));
+            if (state->runs == NULL) {
+#ifdef PRINT_ERRORS
+                printf("ERROR: Failed to malloc while initializing sort operator\n");
+#endif
+                return;
+            }
+        }
+        if (!state->fileInterface->open(state->scratchFile, EMBEDDB_FILE_MODE_W_PLUS_B)) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to open sort scratch file\n");
+#endif
+            return;
+        }
+        state->isFileOpen = 1;
+    } else if (state->memorySize < state->recordSize) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Sort operator memory is too small to hold a record\n");
+#endif
+        return;
+    }
+
+    // Sorting does not change the schema
+    if (op->schema == NULL) {
+        op->schema = copySchema(inputSchema);
+        if (op->schema == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing sort operator\n");
+#endif
+            return;
+        }
+    }
+    if (op->recordBuffer == NULL) {
+        op->recordBuffer = createBufferFromSchema(op->schema);
+        if (op->recordBuffer == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing sort operator\n");
+#endif
+            return;
+        }
+    }
+    state->isValid = 1;
+}
+
+/**
+ * @brief	Compares the sort column of two records
+ * @return	Negative if @c a is output before @c b, positive if after, 0 if they are equal
+ */
+int8_t compareSortRecords(struct sortInfo* state, const int8_t* a, const int8_t* b) {
+    int8_t result;
+    a += state->colPos;
+    b += state->colPos;
+    if (state->colType == embedDB_COLUMN_FLOAT || state->colType == embedDB_COLUMN_DOUBLE) {
+        double valA, valB;
+        if (state->colType == embedDB_COLUMN_FLOAT) {
+            float floatA, floatB;
+            memcpy(&floatA, a, sizeof(float));
+            memcpy(&floatB, b, sizeof(float));
+            valA = floatA;
+            valB = floatB;
+        } else {
+            memcpy(&valA, a, sizeof(double));
+            memcpy(&valB, b, sizeof(double));
+        }
+        result = valA < valB ? -1 : valA > valB;
+    } else if (embedDB_IS_COL_SIGNED(state->colSize)) {
+        result = compareSignedNumbers(a, b, -state->colSize);
+    } else {
+        result = compareUnsignedNumbers(a, b, state->colSize);
+    }
+    return state->direction == EMBEDDB_SORT_DESC ? -result : result;
+}
+
+/**
+ * @brief	Moves record @c i down the heap of @c n records until it is after all its children
+ */
+void sortSiftDown(struct sortInfo* state, int8_t* records, uint32_t i, uint32_t n, void* temp) {
+    uint16_t recordSize = state->recordSize;
+    while (2 * i + 1 < n) {
+        uint32_t child = 2 * i + 1;
+        if (child + 1 < n && compareSortRecords(state, records + (child + 1) * recordSize, records + child * recordSize) > 0) {
+            child++;
+        }
+        if (compareSortRecords(state, records + i * recordSize, records + child * recordSize) >= 0) {
+            return;
+        }
+        memcpy(temp, records + i * recordSize, recordSize);
+        memcpy(records + i * recordSize, records + child * recordSize, recordSize);
+        memcpy(records + child * recordSize, temp, recordSize);
+        i = child;
+    }
+}
+
+/**
+ * @brief	Sorts records in place with heapsort, which needs no memory other than one record of temporary space
+ */
+void sortRecords(struct sortInfo* state, int8_t* records, uint32_t n, void* temp) {
+    uint16_t recordSize = state->recordSize;
+    for (uint32_t i = n / 2; i > 0; i--) {
+        sortSiftDown(state, records, i - 1, n, temp);
+    }
+    for (uint32_t end = n; end > 1; end--) {
+        memcpy(temp, records, recordSize);
+        memcpy(records, records + (end - 1) * recordSize, recordSize);
+        memcpy(records + (end - 1) * recordSize, temp, recordSize);
+        sortSiftDown(state, records, 0, end - 1, temp);
+    }
+}
+
+/**
+ * @brief	Returns the page after the last page of a run
+ */
+uint32_t getSortRunEnd(struct sortInfo* state, uint32_t run) {
+    return run + 1 < state->numRuns ? state->runStarts[run + 1] : state->nextPage;
+}
+
+/**
+ * @brief	Adds a run that starts at the next page of the scratch file
+ * @return	1 if success, 0 on error
+ */
+int8_t startSortRun(struct sortInfo* state) {
+    if (state->numRuns == state->runCapacity) {
+        uint32_t capacity = state->runCapacity == 0 ? 8 : state->runCapacity * 2;
+        uint32_t* runStarts = realloc(state->runStarts, capacity * sizeof(uint32_t));
+        if (runStarts == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while sorting\n");
+#endif
+            return 0;
+        }
+        state->runStarts = runStarts;
+        state->runCapacity = capacity;
+    }
+    state->runStarts[state->numRuns] = state->nextPage;
+    state->numRuns++;
+    return 1;
+}
+
+/**
+ * @brief	Writes a page of the last run to the next page of the scratch file
+ * @return	1 if success, 0 on error
+ */
+int8_t writeSortPage(struct sortInfo* state, int8_t* page, uint16_t count) {
+    memcpy(page, &count, sizeof(uint16_t));
+    if (!state->fileInterface->write(page, state->nextPage, state->pageSize, state->scratchFile)) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to write sort scratch page %lu\n", (unsigned long)state->nextPage);
+#endif
+        return 0;
+    }
+    state->nextPage++;
+    return 1;
+}
+
+/**
+ * @brief	Writes sorted records to the scratch file as a new run. The first page of memory is used as the page buffer
+ * @return	1 if success, 0 on error
+ */
+int8_t writeSortRun(struct sortInfo* state, int8_t* records, uint32_t n) {
+    if (!startSortRun(state)) {
+        return 0;
+    }
+    int8_t* page = state->memory;
+    for (uint32_t i = 0; i < n; i += state->recordsPerPage) {
+        uint16_t count = n - i < state->recordsPerPage ? n - i : state->recordsPerPage;
+        memcpy(page + EMBEDDB_SORT_PAGE_HEADER_SIZE, records + i * state->recordSize, count * state->recordSize);
+        if (!writeSortPage(state, page, count)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief	Prepares to merge a run, reading its pages into @c page
+ */
+void openSortRun(struct sortInfo* state, struct sortRun* run, uint32_t runNum, int8_t* page) {
+    run->nextPage = state->runStarts[runNum];
+    run->endPage = getSortRunEnd(state, runNum);
+    run->page = page;
+    run->count = 0;
+    run->nextRec = 0;
+}
+
+/**
+ * @brief	Returns the next record of a run without removing it, reading the next page of the run when needed
+ * @return	The record, or NULL if the run has no more records
+ */
+int8_t* peekSortRun(struct sortInfo* state, struct sortRun* run) {
+    while (run->nextRec >= run->count) {
+        if (run->nextPage >= run->endPage) {
+            return NULL;
+        }
+        if (!state->fileInterface->read(run->page, run->nextPage, state->pageSize, state->scratchFile)) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to read sort scratch page %lu\n", (unsigned long)run->nextPage);
+#endif
+            return NULL;
+        }
+        memcpy(&run->count, run->page, sizeof(uint16_t));
+        run->nextRec = 0;
+        run->nextPage++;
+    }
+    return run->page + EMBEDDB_SORT_PAGE_HEADER_SIZE + run->nextRec * state->recordSize;
+}
+
+/**
+ * @brief	Finds the run whose next record is output first
+ * @return	Index of the run, or -1 if all runs are empty
+ */
+int32_t selectSortRun(struct sortInfo* state, struct sortRun* runs, uint32_t numRuns) {
+    int32_t best = -1;
+    int8_t* bestRecord = NULL;
+    for (uint32_t i = 0; i < numRuns; i++) {
+        int8_t* record = peekSortRun(state, runs + i);
+        if (record != NULL && (bestRecord == NULL || compareSortRecords(state, record, bestRecord) < 0)) {
+            best = i;
+            bestRecord = record;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief	Merges runs firstRun to firstRun + numRuns - 1 into a new run. The first page of memory is the output buffer and the others hold a page of each run
+ * @return	1 if success, 0 on error
+ */
+int8_t mergeSortRuns(struct sortInfo* state, uint32_t firstRun, uint32_t numRuns) {
+    for (uint32_t i = 0; i < numRuns; i++) {
+        openSortRun(state, state->runs + i, firstRun + i, state->memory + (i + 1) * state->pageSize);
+    }
+    if (!startSortRun(state)) {
+        return 0;
+    }
+
+    int8_t* page = state->memory;
+    uint16_t count = 0;
+    int32_t next;
+    while ((next = selectSortRun(state, state->runs, numRuns)) >= 0) {
+        struct sortRun* run = state->runs + next;
+        memcpy(page + EMBEDDB_SORT_PAGE_HEADER_SIZE + count * state->recordSize, peekSortRun(state, run), state->recordSize);
+        run->nextRec++;
+        count++;
+        if (count == state->recordsPerPage) {
+            if (!writeSortPage(state, page, count)) {
+                return 0;
+            }
+            count = 0;
+        }
+    }
+    if (count > 0 && !writeSortPage(state, page, count)) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief	Reads the whole input. Sorts it in memory if it fits, otherwise writes sorted runs and merges them until the remaining runs can be merged at once
+ * @return	1 if success, 0 on error
+ */
+int8_t sortInput(embedDBOperator* op) {
+    struct sortInfo* state = op->state;
+    embedDBOperator* input = op->input;
+
+    // When spilling, the first page of memory is kept to write runs
+    uint32_t reserved = state->fileInterface != NULL ? state->pageSize : 0;
+    int8_t* records = state->memory + reserved;
+    uint32_t capacity = (state->memorySize - reserved) / state->recordSize;
+    uint32_t n = 0;
+    while (input->next(input)) {
+        if (n == capacity) {
+            if (state->fileInterface == NULL) {
+#ifdef PRINT_ERRORS
+                printf("ERROR: Sort operator memory is full and no scratch file was provided\n");
+#endif
+                return 0;
+            }
+            sortRecords(state, records, n, op->recordBuffer);
+            if (!writeSortRun(state, records, n)) {
+                return 0;
+            }
+            n = 0;
+        }
+        memcpy(records + n * state->recordSize, input->recordBuffer, state->recordSize);
+        n++;
+    }
+    sortRecords(state, records, n, op->recordBuffer);
+
+    if (state->numRuns == 0) {
+        state->numRecords = n;
+        state->nextRecord = 0;
+        return 1;
+    }
+    if (n > 0 && !writeSortRun(state, records, n)) {
+        return 0;
+    }
+
+    // Merge passes until every remaining run can have a page of memory
+    while (state->numRuns - state->firstRun > state->numPages) {
+        uint32_t numRuns = state->numPages - 1;
+        if (!mergeSortRuns(state, state->firstRun, numRuns)) {
+            return 0;
+        }
+        state->firstRun += numRuns;
+    }
+
+    state->numMergeRuns = state->numRuns - state->firstRun;
+    for (uint32_t i = 0; i < state->numMergeRuns; i++) {
+        openSortRun(state, state->runs + i, state->firstRun + i, state->memory + i * state->pageSize);
+    }
+    return 1;
+}
+
+int8_t nextSort(embedDBOperator* op) {
+    struct sortInfo* state = op->state;
+    if (!state->isValid) {
+        return 0;
+    }
+    if (!state->isSorted) {
+        if (!sortInput(op)) {
+            state->isValid = 0;
+            return 0;
+        }
+        state->isSorted = 1;
+    }
+
+    if (state->numRuns == 0) {
+        if (state->nextRecord >= state->numRecords) {
+            return 0;
+        }
+        uint32_t reserved = state->fileInterface != NULL ? state->pageSize : 0;
+        memcpy(op->recordBuffer, state->memory + reserved + state->nextRecord * state->recordSize, state->recordSize);
+        state->nextRecord++;
+        return 1;
+    }
+
+    int32_t next = selectSortRun(state, state->runs, state->numMergeRuns);
+    if (next < 0) {
+        return 0;
+    }
+    struct sortRun* run = state->runs + next;
+    memcpy(op->recordBuffer, peekSortRun(state, run), state->recordSize);
+    run->nextRec++;
+    return 1;
+}
+
+void closeSort(embedDBOperator* op) {
+    struct sortInfo* state = op->state;
+    op->input->close(op->input);
+    if (state->isFileOpen) {
+        state->fileInterface->close(state->scratchFile);
+        state->isFileOpen = 0;
+    }
+    embedDBFree(state->runs);
+    state->runs = NULL;
+    free(state->runStarts);
+    state->runStarts = NULL;
+    embedDBFreeSchema(&op->schema);
+    embedDBFree(op->state);
+    op->state = NULL;
+    embedDBFree(op->recordBuffer);
+    op->recordBuffer = NULL;
+}
+
+/**
+ * @brief	Creates an operator that outputs the records of its input ordered by one column.
+ * 			Records are sorted in memory if they fit. Otherwise sorted runs are written to a scratch file and merged, using only the provided memory for records and pages.
+ * @param	input			The operator that this operator can pull records from
+ * @param	colNum			Zero-indexed column to sort by
+ * @param	direction		EMBEDDB_SORT_ASC or EMBEDDB_SORT_DESC
+ * @param	memory			Caller-allocated space for records and page buffers. Must stay valid until the operator is closed
+ * @param	memorySize		Size of @c memory in bytes. With a scratch file it must hold at least three pages, and memorySize / pageSize runs are merged at once
+ * @param	fileInterface	Interface used to write sorted runs. NULL sorts in memory only
+ * @param	scratchFile		File that sorted runs are written to. Its contents are overwritten
+ * @param	pageSize		Size of the pages written to @c scratchFile
+ */
+embedDBOperator* createSortOperator(embedDBOperator* input, uint8_t colNum, int8_t direction, void* memory, uint32_t memorySize, embedDBFileInterface* fileInterface, void* scratchFile, uint32_t pageSize) {
+    if (memory == NULL || (fileInterface != NULL && scratchFile == NULL)) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Sort operator needs memory, and a scratch file if it uses a file interface\n");
+#endif
+        return NULL;
+    }
+
+    struct sortInfo* state = embedDBMalloc(sizeof(struct sortInfo));
+    if (state == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating sort operator\n");
+#endif
+        return NULL;
+    }
+    state->colNum = colNum;
+    state->direction = direction;
+    state->memory = memory;
+    state->memorySize = memorySize;
+    state->fileInterface = fileInterface;
+    state->scratchFile = scratchFile;
+    state->pageSize = pageSize;
+    state->runStarts = NULL;
+    state->numRuns = 0;
+    state->runCapacity = 0;
+    state->nextPage = 0;
+    state->runs = NULL;
+    state->isValid = 0;
+    state->isFileOpen = 0;
+
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
+    if (op == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating sort operator\n");
+#endif
+        embedDBFree(state);
+        return NULL;
+    }
+
+    op->state = state;
+    op->input = input;
+    op->schema = NULL;
+    op->recordBuffer = NULL;
+    op->init = initSort;
+    op->next = nextSort;
+    op->close = closeSort;
+
+    return op;
+}
+
+/**
+ * @brief	Creates the output schema of a join: the columns of @c schema1 followed by the columns of @c schema2
+ * @return	The schema, or NULL if memory could not be allocated
+ */
+embedDBSchema* createJoinSchema(embedDBSchema* schema1, embedDBSchema* schema2) {
+    embedDBSchema* schema = embedDBMalloc(sizeof(embedDBSchema));
+    if (schema == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while initializing join operator\n");
+#endif
+        return NULL;
+    }
+    schema->numCols = schema1->numCols + schema2->numCols;
+    schema->columnSizes = embedDBMalloc(schema->numCols * sizeof(int8_t));
+    schema->columnTypes = embedDBMalloc(schema->numCols * sizeof(ColumnType));
+    if (schema->columnSizes == NULL || schema->columnTypes == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while initializing join operator\n");
+#endif
+        embedDBFreeSchema(&schema);
+        return NULL;
+    }
+    memcpy(schema->columnSizes, schema1->columnSizes, schema1->numCols);
+    memcpy(schema->columnSizes + schema1->numCols, schema2->columnSizes, schema2->numCols);
+    memcpy(schema->columnTypes, schema1->columnTypes, schema1->numCols * sizeof(ColumnType));
+    memcpy(schema->columnTypes + schema1->numCols, schema2->columnTypes, schema2->numCols * sizeof(ColumnType));
+    return schema;
+}
+
+struct keyJoinInfo {
+    embedDBOperator* input2;
+    int8_t firstCall;
+};
+
+void initKeyJoin(embedDBOperator* op) {
+    struct keyJoinInfo* state = op->state;
+    embedDBOperator* input1 = op->input;
+    embedDBOperator* input2 = state->input2;
+
+    // Init inputs
+    input1->init(input1);
+    input2->init(input2);
+    copySharedScanRecords(input1, input2);
+
+    embedDBSchema* schema1 = input1->schema;
+    embedDBSchema* schema2 = input2->schema;
+
+    // Check that join is compatible
+    if (schema1->columnSizes[0] != schema2->columnSizes[0] || schema1->columnSizes[0] < 0 || schema2->columnSizes[0] < 0) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: The first columns of the two tables must be the key and must be the same size. Make sure you haven't projected them out.\n");
+#endif
+        return;
+    }
+
+    // Setup schema
+    if (op->schema == NULL) {
+        op->schema = createJoinSchema(schema1, schema2);
+        if (op->schema == NULL) {
+            return;
+        }
+    }
+
+    // Allocate recordBuffer
+    op->recordBuffer = embedDBMalloc(getRecordSizeFromSchema(op->schema));
+    if (op->recordBuffer == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while initializing join operator\n");
+#endif
+        return;
+    }
+
+    state->firstCall = 1;
+}
+
+/**
+ * @brief	Finds the table scan an operator reads from, looking through selections since they don't buffer records
+ * @return	The table scan operator, or NULL if the operator can't be repositioned
+ */
+embedDBOperator* getSeekableScan(embedDBOperator* op) {
+    embedDBOperator* scan = op->next == nextSelection ? getPushDownScan(op) : op;
+    if (scan == NULL || scan->next != nextTableScan)
+        return NULL;
+
+    // Reverse scans return keys in decreasing order
+    embedDBIterator* it = (embedDBIterator*)(((void**)scan->state)[1]);
+    return it->isReverse ? NULL : scan;
+}
+
+/**
+ * @brief	Advances an input of a key join to its first record with a key >= key. Table scans are repositioned
+ * 			with embedDBIteratorSeek so the pages in between are not read, other inputs are stepped with next()
+ * @return	1 if the input has a record, 0 if it ran out of records
+ */
+int8_t advanceKeyJoinInput(embedDBOperator* input, void* key, int8_t colSize) {
+    // A single step is enough when the inputs are interleaved, so only seek if that doesn't catch up
+    if (!input->next(input))
+        return 0;
+    if (compareUnsignedNumbers(input->recordBuffer, key, colSize) >= 0)
+        return 1;
+
+    embedDBOperator* scan = getSeekableScan(input);
+    if (scan != NULL) {
+        embedDBState* state = (embedDBState*)(((void**)scan->state)[0]);
+        embedDBIterator* it = (embedDBIterator*)(((void**)scan->state)[1]);
+        if (embedDBIteratorSeek(state, it, key) != 0)
+            return 0;
+    }
+
+    do {
+        if (!input->next(input))
+            return 0;
+    } while (compareUnsignedNumbers(input->recordBuffer, key, colSize) < 0);
+    return 1;
+}
+
+int8_t nextKeyJoin(embedDBOperator* op) {
+    struct keyJoinInfo* state = op->state;
+    embedDBOperator* input1 = op->input;
+    embedDBOperator* input2 = state->input2;
+    embedDBSchema* schema1 = input1->schema;
+    embedDBSchema* schema2 = input2->schema;
+
+    int8_t colSize = abs(schema1->columnSizes[0]);
+
+    if (state->firstCall) {
+        state->firstCall = 0;
+
+        if (!input1->next(input1) || !input2->next(input2)) {
+            // If this case happens, you goofed, but I'll handle it anyway
+            return 0;
+        }
+        goto check;
+    }
+
+    while (1) {
+        // Advance the input with the smaller value
+        int8_t comp = compareUnsignedNumbers(input1->recordBuffer, input2->recordBuffer, colSize);
+        if (comp == 0) {
+            // Move both forward because if they match at this point, they've already been matched
+            if (!input1->next(input1) || !input2->next(input2)) {
+                return 0;
+            }
+        } else if (comp < 0) {
+            // Move record 1 forward to the key of record 2
+            if (!advanceKeyJoinInput(input1, input2->recordBuffer, colSize)) {
+                // We are out of records on one side. Given the assumption that the inputs are sorted, there are no more possible joins
+                return 0;
+            }
+        } else {
+            // Move record 2 forward to the key of record 1
+            if (!advanceKeyJoinInput(input2, input1->recordBuffer, colSize)) {
+                // We are out of records on one side. Given the assumption that the inputs are sorted, there are no more possible joins
+                return 0;
+            }
+        }
+
+    check:
+        // See if these records join
+        if (compareUnsignedNumbers(input1->recordBuffer, input2->recordBuffer, colSize) == 0) {
+            // Copy both records into the output
+            uint16_t record1Size = getRecordSizeFromSchema(schema1);
+            memcpy(op->recordBuffer, input1->recordBuffer, record1Size);
+            memcpy((int8_t*)op->recordBuffer + record1Size, input2->recordBuffer, getRecordSizeFromSchema(schema2));
+            return 1;
+        }
+        // Else keep advancing inputs until a match is found
+    }
+
+    return 0;
+}
+
+void closeKeyJoin(embedDBOperator* op) {
+    struct keyJoinInfo* state = op->state;
+    embedDBOperator* input1 = op->input;
+    embedDBOperator* input2 = state->input2;
+    input1->close(input1);
+    input2->close(input2);
+
+    embedDBFreeSchema(&op->schema);
+    embedDBFree(op->state);
+    op->state = NULL;
+    embedDBFree(op->recordBuffer);
+    op->recordBuffer = NULL;
+}
+
+/**
+ * @brief	Creates an operator for perfoming an equijoin on the keys (sorted and distinct) of two tables
+ */
+embedDBOperator* createKeyJoinOperator(embedDBOperator* input1, embedDBOperator* input2) {
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
+    if (op == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating join operator\n");
+#endif
+        return NULL;
+    }
+
+    struct keyJoinInfo* state = embedDBMalloc(sizeof(struct keyJoinInfo));
+    if (state == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating join operator\n");
+#endif
+        return NULL;
+    }
+    state->input2 = input2;
+
+    op->input = input1;
+    op->state = state;
+    op->recordBuffer = NULL;
+    op->schema = NULL;
+    op->init = initKeyJoin;
+    op->next = nextKeyJoin;
+    op->close = closeKeyJoin;
+
+    return op;
+}
+
+/**
+ * @brief	A private struct to hold the state of the index nested-loop join operator
+ */
+struct indexJoinInfo {
+    uint8_t outerColNum;        // Column of the outer input that holds a key of the inner table
+    embedDBState* innerState;   // Table that is probed for each outer record
+    embedDBSchema* innerSchema; // Schema of the inner table
+    uint16_t outerColPos;       // Byte offset of the join column in an outer record
+    uint16_t outerRecordSize;   // Size of an outer record
+    int8_t isValid;             // Was the operator initialized without errors
+};
+
+void initIndexJoin(embedDBOperator* op) {
+    struct indexJoinInfo* state = op->state;
+    embedDBOperator* outer = op->input;
+    state->isValid = 0;
+
+    // Init input
+    outer->init(outer);
+
+    embedDBSchema* outerSchema = outer->schema;
+    if (state->outerColNum >= outerSchema->numCols || abs(outerSchema->columnSizes[state->outerColNum]) != state->innerState->keySize ||
+        getRecordSizeFromSchema(state->innerSchema) != state->innerState->keySize + state->innerState->dataSize) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: The join column must be the same size as the key of the inner table, and the inner schema must match the inner table\n");
+#endif
+        return;
+    }
+    state->outerColPos = getColOffsetFromSchema(outerSchema, state->outerColNum);
+    state->outerRecordSize = getRecordSizeFromSchema(outerSchema);
+
+    // Setup schema
+    if (op->schema == NULL) {
+        op->schema = createJoinSchema(outerSchema, state->innerSchema);
+        if (op->schema == NULL) {
+            return;
+        }
+    }
+
+    if (op->recordBuffer == NULL) {
+        op->recordBuffer = createBufferFromSchema(op->schema);
+        if (op->recordBuffer == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing join operator\n");
+#endif
+            return;
+        }
+    }
+    state->isValid = 1;
+}
+
+int8_t nextIndexJoin(embedDBOperator* op) {
+    struct indexJoinInfo* state = op->state;
+    embedDBOperator* outer = op->input;
+    if (!state->isValid) {
+        return 0;
+    }
+
+    int8_t* innerRecord = (int8_t*)op->recordBuffer + state->outerRecordSize;
+    while (outer->next(outer)) {
+        // Look up the key with the index of the inner table instead of scanning it
+        // The outer record is copied first since the lookup can replace the page it is in
+        memcpy(op->recordBuffer, outer->recordBuffer, state->outerRecordSize);
+        memcpy(innerRecord, (int8_t*)op->recordBuffer + state->outerColPos, state->innerState->keySize);
+        if (embedDBGet(state->innerState, innerRecord, innerRecord + state->innerState->keySize) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void closeIndexJoin(embedDBOperator* op) {
+    op->input->close(op->input);
+    embedDBFreeSchema(&op->schema);
+    embedDBFree(op->state);
+    op->state = NULL;
+    embedDBFree(op->recordBuffer);
+    op->recordBuffer = NULL;
+}
+
+/**
+ * @brief	Creates an operator that joins each record of its input with the record of another table whose key equals one of its columns.
+ * 			Each key is looked up with embedDBGet, so the pages read are proportional to the number of input records, not to the size of the table.
+ * @param	outer		The operator that this operator can pull records from
+ * @param	outerColNum	Zero-indexed column of @c outer that holds a key of the inner table. Must be the same size as the key
+ * @param	innerState	The state of the table to look keys up in
+ * @param	innerSchema	The schema of the table to look keys up in
+ */
+embedDBOperator* createIndexJoinOperator(embedDBOperator* outer, uint8_t outerColNum, embedDBState* innerState, embedDBSchema* innerSchema) {
+    if (innerState == NULL || innerSchema == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: An index join needs the state and schema of the inner table\n");
+#endif
+        return NULL;
+    }
+
+    struct indexJoinInfo* state = embedDBMalloc(sizeof(struct indexJoinInfo));
+    if (state == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating join operator\n");
+#endif
+        return NULL;
+    }
+    state->outerColNum = outerColNum;
+    state->innerState = innerState;
+    state->innerSchema = innerSchema;
+    state->isValid = 0;
+
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
+    if (op == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating join operator\n");
+#endif
+        embedDBFree(state);
+        return NULL;
+    }
+
+    op->input = outer;
+    op->state = state;
+    op->recordBuffer = NULL;
+    op->schema = NULL;
+    op->init = initIndexJoin;
+    op->next = nextIndexJoin;
+    op->close = closeIndexJoin;
+
+    return op;
+}
+
+/**
+ * @brief	A private struct to hold the state of the hash join operator
+ */
+struct hashJoinInfo {
+    embedDBOperator* input2;  // Build input, which is read into the hash table
+    uint8_t colNum1;          // Join column of the probe input
+    uint8_t colNum2;          // Join column of the build input
+    int8_t* memory;           // Caller-allocated space for the hash table
+    uint32_t memorySize;      // Size of memory in bytes
+    uint16_t colPos1;         // Byte offset of the join column in a probe record
+    uint16_t colPos2;         // Byte offset of the join column in a build record
+    uint8_t colSize;          // Size of the join columns
+    uint16_t recordSize1;     // Size of a probe record
+    uint16_t recordSize2;     // Size of a build record
+    uint16_t entrySize;       // Size of a hash table entry: a used flag and a build record
+    uint32_t numSlots;        // Number of entries of the hash table
+    uint32_t nextSlot;        // Next entry to compare with the current probe record
+    int8_t isBuilt;           // Has the build input been read into the table
+    int8_t hasProbeRecord;    // Is a probe record being matched with the table
+    int8_t isValid;           // Was the operator initialized without errors
+};
+
+void initHashJoin(embedDBOperator* op) {
+    struct hashJoinInfo* state = op->state;
+    embedDBOperator* input1 = op->input;
+    embedDBOperator* input2 = state->input2;
+    state->isValid = 0;
+
+    // Init inputs
+    input1->init(input1);
+    input2->init(input2);
+
+    embedDBSchema* schema1 = input1->schema;
+    embedDBSchema* schema2 = input2->schema;
+    if (state->colNum1 >= schema1->numCols || state->colNum2 >= schema2->numCols || schema1->columnSizes[state->colNum1] != schema2->columnSizes[state->colNum2]) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: The join columns of a hash join must exist and be the same size\n");
+#endif
+        return;
+    }
+    state->colPos1 = getColOffsetFromSchema(schema1, state->colNum1);
+    state->colPos2 = getColOffsetFromSchema(schema2, state->colNum2);
+    state->colSize = abs(schema1->columnSizes[state->colNum1]);
+    state->recordSize1 = getRecordSizeFromSchema(schema1);
+    state->recordSize2 = getRecordSizeFromSchema(schema2);
+    state->entrySize = 1 + state->recordSize2;
+    state->numSlots = state->memorySize / state->entrySize;
+    state->isBuilt = 0;
+    state->hasProbeRecord = 0;
+    if (state->numSlots < 2) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Hash join memory is too small to hold a record\n");
+#endif
+        return;
+    }
+
+    // Setup schema
+    if (op->schema == NULL) {
+        op->schema = createJoinSchema(schema1, schema2);
+        if (op->schema == NULL) {
+            return;
+        }
+    }
+
+    if (op->recordBuffer == NULL) {
+        op->recordBuffer = createBufferFromSchema(op->schema);
+        if (op->recordBuffer == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing join operator\n");
+#endif
+            return;
+        }
+    }
+    state->isValid = 1;
+}
+
+/**
+ * @brief	Reads the whole build input into the hash table
+ * @return	1 if success, 0 if the build input does not fit in memory
+ */
+int8_t buildHashJoinTable(embedDBOperator* op) {
+    struct hashJoinInfo* state = op->state;
+    embedDBOperator* input2 = state->input2;
+
+    memset(state->memory, 0, state->numSlots * state->entrySize);
+
+    // Keep a quarter of the slots empty so probes stop quickly
+    uint32_t maxRecords = state->numSlots * 3 / 4;
+    uint32_t numRecords = 0;
+    while (input2->next(input2)) {
+        if (numRecords == maxRecords) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Build input of hash join does not fit in memory\n");
+#endif
+            return 0;
+        }
+        uint32_t slot = hashColumnValue((int8_t*)input2->recordBuffer + state->colPos2, state->colSize) % state->numSlots;
+        int8_t* entry = state->memory + slot * state->entrySize;
+        while (entry[0]) {
+            slot = slot + 1 == state->numSlots ? 0 : slot + 1;
+            entry = state->memory + slot * state->entrySize;
+        }
+        entry[0] = 1;
+        memcpy(entry + 1, input2->recordBuffer, state->recordSize2);
+        numRecords++;
+    }
+    return 1;
+}
+
+int8_t nextHashJoin(embedDBOperator* op) {
+    struct hashJoinInfo* state = op->state;
+    embedDBOperator* input1 = op->input;
+    if (!state->isValid) {
+        return 0;
+    }
+    if (!state->isBuilt) {
+        if (!buildHashJoinTable(op)) {
+            state->isValid = 0;
+            return 0;
+        }
+        state->isBuilt = 1;
+    }
+
+    while (1) {
+        if (!state->hasProbeRecord) {
+            if (!input1->next(input1)) {
+                return 0;
+            }
+            state->nextSlot = hashColumnValue((int8_t*)input1->recordBuffer + state->colPos1, state->colSize) % state->numSlots;
+            state->hasProbeRecord = 1;
+        }
+
+        // Every build record with the same value is in the run of used entries starting at the hash slot
+        const int8_t* value = (int8_t*)input1->recordBuffer + state->colPos1;
+        int8_t* entry = state->memory + state->nextSlot * state->entrySize;
+        while (entry[0]) {
+            state->nextSlot = state->nextSlot + 1 == state->numSlots ? 0 : state->nextSlot + 1;
+            if (memcmp(entry + 1 + state->colPos2, value, state->colSize) == 0) {
+                memcpy(op->recordBuffer, input1->recordBuffer, state->recordSize1);
+                memcpy((int8_t*)op->recordBuffer + state->recordSize1, entry + 1, state->recordSize2);
+                return 1;
+            }
+            entry = state->memory + state->nextSlot * state->entrySize;
+        }
+        state->hasProbeRecord = 0;
+    }
+}
+
+void closeHashJoin(embedDBOperator* op) {
+    struct hashJoinInfo* state = op->state;
+    op->input->close(op->input);
+    state->input2->close(state->input2);
+
+    embedDBFreeSchema(&op->schema);
+    embedDBFree(op->state);
+    op->state = NULL;
+    embedDBFree(op->recordBuffer);
+    op->recordBuffer = NULL;
+}
+
+/**
+ * @brief	Creates an operator that joins two inputs on columns with equal values. The second input is read into a hash table, then each record of the first input is matched with it.
+ * 			Outputs the columns of @c input1 followed by the columns of @c input2, once for every pair of matching records.
+ * @param	input1		The probe input, which can be any size
+ * @param	input2		The build input, which must fit in @c memory. Like the key join, it is not freed by embedDBFreeOperatorRecursive
+ * @param	colNum1		Zero-indexed join column of @c input1
+ * @param	colNum2		Zero-indexed join column of @c input2. Must be the same size as @c colNum1
+ * @param	memory		Caller-allocated space for the hash table. Must stay valid until the operator is closed
+ * @param	memorySize	Size of @c memory in bytes. Holds memorySize / (1 + record size) * 3 / 4 build records
+ */
+embedDBOperator* createHashJoinOperator(embedDBOperator* input1, embedDBOperator* input2, uint8_t colNum1, uint8_t colNum2, void* memory, uint32_t memorySize) {
+    if (input2 == NULL || memory == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: A hash join needs a build input and memory for its hash table\n");
+#endif
+        return NULL;
+    }
+
+    struct hashJoinInfo* state = embedDBMalloc(sizeof(struct hashJoinInfo));
+    if (state == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating join operator\n");
+#endif
+        return NULL;
+    }
+    state->input2 = input2;
+    state->colNum1 = colNum1;
+    state->colNum2 = colNum2;
+    state->memory = memory;
+    state->memorySize = memorySize;
+    state->isValid = 0;
+
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
+    if (op == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating join operator\n");
+#endif
+        embedDBFree(state);
+        return NULL;
+    }
+
+    op->input = input1;
+    op->state = state;
+    op->recordBuffer = NULL;
+    op->schema = NULL;
+    op->init = initHashJoin;
+    op->next = nextHashJoin;
+    op->close = closeHashJoin;
+
+    return op;
+}
+
+/**
+ * @brief	A private struct to hold the state of the as-of join operator
+ */
+struct asOfJoinInfo {
+    embedDBOperator* input2;  // Right input, whose records are matched to the left input
+    void* tolerance;          // Largest allowed distance between the keys, NULL if unlimited
+    uint64_t toleranceValue;  // Value of tolerance, set by init
+    uint8_t keySize;          // Size of the key columns
+    uint16_t recordSize1;     // Size of a left record
+    uint16_t recordSize2;     // Size of a right record
+    void* candidate;          // Latest right record with a key <= the current left key
+    int8_t hasCandidate;      // Does candidate hold a record
+    int8_t hasLookahead;      // Does the right input's recordBuffer hold a record that is not yet in candidate
+    int8_t isStarted;         // Has the first right record been read
+    int8_t isValid;           // Did init succeed
+};
+
+uint64_t getAsOfJoinKey(struct asOfJoinInfo* state, void* record) {
+    uint64_t key = 0;
+    memcpy(&key, record, state->keySize);
+    return key;
+}
+
+void initAsOfJoin(embedDBOperator* op) {
+    struct asOfJoinInfo* state = op->state;
+    embedDBOperator* input1 = op->input;
+    embedDBOperator* input2 = state->input2;
+    state->isValid = 0;
+
+    // Init inputs
+    input1->init(input1);
+    input2->init(input2);
+    copySharedScanRecords(input1, input2);
+
+    embedDBSchema* schema1 = input1->schema;
+    embedDBSchema* schema2 = input2->schema;
+    if (schema1->columnSizes[0] != schema2->columnSizes[0] || schema1->columnSizes[0] < 0 || schema1->columnSizes[0] > 8) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: The first columns of the two tables of an as-of join must be unsigned keys of the same size\n");
+#endif
+        return;
+    }
+    state->keySize = schema1->columnSizes[0];
+    state->recordSize1 = getRecordSizeFromSchema(schema1);
+    state->recordSize2 = getRecordSizeFromSchema(schema2);
+    state->toleranceValue = 0;
+    if (state->tolerance != NULL) {
+        memcpy(&state->toleranceValue, state->tolerance, state->keySize);
+    }
+    state->hasCandidate = 0;
+    state->hasLookahead = 0;
+    state->isStarted = 0;
+
+    // Setup schema
+    if (op->schema == NULL) {
+        op->schema = createJoinSchema(schema1, schema2);
+        if (op->schema == NULL) {
+            return;
+        }
+    }
+
+    if (op->recordBuffer == NULL) {
+        op->recordBuffer = createBufferFromSchema(op->schema);
+        if (op->recordBuffer == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing join operator\n");
+#endif
+            return;
+        }
+    }
+
+    if (state->candidate == NULL) {
+        state->candidate = embedDBMalloc(state->recordSize2);
+        if (state->candidate == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing join operator\n");
+#endif
+            return;
+        }
+    }
+    state->isValid = 1;
+}
+
+int8_t nextAsOfJoin(embedDBOperator* op) {
+    struct asOfJoinInfo* state = op->state;
+    embedDBOperator* input1 = op->input;
+    embedDBOperator* input2 = state->input2;
+    if (!state->isValid)
+        return 0;
+
+    if (!state->isStarted) {
+        state->isStarted = 1;
+        state->hasLookahead = input2->next(input2);
+    }
+
+    int8_t hasLeftRecord = 0;
+    while (1) {
+        if (!hasLeftRecord && !input1->next(input1))
+            return 0;
+        hasLeftRecord = 0;
+        uint64_t leftKey = getAsOfJoinKey(state, input1->recordBuffer);
+
+        // Right records older than the tolerance can't match this or any later left record, so seek past them
+        if (state->tolerance != NULL && state->hasLookahead && leftKey >= state->toleranceValue &&
+            getAsOfJoinKey(state, input2->recordBuffer) < leftKey - state->toleranceValue) {
+            uint64_t oldestKey = leftKey - state->toleranceValue;
+            state->hasCandidate = 0;
+            state->hasLookahead = advanceKeyJoinInput(input2, &oldestKey, state->keySize);
+        }
+
+        // Keep the last right record with a key <= the left key
+        while (state->hasLookahead && getAsOfJoinKey(state, input2->recordBuffer) <= leftKey) {
+            memcpy(state->candidate, input2->recordBuffer, state->recordSize2);
+            state->hasCandidate = 1;
+            state->hasLookahead = input2->next(input2);
+        }
+
+        if (state->hasCandidate && (state->tolerance == NULL || leftKey - getAsOfJoinKey(state, state->candidate) <= state->toleranceValue)) {
+            memcpy(op->recordBuffer, input1->recordBuffer, state->recordSize1);
+            memcpy((int8_t*)op->recordBuffer + state->recordSize1, state->candidate, state->recordSize2);
+            return 1;
+        }
+
+        // Nothing matches until the left input reaches the next right record, so seek the left input to it
+        if (!state->hasLookahead || !advanceKeyJoinInput(input1, input2->recordBuffer, state->keySize))
+            return 0;
+        hasLeftRecord = 1;
+    }
+}
+
+void closeAsOfJoin(embedDBOperator* op) {
+    struct asOfJoinInfo* state = op->state;
+    op->input->close(op->input);
+    state->input2->close(state->input2);
+
+    embedDBFreeSchema(&op->schema);
+    embedDBFree(state->candidate);
+    embedDBFree(op->state);
+    op->state = NULL;
+    embedDBFree(op->recordBuffer);
+    op->recordBuffer = NULL;
+}
+
+/**
+ * @brief	Creates an operator that joins each record of the left input with the latest record of the right input whose key is at or before its key.
+ * 			Both inputs must be sorted by an unsigned key in their first column. Outputs the columns of @c input1 followed by the columns of @c input2.
+ * 			Left records without a right record within the tolerance are skipped.
+ * @param	input1		The left input
+ * @param	input2		The right input. Like the key join, it is not freed by embedDBFreeOperatorRecursive
+ * @param	tolerance	Largest allowed difference between the left and right keys, the same size as the keys. NULL to match any earlier right record. Must stay valid until the operator is initialized
+ */
+embedDBOperator* createAsOfJoinOperator(embedDBOperator* input1, embedDBOperator* input2, void* tolerance) {
+    if (input1 == NULL || input2 == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: An as-of join needs two inputs\n");
+#endif
+        return NULL;
+    }
+
+    struct asOfJoinInfo* state = embedDBMalloc(sizeof(struct asOfJoinInfo));
+    if (state == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating join operator\n");
+#endif
+        return NULL;
+    }
+    state->input2 = input2;
+    state->tolerance = tolerance;
+    state->candidate = NULL;
+    state->isValid = 0;
+
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
+    if (op == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while creating join operator\n");
+#endif
+        embedDBFree(state);
+        return NULL;
+    }
+
+    op->input = input1;
+    op->state = state;
+    op->recordBuffer = NULL;
+    op->schema = NULL;
+    op->init = initAsOfJoin;
+    op->next = nextAsOfJoin;
+    op->close = closeAsOfJoin;
+
+    return op;
+}
+
+/**
+ * @brief	A private struct to hold the state of the limit operator
+ */
+struct limitInfo {
+    uint32_t limit;  // Most records to output
+    uint32_t count;  // Number of records output so far
+};
+
+void initLimit(embedDBOperator* op) {
+    if (op->input == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Limit operator needs an input operator\n");
+#endif
+        return;
+    }
+
+    // Init input
+    op->input->init(op->input);
+
+    struct limitInfo* state = op->state;
+    state->count = 0;
+
+    // Limiting does not change the schema
+    if (op->schema == NULL) {
+        op->schema = copySchema(op->input->schema);
+        if (op->schema == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing limit operator\n");
+#endif
+            return;
+        }
+    }
+    if (op->recordBuffer == NULL) {
+        op->recordBuffer = createBufferFromSchema(op->schema);
+        if (op->recordBuffer == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing limit operator\n");
+#endif
+            return;
+        }
+    }
+}
+
+int8_t nextLimit(embedDBOperator* op) {
+    struct limitInfo* state = op->state;
 
+    // Don't pull any more records from the input once the limit is reached
+    if (state->count >= state->limit || op->recordBuffer == NULL || !op->input->next(op->input))
+        return 0;
+
+    memcpy(op->recordBuffer, op->input->recordBuffer, getRecordSizeFromSchema(op->schema));
+    state->count++;
     return 1;
 }
 
-void closeAggregate(embedDBOperator* op) {
+void closeLimit(embedDBOperator* op) {
     op->input->close(op->input);
-    op->input = NULL;
+
     embedDBFreeSchema(&op->schema);
-    free(((struct aggregateInfo*)op->state)->lastRecordBuffer);
-    free(op->state);
+    embedDBFree(op->state);
     op->state = NULL;
-    free(op->recordBuffer);
+    embedDBFree(op->recordBuffer);
     op->recordBuffer = NULL;
 }
 
 /**
- * @brief	Creates an operator that will find groups and preform aggregate functions over each group.
- * @param	input			The operator that this operator can pull records from
- * @param	groupfunc		A function that returns whether or not the @c record is part of the same group as the @c lastRecord. Assumes that records in groups are always next to each other and sorted when read in (i.e. Groups need to be 1122333, not 13213213)
- * @param	functions		An array of aggregate functions, each of which will be updated with each record read from the iterator
- * @param	functionsLength			The number of embedDBAggregateFuncs in @c functions
+ * @brief	Creates an operator that outputs the first records of its input and then stops reading it
+ * @param	input	The operator that this operator can pull records from
+ * @param	limit	Most records to output
  */
-embedDBOperator* createAggregateOperator(embedDBOperator* input, int8_t (*groupfunc)(const void* lastRecord, const void* record), embedDBAggregateFunc* functions, uint32_t functionsLength) {
-    struct aggregateInfo* state = malloc(sizeof(struct aggregateInfo));
+embedDBOperator* createLimitOperator(embedDBOperator* input, uint32_t limit) {
+    struct limitInfo* state = embedDBMalloc(sizeof(struct limitInfo));
     if (state == NULL) {
 #ifdef PRINT_ERRORS
-        printf("ERROR: Failed to malloc while creating aggregate operator\n");
+        printf("ERROR: Failed to malloc while creating limit operator\n");
 #endif
         return NULL;
     }
+    state->limit = limit;
+    state->count = 0;
 
-    state->groupfunc = groupfunc;
-    state->functions = functions;
-    state->functionsLength = functionsLength;
-    state->lastRecordBuffer = NULL;
-
-    embedDBOperator* op = malloc(sizeof(embedDBOperator));
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
     if (op == NULL) {
 #ifdef PRINT_ERRORS
-        printf("ERROR: Failed to malloc while creating aggregate operator\n");
+        printf("ERROR: Failed to malloc while creating limit operator\n");
 #endif
+        embedDBFree(state);
         return NULL;
     }
 
-    op->state = state;
     op->input = input;
-    op->schema = NULL;
+    op->state = state;
     op->recordBuffer = NULL;
-    op->init = initAggregate;
-    op->next = nextAggregate;
-    op->close = closeAggregate;
+    op->schema = NULL;
+    op->init = initLimit;
+    op->next = nextLimit;
+    op->close = closeLimit;
 
     return op;
 }
 
-struct keyJoinInfo {
-    embedDBOperator* input2;
-    int8_t firstCall;
+/**
+ * @brief	A private struct to hold the state of the top-k operator
+ */
+struct topKInfo {
+    struct sortInfo sort;        // Column, direction and record layout used by the sort operator's heap functions
+    uint32_t k;                  // Most records to output
+    int8_t* records;             // Heap of the first k records in output order seen so far, sorted once the input is read
+    uint32_t numRecords;         // Number of records in records
+    uint32_t nextRecord;         // Next record to output
+    int8_t isOrdered;            // Does the input return records in output order, so its first k records are the result
+    embedDBState* orderedTable;  // Table of the scan whose direction was changed to read in output order, or NULL
+    embedDBIterator* orderedIt;  // Iterator of that scan, which belongs to the caller
+    int8_t wasReverse;           // Direction of that iterator before it was changed
+    int8_t isSorted;             // Has the input been read into the heap
+    int8_t isValid;              // Was the operator initialized without errors
 };
 
-void initKeyJoin(embedDBOperator* op) {
-    struct keyJoinInfo* state = op->state;
-    embedDBOperator* input1 = op->input;
-    embedDBOperator* input2 = state->input2;
+/**
+ * @brief	Moves record @c i up the heap until it is before its parent
+ */
+void sortSiftUp(struct sortInfo* state, int8_t* records, uint32_t i, void* temp) {
+    uint16_t recordSize = state->recordSize;
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (compareSortRecords(state, records + parent * recordSize, records + i * recordSize) >= 0) {
+            return;
+        }
+        memcpy(temp, records + i * recordSize, recordSize);
+        memcpy(records + i * recordSize, records + parent * recordSize, recordSize);
+        memcpy(records + parent * recordSize, temp, recordSize);
+        i = parent;
+    }
+}
 
-    // Init inputs
-    input1->init(input1);
-    input2->init(input2);
+/**
+ * @brief	If the top-k is on the key of a table scan (possibly below selections), makes the scan read in the output
+ * 			order so the first k records it returns are the result. Descending order reads backwards from the newest page.
+ * @return	1 if the input now returns records in output order, 0 otherwise
+ */
+int8_t orderTopKScan(embedDBOperator* op) {
+    struct topKInfo* state = op->state;
+    embedDBOperator* scan = op->input->next == nextSelection ? getPushDownScan(op->input) : op->input;
+    if (state->sort.colNum != 0 || scan == NULL || scan->next != nextTableScan)
+        return 0;
 
-    embedDBSchema* schema1 = input1->schema;
-    embedDBSchema* schema2 = input2->schema;
+    embedDBState* embedDBstate = (embedDBState*)(((void**)scan->state)[0]);
+    embedDBIterator* it = (embedDBIterator*)(((void**)scan->state)[1]);
+    int8_t isReverse = state->sort.direction == EMBEDDB_SORT_DESC;
+    if (it->isReverse != isReverse) {
+        state->orderedTable = embedDBstate;
+        state->orderedIt = it;
+        state->wasReverse = it->isReverse;
+        it->isReverse = isReverse;
+        embedDBIteratorUpdateBounds(embedDBstate, it);
+    }
+    return 1;
+}
 
-    // Check that join is compatible
-    if (schema1->columnSizes[0] != schema2->columnSizes[0] || schema1->columnSizes[0] < 0 || schema2->columnSizes[0] < 0) {
+/**
+ * @brief	Gives the caller's iterator back the direction it had before orderTopKScan changed it
+ */
+void restoreTopKScan(struct topKInfo* state) {
+    if (state->orderedIt == NULL)
+        return;
+    state->orderedIt->isReverse = state->wasReverse;
+    embedDBIteratorUpdateBounds(state->orderedTable, state->orderedIt);
+    state->orderedIt = NULL;
+}
+
+void initTopK(embedDBOperator* op) {
+    if (op->input == NULL) {
 #ifdef PRINT_ERRORS
-        printf("ERROR: The first columns of the two tables must be the key and must be the same size. Make sure you haven't projected them out.\n");
+        printf("ERROR: Top-k operator needs an input operator\n");
 #endif
         return;
     }
 
-    // Setup schema
-    if (op->schema == NULL) {
-        op->schema = malloc(sizeof(embedDBSchema));
-        if (op->schema == NULL) {
+    // Init input
+    op->input->init(op->input);
+
+    struct topKInfo* state = op->state;
+    embedDBSchema* inputSchema = op->input->schema;
+    if (state->sort.colNum >= inputSchema->numCols) {
 #ifdef PRINT_ERRORS
-            printf("ERROR: Failed to malloc while initializing join operator\n");
+        printf("ERROR: Top-k column is not in the input schema\n");
+#endif
+        return;
+    }
+    state->sort.colPos = getColOffsetFromSchema(inputSchema, state->sort.colNum);
+    state->sort.colSize = inputSchema->columnSizes[state->sort.colNum];
+    state->sort.colType = inputSchema->columnTypes[state->sort.colNum];
+    state->sort.recordSize = getRecordSizeFromSchema(inputSchema);
+    state->numRecords = 0;
+    state->nextRecord = 0;
+    state->isSorted = 0;
+    state->isOrdered = orderTopKScan(op);
+
+    if (!state->isOrdered && state->records == NULL && state->k > 0) {
+        state->records = embedDBMalloc((size_t)state->k * state->sort.recordSize);
+        if (state->records == NULL) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Failed to malloc while initializing top-k operator\n");
 #endif
             return;
         }
-        op->schema->numCols = schema1->numCols + schema2->numCols;
-        op->schema->columnSizes = malloc(op->schema->numCols * sizeof(int8_t));
-        op->schema->columnTypes = malloc(op->schema->numCols * sizeof(ColumnType));
-        if (op->schema->columnSizes == NULL || op->schema->columnTypes == NULL) {
+    }
+
+    // Top-k does not change the schema
+    if (op->schema == NULL) {
+        op->schema = copySchema(inputSchema);
+        if (op->schema == NULL) {
 #ifdef PRINT_ERRORS
-            printf("ERROR: Failed to malloc while initializing join operator\n");
+            printf("ERROR: Failed to malloc while initializing top-k operator\n");
 #endif
             return;
         }
-        memcpy(op->schema->columnSizes, schema1->columnSizes, schema1->numCols);
-        memcpy(op->schema->columnSizes + schema1->numCols, schema2->columnSizes, schema2->numCols);
-        memcpy(op->schema->columnTypes, schema1->columnTypes, schema1->numCols);
-        memcpy(op->schema->columnTypes + schema1->numCols, schema2->columnTypes, schema2->numCols);
     }
-
-    // Allocate recordBuffer
-    op->recordBuffer = malloc(getRecordSizeFromSchema(op->schema));
     if (op->recordBuffer == NULL) {
+        op->recordBuffer = createBufferFromSchema(op->schema);
+        if (op->recordBuffer == NULL) {
 #ifdef PRINT_ERRORS
-        printf("ERROR: Failed to malloc while initializing join operator\n");
+            printf("ERROR: Failed to malloc while initializing top-k operator\n");
 #endif
-        return;
+            return;
+        }
     }
-
-    state->firstCall = 1;
+    state->isValid = 1;
 }
 
-int8_t nextKeyJoin(embedDBOperator* op) {
-    struct keyJoinInfo* state = op->state;
-    embedDBOperator* input1 = op->input;
-    embedDBOperator* input2 = state->input2;
-    embedDBSchema* schema1 = input1->schema;
-    embedDBSchema* schema2 = input2->schema;
-
-    // We've already used this match
-    void* record1 = input1->recordBuffer;
-    void* record2 = input2->recordBuffer;
-
-    int8_t colSize = abs(schema1->columnSizes[0]);
-
-    if (state->firstCall) {
-        state->firstCall = 0;
+/**
+ * @brief	Reads the whole input, keeping the first k records in output order in a heap whose root is the last of them
+ */
+void readTopKInput(embedDBOperator* op) {
+    struct topKInfo* state = op->state;
+    embedDBOperator* input = op->input;
+    uint16_t recordSize = state->sort.recordSize;
 
-        if (!input1->next(input1) || !input2->next(input2)) {
-            // If this case happens, you goofed, but I'll handle it anyway
-            return 0;
+    while (input->next(input)) {
+        if (state->numRecords < state->k) {
+            memcpy(state->records + state->numRecords * recordSize, input->recordBuffer, recordSize);
+            sortSiftUp(&state->sort, state->records, state->numRecords, op->recordBuffer);
+            state->numRecords++;
+        } else if (compareSortRecords(&state->sort, input->recordBuffer, state->records) < 0) {
+            // Replace the last of the kept records
+            memcpy(state->records, input->recordBuffer, recordSize);
+            sortSiftDown(&state->sort, state->records, 0, state->numRecords, op->recordBuffer);
         }
-        goto check;
     }
+    sortRecords(&state->sort, state->records, state->numRecords, op->recordBuffer);
+    state->isSorted = 1;
+}
 
-    while (1) {
-        // Advance the input with the smaller value
-        int8_t comp = compareUnsignedNumbers(record1, record2, colSize);
-        if (comp == 0) {
-            // Move both forward because if they match at this point, they've already been matched
-            if (!input1->next(input1) || !input2->next(input2)) {
-                return 0;
-            }
-        } else if (comp < 0) {
-            // Move record 1 forward
-            if (!input1->next(input1)) {
-                // We are out of records on one side. Given the assumption that the inputs are sorted, there are no more possible joins
-                return 0;
-            }
-        } else {
-            // Move record 2 forward
-            if (!input2->next(input2)) {
-                // We are out of records on one side. Given the assumption that the inputs are sorted, there are no more possible joins
-                return 0;
-            }
-        }
+int8_t nextTopK(embedDBOperator* op) {
+    struct topKInfo* state = op->state;
+    if (!state->isValid || state->nextRecord >= state->k)
+        return 0;
 
-    check:
-        // See if these records join
-        if (compareUnsignedNumbers(record1, record2, colSize) == 0) {
-            // Copy both records into the output
-            uint16_t record1Size = getRecordSizeFromSchema(schema1);
-            memcpy(op->recordBuffer, input1->recordBuffer, record1Size);
-            memcpy((int8_t*)op->recordBuffer + record1Size, input2->recordBuffer, getRecordSizeFromSchema(schema2));
-            return 1;
-        }
-        // Else keep advancing inputs until a match is found
+    if (state->isOrdered) {
+        if (!op->input->next(op->input))
+            return 0;
+        memcpy(op->recordBuffer, op->input->recordBuffer, state->sort.recordSize);
+        state->nextRecord++;
+        return 1;
     }
 
-    return 0;
+    if (!state->isSorted) {
+        readTopKInput(op);
+    }
+    if (state->nextRecord >= state->numRecords)
+        return 0;
+    memcpy(op->recordBuffer, state->records + state->nextRecord * state->sort.recordSize, state->sort.recordSize);
+    state->nextRecord++;
+    return 1;
 }
 
-void closeKeyJoin(embedDBOperator* op) {
-    struct keyJoinInfo* state = op->state;
-    embedDBOperator* input1 = op->input;
-    embedDBOperator* input2 = state->input2;
-    input1->close(input1);
-    input2->close(input2);
+void closeTopK(embedDBOperator* op) {
+    struct topKInfo* state = op->state;
+    op->input->close(op->input);
+    restoreTopKScan(state);
 
     embedDBFreeSchema(&op->schema);
-    free(op->state);
+    embedDBFree(state->records);
+    embedDBFree(op->state);
     op->state = NULL;
-    free(op->recordBuffer);
+    embedDBFree(op->recordBuffer);
     op->recordBuffer = NULL;
 }
 
 /**
- * @brief	Creates an operator for perfoming an equijoin on the keys (sorted and distinct) of two tables
+ * @brief	Creates an operator that outputs the first k records of its input ordered by a column, keeping only k records in memory.
+ * 			On the key column of a table scan the scan is read in the output order instead, backwards from the newest page for descending order.
+ * @param	input		The operator that this operator can pull records from
+ * @param	colNum		Zero-indexed column to order by
+ * @param	k			Most records to output
+ * @param	direction	EMBEDDB_SORT_ASC for the smallest values first or EMBEDDB_SORT_DESC for the largest values first
  */
-embedDBOperator* createKeyJoinOperator(embedDBOperator* input1, embedDBOperator* input2) {
-    embedDBOperator* op = malloc(sizeof(embedDBOperator));
-    if (op == NULL) {
+embedDBOperator* createTopKOperator(embedDBOperator* input, uint8_t colNum, uint32_t k, int8_t direction) {
+    struct topKInfo* state = embedDBMalloc(sizeof(struct topKInfo));
+    if (state == NULL) {
 #ifdef PRINT_ERRORS
-        printf("ERROR: Failed to malloc while creating join operator\n");
+        printf("ERROR: Failed to malloc while creating top-k operator\n");
 #endif
         return NULL;
     }
+    state->sort.colNum = colNum;
+    state->sort.direction = direction;
+    state->k = k;
+    state->records = NULL;
+    state->orderedIt = NULL;
+    state->isValid = 0;
 
-    struct keyJoinInfo* state = malloc(sizeof(struct keyJoinInfo));
-    if (state == NULL) {
+    embedDBOperator* op = embedDBMalloc(sizeof(embedDBOperator));
+    if (op == NULL) {
 #ifdef PRINT_ERRORS
-        printf("ERROR: Failed to malloc while creating join operator\n");
+        printf("ERROR: Failed to malloc while creating top-k operator\n");
 #endif
+        embedDBFree(state);
         return NULL;
     }
-    state->input2 = input2;
 
-    op->input = input1;
+    op->input = input;
     op->state = state;
     op->recordBuffer = NULL;
     op->schema = NULL;
-    op->init = initKeyJoin;
-    op->next = nextKeyJoin;
-    op->close = closeKeyJoin;
+    op->init = initTopK;
+    op->next = nextTopK;
+    op->close = closeTopK;
 
     return op;
 }
@@ -839,11 +3397,11 @@ void countCompute(embedDBAggregateFunc* aggFunc, embedDBSchema* outputSchema, vo
  * @brief	Creates an aggregate function to count the number of records in a group. To be used in combination with an embedDBOperator produced by createAggregateOperator
  */
 embedDBAggregateFunc* createCountAggregate() {
-    embedDBAggregateFunc* aggFunc = malloc(sizeof(embedDBAggregateFunc));
+    embedDBAggregateFunc* aggFunc = embedDBMalloc(sizeof(embedDBAggregateFunc));
     aggFunc->reset = countReset;
     aggFunc->add = countAdd;
     aggFunc->compute = countCompute;
-    aggFunc->state = malloc(sizeof(uint32_t));
+    aggFunc->state = embedDBMalloc(sizeof(uint32_t));
     aggFunc->colSize = 4;
     return aggFunc;
 }
@@ -880,6 +3438,35 @@ void sumAdd(embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, const voi
     }
 }
 
+void sumAddBatch(embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, embedDBBatch* batch, uint16_t start, uint16_t end) {
+    uint8_t colNum = *((uint8_t*)aggFunc->state + sizeof(int64_t));
+    int8_t colSize = inputSchema->columnSizes[colNum];
+    int8_t isSigned = embedDB_IS_COL_SIGNED(colSize);
+    colSize = min(abs(colSize), sizeof(int64_t));
+    uint16_t colPos = getColOffsetFromSchema(inputSchema, colNum);
+    if (isSigned) {
+        int64_t sum = *(int64_t*)aggFunc->state;
+        for (uint16_t i = start; i < end; i++) {
+            int64_t val = 0;
+            memcpy(&val, (int8_t*)EMBEDDB_BATCH_RECORD(batch, i) + colPos, colSize);
+            // Extend two's complement sign to fill 64 bit number if val is negative
+            if (colSize < sizeof(int64_t) && ((val >> (colSize * 8 - 1)) & 1)) {
+                val |= (int64_t)(UINT64_MAX << (colSize * 8));
+            }
+            sum += val;
+        }
+        *(int64_t*)aggFunc->state = sum;
+    } else {
+        uint64_t sum = *(uint64_t*)aggFunc->state;
+        for (uint16_t i = start; i < end; i++) {
+            uint64_t val = 0;
+            memcpy(&val, (int8_t*)EMBEDDB_BATCH_RECORD(batch, i) + colPos, colSize);
+            sum += val;
+        }
+        *(uint64_t*)aggFunc->state = sum;
+    }
+}
+
 void sumCompute(embedDBAggregateFunc* aggFunc, embedDBSchema* outputSchema, void* recordBuffer, const void* lastRecord) {
     // Put count in record
     memcpy((int8_t*)recordBuffer + getColOffsetFromSchema(outputSchema, aggFunc->colNum), aggFunc->state, sizeof(int64_t));
@@ -890,11 +3477,11 @@ void sumCompute(embedDBAggregateFunc* aggFunc, embedDBSchema* outputSchema, void
  * @param	colNum	The index (zero-indexed) of the column which you want to sum. Column must be <= 8 bytes
  */
 embedDBAggregateFunc* createSumAggregate(uint8_t colNum) {
-    embedDBAggregateFunc* aggFunc = malloc(sizeof(embedDBAggregateFunc));
+    embedDBAggregateFunc* aggFunc = embedDBMalloc(sizeof(embedDBAggregateFunc));
     aggFunc->reset = sumReset;
     aggFunc->add = sumAdd;
     aggFunc->compute = sumCompute;
-    aggFunc->state = malloc(sizeof(int8_t) + sizeof(int64_t));
+    aggFunc->state = embedDBMalloc(sizeof(int8_t) + sizeof(int64_t));
     *((uint8_t*)aggFunc->state + sizeof(int64_t)) = colNum;
     aggFunc->colSize = -8;
     return aggFunc;
@@ -933,6 +3520,20 @@ void minAdd(embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, const voi
     }
 }
 
+void minMaxAddBatch(embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, embedDBBatch* batch, uint16_t start, uint16_t end, uint8_t operation) {
+    struct minMaxState* state = aggFunc->state;
+    int8_t colSize = inputSchema->columnSizes[state->colNum];
+    int8_t isSigned = embedDB_IS_COL_SIGNED(colSize);
+    colSize = abs(colSize);
+    uint16_t colPos = getColOffsetFromSchema(inputSchema, state->colNum);
+    for (uint16_t i = start; i < end; i++) {
+        void* newValue = (int8_t*)EMBEDDB_BATCH_RECORD(batch, i) + colPos;
+        if (compare(newValue, operation, state->current, isSigned, colSize)) {
+            memcpy(state->current, newValue, colSize);
+        }
+    }
+}
+
 void minMaxCompute(embedDBAggregateFunc* aggFunc, embedDBSchema* outputSchema, void* recordBuffer, const void* lastRecord) {
     // Put count in record
     memcpy((int8_t*)recordBuffer + getColOffsetFromSchema(outputSchema, aggFunc->colNum), ((struct minMaxState*)aggFunc->state)->current, abs(outputSchema->columnSizes[aggFunc->colNum]));
@@ -944,14 +3545,14 @@ void minMaxCompute(embedDBAggregateFunc* aggFunc, embedDBSchema* outputSchema, v
  * @param	colSize	The size, in bytes, of the column to find the min of. Negative number represents a signed number, positive is unsigned.
  */
 embedDBAggregateFunc* createMinAggregate(uint8_t colNum, int8_t colSize) {
-    embedDBAggregateFunc* aggFunc = malloc(sizeof(embedDBAggregateFunc));
+    embedDBAggregateFunc* aggFunc = embedDBMalloc(sizeof(embedDBAggregateFunc));
     if (aggFunc == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to allocate while creating min aggregate function\n");
 #endif
         return NULL;
     }
-    struct minMaxState* state = malloc(sizeof(struct minMaxState));
+    struct minMaxState* state = embedDBMalloc(sizeof(struct minMaxState));
     if (state == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to allocate while creating min aggregate function\n");
@@ -959,7 +3560,7 @@ embedDBAggregateFunc* createMinAggregate(uint8_t colNum, int8_t colSize) {
         return NULL;
     }
     state->colNum = colNum;
-    state->current = malloc(abs(colSize));
+    state->current = embedDBMalloc(abs(colSize));
     if (state->current == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to allocate while creating min aggregate function\n");
@@ -1009,14 +3610,14 @@ void maxAdd(embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, const voi
  * @param	colSize	The size, in bytes, of the column to find the max of. Negative number represents a signed number, positive is unsigned.
  */
 embedDBAggregateFunc* createMaxAggregate(uint8_t colNum, int8_t colSize) {
-    embedDBAggregateFunc* aggFunc = malloc(sizeof(embedDBAggregateFunc));
+    embedDBAggregateFunc* aggFunc = embedDBMalloc(sizeof(embedDBAggregateFunc));
     if (aggFunc == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to allocate while creating max aggregate function\n");
 #endif
         return NULL;
     }
-    struct minMaxState* state = malloc(sizeof(struct minMaxState));
+    struct minMaxState* state = embedDBMalloc(sizeof(struct minMaxState));
     if (state == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to allocate while creating max aggregate function\n");
@@ -1024,7 +3625,7 @@ embedDBAggregateFunc* createMaxAggregate(uint8_t colNum, int8_t colSize) {
         return NULL;
     }
     state->colNum = colNum;
-    state->current = malloc(abs(colSize));
+    state->current = embedDBMalloc(abs(colSize));
     if (state->current == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to allocate while creating max aggregate function\n");
@@ -1054,10 +3655,10 @@ void avgReset(struct embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema)
     state->sum = 0.0;
 }
 
-void avgAdd(struct embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, const void* record) {
-    struct avgState* state = aggFunc->state;
-    uint8_t colNum = state->colNum;
-    void* colPos = (int8_t*)record + getColOffsetFromSchema(inputSchema, colNum);
+/**
+ * @brief	Adds the value of the avg column at @c colPos to the running sum
+ */
+void avgAddValue(struct avgState* state, const void* colPos) {
     switch (state->colType) {
         case embedDB_COLUMN_INT32: {
             int32_t val;
@@ -1104,6 +3705,19 @@ void avgAdd(struct embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, co
     state->count++;
 }
 
+void avgAdd(struct embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, const void* record) {
+    struct avgState* state = aggFunc->state;
+    avgAddValue(state, (int8_t*)record + getColOffsetFromSchema(inputSchema, state->colNum));
+}
+
+void avgAddBatch(struct embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, embedDBBatch* batch, uint16_t start, uint16_t end) {
+    struct avgState* state = aggFunc->state;
+    uint16_t colPos = getColOffsetFromSchema(inputSchema, state->colNum);
+    for (uint16_t i = start; i < end; i++) {
+        avgAddValue(state, (int8_t*)EMBEDDB_BATCH_RECORD(batch, i) + colPos);
+    }
+}
+
 void avgCompute(struct embedDBAggregateFunc* aggFunc, embedDBSchema* outputSchema, void* recordBuffer, const void* lastRecord) {
     struct avgState* state = aggFunc->state;
     if (state->count == 0) {
@@ -1136,20 +3750,65 @@ void avgCompute(struct embedDBAggregateFunc* aggFunc, embedDBSchema* outputSchem
 }
 
 
+/**
+ * @brief	Adds the selected records start to end - 1 of a batch to an aggregate function
+ */
+void addBatchToAggregate(embedDBAggregateFunc* func, embedDBSchema* inputSchema, embedDBBatch* batch, uint16_t start, uint16_t end) {
+    if (func->add == NULL) {
+        return;
+    } else if (func->add == countAdd) {
+        *(uint32_t*)func->state += end - start;
+    } else if (func->add == sumAdd) {
+        sumAddBatch(func, inputSchema, batch, start, end);
+    } else if (func->add == minAdd) {
+        minMaxAddBatch(func, inputSchema, batch, start, end, SELECT_LT);
+    } else if (func->add == maxAdd) {
+        minMaxAddBatch(func, inputSchema, batch, start, end, SELECT_GT);
+    } else if (func->add == avgAdd) {
+        avgAddBatch(func, inputSchema, batch, start, end);
+    } else {
+        for (uint16_t i = start; i < end; i++) {
+            func->add(func, inputSchema, EMBEDDB_BATCH_RECORD(batch, i));
+        }
+    }
+}
+
+/**
+ * @brief	Finds the part of the state of a built-in aggregate function that changes as records are added, so it can be saved and restored for each group
+ * @param	bytes	Set to the start of that part of the state
+ * @return	Size of that part of the state in bytes, or 0 if the function is not a built-in function
+ */
+uint16_t getAggregateStateBytes(embedDBAggregateFunc* func, void** bytes) {
+    if (func->add == countAdd) {
+        *bytes = func->state;
+        return sizeof(uint32_t);
+    } else if (func->add == sumAdd) {
+        *bytes = func->state;
+        return sizeof(int64_t);
+    } else if (func->add == minAdd || func->add == maxAdd) {
+        *bytes = ((struct minMaxState*)func->state)->current;
+        return abs(func->colSize);
+    } else if (func->add == avgAdd) {
+        *bytes = func->state;
+        return sizeof(struct avgState);
+    }
+    return 0;
+}
+
 /**
  * @brief	Creates an operator to compute the average of a column over a group. **WARNING: Outputs a floating point number that may not be compatible with other operators**
  * @param	colNum			Zero-indexed column to take average of
  * @param	outputFloatSize	Size of float to output. Must be either 4 (float) or 8 (double)
  */
 embedDBAggregateFunc* createAvgAggregate(uint8_t colNum, int8_t outputFloatSize) {
-    embedDBAggregateFunc* aggFunc = malloc(sizeof(embedDBAggregateFunc));
+    embedDBAggregateFunc* aggFunc = embedDBMalloc(sizeof(embedDBAggregateFunc));
     if (aggFunc == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to allocate while creating avg aggregate function\n");
 #endif
         return NULL;
     }
-    struct avgState* state = malloc(sizeof(struct avgState));
+    struct avgState* state = embedDBMalloc(sizeof(struct avgState));
     if (state == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: Failed to allocate while creating avg aggregate function\n");
@@ -1178,6 +3837,126 @@ embedDBAggregateFunc* createAvgAggregate(uint8_t colNum, int8_t outputFloatSize)
     return aggFunc;
 }
 
+/**
+ * @brief	Restarts an initialized chain of operators so it returns its records again from the start. The table scans' iterators
+ * 			go back to the bounds they had when the scan was created, and the selections push their current values down again,
+ * 			so both can be changed between runs. Buffers, schemas, scratch files and caller-provided memory are reused.
+ * @return	0 if success, -1 if an operator in the chain can't be reset
+ */
+int8_t embedDBResetOperator(embedDBOperator* op) {
+    if (op == NULL || op->state == NULL) {
+        return -1;
+    }
+
+    if (op->next == nextTableScan) {
+        // Go back to the iterator's own bounds, the selections above push their predicates down again
+        restoreScanIterator(op->state);
+        return 0;
+    }
+
+    if (op->next == nextSecondaryIndexScan) {
+        // Start again from the oldest secondary index run
+        embedDBState* state = (embedDBState*)(((void**)op->state)[0]);
+        embedDBSecondaryIterator* it = (embedDBSecondaryIterator*)(((void**)op->state)[1]);
+        embedDBCloseSecondaryIterator(it);
+        return embedDBInitSecondaryIterator(state, it);
+    }
+
+    // Reset the inputs first, the second input of a join is in its state
+    if (op->input != NULL && embedDBResetOperator(op->input) != 0) {
+        return -1;
+    }
+
+    if (op->next == nextProjection || op->next == nextIndexJoin) {
+        // Nothing is kept between records
+    } else if (op->next == nextSelection) {
+        pushDownSelection(op);
+    } else if (op->next == nextAggregate) {
+        struct aggregateInfo* state = op->state;
+        state->isLastRecordUsable = 0;
+        if (state->inputBatch != NULL) {
+            state->inputBatch->count = 0;
+            state->inputBatch->numSelected = 0;
+        }
+        state->batchPos = 0;
+    } else if (op->next == nextHashAggregate) {
+        struct hashAggregateInfo* state = op->state;
+        state->isTableBuilt = 0;
+        state->isReadingInput = 1;
+        state->passStartPage = 0;
+        state->passEndPage = 0;
+        state->nextSpillPage = 0;
+    } else if (op->next == nextSort) {
+        // Runs are written again from the start of the scratch file
+        struct sortInfo* state = op->state;
+        state->numRuns = 0;
+        state->nextPage = 0;
+        state->firstRun = 0;
+        state->numMergeRuns = 0;
+        state->isSorted = 0;
+    } else if (op->next == nextLimit) {
+        ((struct limitInfo*)op->state)->count = 0;
+    } else if (op->next == nextTopK) {
+        struct topKInfo* state = op->state;
+        state->numRecords = 0;
+        state->nextRecord = 0;
+        state->isSorted = 0;
+    } else if (op->next == nextKeyJoin) {
+        struct keyJoinInfo* state = op->state;
+        if (embedDBResetOperator(state->input2) != 0) {
+            return -1;
+        }
+        state->firstCall = 1;
+    } else if (op->next == nextHashJoin) {
+        // The build input is read again since its bounds may have changed
+        struct hashJoinInfo* state = op->state;
+        if (embedDBResetOperator(state->input2) != 0) {
+            return -1;
+        }
+        state->isBuilt = 0;
+        state->hasProbeRecord = 0;
+    } else if (op->next == nextAsOfJoin) {
+        struct asOfJoinInfo* state = op->state;
+        if (embedDBResetOperator(state->input2) != 0) {
+            return -1;
+        }
+        state->toleranceValue = 0;
+        if (state->tolerance != NULL) {
+            memcpy(&state->toleranceValue, state->tolerance, state->keySize);
+        }
+        state->hasCandidate = 0;
+        state->hasLookahead = 0;
+        state->isStarted = 0;
+    } else {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Custom operators can't be reset, initialize the query again instead\n");
+#endif
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief	Replaces the value a predicate of an initialized selection compares with. The selection keeps its own copy of the
+ * 			value, and pushes it down to the table scan's iterator again when reset. Takes effect after embedDBResetOperator.
+ * @param	op				A selection operator
+ * @param	predicateNum	Zero-indexed predicate of the selection, 0 for selections made with createSelectionOperator
+ * @param	value			New value, the same size as the predicate's column
+ * @return	0 if success, -1 if the operator is not an initialized selection with that predicate
+ */
+int8_t embedDBRebindSelection(embedDBOperator* op, uint8_t predicateNum, const void* value) {
+    if (op == NULL || op->next != nextSelection || op->state == NULL || ((struct selectionInfo*)op->state)->values == NULL || value == NULL ||
+        predicateNum >= ((struct selectionInfo*)op->state)->numPredicates) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Only an initialized selection operator can be rebound\n");
+#endif
+        return -1;
+    }
+    struct selectionPredicate* predicate = ((struct selectionInfo*)op->state)->predicates + predicateNum;
+    memcpy(predicate->compVal, value, predicate->colSize);
+    return 0;
+}
+
 /**
  * @brief	Completely free a chain of functions recursively after it's already been closed.
  */
@@ -1185,17 +3964,29 @@ void embedDBFreeOperatorRecursive(embedDBOperator** op) {
     if ((*op)->input != NULL) {
         embedDBFreeOperatorRecursive(&(*op)->input);
     }
+    if ((*op)->next == nextTableScan && (*op)->state != NULL) {
+        // A table scan's record buffer is in the page buffer of its table, unless it copies records
+        restoreScanIterator((*op)->state);
+        embedDBFree(((void**)(*op)->state)[2]);
+        (*op)->recordBuffer = NULL;
+    }
+    if ((*op)->next == nextSelection && (*op)->state != NULL) {
+        embedDBFree(((struct selectionInfo*)(*op)->state)->values);
+    }
+    if ((*op)->next == nextTopK && (*op)->state != NULL) {
+        restoreTopKScan((*op)->state);
+    }
     if ((*op)->state != NULL) {
-        free((*op)->state);
+        embedDBFree((*op)->state);
         (*op)->state = NULL;
     }
     if ((*op)->schema != NULL) {
         embedDBFreeSchema(&(*op)->schema);
     }
     if ((*op)->recordBuffer != NULL) {
-        free((*op)->recordBuffer);
+        embedDBFree((*op)->recordBuffer);
         (*op)->recordBuffer = NULL;
     }
-    free(*op);
+    embedDBFree(*op);
     (*op) = NULL;
 }
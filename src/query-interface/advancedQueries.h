@@ -50,6 +50,27 @@ extern "C" {
 #define SELECT_EQ 4
 #define SELECT_NEQ 5
 
+/* How the predicates of a selection are combined */
+#define EMBEDDB_SELECT_AND 0
+#define EMBEDDB_SELECT_OR 1
+
+/* Iterator bounds that the predicates of a selection may be pushed into */
+#define EMBEDDB_PUSH_DOWN_NONE 0
+#define EMBEDDB_PUSH_DOWN_KEYS 1
+#define EMBEDDB_PUSH_DOWN_DATA 2
+#define EMBEDDB_PUSH_DOWN_BLOOM 4
+#define EMBEDDB_PUSH_DOWN_ALL 7
+
+#define EMBEDDB_SORT_ASC 0
+#define EMBEDDB_SORT_DESC 1
+
+/**
+ * @brief	Number of records read at a time by operators that pull their input in batches
+ */
+#ifndef EMBEDDB_BATCH_SIZE
+#define EMBEDDB_BATCH_SIZE 32
+#endif
+
 typedef struct embedDBAggregateFunc {
     /**
      * @brief	Resets the state
@@ -84,6 +105,23 @@ typedef struct embedDBAggregateFunc {
     uint8_t colNum;
 } embedDBAggregateFunc;
 
+typedef struct embedDBPredicate {
+    /**
+     * @brief	Zero-indexed column of the schema to compare
+     */
+    uint8_t colNum;
+
+    /**
+     * @brief	One of the SELECT_ operations
+     */
+    int8_t operation;
+
+    /**
+     * @brief	Value to compare with, the same size as the column. Must stay valid while the operator or plan using it exists
+     */
+    void* value;
+} embedDBPredicate;
+
 typedef struct embedDBOperator {
     /**
      * @brief	The input operator to this operator
@@ -117,22 +155,119 @@ typedef struct embedDBOperator {
     embedDBSchema* schema;
 
     /**
-     * @brief	The output record of this operator
+     * @brief	The output record of this operator. A table scan points it at the record in the page buffer of its table,
+     * 			so read it again after each call to next and do not keep it across calls that read the same table.
      */
     void* recordBuffer;
 } embedDBOperator;
 
+typedef struct embedDBBatch {
+    /**
+     * @brief	Maximum number of records the batch can hold
+     */
+    uint16_t capacity;
+
+    /**
+     * @brief	Number of records stored in @c records
+     */
+    uint16_t count;
+
+    /**
+     * @brief	Size of each record in bytes. Records use the layout of the schema of the operator that produced them
+     */
+    uint16_t recordSize;
+
+    /**
+     * @brief	The records of the batch, stored one after the other
+     */
+    void* records;
+
+    /**
+     * @brief	Selection vector. Indexes into @c records of the records that passed all filters, in order
+     */
+    uint16_t* selection;
+
+    /**
+     * @brief	Number of entries in @c selection
+     */
+    uint16_t numSelected;
+} embedDBBatch;
+
+/**
+ * @brief	Pointer to the i-th selected record of a batch
+ */
+#define EMBEDDB_BATCH_RECORD(batch, i) ((void*)((int8_t*)(batch)->records + (uint32_t)(batch)->selection[i] * (batch)->recordSize))
+
+/**
+ * @brief	Compares two numbers of the same size
+ * @param	operation	One of the SELECT_ operations
+ * @param	isSigned	Whether the numbers are signed
+ * @param	numBytes	Size of the numbers in bytes
+ * @return	0 or 1 to indicate if inequality is true
+ */
+int8_t compare(void* a, uint8_t operation, void* b, int8_t isSigned, int8_t numBytes);
+
 /**
  * @brief	Extract a record from an operator
  * @return	1 if a record was returned, 0 if there are no more rows to return
  */
 int8_t exec(embedDBOperator* op);
 
+/**
+ * @brief	Extract the next batch of records from an operator. Table scans, selections and projections fill the batch without
+ * 			copying records between operators. Other operators fill it by calling next. Do not mix calls to exec and execBatch on the same operator.
+ * @param	op		An initialized operator
+ * @param	batch	A batch created with the output schema of @c op
+ * @return	The number of selected records in the batch, 0 if there are no more rows to return
+ */
+uint16_t execBatch(embedDBOperator* op, embedDBBatch* batch);
+
+/**
+ * @brief	Allocates a batch for records with the given schema
+ * @param	schema		The schema of the records, usually the output schema of the operator the batch is read from
+ * @param	capacity	Maximum number of records in the batch
+ */
+embedDBBatch* createBatchFromSchema(embedDBSchema* schema, uint16_t capacity);
+
+/**
+ * @brief	Frees a batch and sets the pointer to NULL
+ */
+void embedDBFreeBatch(embedDBBatch** batch);
+
+/**
+ * @brief	Copies one column of the selected records of a batch into a column vector
+ * @param	batch	The batch to read from
+ * @param	schema	The schema of the records in the batch
+ * @param	colNum	Zero-indexed column to copy
+ * @param	column	Array with space for @c batch->numSelected values of the column
+ * @return	The number of values copied
+ */
+uint16_t embedDBBatchGetColumn(embedDBBatch* batch, embedDBSchema* schema, uint8_t colNum, void* column);
+
 /**
  * @brief	Completely free a chain of operators recursively after it's already been closed.
  */
 void embedDBFreeOperatorRecursive(embedDBOperator** op);
 
+/**
+ * @brief	Restarts an initialized chain of built-in operators so exec returns its records again from the start. The table
+ * 			scans' iterators go back to the bounds they had when the scan was created, and selections push their values down
+ * 			again. Change the values the iterator bounds point to, or rebind selections, before resetting to run the same
+ * 			query with new parameters.
+ * @return	0 if success, -1 if an operator in the chain can't be reset
+ */
+int8_t embedDBResetOperator(embedDBOperator* op);
+
+/**
+ * @brief	Copies a new value into the selection's own copy of a predicate's value. The caller's value is not written to.
+ * 			Takes effect after embedDBResetOperator.
+ * @param	op				A selection operator
+ * @param	predicateNum	Zero-indexed predicate of the selection, 0 for selections made with createSelectionOperator
+ * @param	value			New value, the same size as the predicate's column
+ * @return	0 if success, -1 if the operator is not an initialized selection with that predicate
+ */
+int8_t embedDBRebindSelection(embedDBOperator* op, uint8_t predicateNum, const void* value);
+
 ///////////////////////////////////////////
 // Pre-built operators for basic queries //
 ///////////////////////////////////////////
@@ -145,6 +280,15 @@ void embedDBFreeOperatorRecursive(embedDBOperator** op);
  */
 embedDBOperator* createTableScanOperator(embedDBState* state, embedDBIterator* it, embedDBSchema* baseSchema);
 
+/**
+ * @brief	Used as the bottom operator to read the records whose secondary index column is in the range of a secondary iterator.
+ * 			Records are returned in key order.
+ * @param	state		The state associated with the database to read from, using EMBEDDB_USE_SECONDARY_INDEX
+ * @param	it			An initialized secondary iterator with the range of values to read
+ * @param	baseSchema	The schema of the database being read from
+ */
+embedDBOperator* createSecondaryIndexScanOperator(embedDBState* state, embedDBSecondaryIterator* it, embedDBSchema* baseSchema);
+
 /**
  * @brief	Creates an operator capable of projecting the specified columns. Cannot re-order columns
  * @param	input	The operator that this operator can pull records from
@@ -158,10 +302,30 @@ embedDBOperator* createProjectionOperator(embedDBOperator* input, uint8_t numCol
  * @param	input		The operator that this operator can pull records from
  * @param	colNum		The index (zero-indexed) of the column base the select on
  * @param	operation	A constant representing which comparison operation to perform. (e.g. SELECT_GT, SELECT_EQ, etc)
- * @param	compVal		A pointer to the value to compare with. Make sure the size of this is the same number of bytes as is described in the schema
+ * @param	compVal		A pointer to the value to compare with, copied when the operator is initialized. Make sure the size of this is the same number of bytes as is described in the schema
  */
 embedDBOperator* createSelectionOperator(embedDBOperator* input, int8_t colNum, int8_t operation, void* compVal);
 
+/**
+ * @brief	Creates an operator that selects records that meet all, or any, of several predicates in one pass.
+ * 			Each predicate is evaluated with a comparison picked for its column's type and width when the operator is initialized.
+ * @param	input			The operator that this operator can pull records from
+ * @param	predicates		The predicates, which are copied. Their values are copied when the operator is initialized. Put the most
+ * 							selective first, since evaluation stops once the result is known
+ * @param	numPredicates	The number of predicates
+ * @param	combine			EMBEDDB_SELECT_AND to select records that meet every predicate, EMBEDDB_SELECT_OR for records that meet any of them
+ */
+embedDBOperator* createPredicateSelectionOperator(embedDBOperator* input, embedDBPredicate* predicates, uint8_t numPredicates, int8_t combine);
+
+/**
+ * @brief	Chooses which bounds of the table scan's iterator the predicates of a selection are pushed into. All of them are by default.
+ * 			Takes effect when the operator is initialized or reset.
+ * @param	op			A selection operator
+ * @param	pushDown	EMBEDDB_PUSH_DOWN_KEYS, EMBEDDB_PUSH_DOWN_DATA and EMBEDDB_PUSH_DOWN_BLOOM combined with |, or EMBEDDB_PUSH_DOWN_NONE
+ * @return	0 if success, -1 if the operator is not a selection
+ */
+int8_t embedDBSetSelectionPushDown(embedDBOperator* op, uint8_t pushDown);
+
 /**
  * @brief	Creates an operator that will find groups and preform aggregate functions over each group.
  * @param	input			The operator that this operator can pull records from
@@ -171,11 +335,90 @@ embedDBOperator* createSelectionOperator(embedDBOperator* input, int8_t colNum,
  */
 embedDBOperator* createAggregateOperator(embedDBOperator* input, int8_t (*groupfunc)(const void* lastRecord, const void* record), embedDBAggregateFunc* functions, uint32_t functionsLength);
 
+/**
+ * @brief	Creates an operator that groups records by the value of one column with a hash table, so the records of a group do not need to be next to each other.
+ * 			Outputs one record per group, in no particular order, with the group value followed by the result of each aggregate function.
+ * 			When the table is full, records of new groups are spilled to a scratch file and aggregated in later passes.
+ * @param	input			The operator that this operator can pull records from
+ * @param	groupColNum		Zero-indexed column whose value determines the group of a record
+ * @param	functions		An array of the built-in count, sum, min, max or avg aggregate functions
+ * @param	functionsLength	The number of embedDBAggregateFuncs in @c functions
+ * @param	memory			Caller-allocated space for the hash table and, if spilling, two page buffers. Must stay valid until the operator is closed
+ * @param	memorySize		Size of @c memory in bytes
+ * @param	fileInterface	Interface used to write spilled records. NULL disables spilling
+ * @param	scratchFile		File that spilled records are written to. Its contents are overwritten
+ * @param	pageSize		Size of the pages written to @c scratchFile
+ */
+embedDBOperator* createHashAggregateOperator(embedDBOperator* input, uint8_t groupColNum, embedDBAggregateFunc* functions, uint32_t functionsLength, void* memory, uint32_t memorySize, embedDBFileInterface* fileInterface, void* scratchFile, uint32_t pageSize);
+
+/**
+ * @brief	Creates an operator that outputs the records of its input ordered by one column.
+ * 			Records are sorted in memory if they fit. Otherwise sorted runs are written to a scratch file and merged, using only the provided memory for records and pages.
+ * @param	input			The operator that this operator can pull records from
+ * @param	colNum			Zero-indexed column to sort by
+ * @param	direction		EMBEDDB_SORT_ASC or EMBEDDB_SORT_DESC
+ * @param	memory			Caller-allocated space for records and page buffers. Must stay valid until the operator is closed
+ * @param	memorySize		Size of @c memory in bytes. With a scratch file it must hold at least three pages, and memorySize / pageSize runs are merged at once
+ * @param	fileInterface	Interface used to write sorted runs. NULL sorts in memory only
+ * @param	scratchFile		File that sorted runs are written to. Its contents are overwritten
+ * @param	pageSize		Size of the pages written to @c scratchFile
+ */
+embedDBOperator* createSortOperator(embedDBOperator* input, uint8_t colNum, int8_t direction, void* memory, uint32_t memorySize, embedDBFileInterface* fileInterface, void* scratchFile, uint32_t pageSize);
+
+/**
+ * @brief	Creates an operator that outputs the first records of its input and then stops reading it
+ * @param	input	The operator that this operator can pull records from
+ * @param	limit	Most records to output
+ */
+embedDBOperator* createLimitOperator(embedDBOperator* input, uint32_t limit);
+
+/**
+ * @brief	Creates an operator that outputs the first k records of its input ordered by a column, keeping only k records in memory.
+ * 			On the key column of a table scan the scan is read in the output order instead, backwards from the newest page for descending order.
+ * @param	input		The operator that this operator can pull records from
+ * @param	colNum		Zero-indexed column to order by
+ * @param	k			Most records to output
+ * @param	direction	EMBEDDB_SORT_ASC for the smallest values first or EMBEDDB_SORT_DESC for the largest values first
+ */
+embedDBOperator* createTopKOperator(embedDBOperator* input, uint8_t colNum, uint32_t k, int8_t direction);
+
 /**
  * @brief	Creates an operator for perfoming an equijoin on the keys (sorted and distinct) of two tables
  */
 embedDBOperator* createKeyJoinOperator(embedDBOperator* input1, embedDBOperator* input2);
 
+/**
+ * @brief	Creates an operator that joins each record of its input with the record of another table whose key equals one of its columns.
+ * 			Each key is looked up with embedDBGet, so the pages read are proportional to the number of input records, not to the size of the table.
+ * @param	outer		The operator that this operator can pull records from
+ * @param	outerColNum	Zero-indexed column of @c outer that holds a key of the inner table. Must be the same size as the key
+ * @param	innerState	The state of the table to look keys up in
+ * @param	innerSchema	The schema of the table to look keys up in
+ */
+embedDBOperator* createIndexJoinOperator(embedDBOperator* outer, uint8_t outerColNum, embedDBState* innerState, embedDBSchema* innerSchema);
+
+/**
+ * @brief	Creates an operator that joins two inputs on columns with equal values. The second input is read into a hash table, then each record of the first input is matched with it.
+ * 			Outputs the columns of @c input1 followed by the columns of @c input2, once for every pair of matching records.
+ * @param	input1		The probe input, which can be any size
+ * @param	input2		The build input, which must fit in @c memory. Like the key join, it is not freed by embedDBFreeOperatorRecursive
+ * @param	colNum1		Zero-indexed join column of @c input1
+ * @param	colNum2		Zero-indexed join column of @c input2. Must be the same size as @c colNum1
+ * @param	memory		Caller-allocated space for the hash table. Must stay valid until the operator is closed
+ * @param	memorySize	Size of @c memory in bytes. Holds memorySize / (1 + record size) * 3 / 4 build records
+ */
+embedDBOperator* createHashJoinOperator(embedDBOperator* input1, embedDBOperator* input2, uint8_t colNum1, uint8_t colNum2, void* memory, uint32_t memorySize);
+
+/**
+ * @brief	Creates an operator that joins each record of the left input with the latest record of the right input whose key is at or before its key.
+ * 			Both inputs must be sorted by an unsigned key in their first column. Outputs the columns of @c input1 followed by the columns of @c input2.
+ * 			Left records without a right record within the tolerance are skipped.
+ * @param	input1		The left input
+ * @param	input2		The right input. Like the key join, it is not freed by embedDBFreeOperatorRecursive
+ * @param	tolerance	Largest allowed difference between the left and right keys, the same size as the keys. NULL to match any earlier right record. Must stay valid until the operator is initialized
+ */
+embedDBOperator* createAsOfJoinOperator(embedDBOperator* input1, embedDBOperator* input2, void* tolerance);
+
 //////////////////////////////////
 // Prebuilt aggregate functions //
 //////////////////////////////////
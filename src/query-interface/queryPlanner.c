@@ -0,0 +1,600 @@
+/******************************************************************************/
+/**
+ * @file        queryPlanner.c
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Source code file for the query planner of the advanced query interface for EmbedDB
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/******************************************************************************/
+
+#include "queryPlanner.h"
+
+#include <string.h>
+
+#if defined(ARDUINO)
+#include "serial_c_iface.h"
+#endif
+
+/* Fraction of the data pages assumed to hold a value tested for equality, or a value in a range. No statistics are kept on
+ * the data, so these are only used when an index can't tell */
+#define PLAN_EQUALITY_SELECTIVITY 0.1f
+#define PLAN_RANGE_SELECTIVITY 0.33f
+
+/**
+ * @brief	What the planner learns about a query before choosing its access path
+ */
+struct planCandidates {
+    uint8_t paths;               // EMBEDDB_PLAN_ flags of the access paths that can be used
+    uint32_t keyFirstPage;       // First and last data pages of the key range
+    uint32_t keyLastPage;
+    float bitmapSelectivity;     // Fraction of the bitmap buckets the data range covers
+    float secondarySelectivity;  // Fraction of the data pages assumed to hold a value in the secondary index range
+    void* secondaryMin;          // Range of the secondary index column, NULL for no bound
+    void* secondaryMax;
+};
+
+/**
+ * @brief	Group function used when a query has aggregates but no group function. Puts every record in the same group
+ */
+int8_t planSingleGroup(const void* lastRecord, const void* record) {
+    (void)lastRecord;
+    (void)record;
+    return 1;
+}
+
+/**
+ * @brief	Returns the order a predicate is applied in. Key predicates are checked first since the iterator has
+ * 			already applied them, then equality tests that discard the most records, and inequalities last
+ */
+uint8_t planPredicateRank(embedDBPredicate* predicate) {
+    if (predicate->colNum == 0)
+        return 0;
+    if (predicate->operation == SELECT_EQ)
+        return 1;
+    if (predicate->operation != SELECT_NEQ)
+        return 2;
+    return 3;
+}
+
+/**
+ * @brief	Creates a table scan over the plan's iterator with a selection of the predicates above it
+ * @param	pushDown	EMBEDDB_PUSH_DOWN_ flags of the iterator bounds the predicates are pushed into
+ */
+embedDBOperator* planCreateTableScan(embedDBQueryPlan* plan, uint8_t pushDown) {
+    embedDBOperator* root = createTableScanOperator(plan->state, &plan->iterator, plan->baseSchema);
+    if (plan->query.numPredicates > 0 && root != NULL) {
+        embedDBOperator* op = createPredicateSelectionOperator(root, plan->query.predicates, plan->query.numPredicates, EMBEDDB_SELECT_AND);
+        if (op == NULL) {
+            embedDBFreeOperatorRecursive(&root);
+        } else {
+            embedDBSetSelectionPushDown(op, pushDown);
+        }
+        root = op;
+    }
+    return root;
+}
+
+/**
+ * @brief	Finds the range of the secondary index column that every record of the query is in
+ * @return	1 if the secondary index can be used, 0 otherwise
+ */
+int8_t planFindSecondaryRange(embedDBQueryPlan* plan, struct planCandidates* candidates) {
+    embedDBState* state = plan->state;
+    embedDBSchema* schema = plan->baseSchema;
+    if (!EMBEDDB_USING_SECONDARY_INDEX(state->parameters))
+        return 0;
+
+    candidates->secondaryMin = NULL;
+    candidates->secondaryMax = NULL;
+    candidates->secondarySelectivity = 1;
+    for (uint8_t i = 0; i < plan->query.numPredicates; i++) {
+        embedDBPredicate* predicate = plan->query.predicates + i;
+        if (predicate->colNum == 0 || predicate->operation == SELECT_NEQ ||
+            getColOffsetFromSchema(schema, predicate->colNum) - state->keySize != state->secondaryIndexOffset ||
+            abs(schema->columnSizes[predicate->colNum]) != state->secondaryIndexSize)
+            continue;
+
+        if (predicate->operation == SELECT_GT || predicate->operation == SELECT_GTE || predicate->operation == SELECT_EQ) {
+            if (candidates->secondaryMin == NULL || state->compareSecondaryIndex(predicate->value, candidates->secondaryMin) > 0)
+                candidates->secondaryMin = predicate->value;
+        }
+        if (predicate->operation == SELECT_LT || predicate->operation == SELECT_LTE || predicate->operation == SELECT_EQ) {
+            if (candidates->secondaryMax == NULL || state->compareSecondaryIndex(predicate->value, candidates->secondaryMax) < 0)
+                candidates->secondaryMax = predicate->value;
+        }
+        float selectivity = predicate->operation == SELECT_EQ ? PLAN_EQUALITY_SELECTIVITY : PLAN_RANGE_SELECTIVITY;
+        if (selectivity < candidates->secondarySelectivity)
+            candidates->secondarySelectivity = selectivity;
+    }
+    return candidates->secondaryMin != NULL || candidates->secondaryMax != NULL;
+}
+
+/**
+ * @brief	Finds the access paths a table scan can use by pushing the predicates down into the plan's iterator, as the
+ * 			selection does when initialized, and reading the resulting key range, query bitmap and Bloom filter probe
+ */
+void planFindTableScanPaths(embedDBQueryPlan* plan, struct planCandidates* candidates) {
+    embedDBState* state = plan->state;
+    embedDBIterator* it = &plan->iterator;
+
+    candidates->paths = EMBEDDB_PLAN_FULL_SCAN;
+    candidates->keyFirstPage = state->minDataPageId;
+    candidates->keyLastPage = state->minDataPageId;
+    candidates->bitmapSelectivity = 1;
+    embedDBOperator* probe = planCreateTableScan(plan, EMBEDDB_PUSH_DOWN_ALL);
+    if (probe == NULL)
+        return;
+    probe->init(probe);
+
+    if (it->minKey != NULL || it->maxKey != NULL) {
+        candidates->paths |= EMBEDDB_PLAN_KEY_RANGE;
+    }
+    if (it->queryBitmap != NULL && state->indexFile != NULL) {
+        candidates->paths |= EMBEDDB_PLAN_BITMAP_INDEX;
+
+        // Assume the values are spread evenly over the bitmap buckets
+        uint16_t bitsSet = 0;
+        for (int8_t i = 0; i < state->bitmapSize; i++) {
+            for (uint8_t bits = ((uint8_t*)it->queryBitmap)[i]; bits != 0; bits >>= 1) {
+                bitsSet += bits & 1;
+            }
+        }
+        candidates->bitmapSelectivity = (float)bitsSet / (state->bitmapSize * 8);
+    }
+    if (it->queryBloomFilter != NULL && state->indexFile != NULL) {
+        candidates->paths |= EMBEDDB_PLAN_BLOOM_FILTER;
+    }
+
+    // The spline gives the pages of the key range
+    candidates->keyFirstPage = it->nextDataPage;
+    candidates->keyLastPage = state->nextDataPageId - 1;
+    if (it->maxKey != NULL && !EMBEDDB_USING_BINARY_SEARCH(state->parameters) && state->spl->count != 0 &&
+        state->compareKey(it->maxKey, splinePointLocation(state->spl, state->spl->count - 1)) < 0) {
+        uint32_t location, lowbound, highbound = 0;
+        splineFind(state->spl, it->maxKey, state->compareKey, &location, &lowbound, &highbound);
+        if (highbound < candidates->keyLastPage) {
+            candidates->keyLastPage = highbound;
+        }
+    }
+    if (candidates->keyLastPage < candidates->keyFirstPage) {
+        candidates->keyLastPage = candidates->keyFirstPage;
+    }
+
+    // The selection's values, which the iterator points to, are freed with it
+    probe->close(probe);
+    embedDBFreeOperatorRecursive(&probe);
+    embedDBCloseIterator(it);
+    it->minKey = plan->query.minKey;
+    it->maxKey = plan->query.maxKey;
+    it->minData = NULL;
+    it->maxData = NULL;
+    embedDBInitIterator(state, it);
+}
+
+/**
+ * @brief	Estimates the data and index pages read with an access path, and sets the pages the plan reads
+ */
+void planEstimatePath(embedDBQueryPlan* plan, struct planCandidates* candidates, uint8_t path) {
+    embedDBState* state = plan->state;
+
+    plan->firstPage = state->minDataPageId;
+    plan->lastPage = state->minDataPageId;
+    plan->bitmapSelectivity = path & EMBEDDB_PLAN_BITMAP_INDEX ? candidates->bitmapSelectivity : 1;
+    plan->estimatedDataPageReads = 0;
+    plan->estimatedIndexPageReads = 0;
+
+    // The page in the write buffer is scanned without being read
+    if (state->nextDataPageId == state->minDataPageId) {
+        return;
+    }
+
+    // The secondary index reads every stored run, then only the pages they flag. It has no key range
+    if (path & EMBEDDB_PLAN_SECONDARY_INDEX) {
+        uint32_t numPages = state->nextDataPageId - state->minDataPageId;
+        plan->lastPage = state->nextDataPageId - 1;
+        plan->estimatedIndexPageReads = state->nextSecondaryIndexPageId - state->minSecondaryIndexPageId;
+        plan->estimatedDataPageReads = (uint32_t)(numPages * candidates->secondarySelectivity);
+        if (plan->estimatedDataPageReads < numPages * candidates->secondarySelectivity) {
+            plan->estimatedDataPageReads++;
+        }
+        return;
+    }
+
+    uint32_t firstPage = state->minDataPageId;
+    uint32_t lastPage = state->nextDataPageId - 1;
+    if (path & EMBEDDB_PLAN_KEY_RANGE) {
+        firstPage = candidates->keyFirstPage;
+        lastPage = candidates->keyLastPage;
+    }
+    plan->firstPage = firstPage;
+    plan->lastPage = lastPage;
+    uint32_t numPages = lastPage - firstPage + 1;
+
+    if (!(path & (EMBEDDB_PLAN_BITMAP_INDEX | EMBEDDB_PLAN_BLOOM_FILTER))) {
+        plan->estimatedDataPageReads = numPages;
+        return;
+    }
+
+    // The bitmap and the Bloom filter of a page are in the same index record, and are assumed to be independent
+    float selectivity = plan->bitmapSelectivity * (path & EMBEDDB_PLAN_BLOOM_FILTER ? PLAN_EQUALITY_SELECTIVITY : 1);
+
+    // Only pages whose index record has been written to storage can be skipped
+    uint32_t firstIndexPage = max(firstPage / state->maxIdxRecordsPerPage, state->minIndexPageId);
+    uint32_t lastIndexPage = lastPage / state->maxIdxRecordsPerPage;
+    if (lastIndexPage >= state->nextIdxPageId) {
+        lastIndexPage = state->nextIdxPageId - 1;
+    }
+    uint32_t indexedPages = 0;
+    if (state->nextIdxPageId > firstIndexPage && lastIndexPage >= firstIndexPage) {
+        plan->estimatedIndexPageReads = lastIndexPage - firstIndexPage + 1;
+        uint32_t lastIndexedPage = (lastIndexPage + 1) * state->maxIdxRecordsPerPage - 1;
+        indexedPages = min(lastIndexedPage, lastPage) - max(firstIndexPage * state->maxIdxRecordsPerPage, firstPage) + 1;
+    }
+    uint32_t indexedReads = (uint32_t)(indexedPages * selectivity);
+    if (indexedReads < indexedPages * selectivity) {
+        indexedReads++;
+    }
+    plan->estimatedDataPageReads = numPages - indexedPages + indexedReads;
+}
+
+/**
+ * @brief	Estimates the pages read by each access path the query can use and picks the one that reads the fewest.
+ * 			The key range is always used when there is one, since the spline finds its pages without reading any
+ */
+void planChoosePath(embedDBQueryPlan* plan, struct planCandidates* candidates) {
+    uint8_t base = candidates->paths & EMBEDDB_PLAN_KEY_RANGE;
+    uint8_t paths[] = {base, base | EMBEDDB_PLAN_BITMAP_INDEX, base | EMBEDDB_PLAN_BLOOM_FILTER,
+                       base | EMBEDDB_PLAN_BITMAP_INDEX | EMBEDDB_PLAN_BLOOM_FILTER, EMBEDDB_PLAN_SECONDARY_INDEX};
+
+    plan->numCandidates = 0;
+    uint32_t bestCost = UINT32_MAX;
+    for (uint8_t i = 0; i < sizeof(paths); i++) {
+        if ((paths[i] & candidates->paths) != paths[i])
+            continue;
+        planEstimatePath(plan, candidates, paths[i]);
+        uint32_t cost = plan->estimatedDataPageReads + plan->estimatedIndexPageReads;
+        plan->candidatePaths[plan->numCandidates] = paths[i];
+        plan->candidateCosts[plan->numCandidates] = cost;
+        plan->numCandidates++;
+        if (cost < bestCost) {
+            bestCost = cost;
+            plan->accessPath = paths[i];
+        }
+    }
+    planEstimatePath(plan, candidates, plan->accessPath);
+}
+
+/**
+ * @brief	Plans a query: estimates the pages read by each access path, picks the cheapest, and builds and initializes the
+ * 			operator tree. The plan can be inspected before any page is read, and freed without being executed.
+ * @param	state		The state of the database to read from
+ * @param	baseSchema	The schema of the database being read from
+ * @param	query		Description of the query
+ * @return	The plan, or NULL if the query is invalid or memory could not be allocated
+ */
+embedDBQueryPlan* embedDBPlanQuery(embedDBState* state, embedDBSchema* baseSchema, embedDBQuery* query) {
+    if (state == NULL || baseSchema == NULL || query == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: A state, schema and query must be provided to plan a query\n");
+#endif
+        return NULL;
+    }
+    for (uint8_t i = 0; i < query->numPredicates; i++) {
+        if (query->predicates[i].colNum >= baseSchema->numCols || query->predicates[i].operation < SELECT_GT || query->predicates[i].operation > SELECT_NEQ) {
+#ifdef PRINT_ERRORS
+            printf("ERROR: Query predicate %d has an invalid column or operation\n", i);
+#endif
+            return NULL;
+        }
+    }
+
+    // The table scan keeps a pointer to the plan's iterator, so the plan is not moved after this
+    embedDBQueryPlan* plan = calloc(1, sizeof(embedDBQueryPlan));
+    if (plan == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while planning query\n");
+#endif
+        return NULL;
+    }
+    plan->state = state;
+    plan->baseSchema = baseSchema;
+    plan->query = *query;
+
+    // Two more predicates hold the key range when the secondary index is used
+    plan->query.predicates = malloc((query->numPredicates + 2) * sizeof(embedDBPredicate));
+    if (plan->query.predicates == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to malloc while planning query\n");
+#endif
+        free(plan);
+        return NULL;
+    }
+
+    // Stable insertion sort of the predicates by the order they are applied in
+    embedDBPredicate* predicates = plan->query.predicates;
+    for (uint8_t i = 0; i < query->numPredicates; i++) {
+        uint8_t j = i;
+        while (j > 0 && planPredicateRank(&predicates[j - 1]) > planPredicateRank(&query->predicates[i])) {
+            predicates[j] = predicates[j - 1];
+            j--;
+        }
+        predicates[j] = query->predicates[i];
+    }
+
+    plan->iterator.minKey = query->minKey;
+    plan->iterator.maxKey = query->maxKey;
+    plan->iterator.minData = NULL;
+    plan->iterator.maxData = NULL;
+    embedDBInitIterator(state, &plan->iterator);
+
+    struct planCandidates candidates;
+    planFindTableScanPaths(plan, &candidates);
+    if (planFindSecondaryRange(plan, &candidates)) {
+        candidates.paths |= EMBEDDB_PLAN_SECONDARY_INDEX;
+    }
+    planChoosePath(plan, &candidates);
+
+    // Build the tree bottom up. The predicates are evaluated in one pass
+    embedDBOperator* root = NULL;
+    if (plan->accessPath & EMBEDDB_PLAN_SECONDARY_INDEX) {
+        // The secondary index has no key range, so the selection checks it
+        embedDBCloseIterator(&plan->iterator);
+        if (query->minKey != NULL) {
+            embedDBPredicate minKeyPredicate = {0, SELECT_GTE, query->minKey};
+            predicates[plan->query.numPredicates++] = minKeyPredicate;
+        }
+        if (query->maxKey != NULL) {
+            embedDBPredicate maxKeyPredicate = {0, SELECT_LTE, query->maxKey};
+            predicates[plan->query.numPredicates++] = maxKeyPredicate;
+        }
+        plan->secondaryIterator.minValue = candidates.secondaryMin;
+        plan->secondaryIterator.maxValue = candidates.secondaryMax;
+        if (embedDBInitSecondaryIterator(state, &plan->secondaryIterator) == 0) {
+            root = createSecondaryIndexScanOperator(state, &plan->secondaryIterator, baseSchema);
+        }
+        if (root != NULL) {
+            embedDBOperator* op = createPredicateSelectionOperator(root, predicates, plan->query.numPredicates, EMBEDDB_SELECT_AND);
+            if (op == NULL) {
+                embedDBFreeOperatorRecursive(&root);
+            }
+            root = op;
+        }
+    } else {
+        // Only the chosen indexes are used, the key range is always pushed down
+        uint8_t pushDown = EMBEDDB_PUSH_DOWN_KEYS;
+        if (plan->accessPath & EMBEDDB_PLAN_BITMAP_INDEX)
+            pushDown |= EMBEDDB_PUSH_DOWN_DATA;
+        if (plan->accessPath & EMBEDDB_PLAN_BLOOM_FILTER)
+            pushDown |= EMBEDDB_PUSH_DOWN_BLOOM;
+        root = planCreateTableScan(plan, pushDown);
+    }
+    if (query->numAggregates > 0 && root != NULL) {
+        embedDBOperator* op = createAggregateOperator(root, query->groupfunc != NULL ? query->groupfunc : planSingleGroup, query->aggregates, query->numAggregates);
+        if (op == NULL) {
+            embedDBFreeOperatorRecursive(&root);
+        }
+        root = op;
+    }
+    if (query->numProjectionCols > 0 && root != NULL) {
+        embedDBOperator* op = createProjectionOperator(root, query->numProjectionCols, query->projectionCols);
+        if (op == NULL) {
+            embedDBFreeOperatorRecursive(&root);
+        }
+        root = op;
+    }
+    if (root == NULL) {
+#ifdef PRINT_ERRORS
+        printf("ERROR: Failed to create the operators of the query plan\n");
+#endif
+        if (plan->accessPath & EMBEDDB_PLAN_SECONDARY_INDEX) {
+            embedDBCloseSecondaryIterator(&plan->secondaryIterator);
+        } else {
+            embedDBCloseIterator(&plan->iterator);
+        }
+        free(plan->query.predicates);
+        free(plan);
+        return NULL;
+    }
+    plan->root = root;
+    root->init(root);
+    return plan;
+}
+
+/**
+ * @brief	Prints a predicate value using the type of its column
+ */
+void planPrintValue(embedDBSchema* schema, uint8_t colNum, void* value) {
+    int8_t colSize = schema->columnSizes[colNum];
+    if (schema->columnTypes != NULL && schema->columnTypes[colNum] == embedDB_COLUMN_FLOAT) {
+        float val;
+        memcpy(&val, value, sizeof(float));
+        printf("%f", val);
+    } else if (schema->columnTypes != NULL && schema->columnTypes[colNum] == embedDB_COLUMN_DOUBLE) {
+        double val;
+        memcpy(&val, value, sizeof(double));
+        printf("%f", val);
+    } else if (embedDB_IS_COL_SIGNED(colSize)) {
+        int64_t val = 0;
+        memcpy(&val, value, abs(colSize) < 8 ? abs(colSize) : 8);
+        // Sign extend
+        if (abs(colSize) < 8 && (val >> (abs(colSize) * 8 - 1)) & 1) {
+            val |= (int64_t)(~(uint64_t)0 << (abs(colSize) * 8));
+        }
+        printf("%lld", (long long)val);
+    } else {
+        uint64_t val = 0;
+        memcpy(&val, value, colSize < 8 ? colSize : 8);
+        printf("%llu", (unsigned long long)val);
+    }
+}
+
+/**
+ * @brief	Prints the names of the access paths in a set of EMBEDDB_PLAN_ flags
+ */
+void planPrintPath(uint8_t path) {
+    static const char* names[] = {"key range", "bitmap index", "Bloom filter", "secondary index"};
+    if (path == EMBEDDB_PLAN_FULL_SCAN) {
+        printf("full scan");
+        return;
+    }
+    const char* separator = "";
+    for (uint8_t i = 0; i < 4; i++) {
+        if (path & (1 << i)) {
+            printf("%s%s", separator, names[i]);
+            separator = " + ";
+        }
+    }
+}
+
+/**
+ * @brief	Returns the column of the schema that the secondary index is on, or -1 if there is none
+ */
+int8_t planSecondaryIndexColumn(embedDBQueryPlan* plan) {
+    for (uint8_t i = 1; i < plan->baseSchema->numCols; i++) {
+        if (getColOffsetFromSchema(plan->baseSchema, i) - plan->state->keySize == plan->state->secondaryIndexOffset)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief	Prints the pages a plan reads, the estimated reads and the cost of every access path that was considered
+ */
+void planPrintEstimates(embedDBQueryPlan* plan, uint8_t depth) {
+    if (plan->estimatedDataPageReads == 0) {
+        printf("%*sPages: none on storage\n", depth * 2, "");
+    } else {
+        printf("%*sPages: %lu to %lu\n", depth * 2, "", (unsigned long)plan->firstPage, (unsigned long)plan->lastPage);
+    }
+    if (plan->accessPath & EMBEDDB_PLAN_BITMAP_INDEX) {
+        printf("%*sBitmap selectivity: %.2f\n", depth * 2, "", plan->bitmapSelectivity);
+    }
+    printf("%*sEstimated reads: %lu data pages, %lu index pages\n", depth * 2, "", (unsigned long)plan->estimatedDataPageReads, (unsigned long)plan->estimatedIndexPageReads);
+    printf("%*sCandidates:", depth * 2, "");
+    for (uint8_t i = 0; i < plan->numCandidates; i++) {
+        printf("%s ", i ? "," : "");
+        planPrintPath(plan->candidatePaths[i]);
+        printf(" %lu%s", (unsigned long)plan->candidateCosts[i], plan->candidatePaths[i] == plan->accessPath ? " (chosen)" : "");
+    }
+    printf("\n");
+}
+
+/**
+ * @brief	Prints the operator tree, access path and estimated page reads of a plan
+ */
+void embedDBExplainQueryPlan(embedDBQueryPlan* plan) {
+    static const char* operations[] = {">", "<", ">=", "<=", "==", "!="};
+    embedDBQuery* query = &plan->query;
+    uint8_t depth = 0;
+
+    if (query->numProjectionCols > 0) {
+        printf("Projection: columns");
+        for (uint8_t i = 0; i < query->numProjectionCols; i++) {
+            printf("%s %d", i ? "," : "", query->projectionCols[i]);
+        }
+        printf("\n");
+        depth++;
+    }
+    if (query->numAggregates > 0) {
+        printf("%*sAggregate: %lu functions, %s\n", depth * 2, "", (unsigned long)query->numAggregates, query->groupfunc != NULL ? "grouped" : "one group");
+        depth++;
+    }
+    if (query->numPredicates > 0) {
+        printf("%*sSelection:", depth * 2, "");
+        for (uint8_t i = 0; i < query->numPredicates; i++) {
+            printf("%s column %d %s ", i ? " AND" : "", query->predicates[i].colNum, operations[query->predicates[i].operation]);
+            planPrintValue(plan->baseSchema, query->predicates[i].colNum, query->predicates[i].value);
+        }
+        printf("\n");
+        depth++;
+    }
+
+    if (plan->accessPath & EMBEDDB_PLAN_SECONDARY_INDEX) {
+        int8_t colNum = planSecondaryIndexColumn(plan);
+        printf("%*sSecondary index scan: column %d [", depth * 2, "", colNum);
+        if (plan->secondaryIterator.minValue != NULL)
+            planPrintValue(plan->baseSchema, colNum, plan->secondaryIterator.minValue);
+        printf(", ");
+        if (plan->secondaryIterator.maxValue != NULL)
+            planPrintValue(plan->baseSchema, colNum, plan->secondaryIterator.maxValue);
+        printf("]\n");
+        planPrintEstimates(plan, depth + 1);
+        return;
+    }
+
+    printf("%*sTable scan: ", depth * 2, "");
+    planPrintPath(plan->accessPath);
+    if (plan->iterator.minKey != NULL || plan->iterator.maxKey != NULL) {
+        printf(", keys [");
+        if (plan->iterator.minKey != NULL)
+            planPrintValue(plan->baseSchema, 0, plan->iterator.minKey);
+        printf(", ");
+        if (plan->iterator.maxKey != NULL)
+            planPrintValue(plan->baseSchema, 0, plan->iterator.maxKey);
+        printf("]");
+    }
+    if (plan->iterator.minData != NULL || plan->iterator.maxData != NULL) {
+        printf(", column 1 [");
+        if (plan->iterator.minData != NULL)
+            planPrintValue(plan->baseSchema, 1, plan->iterator.minData);
+        printf(", ");
+        if (plan->iterator.maxData != NULL)
+            planPrintValue(plan->baseSchema, 1, plan->iterator.maxData);
+        printf("]");
+    }
+    printf("\n");
+    planPrintEstimates(plan, depth + 1);
+}
+
+/**
+ * @brief	Closes and frees a plan and its operators, and sets the pointer to NULL
+ */
+void embedDBFreeQueryPlan(embedDBQueryPlan** plan) {
+    if (*plan == NULL)
+        return;
+    /* Closing an aggregate detaches it from its input, so the chain is collected before closing and each operator is freed on its own */
+    embedDBOperator* operators[4];
+    uint8_t numOperators = 0;
+    for (embedDBOperator* op = (*plan)->root; op != NULL && numOperators < 4; op = op->input) {
+        operators[numOperators++] = op;
+    }
+    (*plan)->root->close((*plan)->root);
+    for (uint8_t i = 0; i < numOperators; i++) {
+        operators[i]->input = NULL;
+        embedDBFreeOperatorRecursive(&operators[i]);
+    }
+    if ((*plan)->accessPath & EMBEDDB_PLAN_SECONDARY_INDEX) {
+        embedDBCloseSecondaryIterator(&(*plan)->secondaryIterator);
+    } else {
+        embedDBCloseIterator(&(*plan)->iterator);
+    }
+    free((*plan)->query.predicates);
+    free(*plan);
+    *plan = NULL;
+}
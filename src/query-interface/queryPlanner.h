@@ -0,0 +1,160 @@
+/******************************************************************************/
+/**
+ * @file        queryPlanner.h
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Header file for the query planner of the advanced query interface for EmbedDB
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/******************************************************************************/
+
+#ifndef _QUERYPLANNER_H
+#define _QUERYPLANNER_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "advancedQueries.h"
+
+/* Access paths used by a query plan. A plan with no flags set reads every data page */
+#define EMBEDDB_PLAN_FULL_SCAN 0
+#define EMBEDDB_PLAN_KEY_RANGE 1
+#define EMBEDDB_PLAN_BITMAP_INDEX 2
+#define EMBEDDB_PLAN_BLOOM_FILTER 4
+#define EMBEDDB_PLAN_SECONDARY_INDEX 8
+
+/* Most access paths a plan compares: full scan or key range, alone or with the bitmap index, the Bloom filter or both, and the secondary index */
+#define EMBEDDB_PLAN_MAX_CANDIDATES 5
+
+typedef struct embedDBQuery {
+    /**
+     * @brief	Inclusive key range of the query. NULL for no bound
+     */
+    void* minKey;
+    void* maxKey;
+
+    /**
+     * @brief	Predicates that every returned record must satisfy
+     */
+    embedDBPredicate* predicates;
+    uint8_t numPredicates;
+
+    /**
+     * @brief	Columns of the result to output. 0 columns outputs all of them
+     */
+    uint8_t* projectionCols;
+    uint8_t numProjectionCols;
+
+    /**
+     * @brief	Function that returns whether two records are in the same group. NULL puts all records in one group. Only used with aggregates
+     */
+    int8_t (*groupfunc)(const void* lastRecord, const void* record);
+
+    /**
+     * @brief	Aggregate functions computed over each group. 0 functions returns the records themselves
+     */
+    embedDBAggregateFunc* aggregates;
+    uint32_t numAggregates;
+} embedDBQuery;
+
+typedef struct embedDBQueryPlan {
+    /**
+     * @brief	The initialized operator tree. Execute it with exec or execBatch
+     */
+    embedDBOperator* root;
+
+    /**
+     * @brief	Bit flags of the EMBEDDB_PLAN_ access paths that are used
+     */
+    uint8_t accessPath;
+
+    /**
+     * @brief	Access paths the query could use, and the data and index pages each is estimated to read. The cheapest is used
+     */
+    uint8_t candidatePaths[EMBEDDB_PLAN_MAX_CANDIDATES];
+    uint32_t candidateCosts[EMBEDDB_PLAN_MAX_CANDIDATES];
+    uint8_t numCandidates;
+
+    /**
+     * @brief	Logical ids of the first and last data pages that may be read. Only meaningful if estimatedDataPageReads is not 0
+     */
+    uint32_t firstPage;
+    uint32_t lastPage;
+
+    /**
+     * @brief	Fraction of the data pages in the range that the bitmap index is expected to keep
+     */
+    float bitmapSelectivity;
+
+    /**
+     * @brief	Estimated number of data and index pages read from storage when the plan is executed
+     */
+    uint32_t estimatedDataPageReads;
+    uint32_t estimatedIndexPageReads;
+
+    /**
+     * @brief	Iterator used by the table scan, or by the secondary index scan with EMBEDDB_PLAN_SECONDARY_INDEX
+     */
+    embedDBIterator iterator;
+    embedDBSecondaryIterator secondaryIterator;
+
+    /**
+     * @brief	Copy of the planned query. Its predicates are owned by the plan and are in the order they are applied.
+     * 			With the secondary index, the key range is checked by two more predicates at the end
+     */
+    embedDBQuery query;
+    embedDBState* state;
+    embedDBSchema* baseSchema;
+} embedDBQueryPlan;
+
+/**
+ * @brief	Plans a query: estimates the pages read by each access path, picks the cheapest, and builds and initializes the
+ * 			operator tree. The plan can be inspected before any page is read, and freed without being executed.
+ * @param	state		The state of the database to read from
+ * @param	baseSchema	The schema of the database being read from
+ * @param	query		Description of the query
+ * @return	The plan, or NULL if the query is invalid or memory could not be allocated
+ */
+embedDBQueryPlan* embedDBPlanQuery(embedDBState* state, embedDBSchema* baseSchema, embedDBQuery* query);
+
+/**
+ * @brief	Prints the operator tree, access path and estimated page reads of a plan
+ */
+void embedDBExplainQueryPlan(embedDBQueryPlan* plan);
+
+/**
+ * @brief	Closes and frees a plan and its operators, and sets the pointer to NULL
+ */
+void embedDBFreeQueryPlan(embedDBQueryPlan** plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -52,10 +52,10 @@
  * @param   colTypes        An array describing the type of the column. Use the defined constants embedDB_COLUMN_INT or embedDB_COLUMN_FLOAT
  */
 embedDBSchema* embedDBCreateSchema(uint8_t numCols, int8_t* colSizes, int8_t* colSignedness, ColumnType* colTypes) {
-    embedDBSchema* schema = malloc(sizeof(embedDBSchema));
-    schema->columnSizes = malloc(numCols * sizeof(int8_t));
+    embedDBSchema* schema = embedDBMalloc(sizeof(embedDBSchema));
+    schema->columnSizes = embedDBMalloc(numCols * sizeof(int8_t));
     schema->numCols = numCols;
-    schema->columnTypes = malloc(numCols * sizeof(ColumnType));
+    schema->columnTypes = embedDBMalloc(numCols * sizeof(ColumnType));
     memcpy(schema->columnTypes, colTypes, numCols * sizeof(ColumnType));
 
     uint16_t totalSize = 0;
@@ -89,9 +89,9 @@ embedDBSchema* embedDBCreateSchema(uint8_t numCols, int8_t* colSizes, int8_t* co
  */
 void embedDBFreeSchema(embedDBSchema** schema) {
     if (*schema == NULL) return;
-    free((*schema)->columnSizes);
-    free((*schema)->columnTypes);
-    free(*schema);
+    embedDBFree((*schema)->columnSizes);
+    embedDBFree((*schema)->columnTypes);
+    embedDBFree(*schema);
     *schema = NULL;
 }
 
@@ -103,14 +103,14 @@ void* createBufferFromSchema(embedDBSchema* schema) {
     for (uint8_t i = 0; i < schema->numCols; i++) {
         totalSize += abs(schema->columnSizes[i]);
     }
-    return calloc(1, totalSize);
+    return embedDBCalloc(1, totalSize);
 }
 
 /**
  * @brief	Deep copy schema and return a pointer to the copy
  */
 embedDBSchema* copySchema(const embedDBSchema* schema) {
-    embedDBSchema* copy = malloc(sizeof(embedDBSchema));
+    embedDBSchema* copy = embedDBMalloc(sizeof(embedDBSchema));
     if (copy == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: malloc failed while copying schema\n");
@@ -118,8 +118,8 @@ embedDBSchema* copySchema(const embedDBSchema* schema) {
         return NULL;
     }
     copy->numCols = schema->numCols;
-    copy->columnSizes = malloc(schema->numCols * sizeof(int8_t));
-    copy->columnTypes = malloc(schema->numCols * sizeof(ColumnType));
+    copy->columnSizes = embedDBMalloc(schema->numCols * sizeof(int8_t));
+    copy->columnTypes = embedDBMalloc(schema->numCols * sizeof(ColumnType));
     if (copy->columnSizes == NULL || copy->columnTypes == NULL) {
 #ifdef PRINT_ERRORS
         printf("ERROR: malloc failed while copying schema\n");
@@ -163,3 +163,148 @@ void printSchema(embedDBSchema* schema) {
     }
     printf("\n");
 }
+
+/* Allocations from an arena are aligned for any column type */
+#define ARENA_ALIGNMENT 8
+
+/* Each rule worker thread evaluates queries with its own arena */
+#ifdef EMBEDDB_RULE_THREAD
+#define ARENA_THREAD_LOCAL _Thread_local
+#else
+#define ARENA_THREAD_LOCAL
+#endif
+
+static ARENA_THREAD_LOCAL embedDBArena* currentArena = NULL;
+
+/* Arenas of the thread with allocations that were not released or freed, so memory is freed by its own arena whichever is in use */
+static ARENA_THREAD_LOCAL embedDBArena* liveArenas = NULL;
+
+/* Header of an allocation that overflowed to malloc, so freeing it takes it out of the arena's overflow */
+typedef struct arenaBlock {
+    struct arenaBlock* next;  // Next overflowed allocation of the arena
+    uint32_t size;            // Bytes counted in overflow for this allocation
+} arenaBlock;
+
+#define ARENA_BLOCK_HEADER_SIZE ((sizeof(arenaBlock) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT)
+
+static int8_t isArenaLive(embedDBArena* arena) {
+    return arena->used != 0 || arena->overflowBlocks != NULL;
+}
+
+static void removeLiveArena(embedDBArena* arena) {
+    for (embedDBArena** live = &liveArenas; *live != NULL; live = &(*live)->next) {
+        if (*live == arena) {
+            *live = arena->next;
+            arena->next = NULL;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief	Initialize an arena that allocates from memory
+ * @param	arena	Arena to initialize
+ * @param	memory	Memory to allocate from. It is used until the arena is no longer needed
+ * @param	size	Size of memory in bytes
+ */
+void embedDBArenaInit(embedDBArena* arena, void* memory, uint32_t size) {
+    removeLiveArena(arena);
+    uint32_t offset = (uint32_t)((ARENA_ALIGNMENT - (uintptr_t)memory % ARENA_ALIGNMENT) % ARENA_ALIGNMENT);
+    arena->memory = (uint8_t*)memory + offset;
+    arena->size = size > offset ? size - offset : 0;
+    arena->used = 0;
+    arena->overflow = 0;
+    arena->highWater = 0;
+    arena->overflowBlocks = NULL;
+    arena->next = NULL;
+}
+
+/**
+ * @brief	Makes the create*Operator, create*Aggregate and schema functions allocate from arena until another arena is used.
+ * 			Pass NULL to allocate with malloc again. Operators from an arena must be freed while it is in use, or not at all.
+ * @return	The arena that was in use before, or NULL
+ */
+embedDBArena* embedDBUseArena(embedDBArena* arena) {
+    embedDBArena* previous = currentArena;
+    currentArena = arena;
+    return previous;
+}
+
+/**
+ * @brief	Releases everything allocated from arena, so its memory can be reused by the next query.
+ * 			Allocations that overflowed to malloc must have been freed.
+ */
+void embedDBArenaRelease(embedDBArena* arena) {
+    arena->used = 0;
+    if (!isArenaLive(arena))
+        removeLiveArena(arena);
+}
+
+/**
+ * @brief	Allocates from the arena in use, or with malloc if there is none or it is full
+ */
+void* embedDBMalloc(size_t size) {
+    embedDBArena* arena = currentArena;
+    if (arena == NULL)
+        return malloc(size);
+
+    size_t alignedSize = (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+    int8_t wasLive = isArenaLive(arena);
+    void* ptr = NULL;
+    if (alignedSize <= arena->size - arena->used) {
+        ptr = arena->memory + arena->used;
+        arena->used += (uint32_t)alignedSize;
+    } else {
+        arenaBlock* block = malloc(ARENA_BLOCK_HEADER_SIZE + size);
+        if (block == NULL)
+            return NULL;
+        block->next = arena->overflowBlocks;
+        block->size = (uint32_t)alignedSize;
+        arena->overflowBlocks = block;
+        arena->overflow += block->size;
+        ptr = (uint8_t*)block + ARENA_BLOCK_HEADER_SIZE;
+    }
+    if (!wasLive) {
+        arena->next = liveArenas;
+        liveArenas = arena;
+    }
+    if (arena->used + arena->overflow > arena->highWater)
+        arena->highWater = arena->used + arena->overflow;
+    return ptr;
+}
+
+/**
+ * @brief	Allocates zeroed memory from the arena in use, or with calloc if there is none or it is full
+ */
+void* embedDBCalloc(size_t num, size_t size) {
+    if (currentArena == NULL)
+        return calloc(num, size);
+    void* ptr = embedDBMalloc(num * size);
+    if (ptr != NULL)
+        memset(ptr, 0, num * size);
+    return ptr;
+}
+
+/**
+ * @brief	Frees memory from embedDBMalloc or embedDBCalloc. Does nothing for memory of the arena in use.
+ */
+void embedDBFree(void* ptr) {
+    if (ptr == NULL)
+        return;
+    for (embedDBArena* arena = liveArenas; arena != NULL; arena = arena->next) {
+        if ((uint8_t*)ptr >= arena->memory && (uint8_t*)ptr < arena->memory + arena->size)
+            return;
+        for (arenaBlock** block = (arenaBlock**)&arena->overflowBlocks; *block != NULL; block = &(*block)->next) {
+            if ((uint8_t*)*block + ARENA_BLOCK_HEADER_SIZE == (uint8_t*)ptr) {
+                arenaBlock* freed = *block;
+                *block = freed->next;
+                arena->overflow -= freed->size;
+                free(freed);
+                if (!isArenaLive(arena))
+                    removeLiveArena(arena);
+                return;
+            }
+        }
+    }
+    free(ptr);
+}
@@ -40,6 +40,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define embedDB_COLUMN_SIGNED 0
@@ -100,6 +101,57 @@ uint16_t getRecordSizeFromSchema(embedDBSchema* schema);
 
 void printSchema(embedDBSchema* schema);
 
+/**
+ * @brief	A bump allocator for operators, aggregates, schemas and record buffers. While an arena is in use, they are
+ * 			allocated from its memory and freeing them does nothing. All of them are released at once with embedDBArenaRelease.
+ */
+typedef struct embedDBArena {
+    uint8_t* memory;            // Memory that allocations are taken from
+    uint32_t size;              // Size of memory in bytes
+    uint32_t used;              // Bytes allocated from memory since the last release
+    uint32_t overflow;          // Bytes allocated with malloc because memory was full and not freed yet
+    uint32_t highWater;         // Largest number of bytes needed at once, including overflow. Use it to size memory
+    void* overflowBlocks;       // List of the allocations counted in overflow
+    struct embedDBArena* next;  // Next arena of the thread with allocations that were not released
+} embedDBArena;
+
+/**
+ * @brief	Initialize an arena that allocates from memory. It must not have allocations that were not released or freed.
+ * @param	arena	Arena to initialize
+ * @param	memory	Memory to allocate from. It is used until the arena is no longer needed
+ * @param	size	Size of memory in bytes
+ */
+void embedDBArenaInit(embedDBArena* arena, void* memory, uint32_t size);
+
+/**
+ * @brief	Makes the create*Operator, create*Aggregate and schema functions allocate from arena until another arena is used.
+ * 			Pass NULL to allocate with malloc again. Operators from an arena can be freed whichever arena is in use, but on the
+ * 			same thread and before the arena is released.
+ * @return	The arena that was in use before, or NULL
+ */
+embedDBArena* embedDBUseArena(embedDBArena* arena);
+
+/**
+ * @brief	Releases everything allocated from the memory of arena, so it can be reused by the next query. Allocations that
+ * 			overflowed to malloc stay counted in overflow until they are freed. An arena must be released before it goes away.
+ */
+void embedDBArenaRelease(embedDBArena* arena);
+
+/**
+ * @brief	Allocates from the arena in use, or with malloc if there is none or it is full
+ */
+void* embedDBMalloc(size_t size);
+
+/**
+ * @brief	Allocates zeroed memory from the arena in use, or with calloc if there is none or it is full
+ */
+void* embedDBCalloc(size_t num, size_t size);
+
+/**
+ * @brief	Frees memory from embedDBMalloc or embedDBCalloc. Does nothing for memory of an arena, which is freed by embedDBArenaRelease.
+ */
+void embedDBFree(void* ptr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,87 @@
+/******************************************************************************/
+/**
+ * @file        testState.h
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Shared fixture of the operator tests: a table with only a data file, and an iterator over all of it.
+ *              Include after unity.h and the getFileInterface, setupFile and tearDownFile definitions of the test.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#ifndef EMBEDDB_TEST_STATE_H_
+#define EMBEDDB_TEST_STATE_H_
+
+/**
+ * @brief	Creates a table with 4 byte keys, int32 comparators and a two page buffer, and initializes it from the data file at path
+ */
+inline embedDBState* createState(char* path, uint8_t dataSize, uint16_t parameters) {
+    embedDBState* state = (embedDBState*)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+    state->keySize = 4;
+    state->dataSize = dataSize;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 2;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 20;
+    state->numDataPages = 1000;
+    state->eraseSizeInPages = 4;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(path);
+    state->parameters = parameters;
+    state->bitmapSize = 0;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(state, 1), "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+    return state;
+}
+
+/**
+ * @brief	Closes a table from createState and frees it
+ */
+inline void freeState(embedDBState* state) {
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+}
+
+/**
+ * @brief	Initializes an iterator over every record of a table
+ */
+inline void initFullIterator(embedDBState* state, embedDBIterator* it) {
+    it->minKey = NULL;
+    it->maxKey = NULL;
+    it->minData = NULL;
+    it->maxData = NULL;
+    embedDBInitIterator(state, it);
+}
+
+#endif
@@ -464,6 +464,401 @@ void test_whereClause(void){
     }
 }
 
+#define WINDOW_RECORDS 2500
+#define WINDOW_LENGTH 100
+
+int32_t windowValues[WINDOW_RECORDS];
+int32_t windowCurrentKey;
+
+int32_t windowValueForKey(int32_t key) {
+    return (key * 37) % 101 - 50;
+}
+
+// This function tests that the incremental window of a rule matches the last numLastEntries records,
+// including records that were inserted before the rule was added and records that have been written to storage.
+void test_SlidingWindowMatchesRecords(void) {
+    std::cout << "Running test_SlidingWindowMatchesRecords..." << std::endl;
+    CallbackContext* minContext = (CallbackContext*)malloc(sizeof(CallbackContext));
+    minContext->int1 = 0;
+    CallbackContext* avgContext = (CallbackContext*)malloc(sizeof(CallbackContext));
+    avgContext->int1 = 0;
+
+    state->rules = NULL;
+    state->numRules = 0;
+    int32_t key = 0;
+    for (; key < 300; key++) {
+        windowValues[key] = windowValueForKey(key);
+        embedDBPut(state, &key, &windowValues[key]);
+    }
+
+    state->rules = (activeRule**)malloc(2 * sizeof(activeRule*));
+    state->rules[0] = createActiveRule(schema, minContext);
+    state->rules[1] = createActiveRule(schema, avgContext);
+
+    int minThreshold = -1000;
+    float avgThreshold = -1000;
+    int numLast = WINDOW_LENGTH;
+    state->rules[0]->IF(state->rules[0], 1, GET_MIN)
+            ->ofLast(state->rules[0], (void*)&numLast)
+            ->is(state->rules[0], GreaterThanOrEqual, (void*)&minThreshold)
+            ->then(state->rules[0], [](void* minimum, void* current, void* ctx) {
+                int32_t expected = INT32_MAX;
+                for (int32_t k = windowCurrentKey - WINDOW_LENGTH + 1; k <= windowCurrentKey; k++) {
+                    if (windowValues[k] < expected) expected = windowValues[k];
+                }
+                TEST_ASSERT_EQUAL_INT32_MESSAGE(expected, *(int32_t*)minimum, "Window min does not match the last records.");
+                ((CallbackContext*)ctx)->int1++;
+    });
+    state->rules[1]->IF(state->rules[1], 1, GET_AVG)
+            ->ofLast(state->rules[1], (void*)&numLast)
+            ->is(state->rules[1], GreaterThanOrEqual, (void*)&avgThreshold)
+            ->then(state->rules[1], [](void* average, void* current, void* ctx) {
+                double sum = 0;
+                for (int32_t k = windowCurrentKey - WINDOW_LENGTH + 1; k <= windowCurrentKey; k++) {
+                    sum += windowValues[k];
+                }
+                TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.001f, (float)(sum / WINDOW_LENGTH), *(float*)average, "Window average does not match the last records.");
+                ((CallbackContext*)ctx)->int1++;
+    });
+    state->numRules = 2;
+
+    for (; key < WINDOW_RECORDS; key++) {
+        windowValues[key] = windowValueForKey(key);
+        windowCurrentKey = key;
+        embedDBPut(state, &key, &windowValues[key]);
+    }
+
+    TEST_ASSERT_EQUAL_INT32(WINDOW_RECORDS - 300, minContext->int1);
+    TEST_ASSERT_EQUAL_INT32(WINDOW_RECORDS - 300, avgContext->int1);
+
+    freeActiveRule(&state->rules[0]);
+    freeActiveRule(&state->rules[1]);
+    TEST_ASSERT_NULL(state->rules[0]);
+    free(state->rules);
+    state->rules = NULL;
+    free(minContext);
+    free(avgContext);
+    std::cout << "test_SlidingWindowMatchesRecords complete" << std::endl;
+}
+
+#define WINDOW_KEY_GAP 7
+
+// This function tests that the windows hold the last numLastEntries records when the keys are not consecutive,
+// both when rules run on insert and when queued records are evaluated after newer records were stored.
+void test_SlidingWindowWithKeyGaps(void) {
+    std::cout << "Running test_SlidingWindowWithKeyGaps..." << std::endl;
+    CallbackContext* minContext = (CallbackContext*)malloc(sizeof(CallbackContext));
+    minContext->int1 = 0;
+    CallbackContext* avgContext = (CallbackContext*)malloc(sizeof(CallbackContext));
+    avgContext->int1 = 0;
+
+    state->rules = NULL;
+    state->numRules = 0;
+    int32_t record = 0, key;
+    for (; record < 300; record++) {
+        windowValues[record] = windowValueForKey(record);
+        key = record * WINDOW_KEY_GAP;
+        embedDBPut(state, &key, &windowValues[record]);
+    }
+
+    state->rules = (activeRule**)malloc(2 * sizeof(activeRule*));
+    state->rules[0] = createActiveRule(schema, minContext);
+    state->rules[1] = createActiveRule(schema, avgContext);
+
+    // windowCurrentKey is the number of the record being evaluated
+    int minThreshold = -1000;
+    float avgThreshold = -1000;
+    int numLast = WINDOW_LENGTH;
+    state->rules[0]->IF(state->rules[0], 1, GET_MIN)
+            ->ofLast(state->rules[0], (void*)&numLast)
+            ->is(state->rules[0], GreaterThanOrEqual, (void*)&minThreshold)
+            ->then(state->rules[0], [](void* minimum, void* current, void* ctx) {
+                int32_t expected = INT32_MAX;
+                for (int32_t r = windowCurrentKey - WINDOW_LENGTH + 1; r <= windowCurrentKey; r++) {
+                    if (windowValues[r] < expected) expected = windowValues[r];
+                }
+                TEST_ASSERT_EQUAL_INT32_MESSAGE(expected, *(int32_t*)minimum, "Window min does not match the last records.");
+                ((CallbackContext*)ctx)->int1++;
+    });
+    state->rules[1]->IF(state->rules[1], 1, GET_AVG)
+            ->ofLast(state->rules[1], (void*)&numLast)
+            ->is(state->rules[1], GreaterThanOrEqual, (void*)&avgThreshold)
+            ->then(state->rules[1], [](void* average, void* current, void* ctx) {
+                double sum = 0;
+                for (int32_t r = windowCurrentKey - WINDOW_LENGTH + 1; r <= windowCurrentKey; r++) {
+                    sum += windowValues[r];
+                }
+                TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.001f, (float)(sum / WINDOW_LENGTH), *(float*)average, "Window average does not match the last records.");
+                ((CallbackContext*)ctx)->int1++;
+    });
+    state->numRules = 2;
+
+    for (; record < 1000; record++) {
+        windowValues[record] = windowValueForKey(record);
+        windowCurrentKey = record;
+        key = record * WINDOW_KEY_GAP;
+        embedDBPut(state, &key, &windowValues[record]);
+    }
+    TEST_ASSERT_EQUAL_INT32(700, minContext->int1);
+    TEST_ASSERT_EQUAL_INT32(700, avgContext->int1);
+
+    // Rebuild the windows from a queued record, when newer records are already stored
+    state->parameters |= EMBEDDB_ASYNC_RULES;
+    state->ruleQueueLength = 16;
+    resetActiveRuleWindow(state->rules[0]);
+    int32_t firstQueued = record;
+    for (; record < firstQueued + 10; record++) {
+        windowValues[record] = windowValueForKey(record);
+        key = record * WINDOW_KEY_GAP;
+        embedDBPut(state, &key, &windowValues[record]);
+    }
+    for (windowCurrentKey = firstQueued; windowCurrentKey < record; windowCurrentKey++) {
+        TEST_ASSERT_EQUAL_UINT32(1, embedDBProcessRules(state, 1));
+    }
+    TEST_ASSERT_EQUAL_INT32(710, minContext->int1);
+    TEST_ASSERT_EQUAL_INT32(710, avgContext->int1);
+
+    freeActiveRule(&state->rules[0]);
+    freeActiveRule(&state->rules[1]);
+    free(state->rules);
+    state->rules = NULL;
+    state->numRules = 0;
+    free(minContext);
+    free(avgContext);
+    std::cout << "test_SlidingWindowWithKeyGaps complete" << std::endl;
+}
+
+// This function tests that rules over the same window share one pass over storage
+// and still each get the correct aggregate.
+void test_RulesWithSameWindowShareScan(void) {
+    std::cout << "Running test_RulesWithSameWindowShareScan..." << std::endl;
+    CallbackContext* context = (CallbackContext*)malloc(sizeof(CallbackContext));
+    context->int1 = 0;
+
+    state->rules = NULL;
+    state->numRules = 0;
+    int32_t key = 0;
+    for (; key < 1000; key++) {
+        windowValues[key] = windowValueForKey(key);
+        embedDBPut(state, &key, &windowValues[key]);
+    }
+
+    int minThreshold = -1000;
+    float avgThreshold = -1000;
+    int numLast = 500;
+    activeRule* rules[3];
+    for (int i = 0; i < 3; i++) {
+        rules[i] = createActiveRule(schema, context);
+        rules[i]->ofLast(rules[i], (void*)&numLast);
+    }
+    rules[0]->IF(rules[0], 1, GET_MAX)
+            ->is(rules[0], GreaterThanOrEqual, (void*)&minThreshold)
+            ->then(rules[0], [](void* maximum, void* current, void* ctx) {
+                TEST_ASSERT_EQUAL_INT32_MESSAGE(50, *(int32_t*)maximum, "Window max is wrong.");
+                ((CallbackContext*)ctx)->int1++;
+    });
+    rules[1]->IF(rules[1], 1, GET_MIN)
+            ->is(rules[1], GreaterThanOrEqual, (void*)&minThreshold)
+            ->then(rules[1], [](void* minimum, void* current, void* ctx) {
+                TEST_ASSERT_EQUAL_INT32_MESSAGE(-50, *(int32_t*)minimum, "Window min is wrong.");
+                ((CallbackContext*)ctx)->int1++;
+    });
+    rules[2]->IF(rules[2], 1, GET_AVG)
+            ->is(rules[2], GreaterThanOrEqual, (void*)&avgThreshold)
+            ->then(rules[2], [](void* average, void* current, void* ctx) {
+                ((CallbackContext*)ctx)->int1++;
+    });
+
+    // One rule reads the window from storage once
+    state->rules = rules;
+    state->numRules = 1;
+    embedDBResetStats(state);
+    windowValues[key] = windowValueForKey(key);
+    embedDBPut(state, &key, &windowValues[key]);
+    key++;
+    uint32_t singleRuleReads = state->numReads;
+    TEST_ASSERT_GREATER_THAN_UINT32(0, singleRuleReads);
+
+    // Three rules over the same window do not read it three times
+    state->numRules = 3;
+    embedDBResetStats(state);
+    windowValues[key] = windowValueForKey(key);
+    embedDBPut(state, &key, &windowValues[key]);
+    key++;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(singleRuleReads, state->numReads, "Rules with the same window did not share a scan.");
+    TEST_ASSERT_EQUAL_INT32(4, context->int1);
+
+    for (int i = 0; i < 3; i++) {
+        freeActiveRule(&rules[i]);
+    }
+    state->rules = NULL;
+    state->numRules = 0;
+    free(context);
+    std::cout << "test_RulesWithSameWindowShareScan complete" << std::endl;
+}
+
+// This function tests that rules using EMBEDDB_ASYNC_RULES are only evaluated when embedDBProcessRules is called,
+// and that the windows are rebuilt correctly after the queue overflows.
+void test_AsyncRulesProcessedOnTick(void) {
+    std::cout << "Running test_AsyncRulesProcessedOnTick..." << std::endl;
+    CallbackContext* context = (CallbackContext*)malloc(sizeof(CallbackContext));
+    context->int1 = 0;
+    context->int2 = 0;
+
+    state->parameters |= EMBEDDB_ASYNC_RULES;
+    state->ruleQueueLength = 8;
+    state->rules = (activeRule**)malloc(sizeof(activeRule*));
+    state->rules[0] = createActiveRule(schema, context);
+
+    int threshold = -1000;
+    int numLast = 5;
+    state->rules[0]->IF(state->rules[0], 1, GET_MAX)
+            ->ofLast(state->rules[0], (void*)&numLast)
+            ->is(state->rules[0], GreaterThanOrEqual, (void*)&threshold)
+            ->then(state->rules[0], [](void* maximum, void* current, void* ctx) {
+                CallbackContext* context = (CallbackContext*)ctx;
+                int32_t expected = INT32_MIN;
+                for (int32_t k = context->int2 - 4; k <= context->int2; k++) {
+                    if (k >= 0 && windowValueForKey(k) > expected) expected = windowValueForKey(k);
+                }
+                TEST_ASSERT_EQUAL_INT32_MESSAGE(expected, *(int32_t*)maximum, "Queued record was evaluated with the wrong window.");
+                context->int1++;
+    });
+    state->numRules = 1;
+
+    int32_t key = 0;
+    for (; key < 6; key++) {
+        int32_t value = windowValueForKey(key);
+        embedDBPut(state, &key, &value);
+    }
+    TEST_ASSERT_EQUAL_INT32_MESSAGE(0, context->int1, "Rules should not run during embedDBPut.");
+
+    embedDBRuleQueueStats stats;
+    embedDBGetRuleQueueStats(state, &stats);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.depth);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.highWaterMark);
+
+    // Evaluate the queued records one at a time, so the callback knows which key it is for
+    for (context->int2 = 0; context->int2 < 6; context->int2++) {
+        TEST_ASSERT_EQUAL_UINT32(1, embedDBProcessRules(state, 1));
+    }
+    TEST_ASSERT_EQUAL_INT32(6, context->int1);
+
+    // Overflow the queue, the records after the dropped ones must still see every stored record
+    for (; key < 26; key++) {
+        int32_t value = windowValueForKey(key);
+        embedDBPut(state, &key, &value);
+    }
+    embedDBGetRuleQueueStats(state, &stats);
+    TEST_ASSERT_EQUAL_UINT32(8, stats.depth);
+    TEST_ASSERT_EQUAL_UINT32(8, stats.highWaterMark);
+    TEST_ASSERT_EQUAL_UINT32(12, stats.dropped);
+
+    for (context->int2 = 6; context->int2 < 14; context->int2++) {
+        TEST_ASSERT_EQUAL_UINT32(1, embedDBProcessRules(state, 1));
+    }
+    key = 26;
+    int32_t value = windowValueForKey(key);
+    embedDBPut(state, &key, &value);
+    context->int2 = 26;
+    TEST_ASSERT_EQUAL_UINT32(1, embedDBProcessRules(state, 10));
+    TEST_ASSERT_EQUAL_UINT32(0, embedDBProcessRules(state, 10));
+    TEST_ASSERT_EQUAL_INT32(15, context->int1);
+
+    freeActiveRule(&state->rules[0]);
+    free(state->rules);
+    state->rules = NULL;
+    state->numRules = 0;
+    free(context);
+    std::cout << "test_AsyncRulesProcessedOnTick complete" << std::endl;
+}
+
+// Sets up a rule that counts the records whose window was evaluated, for the tests that only check how many records are processed.
+void setUpCountingRule(CallbackContext* context) {
+    context->int1 = 0;
+    context->int2 = 0;
+    state->rules = (activeRule**)malloc(sizeof(activeRule*));
+    state->rules[0] = createActiveRule(schema, context);
+
+    static int threshold = -1000;
+    static int numLast = 3;
+    state->rules[0]->IF(state->rules[0], 1, GET_MAX)
+            ->ofLast(state->rules[0], (void*)&numLast)
+            ->is(state->rules[0], GreaterThanOrEqual, (void*)&threshold)
+            ->then(state->rules[0], [](void* maximum, void* current, void* ctx) {
+                ((CallbackContext*)ctx)->int1++;
+    });
+    state->numRules = 1;
+}
+
+void freeCountingRule(CallbackContext* context) {
+    freeActiveRule(&state->rules[0]);
+    free(state->rules);
+    state->rules = NULL;
+    state->numRules = 0;
+    free(context);
+}
+
+// This function tests that a budget of 0 evaluates every queued record.
+void test_AsyncRulesZeroBudgetProcessesAll(void) {
+    std::cout << "Running test_AsyncRulesZeroBudgetProcessesAll..." << std::endl;
+    CallbackContext* context = (CallbackContext*)malloc(sizeof(CallbackContext));
+    state->parameters |= EMBEDDB_ASYNC_RULES;
+    state->ruleQueueLength = 16;
+    setUpCountingRule(context);
+
+    for (int32_t key = 0; key < 10; key++) {
+        int32_t value = key;
+        embedDBPut(state, &key, &value);
+    }
+    TEST_ASSERT_EQUAL_INT32(0, context->int1);
+    TEST_ASSERT_EQUAL_UINT32(10, embedDBProcessRules(state, 0));
+    TEST_ASSERT_EQUAL_INT32(10, context->int1);
+
+    embedDBRuleQueueStats stats;
+    embedDBGetRuleQueueStats(state, &stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.depth);
+    TEST_ASSERT_EQUAL_UINT32(0, embedDBProcessRules(state, 0));
+
+    freeCountingRule(context);
+    std::cout << "test_AsyncRulesZeroBudgetProcessesAll complete" << std::endl;
+}
+
+#ifdef EMBEDDB_RULE_THREAD
+// This function tests that the worker thread evaluates queued records, and that stopping it evaluates the rest.
+void test_RuleWorkerProcessesQueue(void) {
+    std::cout << "Running test_RuleWorkerProcessesQueue..." << std::endl;
+    CallbackContext* context = (CallbackContext*)malloc(sizeof(CallbackContext));
+    state->parameters |= EMBEDDB_ASYNC_RULES;
+    state->ruleQueueLength = 1024;
+    setUpCountingRule(context);
+
+    TEST_ASSERT_EQUAL_INT8(0, embedDBStartRuleWorker(state));
+    TEST_ASSERT_EQUAL_INT8(-1, embedDBStartRuleWorker(state));
+    for (int32_t key = 0; key < 500; key++) {
+        int32_t value = key;
+        embedDBPut(state, &key, &value);
+    }
+
+    // Reads from the application are serialized with the worker
+    int8_t locked = lockActiveRules(state);
+    int32_t key = 250, value = 0;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBGet(state, &key, &value));
+    TEST_ASSERT_EQUAL_INT32(250, value);
+    unlockActiveRules(state, locked);
+
+    embedDBStopRuleWorker(state);
+    embedDBRuleQueueStats stats;
+    embedDBGetRuleQueueStats(state, &stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.depth);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped);
+    TEST_ASSERT_EQUAL_INT32(500, context->int1);
+
+    freeCountingRule(context);
+    std::cout << "test_RuleWorkerProcessesQueue complete" << std::endl;
+}
+#endif
+
 int runUnityTests(void) {
     UNITY_BEGIN();
     RUN_TEST(test_MaxEqual);
@@ -473,6 +868,14 @@ int runUnityTests(void) {
     RUN_TEST(test_MultipleQueries);
     RUN_TEST(test_CustomQuery);
     RUN_TEST(test_whereClause);
+    RUN_TEST(test_SlidingWindowMatchesRecords);
+    RUN_TEST(test_SlidingWindowWithKeyGaps);
+    RUN_TEST(test_RulesWithSameWindowShareScan);
+    RUN_TEST(test_AsyncRulesProcessedOnTick);
+    RUN_TEST(test_AsyncRulesZeroBudgetProcessesAll);
+#ifdef EMBEDDB_RULE_THREAD
+    RUN_TEST(test_RuleWorkerProcessesQueue);
+#endif
     return UNITY_END();
 }
 
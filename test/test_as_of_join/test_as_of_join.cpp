@@ -0,0 +1,240 @@
+/******************************************************************************/
+/**
+ * @file        test_as_of_join.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test the as-of join operator.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define EVENT_PATH "eventFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define EVENT_PATH "build/artifacts/eventFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 20000
+#define SPARSE_STEP 300
+
+embedDBState* denseState;
+embedDBState* sparseState;
+embedDBSchema* denseSchema;
+embedDBSchema* sparseSchema;
+embedDBIterator denseIt;
+embedDBIterator sparseIt;
+
+// The sparse table has no records between 3000 and 15000
+int8_t isSparseKey(uint32_t key) {
+    return key % SPARSE_STEP == 0 && (key < 3000 || (key >= 15000 && key < NUM_RECORDS));
+}
+
+/**
+ * @brief	Finds the latest sparse key at or before key
+ * @return	1 if there is one, 0 otherwise
+ */
+int8_t floorSparseKey(uint32_t key, uint32_t* floorKey) {
+    for (int64_t k = key; k >= 0; k--) {
+        if (isSparseKey(k)) {
+            *floorKey = k;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void setUp(void) {
+    char densePath[] = DATA_PATH, sparsePath[] = EVENT_PATH;
+    denseState = createState(densePath, 8, EMBEDDB_RESET_DATA);
+    sparseState = createState(sparsePath, 4, EMBEDDB_RESET_DATA);
+
+    uint32_t data[2];
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        data[0] = key / 100;
+        data[1] = key % 10;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(denseState, &key, data), "embedDBPut failed.");
+        if (isSparseKey(key)) {
+            TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(sparseState, &key, &key), "embedDBPut failed.");
+        }
+    }
+    embedDBFlush(denseState);
+    embedDBFlush(sparseState);
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32};
+    denseSchema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+    sparseSchema = embedDBCreateSchema(2, colSizes, colSignedness, colTypes);
+
+    initFullIterator(denseState, &denseIt);
+    initFullIterator(sparseState, &sparseIt);
+}
+
+void tearDown(void) {
+    embedDBCloseIterator(&denseIt);
+    embedDBCloseIterator(&sparseIt);
+    embedDBFreeSchema(&denseSchema);
+    embedDBFreeSchema(&sparseSchema);
+    freeState(denseState);
+    freeState(sparseState);
+}
+
+void as_of_join_should_match_latest_earlier_record(void) {
+    embedDBOperator* denseScan = createTableScanOperator(denseState, &denseIt, denseSchema);
+    embedDBOperator* sparseScan = createTableScanOperator(sparseState, &sparseIt, sparseSchema);
+    embedDBOperator* joinOp = createAsOfJoinOperator(denseScan, sparseScan, NULL);
+    joinOp->init(joinOp);
+    TEST_ASSERT_EQUAL_UINT8(5, joinOp->schema->numCols);
+
+    uint32_t count = 0, floorKey = 0;
+    uint32_t* recordBuffer = (uint32_t*)joinOp->recordBuffer;
+    while (exec(joinOp)) {
+        TEST_ASSERT_EQUAL_UINT32(count, recordBuffer[0]);
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[0] / 100, recordBuffer[1]);
+        TEST_ASSERT_TRUE(floorSparseKey(recordBuffer[0], &floorKey));
+        TEST_ASSERT_EQUAL_UINT32(floorKey, recordBuffer[3]);
+        TEST_ASSERT_EQUAL_UINT32(floorKey, recordBuffer[4]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(NUM_RECORDS, count, "As-of join didn't match every left record.");
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+    free(sparseScan);
+}
+
+void as_of_join_should_skip_left_records_outside_tolerance(void) {
+    uint32_t tolerance = 50;
+    embedDBOperator* denseScan = createTableScanOperator(denseState, &denseIt, denseSchema);
+    embedDBOperator* sparseScan = createTableScanOperator(sparseState, &sparseIt, sparseSchema);
+    embedDBOperator* joinOp = createAsOfJoinOperator(denseScan, sparseScan, &tolerance);
+    joinOp->init(joinOp);
+
+    uint32_t expected = 0, floorKey = 0;
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        if (floorSparseKey(key, &floorKey) && key - floorKey <= tolerance)
+            expected++;
+    }
+
+    embedDBResetStats(denseState);
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)joinOp->recordBuffer;
+    while (exec(joinOp)) {
+        TEST_ASSERT_TRUE(floorSparseKey(recordBuffer[0], &floorKey));
+        TEST_ASSERT_EQUAL_UINT32(floorKey, recordBuffer[3]);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(tolerance, recordBuffer[0] - recordBuffer[3]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(expected, count, "As-of join didn't return every match within the tolerance.");
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(denseState->nextDataPageId / 2, denseState->numReads, "As-of join read the whole left table.");
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+    free(sparseScan);
+}
+
+void as_of_join_should_seek_right_input_with_tolerance(void) {
+    uint32_t tolerance = 5;
+    embedDBOperator* sparseScan = createTableScanOperator(sparseState, &sparseIt, sparseSchema);
+    embedDBOperator* denseScan = createTableScanOperator(denseState, &denseIt, denseSchema);
+    embedDBOperator* joinOp = createAsOfJoinOperator(sparseScan, denseScan, &tolerance);
+    joinOp->init(joinOp);
+
+    embedDBResetStats(denseState);
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)joinOp->recordBuffer;
+    while (exec(joinOp)) {
+        TEST_ASSERT_TRUE(isSparseKey(recordBuffer[0]));
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[0], recordBuffer[2]);
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[2] / 100, recordBuffer[3]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(3000 / SPARSE_STEP + (NUM_RECORDS - 15000) / SPARSE_STEP + 1, count, "As-of join didn't match every left record.");
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(denseState->nextDataPageId / 2, denseState->numReads, "As-of join read the whole right table.");
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+    free(denseScan);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(as_of_join_should_match_latest_earlier_record);
+    RUN_TEST(as_of_join_should_skip_left_records_outside_tolerance);
+    RUN_TEST(as_of_join_should_seek_right_input_with_tolerance);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,283 @@
+/******************************************************************************/
+/**
+ * @file        test_bloom_filter.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test EmbedDB per-page Bloom filters.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <math.h>
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define INDEX_PATH "indexFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define INDEX_PATH "build/artifacts/indexFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 6000
+#define RECORDS_PER_SENSOR 200
+
+embedDBState* state;
+
+void insertSensorRecords(uint32_t numRecords) {
+    int32_t data[2];
+    for (uint32_t key = 0; key < numRecords; key++) {
+        data[0] = key / RECORDS_PER_SENSOR;
+        data[1] = key % 97;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+}
+
+void setUp(void) {
+    state = (embedDBState*)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+
+    state->keySize = 4;
+    state->dataSize = 8;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 4;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 20;
+    state->numDataPages = 1000;
+    state->numIndexPages = 16;
+    state->eraseSizeInPages = 4;
+
+    char dataPath[] = DATA_PATH, indexPath[] = INDEX_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->indexFile = setupFile(indexPath);
+
+    state->parameters = EMBEDDB_USE_INDEX | EMBEDDB_USE_BLOOM | EMBEDDB_RESET_DATA;
+    state->bitmapSize = 0;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+
+    /* Bloom filter on the first data column (sensor id) */
+    state->bloomFilterSize = 8;
+    state->numBloomHashes = 3;
+    state->numBloomColumns = 1;
+    state->bloomColumnOffsets[0] = 0;
+    state->bloomColumnSizes[0] = 4;
+
+    int8_t result = embedDBInit(state, 1);
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, result, "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+}
+
+void tearDown(void) {
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    tearDownFile(state->indexFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+    state = NULL;
+}
+
+void embedDBInit_should_reject_bloom_filter_without_index(void) {
+    embedDBState* badState = (embedDBState*)malloc(sizeof(embedDBState));
+    memcpy(badState, state, sizeof(embedDBState));
+    badState->parameters = EMBEDDB_USE_BLOOM | EMBEDDB_RESET_DATA;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(-1, embedDBInit(badState, 1), "EmbedDB should not allow a Bloom filter without an index.");
+    free(badState);
+}
+
+void embedDBIterator_with_bloom_probe_should_only_return_matching_records(void) {
+    insertSensorRecords(NUM_RECORDS);
+
+    embedDBIterator it;
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+
+    int32_t sensorId = 7;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSetBloomProbe(state, &it, 0, &sensorId));
+
+    embedDBResetStats(state);
+    uint32_t key = 0, count = 0;
+    int32_t data[2];
+    while (embedDBNext(state, &it, &key, data)) {
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(sensorId, data[0], "Iterator returned a record with the wrong sensor id.");
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(sensorId * RECORDS_PER_SENSOR + count, key, "Iterator returned an unexpected key.");
+        count++;
+    }
+    embedDBCloseIterator(&it);
+
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(RECORDS_PER_SENSOR, count, "Iterator did not return all records for the sensor.");
+
+    /* Only the pages holding the sensor and the pages without a saved index record should be read */
+    uint32_t unindexedPages = state->nextDataPageId - state->nextIdxPageId * state->maxIdxRecordsPerPage;
+    uint32_t sensorPages = RECORDS_PER_SENSOR / state->maxRecordsPerPage + 2;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(unindexedPages + sensorPages, state->numReads, "Bloom filter did not skip data pages.");
+}
+
+void embedDBIterator_with_bloom_probe_should_find_records_in_write_buffer(void) {
+    insertSensorRecords(NUM_RECORDS);
+
+    embedDBIterator it;
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+
+    int32_t sensorId = (NUM_RECORDS - 1) / RECORDS_PER_SENSOR;
+    embedDBIteratorSetBloomProbe(state, &it, 0, &sensorId);
+
+    uint32_t key = 0, count = 0;
+    int32_t data[2];
+    while (embedDBNext(state, &it, &key, data)) {
+        TEST_ASSERT_EQUAL_INT32(sensorId, data[0]);
+        count++;
+    }
+    embedDBCloseIterator(&it);
+
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(NUM_RECORDS - sensorId * RECORDS_PER_SENSOR, count, "Iterator did not return the records in the write buffer.");
+}
+
+void embedDBIterator_with_bloom_probe_should_return_nothing_for_missing_value(void) {
+    insertSensorRecords(NUM_RECORDS);
+
+    embedDBIterator it;
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+
+    int32_t sensorId = 12345;
+    embedDBIteratorSetBloomProbe(state, &it, 0, &sensorId);
+
+    embedDBResetStats(state);
+    uint32_t key = 0;
+    int32_t data[2];
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBNext(state, &it, &key, data), "Iterator returned a record for a value that was never inserted.");
+    embedDBCloseIterator(&it);
+
+    uint32_t unindexedPages = state->nextDataPageId - state->nextIdxPageId * state->maxIdxRecordsPerPage;
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(state->nextDataPageId / 2, state->numReads, "Bloom filter did not skip data pages.");
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(unindexedPages, state->numReads);
+}
+
+void selection_on_bloom_column_should_skip_pages(void) {
+    insertSensorRecords(NUM_RECORDS);
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_SIGNED, embedDB_COLUMN_SIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_INT32, embedDB_COLUMN_INT32};
+    embedDBSchema* schema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+
+    embedDBIterator it;
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+
+    int32_t sensorId = 3;
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* selectOp = createSelectionOperator(scanOp, 1, SELECT_EQ, &sensorId);
+    selectOp->init(selectOp);
+
+    embedDBResetStats(state);
+    uint32_t count = 0;
+    int32_t* recordBuffer = (int32_t*)selectOp->recordBuffer;
+    while (exec(selectOp)) {
+        TEST_ASSERT_EQUAL_INT32(sensorId, recordBuffer[1]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(RECORDS_PER_SENSOR, count, "Selection did not return all records for the sensor.");
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(state->nextDataPageId / 2, state->numReads, "Selection did not use the Bloom filter to skip pages.");
+
+    selectOp->close(selectOp);
+    embedDBFreeOperatorRecursive(&selectOp);
+    embedDBCloseIterator(&it);
+    embedDBFreeSchema(&schema);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(embedDBInit_should_reject_bloom_filter_without_index);
+    RUN_TEST(embedDBIterator_with_bloom_probe_should_only_return_matching_records);
+    RUN_TEST(embedDBIterator_with_bloom_probe_should_find_records_in_write_buffer);
+    RUN_TEST(embedDBIterator_with_bloom_probe_should_return_nothing_for_missing_value);
+    RUN_TEST(selection_on_bloom_column_should_skip_pages);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
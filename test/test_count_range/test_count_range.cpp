@@ -0,0 +1,259 @@
+/******************************************************************************/
+/**
+ * @file        test_count_range.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test counting the records in a key range with embedDBCountRange.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 5000
+
+embedDBState *state;
+
+// Keys come in runs of 500 separated by gaps of 500
+uint32_t keyOf(uint32_t record) {
+    return (record / 500) * 1000 + record % 500;
+}
+
+void setUpState(uint16_t parameters) {
+    state = (embedDBState *)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+    state->keySize = 4;
+    state->dataSize = 4;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 2;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 30;
+    state->numDataPages = 1000;
+    state->eraseSizeInPages = 4;
+    char dataPath[] = DATA_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->parameters = parameters;
+    state->bitmapSize = 0;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(state, 1), "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+        uint32_t key = keyOf(i), data = i;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, &data), "embedDBPut failed.");
+    }
+}
+
+void setUp(void) {
+    setUpState(EMBEDDB_RESET_DATA);
+}
+
+void tearDown(void) {
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+}
+
+uint32_t countByIterating(uint32_t *minKey, uint32_t *maxKey) {
+    embedDBIterator it;
+    it.minKey = minKey;
+    it.maxKey = maxKey;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+    uint32_t key, data, count = 0;
+    while (embedDBNext(state, &it, &key, &data)) {
+        count++;
+    }
+    embedDBCloseIterator(&it);
+    return count;
+}
+
+// Ranges that start and end in runs, in gaps, before and after the records, and in the write buffer
+uint32_t bounds[] = {0, 1, 250, 499, 500, 750, 1000, 1001, 2345, 4999, 5000, 6200, 7777, 9000, 9400, 9499, 9500, 12000};
+#define NUM_BOUNDS (sizeof(bounds) / sizeof(bounds[0]))
+
+void count_range_should_be_exact(void) {
+    uint32_t count;
+    for (uint32_t i = 0; i < NUM_BOUNDS; i++) {
+        for (uint32_t j = 0; j < NUM_BOUNDS; j++) {
+            TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &bounds[i], &bounds[j], EMBEDDB_COUNT_EXACT, &count));
+            TEST_ASSERT_EQUAL_UINT32(countByIterating(&bounds[i], &bounds[j]), count);
+        }
+        TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &bounds[i], NULL, EMBEDDB_COUNT_EXACT, &count));
+        TEST_ASSERT_EQUAL_UINT32(countByIterating(&bounds[i], NULL), count);
+        TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, NULL, &bounds[i], EMBEDDB_COUNT_EXACT, &count));
+        TEST_ASSERT_EQUAL_UINT32(countByIterating(NULL, &bounds[i]), count);
+    }
+    TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, NULL, NULL, EMBEDDB_COUNT_EXACT, &count));
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+}
+
+void count_range_should_be_exact_with_binary_search(void) {
+    tearDown();
+    setUpState(EMBEDDB_RESET_DATA | EMBEDDB_USE_BINARY_SEARCH);
+    uint32_t count;
+    for (uint32_t i = 0; i < NUM_BOUNDS; i++) {
+        for (uint32_t j = i; j < NUM_BOUNDS; j++) {
+            // Without a spline the estimate is also exact
+            TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &bounds[i], &bounds[j], EMBEDDB_COUNT_ESTIMATE, &count));
+            TEST_ASSERT_EQUAL_UINT32(countByIterating(&bounds[i], &bounds[j]), count);
+        }
+    }
+}
+
+void count_range_should_only_read_boundary_pages(void) {
+    uint32_t minKey = 1234, maxKey = 8321, count;
+    state->numReads = 0;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &minKey, &maxKey, EMBEDDB_COUNT_EXACT, &count));
+    TEST_ASSERT_EQUAL_UINT32(countByIterating(&minKey, &maxKey), count);
+
+    state->numReads = 0;
+    state->bufferedPageId = -1;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &minKey, &maxKey, EMBEDDB_COUNT_EXACT, &count));
+    TEST_ASSERT_TRUE(state->numReads <= 4);
+}
+
+void count_range_should_count_partly_filled_pages(void) {
+    // Flush a partly filled page into the middle of the records
+    uint32_t key = 20000, data = 0;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBPut(state, &key, &data));
+    TEST_ASSERT_EQUAL_INT8(0, embedDBFlush(state));
+    for (key = 20001; key < 20500; key++) {
+        TEST_ASSERT_EQUAL_INT8(0, embedDBPut(state, &key, &data));
+    }
+
+    uint32_t minKey = 1234, maxKey = 20250, count;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &minKey, &maxKey, EMBEDDB_COUNT_EXACT, &count));
+    TEST_ASSERT_EQUAL_UINT32(countByIterating(&minKey, &maxKey), count);
+    TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, NULL, NULL, EMBEDDB_COUNT_EXACT, &count));
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS + 500, count);
+
+    // Pages after the partly filled one are full, so only the boundary pages are read
+    minKey = 20100;
+    state->numReads = 0;
+    state->bufferedPageId = -1;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &minKey, &maxKey, EMBEDDB_COUNT_EXACT, &count));
+    TEST_ASSERT_TRUE(state->numReads <= 4);
+    TEST_ASSERT_EQUAL_UINT32(countByIterating(&minKey, &maxKey), count);
+}
+
+void count_range_estimate_should_not_read_storage(void) {
+    uint32_t count, tolerance = 2 * state->maxRecordsPerPage;
+    state->numReads = 0;
+    for (uint32_t i = 0; i < NUM_BOUNDS; i++) {
+        for (uint32_t j = i; j < NUM_BOUNDS; j++) {
+            TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &bounds[i], &bounds[j], EMBEDDB_COUNT_ESTIMATE, &count));
+            uint32_t exact = countByIterating(&bounds[i], &bounds[j]);
+            TEST_ASSERT_TRUE(count + tolerance >= exact && count <= exact + tolerance);
+        }
+    }
+
+    state->numReads = 0;
+    for (uint32_t i = 0; i < NUM_BOUNDS; i++) {
+        TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &bounds[i], NULL, EMBEDDB_COUNT_ESTIMATE, &count));
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, state->numReads);
+}
+
+void count_range_should_be_zero_for_empty_ranges(void) {
+    uint32_t minKey = 600, maxKey = 900, count = 1;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &minKey, &maxKey, EMBEDDB_COUNT_EXACT, &count));
+    TEST_ASSERT_EQUAL_UINT32(0, count);
+
+    minKey = 3000;
+    maxKey = 2000;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &minKey, &maxKey, EMBEDDB_COUNT_EXACT, &count));
+    TEST_ASSERT_EQUAL_UINT32(0, count);
+    TEST_ASSERT_EQUAL_INT8(0, embedDBCountRange(state, &minKey, &maxKey, EMBEDDB_COUNT_ESTIMATE, &count));
+    TEST_ASSERT_EQUAL_UINT32(0, count);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(count_range_should_be_exact);
+    RUN_TEST(count_range_should_be_exact_with_binary_search);
+    RUN_TEST(count_range_should_only_read_boundary_pages);
+    RUN_TEST(count_range_should_count_partly_filled_pages);
+    RUN_TEST(count_range_estimate_should_not_read_storage);
+    RUN_TEST(count_range_should_be_zero_for_empty_ranges);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,225 @@
+/******************************************************************************/
+/**
+ * @file        test_floor_ceil.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test nearest key lookups with embedDBGetFloor and embedDBGetCeil.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 3000
+#define KEY_STEP 3
+#define FIRST_KEY 1
+#define LAST_KEY (FIRST_KEY + (NUM_RECORDS - 1) * KEY_STEP)
+
+embedDBState *state;
+
+void setUpState(uint16_t parameters) {
+    state = (embedDBState *)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+    state->keySize = 4;
+    state->dataSize = 4;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 2;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 8;
+    state->numDataPages = 1000;
+    state->eraseSizeInPages = 4;
+    char dataPath[] = DATA_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->parameters = parameters;
+    state->bitmapSize = 0;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(state, 1), "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+}
+
+void insertRecords(uint32_t numRecords) {
+    for (uint32_t i = 0; i < numRecords; i++) {
+        uint32_t key = FIRST_KEY + i * KEY_STEP;
+        uint32_t data = i;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, &data), "embedDBPut failed.");
+    }
+}
+
+void setUp(void) {
+    setUpState(EMBEDDB_RESET_DATA);
+}
+
+void tearDown(void) {
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+}
+
+// Checks every key from before the first record to after the last, including the gaps between keys and pages
+void checkAllLookups(uint32_t lastKey) {
+    for (uint32_t query = 0; query <= lastKey + KEY_STEP; query++) {
+        uint32_t key = 0, data = 0;
+        int8_t result = embedDBGetFloor(state, &query, &key, &data);
+        if (query < FIRST_KEY) {
+            TEST_ASSERT_EQUAL_INT8(NO_RECORD_FOUND, result);
+        } else {
+            uint32_t expected = query > lastKey ? lastKey : query - (query - FIRST_KEY) % KEY_STEP;
+            TEST_ASSERT_EQUAL_INT8(0, result);
+            TEST_ASSERT_EQUAL_UINT32(expected, key);
+            TEST_ASSERT_EQUAL_UINT32((expected - FIRST_KEY) / KEY_STEP, data);
+        }
+
+        result = embedDBGetCeil(state, &query, &key, &data);
+        if (query > lastKey) {
+            TEST_ASSERT_EQUAL_INT8(NO_RECORD_FOUND, result);
+        } else {
+            uint32_t expected = query < FIRST_KEY ? FIRST_KEY : query + (KEY_STEP - (query - FIRST_KEY) % KEY_STEP) % KEY_STEP;
+            TEST_ASSERT_EQUAL_INT8(0, result);
+            TEST_ASSERT_EQUAL_UINT32(expected, key);
+            TEST_ASSERT_EQUAL_UINT32((expected - FIRST_KEY) / KEY_STEP, data);
+        }
+    }
+}
+
+void floor_and_ceil_should_find_nearest_keys(void) {
+    insertRecords(NUM_RECORDS);
+    checkAllLookups(LAST_KEY);
+}
+
+void floor_and_ceil_should_find_nearest_keys_with_binary_search(void) {
+    tearDown();
+    setUpState(EMBEDDB_RESET_DATA | EMBEDDB_USE_BINARY_SEARCH);
+    insertRecords(NUM_RECORDS);
+    checkAllLookups(LAST_KEY);
+}
+
+void floor_and_ceil_should_find_nearest_keys_after_flush(void) {
+    insertRecords(NUM_RECORDS);
+    embedDBFlush(state);
+    checkAllLookups(LAST_KEY);
+}
+
+void floor_and_ceil_should_use_write_buffer(void) {
+    // Too few records to fill a page
+    insertRecords(10);
+    uint32_t numReads = state->numReads;
+    checkAllLookups(FIRST_KEY + 9 * KEY_STEP);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(numReads, state->numReads, "Lookups in the write buffer should not read storage.");
+}
+
+void floor_and_ceil_should_find_nothing_when_empty(void) {
+    uint32_t query = 10, key, data;
+    TEST_ASSERT_EQUAL_INT8(NO_RECORD_FOUND, embedDBGetFloor(state, &query, &key, &data));
+    TEST_ASSERT_EQUAL_INT8(NO_RECORD_FOUND, embedDBGetCeil(state, &query, &key, &data));
+}
+
+void floor_and_ceil_should_read_at_most_two_pages(void) {
+    insertRecords(NUM_RECORDS);
+
+    // Includes keys in the gaps between pages
+    uint32_t maxReads = 0;
+    for (uint32_t query = FIRST_KEY; query <= LAST_KEY; query += 5) {
+        uint32_t key;
+        state->numReads = 0;
+        state->bufferedPageId = -1;
+        TEST_ASSERT_EQUAL_INT8(0, embedDBGetFloor(state, &query, &key, NULL));
+        if (state->numReads > maxReads)
+            maxReads = state->numReads;
+
+        state->numReads = 0;
+        state->bufferedPageId = -1;
+        TEST_ASSERT_EQUAL_INT8(0, embedDBGetCeil(state, &query, &key, NULL));
+        if (state->numReads > maxReads)
+            maxReads = state->numReads;
+    }
+    TEST_ASSERT_TRUE(maxReads <= 2);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(floor_and_ceil_should_find_nearest_keys);
+    RUN_TEST(floor_and_ceil_should_find_nearest_keys_with_binary_search);
+    RUN_TEST(floor_and_ceil_should_find_nearest_keys_after_flush);
+    RUN_TEST(floor_and_ceil_should_use_write_buffer);
+    RUN_TEST(floor_and_ceil_should_find_nothing_when_empty);
+    RUN_TEST(floor_and_ceil_should_read_at_most_two_pages);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
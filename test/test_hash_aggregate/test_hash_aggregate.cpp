@@ -0,0 +1,276 @@
+/******************************************************************************/
+/**
+ * @file        test_hash_aggregate.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test the hash aggregate operator.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define INDEX_PATH "indexFile.bin"
+#define SCRATCH_PATH "scratchFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define INDEX_PATH "build/artifacts/indexFile.bin"
+#define SCRATCH_PATH "build/artifacts/scratchFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 6000
+#define NUM_SENSORS 37
+
+embedDBState* state;
+embedDBSchema* baseSchema;
+embedDBIterator it;
+embedDBFileInterface* scratchInterface;
+void* scratchFile;
+uint32_t scratchWrites;
+int8_t (*fileWrite)(void* buffer, uint32_t pageNum, uint32_t pageSize, void* file);
+
+uint32_t sensorForKey(uint32_t key) {
+    return (key * 7) % NUM_SENSORS;
+}
+
+int8_t countingWrite(void* buffer, uint32_t pageNum, uint32_t pageSize, void* file) {
+    scratchWrites++;
+    return fileWrite(buffer, pageNum, pageSize, file);
+}
+
+void setUp(void) {
+    char dataPath[] = DATA_PATH;
+    state = createState(dataPath, 8, EMBEDDB_RESET_DATA);
+
+    // Records of each sensor are spread over the whole table
+    uint32_t data[2];
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        data[0] = sensorForKey(key);
+        data[1] = key;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+    embedDBFlush(state);
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32};
+    baseSchema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+
+    initFullIterator(state, &it);
+
+    char scratchPath[] = SCRATCH_PATH;
+    scratchInterface = getFileInterface();
+    fileWrite = scratchInterface->write;
+    scratchInterface->write = countingWrite;
+    scratchFile = setupFile(scratchPath);
+    scratchWrites = 0;
+}
+
+void tearDown(void) {
+    embedDBCloseIterator(&it);
+    embedDBFreeSchema(&baseSchema);
+    tearDownFile(scratchFile);
+    free(scratchInterface);
+    freeState(state);
+    state = NULL;
+}
+
+/**
+ * @brief	Reads every group of a hash aggregate that counts records and sums, mins and maxes column 2, and checks each group
+ */
+void checkSensorGroups(embedDBOperator* aggOp) {
+    uint8_t seen[NUM_SENSORS] = {0};
+    uint32_t groups = 0;
+    uint32_t* recordBuffer = (uint32_t*)aggOp->recordBuffer;
+    while (exec(aggOp)) {
+        uint32_t sensor = recordBuffer[0];
+        TEST_ASSERT_LESS_THAN_UINT32(NUM_SENSORS, sensor);
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(0, seen[sensor], "Group was output more than once.");
+        seen[sensor] = 1;
+
+        uint32_t count = 0, min = UINT32_MAX, max = 0;
+        int64_t sum = 0;
+        for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+            if (sensorForKey(key) == sensor) {
+                count++;
+                sum += key;
+                min = key < min ? key : min;
+                max = key > max ? key : max;
+            }
+        }
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(count, recordBuffer[1], "Count is wrong.");
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(&sum, recordBuffer + 2, sizeof(int64_t), "Sum is wrong.");
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(min, recordBuffer[4], "Min is wrong.");
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(max, recordBuffer[5], "Max is wrong.");
+        groups++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(NUM_SENSORS, groups, "Hash aggregate didn't return every group.");
+}
+
+void hash_aggregate_should_group_unsorted_records(void) {
+    embedDBAggregateFunc* counter = createCountAggregate();
+    embedDBAggregateFunc* sum = createSumAggregate(2);
+    embedDBAggregateFunc* min = createMinAggregate(2, 4);
+    embedDBAggregateFunc* max = createMaxAggregate(2, 4);
+    embedDBAggregateFunc functions[] = {*counter, *sum, *min, *max};
+
+    uint8_t memory[2048];
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* aggOp = createHashAggregateOperator(scanOp, 1, functions, 4, memory, sizeof(memory), NULL, NULL, 0);
+    aggOp->init(aggOp);
+    TEST_ASSERT_EQUAL_UINT8(5, aggOp->schema->numCols);
+
+    checkSensorGroups(aggOp);
+
+    aggOp->close(aggOp);
+    embedDBFreeOperatorRecursive(&aggOp);
+    for (uint8_t i = 0; i < 4; i++) {
+        free(functions[i].state);
+    }
+    free(counter);
+    free(sum);
+    free(min);
+    free(max);
+}
+
+void hash_aggregate_should_spill_groups_that_do_not_fit(void) {
+    embedDBAggregateFunc* counter = createCountAggregate();
+    embedDBAggregateFunc* sum = createSumAggregate(2);
+    embedDBAggregateFunc* min = createMinAggregate(2, 4);
+    embedDBAggregateFunc* max = createMaxAggregate(2, 4);
+    embedDBAggregateFunc functions[] = {*counter, *sum, *min, *max};
+
+    // Two page buffers and a table of 16 entries, so 12 groups fit in each pass
+    uint32_t pageSize = 256;
+    uint32_t entrySize = 1 + 4 + 4 + 8 + 4 + 4;
+    uint32_t memorySize = 2 * pageSize + 16 * entrySize;
+    uint8_t* memory = (uint8_t*)malloc(memorySize);
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* aggOp = createHashAggregateOperator(scanOp, 1, functions, 4, memory, memorySize, scratchInterface, scratchFile, pageSize);
+    aggOp->init(aggOp);
+
+    checkSensorGroups(aggOp);
+    TEST_ASSERT_GREATER_THAN_UINT32_MESSAGE(0, scratchWrites, "Records were not spilled to the scratch file.");
+
+    aggOp->close(aggOp);
+    embedDBFreeOperatorRecursive(&aggOp);
+    free(memory);
+    for (uint8_t i = 0; i < 4; i++) {
+        free(functions[i].state);
+    }
+    free(counter);
+    free(sum);
+    free(min);
+    free(max);
+}
+
+void hash_aggregate_should_stop_when_full_without_scratch_file(void) {
+    embedDBAggregateFunc* counter = createCountAggregate();
+    uint8_t memory[64];
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* aggOp = createHashAggregateOperator(scanOp, 1, counter, 1, memory, sizeof(memory), NULL, NULL, 0);
+    aggOp->init(aggOp);
+
+    TEST_ASSERT_FALSE_MESSAGE(exec(aggOp), "Hash aggregate returned groups after running out of memory.");
+
+    aggOp->close(aggOp);
+    embedDBFreeOperatorRecursive(&aggOp);
+    free(counter->state);
+    free(counter);
+}
+
+void customAdd(embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, const void* record) {}
+
+void hash_aggregate_should_reject_custom_functions(void) {
+    embedDBAggregateFunc custom = {NULL, customAdd, NULL, NULL, 4};
+    uint8_t memory[256];
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* aggOp = createHashAggregateOperator(scanOp, 1, &custom, 1, memory, sizeof(memory), NULL, NULL, 0);
+    aggOp->init(aggOp);
+
+    TEST_ASSERT_FALSE(exec(aggOp));
+
+    aggOp->close(aggOp);
+    embedDBFreeOperatorRecursive(&aggOp);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(hash_aggregate_should_group_unsorted_records);
+    RUN_TEST(hash_aggregate_should_spill_groups_that_do_not_fit);
+    RUN_TEST(hash_aggregate_should_stop_when_full_without_scratch_file);
+    RUN_TEST(hash_aggregate_should_reject_custom_functions);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,269 @@
+/******************************************************************************/
+/**
+ * @file        test_iterator_seek.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test moving open forward and reverse iterators with embedDBIteratorSeek.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define INDEX_PATH "indexFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define INDEX_PATH "build/artifacts/indexFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 3000
+#define KEY_STEP 3
+#define LAST_KEY ((NUM_RECORDS - 1) * KEY_STEP)
+
+embedDBState *state;
+embedDBIterator it;
+
+void setUp(void) {
+    state = (embedDBState *)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+    state->keySize = 4;
+    state->dataSize = 4;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 4;
+    state->buffer = calloc(1, (size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 8;
+    state->numDataPages = 1000;
+    state->numIndexPages = 48;
+    state->eraseSizeInPages = 4;
+    char dataPath[] = DATA_PATH, indexPath[] = INDEX_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->indexFile = setupFile(indexPath);
+    state->parameters = EMBEDDB_USE_BMAP | EMBEDDB_USE_INDEX | EMBEDDB_RESET_DATA;
+    state->bitmapSize = 1;
+    state->inBitmap = inBitmapInt8;
+    state->updateBitmap = updateBitmapInt8;
+    state->buildBitmapFromRange = buildBitmapInt8FromRange;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(state, 1), "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    // Keys step by 3. The data is the record number.
+    for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+        uint32_t key = i * KEY_STEP, data = i;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, &data), "embedDBPut failed.");
+    }
+
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+}
+
+void tearDown(void) {
+    embedDBCloseIterator(&it);
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    tearDownFile(state->indexFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+}
+
+void seek_should_move_forward_and_backward(void) {
+    embedDBInitIterator(state, &it);
+    uint32_t seeks[] = {4000, 10, 7, 5999, 0, 8000, LAST_KEY - 1, 2500};
+    uint32_t key, data;
+    for (uint32_t i = 0; i < sizeof(seeks) / sizeof(seeks[0]); i++) {
+        TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(state, &it, &seeks[i]));
+        uint32_t expected = (seeks[i] + KEY_STEP - 1) / KEY_STEP * KEY_STEP;
+        for (uint32_t j = 0; j < 5 && expected <= LAST_KEY; j++, expected += KEY_STEP) {
+            TEST_ASSERT_TRUE(embedDBNext(state, &it, &key, &data));
+            TEST_ASSERT_EQUAL_UINT32(expected, key);
+        }
+    }
+
+    // Past the last record
+    uint32_t after = LAST_KEY + 1;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(state, &it, &after));
+    TEST_ASSERT_FALSE(embedDBNext(state, &it, &key, &data));
+}
+
+void seek_should_reuse_current_page(void) {
+    embedDBInitIterator(state, &it);
+    uint32_t target = 1500, key, data;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(state, &it, &target));
+    TEST_ASSERT_TRUE(embedDBNext(state, &it, &key, &data));
+
+    // Move within the page that was just read, backwards and forwards
+    uint32_t numReads = state->numReads;
+    for (uint32_t target2 = key - KEY_STEP; target2 <= key + KEY_STEP; target2 += KEY_STEP) {
+        uint32_t seekKey = target2, foundKey;
+        TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(state, &it, &seekKey));
+        TEST_ASSERT_TRUE(embedDBNext(state, &it, &foundKey, &data));
+        TEST_ASSERT_EQUAL_UINT32(seekKey, foundKey);
+        TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(state, &it, &target));
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(numReads, state->numReads, "Seeking within the current page should not read storage.");
+}
+
+void seek_should_position_reverse_iterator(void) {
+    embedDBInitReverseIterator(state, &it);
+    uint32_t seeks[] = {4000, 10, 7, 5999, 8000, LAST_KEY + 50, 2500, 2};
+    uint32_t key, data;
+    for (uint32_t i = 0; i < sizeof(seeks) / sizeof(seeks[0]); i++) {
+        TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(state, &it, &seeks[i]));
+        uint32_t expected = seeks[i] > LAST_KEY ? LAST_KEY : seeks[i] / KEY_STEP * KEY_STEP;
+        for (uint32_t j = 0; j < 5; j++, expected -= KEY_STEP) {
+            TEST_ASSERT_TRUE(embedDBPrev(state, &it, &key, &data));
+            TEST_ASSERT_EQUAL_UINT32(expected, key);
+            if (expected == 0)
+                break;
+        }
+    }
+
+    // Before the first record
+    uint32_t first = 0;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(state, &it, &first));
+    TEST_ASSERT_TRUE(embedDBPrev(state, &it, &key, &data));
+    TEST_ASSERT_EQUAL_UINT32(0, key);
+    TEST_ASSERT_FALSE(embedDBPrev(state, &it, &key, &data));
+}
+
+void reverse_iterator_should_ignore_previous_position(void) {
+    // Load the first page into the read buffer
+    uint32_t key, data;
+    embedDBInitIterator(state, &it);
+    TEST_ASSERT_TRUE(embedDBNext(state, &it, &key, &data));
+    embedDBCloseIterator(&it);
+
+    // A new iterator in the same memory still points at the page it was on
+    uint32_t maxKey = 3 * KEY_STEP;
+    it.maxKey = &maxKey;
+    embedDBInitReverseIterator(state, &it);
+    for (uint32_t expected = maxKey;; expected -= KEY_STEP) {
+        TEST_ASSERT_TRUE(embedDBPrev(state, &it, &key, &data));
+        TEST_ASSERT_EQUAL_UINT32(expected, key);
+        if (expected == 0)
+            break;
+    }
+    TEST_ASSERT_FALSE(embedDBPrev(state, &it, &key, &data));
+}
+
+void seek_should_keep_filters(void) {
+    // The data filter still applies after the seek
+    uint32_t minData = 300, maxData = 399;
+    it.minData = &minData;
+    it.maxData = &maxData;
+    embedDBInitReverseIterator(state, &it);
+
+    uint32_t target = LAST_KEY, key, data, count = 0;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(state, &it, &target));
+    while (embedDBPrev(state, &it, &key, &data)) {
+        TEST_ASSERT_TRUE(data >= minData && data <= maxData);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, count);
+}
+
+void seek_should_page_through_records(void) {
+    // Read pages of 100 records, resuming each page after the last key of the previous one
+    embedDBInitIterator(state, &it);
+    uint32_t cursor = 0, key, data, total = 0, expected = 0;
+    while (1) {
+        TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(state, &it, &cursor));
+        uint32_t count = 0;
+        while (count < 100 && embedDBNext(state, &it, &key, &data)) {
+            TEST_ASSERT_EQUAL_UINT32(expected, key);
+            expected += KEY_STEP;
+            count++;
+        }
+        total += count;
+        if (count < 100)
+            break;
+        cursor = key + 1;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, total);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(seek_should_move_forward_and_backward);
+    RUN_TEST(seek_should_reuse_current_page);
+    RUN_TEST(seek_should_position_reverse_iterator);
+    RUN_TEST(reverse_iterator_should_ignore_previous_position);
+    RUN_TEST(seek_should_keep_filters);
+    RUN_TEST(seek_should_page_through_records);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,223 @@
+/******************************************************************************/
+/**
+ * @file        test_join_operators.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test the index nested-loop join and hash join operators.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define EVENT_PATH "eventFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define EVENT_PATH "build/artifacts/eventFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 10000
+#define NUM_EVENTS 50
+#define NUM_SENSORS 10
+
+embedDBState* sensorState;
+embedDBState* eventState;
+embedDBSchema* sensorSchema;
+embedDBSchema* eventSchema;
+embedDBIterator sensorIt;
+embedDBIterator eventIt;
+
+uint32_t sensorForKey(uint32_t key) {
+    return key % NUM_SENSORS;
+}
+
+uint32_t referenceForEvent(uint32_t event) {
+    // Some references are past the last key of the sensor table
+    return event * 211;
+}
+
+void setUp(void) {
+    char sensorPath[] = DATA_PATH, eventPath[] = EVENT_PATH;
+    sensorState = createState(sensorPath, 8, EMBEDDB_RESET_DATA);
+    eventState = createState(eventPath, 4, EMBEDDB_RESET_DATA);
+
+    uint32_t data[2];
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        data[0] = key / 100;
+        data[1] = sensorForKey(key);
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(sensorState, &key, data), "embedDBPut failed.");
+    }
+    embedDBFlush(sensorState);
+    for (uint32_t event = 0; event < NUM_EVENTS; event++) {
+        uint32_t reference = referenceForEvent(event);
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(eventState, &event, &reference), "embedDBPut failed.");
+    }
+    embedDBFlush(eventState);
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32};
+    sensorSchema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+    eventSchema = embedDBCreateSchema(2, colSizes, colSignedness, colTypes);
+
+    initFullIterator(sensorState, &sensorIt);
+    initFullIterator(eventState, &eventIt);
+}
+
+void tearDown(void) {
+    embedDBCloseIterator(&sensorIt);
+    embedDBCloseIterator(&eventIt);
+    embedDBFreeSchema(&sensorSchema);
+    embedDBFreeSchema(&eventSchema);
+    freeState(sensorState);
+    freeState(eventState);
+}
+
+void index_join_should_look_up_each_outer_key(void) {
+    embedDBOperator* eventScan = createTableScanOperator(eventState, &eventIt, eventSchema);
+    embedDBOperator* joinOp = createIndexJoinOperator(eventScan, 1, sensorState, sensorSchema);
+    joinOp->init(joinOp);
+    TEST_ASSERT_EQUAL_UINT8(5, joinOp->schema->numCols);
+
+    embedDBResetStats(sensorState);
+    uint32_t expectedEvent = 0, count = 0;
+    uint32_t* recordBuffer = (uint32_t*)joinOp->recordBuffer;
+    while (exec(joinOp)) {
+        uint32_t event = recordBuffer[0];
+        TEST_ASSERT_EQUAL_UINT32(expectedEvent, event);
+        TEST_ASSERT_EQUAL_UINT32(referenceForEvent(event), recordBuffer[1]);
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[1], recordBuffer[2]);
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[2] / 100, recordBuffer[3]);
+        TEST_ASSERT_EQUAL_UINT32(sensorForKey(recordBuffer[2]), recordBuffer[4]);
+        expectedEvent++;
+        count++;
+    }
+    uint32_t expectedMatches = (NUM_RECORDS - 1) / 211 + 1;
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(expectedMatches, count, "Index join didn't return every match.");
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(sensorState->nextDataPageId / 2, sensorState->numReads, "Index join read as many pages as a scan.");
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+}
+
+void hash_join_should_match_data_columns(void) {
+    // Join events with the first 100 sensor records, where each sensor id appears 10 times
+    uint32_t maxKey = 100;
+    embedDBOperator* eventScan = createTableScanOperator(eventState, &eventIt, eventSchema);
+    embedDBOperator* sensorScan = createTableScanOperator(sensorState, &sensorIt, sensorSchema);
+    embedDBOperator* buildOp = createSelectionOperator(sensorScan, 0, SELECT_LT, &maxKey);
+    uint8_t memory[2048];
+    embedDBOperator* joinOp = createHashJoinOperator(eventScan, buildOp, 0, 2, memory, sizeof(memory));
+    joinOp->init(joinOp);
+    TEST_ASSERT_EQUAL_UINT8(5, joinOp->schema->numCols);
+
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)joinOp->recordBuffer;
+    while (exec(joinOp)) {
+        TEST_ASSERT_EQUAL_UINT32(referenceForEvent(recordBuffer[0]), recordBuffer[1]);
+        TEST_ASSERT_LESS_THAN_UINT32(maxKey, recordBuffer[2]);
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[2] / 100, recordBuffer[3]);
+        TEST_ASSERT_EQUAL_UINT32(sensorForKey(recordBuffer[2]), recordBuffer[4]);
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[0], recordBuffer[4]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(100, count, "Hash join didn't return every match.");
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+    embedDBFreeOperatorRecursive(&buildOp);
+}
+
+void hash_join_should_stop_when_build_side_does_not_fit(void) {
+    embedDBOperator* eventScan = createTableScanOperator(eventState, &eventIt, eventSchema);
+    embedDBOperator* sensorScan = createTableScanOperator(sensorState, &sensorIt, sensorSchema);
+    uint8_t memory[256];
+    embedDBOperator* joinOp = createHashJoinOperator(eventScan, sensorScan, 1, 0, memory, sizeof(memory));
+    joinOp->init(joinOp);
+
+    TEST_ASSERT_FALSE_MESSAGE(exec(joinOp), "Hash join returned records after running out of memory.");
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+    free(sensorScan);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(index_join_should_look_up_each_outer_key);
+    RUN_TEST(hash_join_should_match_data_columns);
+    RUN_TEST(hash_join_should_stop_when_build_side_does_not_fit);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
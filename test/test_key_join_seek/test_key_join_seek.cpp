@@ -0,0 +1,298 @@
+/******************************************************************************/
+/**
+ * @file        test_key_join_seek.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test iterator seeking and the seek-skipping key join.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define EVENT_PATH "eventFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define EVENT_PATH "build/artifacts/eventFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 10000
+#define MAX_EVENT_KEY 25000
+#define EVENT_STEP 1370
+
+embedDBState* sensorState;
+embedDBState* eventState;
+embedDBSchema* sensorSchema;
+embedDBSchema* eventSchema;
+embedDBIterator sensorIt;
+embedDBIterator eventIt;
+
+// Sensor keys come in runs of 1000 separated by gaps of 1000
+uint32_t sensorKey(uint32_t i) {
+    return (i / 1000) * 2000 + i % 1000;
+}
+
+int8_t isSensorKey(uint32_t key) {
+    return key < sensorKey(NUM_RECORDS - 1) + 1 && key % 2000 < 1000;
+}
+
+embedDBState* createSensorState(uint8_t parameters) {
+    char sensorPath[] = DATA_PATH;
+    embedDBState* state = createState(sensorPath, 8, parameters);
+    uint32_t data[2];
+    for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+        uint32_t key = sensorKey(i);
+        data[0] = key / 100;
+        data[1] = key % 10;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+    embedDBFlush(state);
+    return state;
+}
+
+void setUp(void) {
+    char eventPath[] = EVENT_PATH;
+    sensorState = createSensorState(EMBEDDB_RESET_DATA);
+    eventState = createState(eventPath, 4, EMBEDDB_RESET_DATA);
+
+    for (uint32_t key = 0; key < MAX_EVENT_KEY; key += EVENT_STEP) {
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(eventState, &key, &key), "embedDBPut failed.");
+    }
+    embedDBFlush(eventState);
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32};
+    sensorSchema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+    eventSchema = embedDBCreateSchema(2, colSizes, colSignedness, colTypes);
+
+    initFullIterator(sensorState, &sensorIt);
+    initFullIterator(eventState, &eventIt);
+}
+
+void tearDown(void) {
+    embedDBCloseIterator(&sensorIt);
+    embedDBCloseIterator(&eventIt);
+    embedDBFreeSchema(&sensorSchema);
+    embedDBFreeSchema(&eventSchema);
+    freeState(sensorState);
+    freeState(eventState);
+}
+
+void seekAndCheck(uint32_t target, int8_t expectRecord, uint32_t expectedKey) {
+    uint32_t key, data[2];
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(sensorState, &sensorIt, &target));
+    TEST_ASSERT_EQUAL_INT8(expectRecord, embedDBNext(sensorState, &sensorIt, &key, data));
+    if (expectRecord) {
+        TEST_ASSERT_EQUAL_UINT32(expectedKey, key);
+        TEST_ASSERT_EQUAL_UINT32(key / 100, data[0]);
+    }
+}
+
+void iterator_seek_should_move_to_first_key_at_or_after(void) {
+    seekAndCheck(37, 1, 37);
+    seekAndCheck(8123, 1, 8123);
+    // Keys in a gap move to the start of the next run
+    seekAndCheck(1500, 1, 2000);
+    seekAndCheck(999, 1, 999);
+    // Seeking backwards works too
+    seekAndCheck(5, 1, 5);
+    seekAndCheck(sensorKey(NUM_RECORDS - 1), 1, sensorKey(NUM_RECORDS - 1));
+    seekAndCheck(sensorKey(NUM_RECORDS - 1) + 1, 0, 0);
+
+    // Records after a seek continue in key order
+    uint32_t target = 4990, key, data[2];
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(sensorState, &sensorIt, &target));
+    uint32_t expected[] = {4990, 4991, 4992, 4993, 4994, 4995, 4996, 4997, 4998, 4999, 6000};
+    for (uint8_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        TEST_ASSERT_EQUAL_INT8(1, embedDBNext(sensorState, &sensorIt, &key, data));
+        TEST_ASSERT_EQUAL_UINT32(expected[i], key);
+    }
+}
+
+void iterator_seek_should_find_records_in_write_buffer(void) {
+    uint32_t data[2] = {0, 0};
+    for (uint32_t key = 30000; key < 30010; key++) {
+        TEST_ASSERT_EQUAL_INT8(0, embedDBPut(sensorState, &key, data));
+    }
+    uint32_t target = 30005, key;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(sensorState, &sensorIt, &target));
+    TEST_ASSERT_EQUAL_INT8(1, embedDBNext(sensorState, &sensorIt, &key, data));
+    TEST_ASSERT_EQUAL_UINT32(30005, key);
+
+    // Keys between the last page and the write buffer move to the write buffer
+    target = 25000;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeek(sensorState, &sensorIt, &target));
+    TEST_ASSERT_EQUAL_INT8(1, embedDBNext(sensorState, &sensorIt, &key, data));
+    TEST_ASSERT_EQUAL_UINT32(30000, key);
+}
+
+void iterator_seek_should_use_binary_search(void) {
+    // Without a spline, which is not allocated when binary search is set at initialization
+    embedDBCloseIterator(&sensorIt);
+    freeState(sensorState);
+    sensorState = createSensorState(EMBEDDB_RESET_DATA | EMBEDDB_USE_BINARY_SEARCH);
+    initFullIterator(sensorState, &sensorIt);
+
+    seekAndCheck(37, 1, 37);
+    seekAndCheck(13500, 1, 14000);
+    seekAndCheck(sensorKey(NUM_RECORDS - 1) + 1, 0, 0);
+}
+
+void iterator_seek_should_keep_filters(void) {
+    uint32_t minKey = 3000, maxKey = 9000, minData = 50;
+    sensorIt.minKey = &minKey;
+    sensorIt.maxKey = &maxKey;
+    sensorIt.minData = &minData;
+    embedDBIteratorUpdateBounds(sensorState, &sensorIt);
+
+    // Below the min key and min data
+    seekAndCheck(100, 1, 6000);
+    seekAndCheck(8999, 1, 8999);
+    seekAndCheck(9001, 0, 0);
+}
+
+uint32_t expectedJoinCount(void) {
+    uint32_t count = 0;
+    for (uint32_t key = 0; key < MAX_EVENT_KEY; key += EVENT_STEP) {
+        if (isSensorKey(key))
+            count++;
+    }
+    return count;
+}
+
+void key_join_should_seek_over_gaps(void) {
+    embedDBOperator* eventScan = createTableScanOperator(eventState, &eventIt, eventSchema);
+    embedDBOperator* sensorScan = createTableScanOperator(sensorState, &sensorIt, sensorSchema);
+    embedDBOperator* joinOp = createKeyJoinOperator(eventScan, sensorScan);
+    joinOp->init(joinOp);
+
+    embedDBResetStats(sensorState);
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)joinOp->recordBuffer;
+    while (exec(joinOp)) {
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[0], recordBuffer[2]);
+        TEST_ASSERT_TRUE(isSensorKey(recordBuffer[0]));
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[0] / 100, recordBuffer[3]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(expectedJoinCount(), count, "Key join didn't return every match.");
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(sensorState->nextDataPageId / 4, sensorState->numReads, "Key join read too many pages.");
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+    free(sensorScan);
+}
+
+void key_join_should_seek_below_selection(void) {
+    uint32_t sensor = 0;
+    embedDBOperator* eventScan = createTableScanOperator(eventState, &eventIt, eventSchema);
+    embedDBOperator* sensorScan = createTableScanOperator(sensorState, &sensorIt, sensorSchema);
+    embedDBOperator* sensorSelect = createSelectionOperator(sensorScan, 2, SELECT_EQ, &sensor);
+    embedDBOperator* joinOp = createKeyJoinOperator(eventScan, sensorSelect);
+    joinOp->init(joinOp);
+
+    uint32_t expected = 0;
+    for (uint32_t key = 0; key < MAX_EVENT_KEY; key += EVENT_STEP) {
+        if (isSensorKey(key) && key % 10 == sensor)
+            expected++;
+    }
+
+    embedDBResetStats(sensorState);
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)joinOp->recordBuffer;
+    while (exec(joinOp)) {
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[0], recordBuffer[2]);
+        TEST_ASSERT_EQUAL_UINT32(sensor, recordBuffer[4]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(expected, count, "Key join didn't return every match.");
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(sensorState->nextDataPageId / 4, sensorState->numReads, "Key join read too many pages.");
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+    embedDBFreeOperatorRecursive(&sensorSelect);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(iterator_seek_should_move_to_first_key_at_or_after);
+    RUN_TEST(iterator_seek_should_find_records_in_write_buffer);
+    RUN_TEST(iterator_seek_should_use_binary_search);
+    RUN_TEST(iterator_seek_should_keep_filters);
+    RUN_TEST(key_join_should_seek_over_gaps);
+    RUN_TEST(key_join_should_seek_below_selection);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,244 @@
+/******************************************************************************/
+/**
+ * @file        test_multi_range_iterator.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test reading several key ranges with one multi-range iterator.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#endif
+
+#include "unity.h"
+
+// One reading per minute for 30 days
+#define MINUTES_PER_DAY 1440
+#define NUM_DAYS 30
+#define NUM_RECORDS (MINUTES_PER_DAY * NUM_DAYS)
+
+embedDBState *state;
+embedDBMultiRangeIterator it;
+
+void setUp(void) {
+    state = (embedDBState *)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+    state->keySize = 4;
+    state->dataSize = 4;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 2;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 30;
+    state->numDataPages = 1000;
+    state->eraseSizeInPages = 4;
+    char dataPath[] = DATA_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->parameters = EMBEDDB_RESET_DATA;
+    state->bitmapSize = 0;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(state, 1), "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    for (uint32_t minute = 0; minute < NUM_RECORDS; minute++) {
+        uint32_t data = minute % MINUTES_PER_DAY;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &minute, &data), "embedDBPut failed.");
+    }
+
+    it.ranges = NULL;
+    it.numRanges = 0;
+    it.minData = NULL;
+    it.maxData = NULL;
+    it.mergedRanges = NULL;
+}
+
+void tearDown(void) {
+    embedDBCloseMultiRangeIterator(&it);
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+}
+
+int8_t inRanges(uint32_t *ranges, uint32_t numRanges, uint32_t key) {
+    for (uint32_t i = 0; i < numRanges; i++) {
+        if (key >= ranges[2 * i] && key <= ranges[2 * i + 1])
+            return 1;
+    }
+    return 0;
+}
+
+// Checks that the iterator returns every key in the ranges once, in order
+void checkRanges(uint32_t *ranges, uint32_t numRanges) {
+    it.ranges = ranges;
+    it.numRanges = numRanges;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBInitMultiRangeIterator(state, &it));
+
+    uint32_t key, data, expected = 0;
+    while (embedDBNextMultiRange(state, &it, &key, &data)) {
+        while (expected < NUM_RECORDS && !inRanges(ranges, numRanges, expected))
+            expected++;
+        TEST_ASSERT_EQUAL_UINT32(expected, key);
+        TEST_ASSERT_EQUAL_UINT32(key % MINUTES_PER_DAY, data);
+        expected++;
+    }
+    while (expected < NUM_RECORDS && !inRanges(ranges, numRanges, expected))
+        expected++;
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(NUM_RECORDS, expected, "Records in the ranges were not returned.");
+}
+
+void multi_range_should_return_records_of_every_range(void) {
+    // 9:00 to 9:05 of every day
+    uint32_t ranges[2 * NUM_DAYS];
+    for (uint32_t day = 0; day < NUM_DAYS; day++) {
+        ranges[2 * day] = day * MINUTES_PER_DAY + 540;
+        ranges[2 * day + 1] = day * MINUTES_PER_DAY + 545;
+    }
+    state->numReads = 0;
+    checkRanges(ranges, NUM_DAYS);
+
+    // Each range is on one or two pages, and the pages in between are not read
+    TEST_ASSERT_TRUE(state->numReads <= 2 * NUM_DAYS);
+}
+
+void multi_range_should_read_shared_pages_once(void) {
+    // Many short ranges close together share pages
+    uint32_t ranges[200];
+    for (uint32_t i = 0; i < 100; i++) {
+        ranges[2 * i] = 5000 + i * 20;
+        ranges[2 * i + 1] = 5000 + i * 20 + 5;
+    }
+    state->numReads = 0;
+    checkRanges(ranges, 100);
+
+    uint32_t pagesSpanned = (ranges[199] - ranges[0]) / state->maxRecordsPerPage + 2;
+    TEST_ASSERT_TRUE(state->numReads <= pagesSpanned + 2);
+}
+
+void multi_range_should_merge_overlapping_ranges(void) {
+    uint32_t ranges[] = {100, 200, 150, 180, 190, 300, 301, 301, 1000, 1000, 40000, 50000};
+    checkRanges(ranges, 6);
+    TEST_ASSERT_EQUAL_UINT32(4, it.numMerged);
+}
+
+void multi_range_should_apply_data_filter(void) {
+    uint32_t ranges[] = {0, 2000, 10000, 12000};
+    uint32_t minData = 100, maxData = 199;
+    it.minData = &minData;
+    it.maxData = &maxData;
+    it.ranges = ranges;
+    it.numRanges = 2;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBInitMultiRangeIterator(state, &it));
+
+    uint32_t key, data, count = 0;
+    while (embedDBNextMultiRange(state, &it, &key, &data)) {
+        TEST_ASSERT_TRUE(inRanges(ranges, 2, key));
+        TEST_ASSERT_TRUE(data >= minData && data <= maxData);
+        count++;
+    }
+    // Days 0, 1, 7 and 8 each have 100 matching minutes in the ranges
+    TEST_ASSERT_EQUAL_UINT32(400, count);
+}
+
+void multi_range_should_reject_unsorted_ranges(void) {
+    uint32_t ranges[] = {500, 600, 100, 200};
+    it.ranges = ranges;
+    it.numRanges = 2;
+    TEST_ASSERT_TRUE(embedDBInitMultiRangeIterator(state, &it) != 0);
+
+    uint32_t inverted[] = {600, 500};
+    it.ranges = inverted;
+    it.numRanges = 1;
+    TEST_ASSERT_TRUE(embedDBInitMultiRangeIterator(state, &it) != 0);
+}
+
+void multi_range_should_handle_no_ranges(void) {
+    uint32_t key, data;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBInitMultiRangeIterator(state, &it));
+    TEST_ASSERT_FALSE(embedDBNextMultiRange(state, &it, &key, &data));
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(multi_range_should_return_records_of_every_range);
+    RUN_TEST(multi_range_should_read_shared_pages_once);
+    RUN_TEST(multi_range_should_merge_overlapping_ranges);
+    RUN_TEST(multi_range_should_apply_data_filter);
+    RUN_TEST(multi_range_should_reject_unsorted_ranges);
+    RUN_TEST(multi_range_should_handle_no_ranges);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
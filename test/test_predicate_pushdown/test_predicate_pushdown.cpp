@@ -0,0 +1,383 @@
+/******************************************************************************/
+/**
+ * @file        test_predicate_pushdown.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test pushing selection predicates down into the table scan iterator.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define INDEX_PATH "indexFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define INDEX_PATH "build/artifacts/indexFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 6000
+
+embedDBState* state;
+embedDBSchema* baseSchema;
+
+int32_t temperatureForKey(uint32_t key) {
+    return key / 100;
+}
+
+void setUp(void) {
+    state = (embedDBState*)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+
+    state->keySize = 4;
+    state->dataSize = 8;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 4;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 20;
+    state->numDataPages = 1000;
+    state->numIndexPages = 16;
+    state->eraseSizeInPages = 4;
+
+    char dataPath[] = DATA_PATH, indexPath[] = INDEX_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->indexFile = setupFile(indexPath);
+
+    state->parameters = EMBEDDB_USE_INDEX | EMBEDDB_USE_BMAP | EMBEDDB_USE_MAX_MIN | EMBEDDB_RESET_DATA;
+    state->bitmapSize = 1;
+    state->inBitmap = inBitmapInt8;
+    state->updateBitmap = updateBitmapInt8;
+    state->buildBitmapFromRange = buildBitmapInt8FromRange;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+
+    int8_t result = embedDBInit(state, 1);
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, result, "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    int32_t data[2];
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        data[0] = temperatureForKey(key);
+        data[1] = key % 7;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+    embedDBFlush(state);
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_SIGNED, embedDB_COLUMN_SIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_INT32, embedDB_COLUMN_INT32};
+    baseSchema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+}
+
+void tearDown(void) {
+    embedDBFreeSchema(&baseSchema);
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    tearDownFile(state->indexFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+    state = NULL;
+}
+
+void key_selections_should_set_iterator_key_range(void) {
+    embedDBIterator it;
+    initFullIterator(state, &it);
+
+    uint32_t minKey = 3000, maxKey = 3100;
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* minOp = createSelectionOperator(scanOp, 0, SELECT_GT, &minKey);
+    embedDBOperator* maxOp = createSelectionOperator(minOp, 0, SELECT_LTE, &maxKey);
+    maxOp->init(maxOp);
+
+    TEST_ASSERT_TRUE_MESSAGE(it.minKey != NULL && *(uint32_t*)it.minKey == minKey, "Key predicate was not pushed into minKey.");
+    TEST_ASSERT_TRUE_MESSAGE(it.maxKey != NULL && *(uint32_t*)it.maxKey == maxKey, "Key predicate was not pushed into maxKey.");
+
+    embedDBResetStats(state);
+    uint32_t expectedKey = 3001;
+    uint32_t* recordBuffer = (uint32_t*)maxOp->recordBuffer;
+    while (exec(maxOp)) {
+        TEST_ASSERT_EQUAL_UINT32(expectedKey, recordBuffer[0]);
+        expectedKey++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(3101, expectedKey, "Selection did not return every record in the key range.");
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(10, state->numReads, "Key range did not limit the pages read.");
+
+    maxOp->close(maxOp);
+    embedDBFreeOperatorRecursive(&maxOp);
+    embedDBCloseIterator(&it);
+}
+
+void data_selections_should_use_bitmap_index(void) {
+    embedDBIterator it;
+    initFullIterator(state, &it);
+
+    int32_t minTemperature = 12, maxTemperature = 14;
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* minOp = createSelectionOperator(scanOp, 1, SELECT_GTE, &minTemperature);
+    embedDBOperator* maxOp = createSelectionOperator(minOp, 1, SELECT_LT, &maxTemperature);
+    maxOp->init(maxOp);
+
+    TEST_ASSERT_TRUE_MESSAGE(it.minData != NULL && *(int32_t*)it.minData == minTemperature, "Data predicate was not pushed into minData.");
+    TEST_ASSERT_TRUE_MESSAGE(it.maxData != NULL && *(int32_t*)it.maxData == maxTemperature, "Data predicate was not pushed into maxData.");
+    TEST_ASSERT_NOT_NULL_MESSAGE(it.queryBitmap, "Query bitmap was not built for the pushed down range.");
+
+    embedDBResetStats(state);
+    uint32_t count = 0;
+    int32_t* recordBuffer = (int32_t*)maxOp->recordBuffer;
+    while (exec(maxOp)) {
+        TEST_ASSERT_TRUE(recordBuffer[1] >= 12 && recordBuffer[1] < 14);
+        TEST_ASSERT_EQUAL_INT32(temperatureForKey(recordBuffer[0]), recordBuffer[1]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(200, count, "Selection did not return every matching record.");
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(state->nextDataPageId / 4, state->numReads, "Bitmap index was not used to skip pages.");
+
+    maxOp->close(maxOp);
+    embedDBFreeOperatorRecursive(&maxOp);
+    embedDBCloseIterator(&it);
+}
+
+void pushdown_should_keep_tighter_iterator_bounds(void) {
+    embedDBIterator it;
+    uint32_t iteratorMinKey = 4000;
+    it.minKey = &iteratorMinKey;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+
+    uint32_t minKey = 3000, maxKey = 4010;
+    embedDBOperator* minOp = createSelectionOperator(createTableScanOperator(state, &it, baseSchema), 0, SELECT_GTE, &minKey);
+    embedDBOperator* maxOp = createSelectionOperator(minOp, 0, SELECT_LT, &maxKey);
+    maxOp->init(maxOp);
+
+    TEST_ASSERT_TRUE_MESSAGE(&iteratorMinKey == it.minKey, "A looser predicate replaced the iterator's minKey.");
+    TEST_ASSERT_TRUE(it.maxKey != NULL && *(uint32_t*)it.maxKey == maxKey);
+
+    uint32_t count = 0;
+    while (exec(maxOp)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(10, count);
+
+    maxOp->close(maxOp);
+    embedDBFreeOperatorRecursive(&maxOp);
+    embedDBCloseIterator(&it);
+}
+
+uint32_t countIteratorRecords(embedDBIterator* it) {
+    uint32_t key, count = 0;
+    int32_t data[2];
+    while (embedDBNext(state, it, &key, data)) {
+        count++;
+    }
+    return count;
+}
+
+void closing_pushed_down_selections_should_restore_iterator(void) {
+    embedDBIterator it;
+    uint32_t iteratorMinKey = 4000;
+    it.minKey = &iteratorMinKey;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+
+    uint32_t maxKey = 4010;
+    int32_t minTemperature = 40;
+    embedDBOperator* keyOp = createSelectionOperator(createTableScanOperator(state, &it, baseSchema), 0, SELECT_LT, &maxKey);
+    embedDBOperator* op = createSelectionOperator(keyOp, 1, SELECT_GTE, &minTemperature);
+    op->init(op);
+    TEST_ASSERT_NOT_NULL(it.maxKey);
+    TEST_ASSERT_NOT_NULL(it.minData);
+    while (exec(op)) {
+    }
+    op->close(op);
+    embedDBFreeOperatorRecursive(&op);
+
+    TEST_ASSERT_TRUE_MESSAGE(&iteratorMinKey == it.minKey, "Closing the plan did not restore the iterator's minKey.");
+    TEST_ASSERT_NULL_MESSAGE(it.maxKey, "Closing the plan left a pushed down maxKey in the iterator.");
+    TEST_ASSERT_NULL_MESSAGE(it.minData, "Closing the plan left a pushed down minData in the iterator.");
+    TEST_ASSERT_NULL(it.queryBitmap);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(NUM_RECORDS - 4000, countIteratorRecords(&it), "Iterator did not read its own range after the plan was closed.");
+
+    // Freeing a plan that was not closed restores the iterator too
+    op = createSelectionOperator(createTableScanOperator(state, &it, baseSchema), 0, SELECT_LT, &maxKey);
+    op->init(op);
+    TEST_ASSERT_NOT_NULL(it.maxKey);
+    embedDBFreeOperatorRecursive(&op);
+    TEST_ASSERT_NULL(it.maxKey);
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS - 4000, countIteratorRecords(&it));
+
+    embedDBCloseIterator(&it);
+}
+
+void selections_on_other_columns_should_not_change_iterator(void) {
+    embedDBIterator it;
+    initFullIterator(state, &it);
+
+    int32_t value = 3;
+    embedDBOperator* op = createSelectionOperator(createTableScanOperator(state, &it, baseSchema), 2, SELECT_EQ, &value);
+    op->init(op);
+    TEST_ASSERT_NULL(it.minKey);
+    TEST_ASSERT_NULL(it.maxKey);
+    TEST_ASSERT_NULL(it.minData);
+    TEST_ASSERT_NULL(it.maxData);
+
+    uint32_t count = 0;
+    while (exec(op)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(857, count);
+
+    op->close(op);
+    embedDBFreeOperatorRecursive(&op);
+    embedDBCloseIterator(&it);
+}
+
+void data_selections_should_not_push_down_with_another_comparator(void) {
+    // The first data column is described as a float, but compareData compares int32 values
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_SIGNED, embedDB_COLUMN_SIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_FLOAT, embedDB_COLUMN_INT32};
+    embedDBSchema* floatSchema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+
+    embedDBIterator it;
+    initFullIterator(state, &it);
+
+    // The int32 temperatures read as floats are tiny positive values, so all of them are below 1
+    float maxValue = 1.0f;
+    embedDBOperator* op = createSelectionOperator(createTableScanOperator(state, &it, floatSchema), 1, SELECT_LT, &maxValue);
+    op->init(op);
+    TEST_ASSERT_NULL_MESSAGE(it.maxData, "A float predicate was pushed down to an int32 comparator.");
+    TEST_ASSERT_NULL(it.queryBitmap);
+
+    uint32_t count = 0;
+    while (exec(op)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+    op->close(op);
+    embedDBFreeOperatorRecursive(&op);
+    embedDBCloseIterator(&it);
+
+    // With the float comparator the predicate means the same to the iterator
+    state->compareData = floatComparator;
+    initFullIterator(state, &it);
+    op = createSelectionOperator(createTableScanOperator(state, &it, floatSchema), 1, SELECT_LT, &maxValue);
+    op->init(op);
+    TEST_ASSERT_NOT_NULL_MESSAGE(it.maxData, "A float predicate was not pushed down to the float comparator.");
+    op->close(op);
+    embedDBFreeOperatorRecursive(&op);
+    embedDBCloseIterator(&it);
+
+    embedDBFreeSchema(&floatSchema);
+}
+
+void embedDBNext_should_skip_pages_outside_min_max_data(void) {
+    // Temperatures of each page are in a narrow range, so the page headers exclude most pages
+    int32_t minData = 25, maxData = 25;
+    embedDBIterator it;
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = &minData;
+    it.maxData = &maxData;
+    embedDBInitIterator(state, &it);
+
+    uint32_t key, count = 0;
+    int32_t data[2];
+    while (embedDBNext(state, &it, &key, data)) {
+        TEST_ASSERT_EQUAL_INT32(25, data[0]);
+        TEST_ASSERT_EQUAL_UINT32(2500 + count, key);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, count);
+    embedDBCloseIterator(&it);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(key_selections_should_set_iterator_key_range);
+    RUN_TEST(data_selections_should_use_bitmap_index);
+    RUN_TEST(pushdown_should_keep_tighter_iterator_bounds);
+    RUN_TEST(closing_pushed_down_selections_should_restore_iterator);
+    RUN_TEST(selections_on_other_columns_should_not_change_iterator);
+    RUN_TEST(data_selections_should_not_push_down_with_another_comparator);
+    RUN_TEST(embedDBNext_should_skip_pages_outside_min_max_data);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
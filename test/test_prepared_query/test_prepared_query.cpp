@@ -0,0 +1,375 @@
+/******************************************************************************/
+/**
+ * @file        test_prepared_query.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test resetting and rebinding initialized query operators.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 1000
+
+embedDBState* state;
+embedDBSchema* schema;
+
+void setUp(void) {
+    char dataPath[] = DATA_PATH;
+    state = createState(dataPath, 8, EMBEDDB_RESET_DATA);
+
+    // The first column is the key modulo 10 and the second is the key
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        uint32_t data[] = {key % 10, key};
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32};
+    schema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+}
+
+void tearDown(void) {
+    embedDBUseArena(NULL);
+    embedDBFreeSchema(&schema);
+    freeState(state);
+}
+
+int8_t singleGroup(const void* lastRecord, const void* record) {
+    return 1;
+}
+
+/* Returns the count and the sum of the key column of the single group of the aggregate */
+void readCountAndSum(embedDBOperator* aggOp, uint32_t* count, int64_t* sum) {
+    TEST_ASSERT_TRUE(exec(aggOp));
+    memcpy(count, aggOp->recordBuffer, sizeof(uint32_t));
+    memcpy(sum, (int8_t*)aggOp->recordBuffer + sizeof(uint32_t), sizeof(int64_t));
+    TEST_ASSERT_FALSE(exec(aggOp));
+}
+
+void rebound_selection_should_rerun_without_allocating(void) {
+    embedDBIterator it;
+    initFullIterator(state, &it);
+
+    // The selection on the key is pushed down to the iterator, which has to follow the rebound value
+    uint32_t minKey = 100;
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* selectOp = createSelectionOperator(scanOp, 0, SELECT_GTE, &minKey);
+    embedDBAggregateFunc* counter = createCountAggregate();
+    embedDBAggregateFunc* summer = createSumAggregate(2);
+    embedDBAggregateFunc functions[] = {*counter, *summer};
+    embedDBOperator* aggOp = createAggregateOperator(selectOp, singleGroup, functions, 2);
+    aggOp->init(aggOp);
+
+    uint32_t count;
+    int64_t sum;
+    readCountAndSum(aggOp, &count, &sum);
+    TEST_ASSERT_EQUAL_UINT32(900, count);
+    TEST_ASSERT_TRUE(sum == (int64_t)(100 + 999) * 900 / 2);
+
+    // Every allocation of the query functions would come from the arena
+    uint8_t memory[64];
+    embedDBArena arena;
+    embedDBArenaInit(&arena, memory, sizeof(memory));
+    embedDBUseArena(&arena);
+
+    uint32_t newMinKey = 950;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBRebindSelection(selectOp, 0, &newMinKey));
+    TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(aggOp));
+    uint32_t numReads = state->numReads;
+    readCountAndSum(aggOp, &count, &sum);
+    TEST_ASSERT_EQUAL_UINT32(50, count);
+    TEST_ASSERT_TRUE(sum == (int64_t)(950 + 999) * 50 / 2);
+    TEST_ASSERT_TRUE(state->numReads - numReads < 10);
+
+    // Rerunning without rebinding returns the same result
+    TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(aggOp));
+    readCountAndSum(aggOp, &count, &sum);
+    TEST_ASSERT_EQUAL_UINT32(50, count);
+
+    TEST_ASSERT_EQUAL_UINT32(0, arena.highWater);
+    embedDBUseArena(NULL);
+
+    aggOp->close(aggOp);
+    embedDBFreeOperatorRecursive(&aggOp);
+    embedDBFreeOperatorRecursive(&selectOp);
+    free(functions[0].state);
+    free(functions[1].state);
+    free(counter);
+    free(summer);
+    embedDBCloseIterator(&it);
+}
+
+void rebound_selection_should_widen_pushed_down_range(void) {
+    // The iterator's own bound is looser than the selection, so the selection replaces it when pushed down
+    embedDBIterator it;
+    uint32_t iteratorMinKey = 500;
+    it.minKey = &iteratorMinKey;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+
+    uint32_t minKey = 950;
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* selectOp = createSelectionOperator(scanOp, 0, SELECT_GTE, &minKey);
+    embedDBAggregateFunc* counter = createCountAggregate();
+    embedDBAggregateFunc* summer = createSumAggregate(2);
+    embedDBAggregateFunc functions[] = {*counter, *summer};
+    embedDBOperator* aggOp = createAggregateOperator(selectOp, singleGroup, functions, 2);
+    aggOp->init(aggOp);
+
+    uint32_t count;
+    int64_t sum;
+    readCountAndSum(aggOp, &count, &sum);
+    TEST_ASSERT_EQUAL_UINT32(50, count);
+
+    // The selection keeps its own copy of the value
+    minKey = 0;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(aggOp));
+    readCountAndSum(aggOp, &count, &sum);
+    TEST_ASSERT_EQUAL_UINT32(50, count);
+
+    // A wider value is not tighter than the iterator's own bound, which is used again
+    uint32_t newMinKey = 100;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBRebindSelection(selectOp, 0, &newMinKey));
+    TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(aggOp));
+    TEST_ASSERT_TRUE(it.minKey == &iteratorMinKey);
+    readCountAndSum(aggOp, &count, &sum);
+    TEST_ASSERT_EQUAL_UINT32(500, count);
+    TEST_ASSERT_TRUE(sum == (int64_t)(500 + 999) * 500 / 2);
+    TEST_ASSERT_EQUAL_UINT32(100, newMinKey);
+
+    // Narrowing again pushes the value down
+    newMinKey = 900;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBRebindSelection(selectOp, 0, &newMinKey));
+    TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(aggOp));
+    TEST_ASSERT_TRUE(it.minKey != &iteratorMinKey && *(uint32_t*)it.minKey == 900);
+    readCountAndSum(aggOp, &count, &sum);
+    TEST_ASSERT_EQUAL_UINT32(100, count);
+
+    aggOp->close(aggOp);
+    embedDBFreeOperatorRecursive(&aggOp);
+    embedDBFreeOperatorRecursive(&selectOp);
+    free(functions[0].state);
+    free(functions[1].state);
+    free(counter);
+    free(summer);
+    embedDBCloseIterator(&it);
+}
+
+void rebound_iterator_bounds_should_be_used_by_rerun(void) {
+    embedDBIterator it;
+    uint32_t minKey = 0, maxKey = 99;
+    it.minKey = &minKey;
+    it.maxKey = &maxKey;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* limitOp = createLimitOperator(scanOp, 20);
+    limitOp->init(limitOp);
+
+    for (uint32_t run = 0; run < 5; run++) {
+        if (run > 0) {
+            minKey = run * 200;
+            maxKey = minKey + 9;
+            TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(limitOp));
+        }
+        uint32_t numRecords = 0;
+        while (exec(limitOp)) {
+            uint32_t key;
+            memcpy(&key, limitOp->recordBuffer, sizeof(uint32_t));
+            TEST_ASSERT_EQUAL_UINT32(minKey + numRecords, key);
+            numRecords++;
+        }
+        TEST_ASSERT_EQUAL_UINT32(run == 0 ? 20 : 10, numRecords);
+    }
+
+    limitOp->close(limitOp);
+    embedDBFreeOperatorRecursive(&limitOp);
+    embedDBCloseIterator(&it);
+}
+
+void sort_and_top_k_should_rerun(void) {
+    embedDBIterator it;
+    initFullIterator(state, &it);
+
+    // Largest keys with the first column equal to the rebound value, sorted by key descending
+    uint32_t group = 3;
+    uint8_t memory[NUM_RECORDS / 10 * 12];
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* selectOp = createSelectionOperator(scanOp, 1, SELECT_EQ, &group);
+    embedDBOperator* sortOp = createSortOperator(selectOp, 2, EMBEDDB_SORT_DESC, memory, sizeof(memory), NULL, NULL, 0);
+    embedDBOperator* topKOp = createTopKOperator(sortOp, 0, 5, EMBEDDB_SORT_DESC);
+    topKOp->init(topKOp);
+
+    for (group = 3; group < 10; group += 3) {
+        if (group != 3) {
+            TEST_ASSERT_EQUAL_INT8(0, embedDBRebindSelection(selectOp, 0, &group));
+            TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(topKOp));
+        }
+        uint32_t numRecords = 0;
+        while (exec(topKOp)) {
+            uint32_t key;
+            memcpy(&key, topKOp->recordBuffer, sizeof(uint32_t));
+            TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS - 10 + group - numRecords * 10, key);
+            numRecords++;
+        }
+        TEST_ASSERT_EQUAL_UINT32(5, numRecords);
+    }
+
+    topKOp->close(topKOp);
+    embedDBFreeOperatorRecursive(&topKOp);
+    embedDBCloseIterator(&it);
+}
+
+void key_join_should_rerun_both_inputs(void) {
+    embedDBIterator it1, it2;
+    uint32_t maxKey = 49;
+    it1.minKey = NULL;
+    it1.maxKey = &maxKey;
+    it1.minData = NULL;
+    it1.maxData = NULL;
+    embedDBInitIterator(state, &it1);
+    initFullIterator(state, &it2);
+
+    embedDBOperator* scan1 = createTableScanOperator(state, &it1, schema);
+    embedDBOperator* scan2 = createTableScanOperator(state, &it2, schema);
+    embedDBOperator* joinOp = createKeyJoinOperator(scan1, scan2);
+    joinOp->init(joinOp);
+
+    for (int run = 0; run < 2; run++) {
+        uint32_t numRecords = 0;
+        while (exec(joinOp)) {
+            uint32_t key1, key2;
+            memcpy(&key1, joinOp->recordBuffer, sizeof(uint32_t));
+            memcpy(&key2, (int8_t*)joinOp->recordBuffer + 12, sizeof(uint32_t));
+            TEST_ASSERT_EQUAL_UINT32(numRecords, key1);
+            TEST_ASSERT_EQUAL_UINT32(key1, key2);
+            numRecords++;
+        }
+        TEST_ASSERT_EQUAL_UINT32(maxKey + 1, numRecords);
+        maxKey = 499;
+        TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(joinOp));
+    }
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+    embedDBFreeOperatorRecursive(&scan2);
+    embedDBCloseIterator(&it1);
+    embedDBCloseIterator(&it2);
+}
+
+int8_t nextCustom(embedDBOperator* op) {
+    return 0;
+}
+
+void reset_should_reject_custom_operators(void) {
+    embedDBIterator it;
+    initFullIterator(state, &it);
+
+    uint32_t count = 0;
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* limitOp = createLimitOperator(scanOp, 10);
+    limitOp->init(limitOp);
+    TEST_ASSERT_EQUAL_INT8(-1, embedDBRebindSelection(limitOp, 0, &count));
+
+    // Operators that don't come from this library have state the reset doesn't know about
+    embedDBOperator custom = {limitOp, NULL, nextCustom, NULL, &count, NULL, NULL};
+    TEST_ASSERT_EQUAL_INT8(-1, embedDBResetOperator(&custom));
+    TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(limitOp));
+
+    limitOp->close(limitOp);
+    embedDBFreeOperatorRecursive(&limitOp);
+    embedDBCloseIterator(&it);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(rebound_selection_should_rerun_without_allocating);
+    RUN_TEST(rebound_selection_should_widen_pushed_down_range);
+    RUN_TEST(rebound_iterator_bounds_should_be_used_by_rerun);
+    RUN_TEST(sort_and_top_k_should_rerun);
+    RUN_TEST(key_join_should_rerun_both_inputs);
+    RUN_TEST(reset_should_reject_custom_operators);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
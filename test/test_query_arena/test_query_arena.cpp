@@ -0,0 +1,285 @@
+/******************************************************************************/
+/**
+ * @file        test_query_arena.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test allocating query operators from an embedDBArena.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 1000
+
+embedDBState* state;
+embedDBSchema* schema;
+embedDBIterator it;
+
+void setUp(void) {
+    char dataPath[] = DATA_PATH;
+    state = createState(dataPath, 8, EMBEDDB_RESET_DATA);
+
+    // The first column is the key modulo 10 and the second is the key
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        uint32_t data[] = {key % 10, key};
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32};
+    schema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+}
+
+void tearDown(void) {
+    embedDBUseArena(NULL);
+    embedDBFreeSchema(&schema);
+    freeState(state);
+}
+
+int8_t singleGroup(const void* lastRecord, const void* record) {
+    return 1;
+}
+
+int8_t isInArena(embedDBArena* arena, void* ptr) {
+    return (uint8_t*)ptr >= arena->memory && (uint8_t*)ptr < arena->memory + arena->size;
+}
+
+/* Counts the records whose first column is 3 and sums their key column, allocating from the arena in use */
+void runQuery(embedDBArena* arena, uint32_t* count, int64_t* sum) {
+    initFullIterator(state, &it);
+
+    uint32_t value = 3;
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* selectOp = createSelectionOperator(scanOp, 1, SELECT_EQ, &value);
+    embedDBAggregateFunc* counter = createCountAggregate();
+    embedDBAggregateFunc* summer = createSumAggregate(2);
+    embedDBAggregateFunc functions[] = {*counter, *summer};
+    embedDBOperator* aggOp = createAggregateOperator(selectOp, singleGroup, functions, 2);
+    aggOp->init(aggOp);
+    if (arena != NULL && arena->size >= arena->highWater) {
+        TEST_ASSERT_TRUE(isInArena(arena, aggOp));
+        TEST_ASSERT_TRUE(isInArena(arena, aggOp->schema));
+        TEST_ASSERT_TRUE(isInArena(arena, aggOp->recordBuffer));
+        TEST_ASSERT_TRUE(isInArena(arena, counter));
+    }
+
+    TEST_ASSERT_TRUE(exec(aggOp));
+    memcpy(count, aggOp->recordBuffer, sizeof(uint32_t));
+    memcpy(sum, (int8_t*)aggOp->recordBuffer + sizeof(uint32_t), sizeof(int64_t));
+    TEST_ASSERT_FALSE(exec(aggOp));
+
+    aggOp->close(aggOp);
+    embedDBFreeOperatorRecursive(&aggOp);
+    embedDBFreeOperatorRecursive(&selectOp);
+    embedDBFree(functions[0].state);
+    embedDBFree(functions[1].state);
+    embedDBFree(counter);
+    embedDBFree(summer);
+    embedDBCloseIterator(&it);
+}
+
+void arena_query_should_match_heap_query(void) {
+    uint32_t heapCount, arenaCount;
+    int64_t heapSum, arenaSum;
+    runQuery(NULL, &heapCount, &heapSum);
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS / 10, heapCount);
+
+    uint8_t memory[2048];
+    embedDBArena arena;
+    embedDBArenaInit(&arena, memory, sizeof(memory));
+    TEST_ASSERT_NULL(embedDBUseArena(&arena));
+    runQuery(&arena, &arenaCount, &arenaSum);
+    TEST_ASSERT_TRUE(embedDBUseArena(NULL) == &arena);
+
+    TEST_ASSERT_EQUAL_UINT32(heapCount, arenaCount);
+    TEST_ASSERT_TRUE(heapSum == arenaSum);
+    TEST_ASSERT_EQUAL_UINT32(0, arena.overflow);
+    TEST_ASSERT_TRUE(arena.used > 0);
+    TEST_ASSERT_EQUAL_UINT32(arena.used, arena.highWater);
+    embedDBArenaRelease(&arena);
+}
+
+void arena_should_be_reused_after_release(void) {
+    uint8_t memory[2048];
+    embedDBArena arena;
+    embedDBArenaInit(&arena, memory, sizeof(memory));
+    embedDBUseArena(&arena);
+
+    uint32_t count, highWater = 0;
+    int64_t sum;
+    for (int i = 0; i < 20; i++) {
+        runQuery(&arena, &count, &sum);
+        TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS / 10, count);
+        if (i == 0)
+            highWater = arena.highWater;
+        TEST_ASSERT_EQUAL_UINT32(highWater, arena.highWater);
+        embedDBArenaRelease(&arena);
+        TEST_ASSERT_EQUAL_UINT32(0, arena.used);
+    }
+}
+
+void arena_should_overflow_to_heap(void) {
+    // Too small for the query, the rest is allocated with malloc and freed as usual
+    uint8_t memory[64];
+    embedDBArena arena;
+    embedDBArenaInit(&arena, memory, sizeof(memory));
+    embedDBUseArena(&arena);
+
+    uint32_t count;
+    int64_t sum;
+    runQuery(&arena, &count, &sum);
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS / 10, count);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, arena.overflow, "Freeing the overflowed allocations did not take them out of overflow.");
+    TEST_ASSERT_TRUE(arena.highWater > arena.size);
+    embedDBArenaRelease(&arena);
+
+    // The high-water mark is enough for the query to fit
+    uint8_t* larger = (uint8_t*)malloc(arena.highWater + 8);
+    uint32_t needed = arena.highWater;
+    embedDBArenaInit(&arena, larger, needed + 8);
+    embedDBUseArena(&arena);
+    runQuery(&arena, &count, &sum);
+    TEST_ASSERT_EQUAL_UINT32(0, arena.overflow);
+    TEST_ASSERT_EQUAL_UINT32(needed, arena.highWater);
+    embedDBUseArena(NULL);
+    embedDBArenaRelease(&arena);
+    free(larger);
+}
+
+void arena_should_allocate_aligned_zeroed_memory(void) {
+    uint8_t memory[128];
+    memset(memory, 0xFF, sizeof(memory));
+    embedDBArena arena;
+    embedDBArenaInit(&arena, memory + 1, sizeof(memory) - 1);
+    embedDBUseArena(&arena);
+    void* a = embedDBMalloc(3);
+    uint8_t* b = (uint8_t*)embedDBCalloc(5, 2);
+    TEST_ASSERT_TRUE((uintptr_t)a % 8 == 0);
+    TEST_ASSERT_TRUE((uintptr_t)b % 8 == 0);
+    TEST_ASSERT_TRUE(b >= (uint8_t*)a + 3);
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_EQUAL_UINT8(0, b[i]);
+    embedDBFree(a);
+    embedDBFree(b);
+    embedDBUseArena(NULL);
+    embedDBArenaRelease(&arena);
+}
+
+void arena_memory_should_be_freed_outside_its_scope(void) {
+    uint8_t memory[64], otherMemory[64];
+    embedDBArena arena, other;
+    embedDBArenaInit(&arena, memory, sizeof(memory));
+    embedDBArenaInit(&other, otherMemory, sizeof(otherMemory));
+
+    // One allocation fits in the arena, the other overflows to malloc
+    embedDBUseArena(&arena);
+    void* inArena = embedDBMalloc(32);
+    void* overflowed = embedDBMalloc(100);
+    TEST_ASSERT_TRUE(isInArena(&arena, inArena));
+    TEST_ASSERT_FALSE(isInArena(&arena, overflowed));
+    TEST_ASSERT_EQUAL_UINT32(104, arena.overflow);
+
+    // Released with an overflowed allocation still live, the arena keeps counting it
+    embedDBArenaRelease(&arena);
+    TEST_ASSERT_EQUAL_UINT32(104, arena.overflow);
+
+    // Freeing under another arena or none goes to the arena the memory came from
+    inArena = embedDBMalloc(32);
+    embedDBUseArena(&other);
+    embedDBFree(inArena);
+    embedDBFree(overflowed);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, arena.overflow, "Freeing an overflowed allocation under another arena did not find its arena.");
+    embedDBUseArena(&arena);
+    inArena = embedDBMalloc(8);
+    embedDBUseArena(NULL);
+    embedDBFree(inArena);
+    embedDBArenaRelease(&arena);
+    embedDBArenaRelease(&other);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(arena_query_should_match_heap_query);
+    RUN_TEST(arena_should_be_reused_after_release);
+    RUN_TEST(arena_should_overflow_to_heap);
+    RUN_TEST(arena_should_allocate_aligned_zeroed_memory);
+    RUN_TEST(arena_memory_should_be_freed_outside_its_scope);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,360 @@
+/******************************************************************************/
+/**
+ * @file        test_query_batch.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test the batch interface of the advanced query operators.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 3000
+
+embedDBState* state;
+embedDBSchema* baseSchema;
+
+int32_t temperatureForKey(uint32_t key) {
+    return (int32_t)((key * 7) % 200) - 100;
+}
+
+int32_t humidityForKey(uint32_t key) {
+    return key % 13;
+}
+
+void setUp(void) {
+    state = (embedDBState*)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+
+    state->keySize = 4;
+    state->dataSize = 8;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 4;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 20;
+    state->numDataPages = 1000;
+    state->eraseSizeInPages = 4;
+
+    char dataPath[] = DATA_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+
+    state->parameters = EMBEDDB_RESET_DATA;
+    state->bitmapSize = 0;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+
+    int8_t result = embedDBInit(state, 1);
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, result, "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    int32_t data[2];
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        data[0] = temperatureForKey(key);
+        data[1] = humidityForKey(key);
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+    embedDBFlush(state);
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_SIGNED, embedDB_COLUMN_SIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_INT32, embedDB_COLUMN_INT32};
+    baseSchema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+}
+
+void tearDown(void) {
+    embedDBFreeSchema(&baseSchema);
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+    state = NULL;
+}
+
+void execBatch_should_return_same_records_as_exec(void) {
+    embedDBIterator it1, it2;
+    initFullIterator(state, &it1);
+    initFullIterator(state, &it2);
+
+    int32_t minTemperature = 50;
+    uint8_t cols[] = {0, 1};
+    embedDBOperator* recordOp = createProjectionOperator(createSelectionOperator(createTableScanOperator(state, &it1, baseSchema), 1, SELECT_GTE, &minTemperature), 2, cols);
+    embedDBOperator* batchOp = createProjectionOperator(createSelectionOperator(createTableScanOperator(state, &it2, baseSchema), 1, SELECT_GTE, &minTemperature), 2, cols);
+    recordOp->init(recordOp);
+    batchOp->init(batchOp);
+
+    embedDBBatch* batch = createBatchFromSchema(batchOp->schema, 20);
+    TEST_ASSERT_NOT_NULL_MESSAGE(batch, "Failed to allocate batch.");
+
+    uint32_t recordsReturned = 0;
+    uint16_t numSelected;
+    while ((numSelected = execBatch(batchOp, batch)) > 0) {
+        TEST_ASSERT_TRUE_MESSAGE(numSelected <= 20, "Batch returned more records than its capacity.");
+        for (uint16_t i = 0; i < numSelected; i++) {
+            TEST_ASSERT_EQUAL_INT8_MESSAGE(1, exec(recordOp), "Batch returned more records than exec.");
+            TEST_ASSERT_EQUAL_MEMORY_MESSAGE(recordOp->recordBuffer, EMBEDDB_BATCH_RECORD(batch, i), 8, "Batch record does not match record from exec.");
+            recordsReturned++;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, exec(recordOp), "Batch returned fewer records than exec.");
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(NUM_RECORDS / 4, recordsReturned, "Wrong number of records selected.");
+
+    embedDBFreeBatch(&batch);
+    TEST_ASSERT_NULL(batch);
+    recordOp->close(recordOp);
+    embedDBFreeOperatorRecursive(&recordOp);
+    batchOp->close(batchOp);
+    embedDBFreeOperatorRecursive(&batchOp);
+    embedDBCloseIterator(&it1);
+    embedDBCloseIterator(&it2);
+}
+
+void embedDBBatchGetColumn_should_copy_selected_values(void) {
+    embedDBIterator it;
+    initFullIterator(state, &it);
+
+    int32_t humidity = 5;
+    embedDBOperator* op = createSelectionOperator(createTableScanOperator(state, &it, baseSchema), 2, SELECT_EQ, &humidity);
+    op->init(op);
+
+    embedDBBatch* batch = createBatchFromSchema(op->schema, EMBEDDB_BATCH_SIZE);
+    int32_t keys[EMBEDDB_BATCH_SIZE];
+    uint32_t expectedKey = 5;
+    uint16_t numSelected;
+    while ((numSelected = execBatch(op, batch)) > 0) {
+        TEST_ASSERT_EQUAL_UINT16(numSelected, embedDBBatchGetColumn(batch, op->schema, 0, keys));
+        for (uint16_t i = 0; i < numSelected; i++) {
+            TEST_ASSERT_EQUAL_UINT32_MESSAGE(expectedKey, keys[i], "Column vector has the wrong key.");
+            expectedKey += 13;
+        }
+    }
+    TEST_ASSERT_TRUE_MESSAGE(expectedKey >= NUM_RECORDS, "Not all matching records were returned.");
+
+    embedDBFreeBatch(&batch);
+    op->close(op);
+    embedDBFreeOperatorRecursive(&op);
+    embedDBCloseIterator(&it);
+}
+
+int8_t sameHundredGroup(const void* lastRecord, const void* record) {
+    return *(uint32_t*)lastRecord / 100 == *(uint32_t*)record / 100;
+}
+
+void writeHundredGroup(embedDBAggregateFunc* aggFunc, embedDBSchema* outputSchema, void* recordBuffer, const void* lastRecord) {
+    uint32_t group = *(uint32_t*)lastRecord / 100;
+    memcpy((int8_t*)recordBuffer + getColOffsetFromSchema(outputSchema, aggFunc->colNum), &group, sizeof(uint32_t));
+}
+
+void customCountReset(embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema) {
+    *(uint32_t*)aggFunc->state = 0;
+}
+
+void customCountAdd(embedDBAggregateFunc* aggFunc, embedDBSchema* inputSchema, const void* record) {
+    (*(uint32_t*)aggFunc->state)++;
+}
+
+void customCountCompute(embedDBAggregateFunc* aggFunc, embedDBSchema* outputSchema, void* recordBuffer, const void* lastRecord) {
+    memcpy((int8_t*)recordBuffer + getColOffsetFromSchema(outputSchema, aggFunc->colNum), aggFunc->state, sizeof(uint32_t));
+}
+
+void aggregate_should_be_correct_when_reading_batches(void) {
+    embedDBIterator it;
+    initFullIterator(state, &it);
+
+    // Groups of 100 keys span several batches, and the selection removes records from each batch
+    int32_t minTemperature = -20;
+    embedDBOperator* selectOp = createSelectionOperator(createTableScanOperator(state, &it, baseSchema), 1, SELECT_GT, &minTemperature);
+    uint32_t customCount = 0;
+    embedDBAggregateFunc groupName = {NULL, NULL, writeHundredGroup, NULL, 4};
+    embedDBAggregateFunc custom = {customCountReset, customCountAdd, customCountCompute, &customCount, 4};
+    embedDBAggregateFunc* counter = createCountAggregate();
+    embedDBAggregateFunc* sum = createSumAggregate(2);
+    embedDBAggregateFunc* minTemp = createMinAggregate(1, -4);
+    embedDBAggregateFunc* maxTemp = createMaxAggregate(1, -4);
+    embedDBAggregateFunc* avgTemp = createAvgAggregate(1, 4);
+    embedDBAggregateFunc aggFunctions[] = {groupName, *counter, *sum, *minTemp, *maxTemp, *avgTemp, custom};
+    uint32_t functionsLength = 7;
+    embedDBOperator* aggOp = createAggregateOperator(selectOp, sameHundredGroup, aggFunctions, functionsLength);
+    aggOp->init(aggOp);
+
+    int32_t* recordBuffer = (int32_t*)aggOp->recordBuffer;
+    uint32_t group = 0;
+    while (exec(aggOp)) {
+        uint32_t count = 0;
+        int64_t sumHumidity = 0;
+        int32_t minT = INT32_MAX, maxT = INT32_MIN;
+        double sumT = 0;
+        for (uint32_t key = group * 100; key < (group + 1) * 100; key++) {
+            int32_t temperature = temperatureForKey(key);
+            if (temperature <= minTemperature)
+                continue;
+            count++;
+            sumHumidity += humidityForKey(key);
+            sumT += temperature;
+            if (temperature < minT)
+                minT = temperature;
+            if (temperature > maxT)
+                maxT = temperature;
+        }
+
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(group, recordBuffer[0], "Group label is wrong");
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(count, recordBuffer[1], "Count is wrong");
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(&sumHumidity, recordBuffer + 2, sizeof(int64_t), "Sum is wrong");
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(minT, recordBuffer[4], "Min is wrong");
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(maxT, recordBuffer[5], "Max is wrong");
+        TEST_ASSERT_EQUAL_FLOAT_MESSAGE((float)(sumT / count), ((float*)recordBuffer)[6], "Average is wrong");
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(count, recordBuffer[7], "Custom aggregate is wrong");
+        group++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(NUM_RECORDS / 100, group, "Aggregate didn't return the right number of groups");
+
+    for (uint32_t i = 1; i < functionsLength - 1; i++) {
+        free(aggFunctions[i].state);
+    }
+    free(counter);
+    free(sum);
+    free(minTemp);
+    free(maxTemp);
+    free(avgTemp);
+    aggOp->close(aggOp);
+    embedDBFreeOperatorRecursive(&aggOp);
+    embedDBCloseIterator(&it);
+}
+
+void initCounterOperator(embedDBOperator* op) {
+    *(uint32_t*)op->state = 0;
+}
+
+int8_t nextCounterOperator(embedDBOperator* op) {
+    uint32_t* next = (uint32_t*)op->state;
+    if (*next >= 100)
+        return 0;
+    memcpy(op->recordBuffer, next, sizeof(uint32_t));
+    (*next)++;
+    return 1;
+}
+
+void closeCounterOperator(embedDBOperator* op) {}
+
+void execBatch_should_read_custom_operators_with_next(void) {
+    int8_t colSizes[] = {4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32};
+    uint32_t counterState = 0, counterRecord = 0;
+    embedDBOperator counter;
+    counter.input = NULL;
+    counter.init = initCounterOperator;
+    counter.next = nextCounterOperator;
+    counter.close = closeCounterOperator;
+    counter.state = &counterState;
+    counter.schema = embedDBCreateSchema(1, colSizes, colSignedness, colTypes);
+    counter.recordBuffer = &counterRecord;
+
+    uint32_t minValue = 40;
+    embedDBOperator* op = createSelectionOperator(&counter, 0, SELECT_GTE, &minValue);
+    op->init(op);
+
+    embedDBBatch* batch = createBatchFromSchema(op->schema, 16);
+    uint32_t expected = 40;
+    uint16_t numSelected;
+    while ((numSelected = execBatch(op, batch)) > 0) {
+        for (uint16_t i = 0; i < numSelected; i++) {
+            TEST_ASSERT_EQUAL_UINT32(expected, *(uint32_t*)EMBEDDB_BATCH_RECORD(batch, i));
+            expected++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(100, expected, "Not all records of the custom operator were returned.");
+
+    embedDBFreeBatch(&batch);
+    op->close(op);
+    embedDBFreeSchema(&counter.schema);
+    free(op);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(execBatch_should_return_same_records_as_exec);
+    RUN_TEST(embedDBBatchGetColumn_should_copy_selected_values);
+    RUN_TEST(aggregate_should_be_correct_when_reading_batches);
+    RUN_TEST(execBatch_should_read_custom_operators_with_next);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,473 @@
+/******************************************************************************/
+/**
+ * @file        test_query_planner.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test the query planner and its page read estimates.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/queryPlanner.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define INDEX_PATH "indexFile.bin"
+#define SECONDARY_DATA_PATH "secondaryDataFile.bin"
+#define SECONDARY_INDEX_PATH "secondaryIndexFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define INDEX_PATH "build/artifacts/indexFile.bin"
+#define SECONDARY_DATA_PATH "build/artifacts/secondaryDataFile.bin"
+#define SECONDARY_INDEX_PATH "build/artifacts/secondaryIndexFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 6000
+
+embedDBState* state;
+embedDBSchema* baseSchema;
+
+int32_t temperatureForKey(uint32_t key) {
+    return key / 100;
+}
+
+void setUp(void) {
+    state = (embedDBState*)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+
+    state->keySize = 4;
+    state->dataSize = 8;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 4;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 20;
+    state->numDataPages = 1000;
+    state->numIndexPages = 16;
+    state->eraseSizeInPages = 4;
+
+    char dataPath[] = DATA_PATH, indexPath[] = INDEX_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->indexFile = setupFile(indexPath);
+
+    state->parameters = EMBEDDB_USE_INDEX | EMBEDDB_USE_BMAP | EMBEDDB_USE_MAX_MIN | EMBEDDB_RESET_DATA;
+    state->bitmapSize = 1;
+    state->inBitmap = inBitmapInt8;
+    state->updateBitmap = updateBitmapInt8;
+    state->buildBitmapFromRange = buildBitmapInt8FromRange;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+
+    int8_t result = embedDBInit(state, 1);
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, result, "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    int32_t data[2];
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        data[0] = temperatureForKey(key);
+        data[1] = key % 7;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+    embedDBFlush(state);
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_SIGNED, embedDB_COLUMN_SIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_INT32, embedDB_COLUMN_INT32};
+    baseSchema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+}
+
+void tearDown(void) {
+    embedDBFreeSchema(&baseSchema);
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    tearDownFile(state->indexFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+    state = NULL;
+}
+
+uint32_t totalDataPages(void) {
+    return state->nextDataPageId - state->minDataPageId;
+}
+
+void initQuery(embedDBQuery* query) {
+    memset(query, 0, sizeof(embedDBQuery));
+}
+
+void full_scan_estimate_should_match_reads(void) {
+    embedDBQuery query;
+    initQuery(&query);
+    embedDBQueryPlan* plan = embedDBPlanQuery(state, baseSchema, &query);
+    TEST_ASSERT_NOT_NULL_MESSAGE(plan, "Query could not be planned.");
+    TEST_ASSERT_EQUAL_UINT8(EMBEDDB_PLAN_FULL_SCAN, plan->accessPath);
+    TEST_ASSERT_EQUAL_UINT32(totalDataPages(), plan->estimatedDataPageReads);
+    TEST_ASSERT_EQUAL_UINT32(0, plan->estimatedIndexPageReads);
+
+    embedDBResetStats(state);
+    uint32_t count = 0;
+    while (exec(plan->root)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(plan->estimatedDataPageReads, state->numReads, "Full scan estimate did not match the pages read.");
+
+    embedDBFreeQueryPlan(&plan);
+    TEST_ASSERT_NULL(plan);
+}
+
+void key_range_estimate_should_bound_reads(void) {
+    uint32_t minKey = 3000, maxKey = 3100;
+    embedDBPredicate predicates[] = {{0, SELECT_GTE, &minKey}, {0, SELECT_LT, &maxKey}};
+    embedDBQuery query;
+    initQuery(&query);
+    query.predicates = predicates;
+    query.numPredicates = 2;
+
+    embedDBQueryPlan* plan = embedDBPlanQuery(state, baseSchema, &query);
+    TEST_ASSERT_NOT_NULL(plan);
+    TEST_ASSERT_EQUAL_UINT8(EMBEDDB_PLAN_KEY_RANGE, plan->accessPath);
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(totalDataPages() / 10, plan->estimatedDataPageReads, "Key range was not used to limit the estimate.");
+
+    embedDBResetStats(state);
+    uint32_t expectedKey = 3000;
+    uint32_t* recordBuffer = (uint32_t*)plan->root->recordBuffer;
+    while (exec(plan->root)) {
+        TEST_ASSERT_EQUAL_UINT32(expectedKey, recordBuffer[0]);
+        expectedKey++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(3100, expectedKey);
+    TEST_ASSERT_TRUE_MESSAGE(state->numReads <= plan->estimatedDataPageReads, "More pages were read than estimated.");
+
+    embedDBFreeQueryPlan(&plan);
+}
+
+void key_range_should_plan_with_binary_search(void) {
+    // As if binary search was set at initialization, when no spline is allocated
+    spline* spl = state->spl;
+    state->spl = NULL;
+    state->parameters |= EMBEDDB_USE_BINARY_SEARCH;
+
+    uint32_t minKey = 3000, maxKey = 3100;
+    embedDBPredicate predicates[] = {{0, SELECT_GTE, &minKey}, {0, SELECT_LT, &maxKey}};
+    embedDBQuery query;
+    initQuery(&query);
+    query.predicates = predicates;
+    query.numPredicates = 2;
+
+    embedDBQueryPlan* plan = embedDBPlanQuery(state, baseSchema, &query);
+    TEST_ASSERT_NOT_NULL(plan);
+    TEST_ASSERT_EQUAL_UINT8(EMBEDDB_PLAN_KEY_RANGE, plan->accessPath);
+    uint32_t count = 0;
+    while (exec(plan->root)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, count);
+    embedDBFreeQueryPlan(&plan);
+
+    state->parameters &= ~EMBEDDB_USE_BINARY_SEARCH;
+    state->spl = spl;
+}
+
+void bitmap_estimate_should_approximate_reads(void) {
+    int32_t minTemperature = 12, maxTemperature = 14;
+    embedDBPredicate predicates[] = {{1, SELECT_GTE, &minTemperature}, {1, SELECT_LT, &maxTemperature}};
+    embedDBQuery query;
+    initQuery(&query);
+    query.predicates = predicates;
+    query.numPredicates = 2;
+
+    embedDBQueryPlan* plan = embedDBPlanQuery(state, baseSchema, &query);
+    TEST_ASSERT_NOT_NULL(plan);
+    TEST_ASSERT_EQUAL_UINT8(EMBEDDB_PLAN_BITMAP_INDEX, plan->accessPath);
+    TEST_ASSERT_TRUE(plan->bitmapSelectivity > 0 && plan->bitmapSelectivity < 1);
+    TEST_ASSERT_LESS_THAN_UINT32(totalDataPages(), plan->estimatedDataPageReads);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, plan->estimatedIndexPageReads);
+    embedDBExplainQueryPlan(plan);
+
+    embedDBResetStats(state);
+    uint32_t count = 0;
+    while (exec(plan->root)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(200, count);
+    // The estimate assumes values are spread evenly over the bitmap buckets, so it is only approximate
+    TEST_ASSERT_TRUE_MESSAGE(state->numReads <= 2 * plan->estimatedDataPageReads && plan->estimatedDataPageReads <= 2 * state->numReads, "Data page estimate is too far from the pages read.");
+    TEST_ASSERT_TRUE_MESSAGE(state->numIdxReads <= plan->estimatedIndexPageReads, "More index pages were read than estimated.");
+
+    embedDBFreeQueryPlan(&plan);
+}
+
+void predicates_should_be_ordered_by_cost(void) {
+    uint32_t minKey = 1000;
+    int32_t remainder = 3, temperature = 40;
+    embedDBPredicate predicates[] = {{2, SELECT_NEQ, &remainder}, {1, SELECT_EQ, &temperature}, {0, SELECT_GTE, &minKey}};
+    embedDBQuery query;
+    initQuery(&query);
+    query.predicates = predicates;
+    query.numPredicates = 3;
+
+    embedDBQueryPlan* plan = embedDBPlanQuery(state, baseSchema, &query);
+    TEST_ASSERT_NOT_NULL(plan);
+    TEST_ASSERT_EQUAL_UINT8(0, plan->query.predicates[0].colNum);
+    TEST_ASSERT_EQUAL_INT8(SELECT_EQ, plan->query.predicates[1].operation);
+    TEST_ASSERT_EQUAL_INT8(SELECT_NEQ, plan->query.predicates[2].operation);
+    TEST_ASSERT_EQUAL_UINT8(EMBEDDB_PLAN_KEY_RANGE | EMBEDDB_PLAN_BITMAP_INDEX, plan->accessPath);
+    embedDBExplainQueryPlan(plan);
+
+    uint32_t count = 0;
+    int32_t* recordBuffer = (int32_t*)plan->root->recordBuffer;
+    while (exec(plan->root)) {
+        TEST_ASSERT_EQUAL_INT32(40, recordBuffer[1]);
+        TEST_ASSERT_TRUE(recordBuffer[2] != 3);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(85, count);
+
+    embedDBFreeQueryPlan(&plan);
+}
+
+void plan_should_aggregate_and_project(void) {
+    embedDBAggregateFunc* counter = createCountAggregate();
+    embedDBAggregateFunc* maxTemperature = createMaxAggregate(1, -4);
+    embedDBAggregateFunc aggregates[] = {*counter, *maxTemperature};
+    uint8_t projectionCols[] = {1, 0};
+    embedDBQuery query;
+    initQuery(&query);
+    query.aggregates = aggregates;
+    query.numAggregates = 2;
+    query.projectionCols = projectionCols;
+    query.numProjectionCols = 2;
+
+    embedDBQueryPlan* plan = embedDBPlanQuery(state, baseSchema, &query);
+    TEST_ASSERT_NOT_NULL(plan);
+    embedDBExplainQueryPlan(plan);
+
+    int32_t* recordBuffer = (int32_t*)plan->root->recordBuffer;
+    TEST_ASSERT_TRUE_MESSAGE(exec(plan->root), "Aggregate did not output a group.");
+    TEST_ASSERT_EQUAL_INT32(59, recordBuffer[0]);
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, recordBuffer[1]);
+    TEST_ASSERT_FALSE_MESSAGE(exec(plan->root), "All records should be in one group.");
+
+    embedDBFreeQueryPlan(&plan);
+    free(counter->state);
+    free(maxTemperature->state);
+    free(counter);
+    free(maxTemperature);
+}
+
+void wide_data_range_should_not_use_bitmap(void) {
+    // Every temperature is in the range, so the bitmap index would cost index reads without skipping a page
+    int32_t minTemperature = 0;
+    embedDBPredicate predicates[] = {{1, SELECT_GTE, &minTemperature}};
+    embedDBQuery query;
+    initQuery(&query);
+    query.predicates = predicates;
+    query.numPredicates = 1;
+
+    embedDBQueryPlan* plan = embedDBPlanQuery(state, baseSchema, &query);
+    TEST_ASSERT_NOT_NULL(plan);
+    TEST_ASSERT_EQUAL_UINT8(2, plan->numCandidates);
+    TEST_ASSERT_EQUAL_UINT8(EMBEDDB_PLAN_BITMAP_INDEX, plan->candidatePaths[1]);
+    TEST_ASSERT_TRUE(plan->candidateCosts[0] < plan->candidateCosts[1]);
+    TEST_ASSERT_EQUAL_UINT8(EMBEDDB_PLAN_FULL_SCAN, plan->accessPath);
+    TEST_ASSERT_NULL_MESSAGE(plan->iterator.queryBitmap, "The bitmap index was used although it was estimated to cost more.");
+    embedDBExplainQueryPlan(plan);
+
+    embedDBResetStats(state);
+    uint32_t count = 0;
+    while (exec(plan->root)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+    TEST_ASSERT_EQUAL_UINT32(0, state->numIdxReads);
+
+    embedDBFreeQueryPlan(&plan);
+}
+
+/* A table with a secondary index on the temperature column and no bitmap index */
+embedDBState* createSecondaryIndexState(void) {
+    embedDBState* secondaryState = (embedDBState*)calloc(1, sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(secondaryState, "Unable to allocate embedDBState.");
+    secondaryState->keySize = 4;
+    secondaryState->dataSize = 8;
+    secondaryState->pageSize = 512;
+    secondaryState->bufferSizeInBlocks = 4;
+    secondaryState->buffer = malloc((size_t)secondaryState->bufferSizeInBlocks * secondaryState->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(secondaryState->buffer, "Failed to allocate buffer for EmbedDB.");
+    secondaryState->numSplinePoints = 20;
+    secondaryState->numDataPages = 1000;
+    secondaryState->eraseSizeInPages = 4;
+
+    char dataPath[] = SECONDARY_DATA_PATH, secondaryIndexPath[] = SECONDARY_INDEX_PATH;
+    secondaryState->fileInterface = getFileInterface();
+    secondaryState->dataFile = setupFile(dataPath);
+    secondaryState->secondaryIndexFile = setupFile(secondaryIndexPath);
+    secondaryState->parameters = EMBEDDB_USE_SECONDARY_INDEX | EMBEDDB_RESET_DATA;
+    secondaryState->compareKey = int32Comparator;
+    secondaryState->compareData = int32Comparator;
+    secondaryState->numSecondaryIndexPages = 48;
+    secondaryState->secondaryIndexOffset = 0;
+    secondaryState->secondaryIndexSize = 4;
+    secondaryState->compareSecondaryIndex = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(secondaryState, 1), "EmbedDB did not initialize correctly.");
+    secondaryState->rules = NULL;
+
+    int32_t data[2];
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        data[0] = temperatureForKey(key);
+        data[1] = key % 7;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(secondaryState, &key, data), "embedDBPut failed.");
+    }
+    embedDBFlush(secondaryState);
+    return secondaryState;
+}
+
+void freeSecondaryIndexState(embedDBState* secondaryState) {
+    void* secondaryIndexFile = secondaryState->secondaryIndexFile;
+    embedDBClose(secondaryState);
+    tearDownFile(secondaryState->dataFile);
+    tearDownFile(secondaryIndexFile);
+    free(secondaryState->fileInterface);
+    free(secondaryState->buffer);
+    free(secondaryState);
+}
+
+void equality_should_use_secondary_index_unless_key_range_is_cheaper(void) {
+    embedDBState* secondaryState = createSecondaryIndexState();
+    uint32_t numPages = secondaryState->nextDataPageId - secondaryState->minDataPageId;
+
+    int32_t temperature = 25;
+    embedDBPredicate predicates[] = {{1, SELECT_EQ, &temperature}};
+    embedDBQuery query;
+    initQuery(&query);
+    query.predicates = predicates;
+    query.numPredicates = 1;
+
+    embedDBQueryPlan* plan = embedDBPlanQuery(secondaryState, baseSchema, &query);
+    TEST_ASSERT_NOT_NULL(plan);
+    TEST_ASSERT_EQUAL_UINT8(EMBEDDB_PLAN_SECONDARY_INDEX, plan->accessPath);
+    TEST_ASSERT_LESS_THAN_UINT32(numPages, plan->estimatedDataPageReads + plan->estimatedIndexPageReads);
+    embedDBExplainQueryPlan(plan);
+
+    embedDBResetStats(secondaryState);
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)plan->root->recordBuffer;
+    while (exec(plan->root)) {
+        TEST_ASSERT_EQUAL_UINT32(2500 + count, recordBuffer[0]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, count);
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(numPages / 2, secondaryState->numReads, "The secondary index did not skip pages.");
+    embedDBFreeQueryPlan(&plan);
+
+    // A few pages of keys cost less than reading the secondary index, whose range is then checked by the selection
+    uint32_t minKey = 2450, maxKey = 2549;
+    query.minKey = &minKey;
+    query.maxKey = &maxKey;
+    plan = embedDBPlanQuery(secondaryState, baseSchema, &query);
+    TEST_ASSERT_NOT_NULL(plan);
+    TEST_ASSERT_EQUAL_UINT8(EMBEDDB_PLAN_KEY_RANGE, plan->accessPath);
+    count = 0;
+    while (exec(plan->root)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(50, count);
+    embedDBFreeQueryPlan(&plan);
+
+    freeSecondaryIndexState(secondaryState);
+}
+
+void invalid_predicate_should_not_plan(void) {
+    int32_t value = 0;
+    embedDBPredicate predicates[] = {{3, SELECT_EQ, &value}};
+    embedDBQuery query;
+    initQuery(&query);
+    query.predicates = predicates;
+    query.numPredicates = 1;
+    TEST_ASSERT_NULL(embedDBPlanQuery(state, baseSchema, &query));
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(full_scan_estimate_should_match_reads);
+    RUN_TEST(key_range_estimate_should_bound_reads);
+    RUN_TEST(key_range_should_plan_with_binary_search);
+    RUN_TEST(bitmap_estimate_should_approximate_reads);
+    RUN_TEST(predicates_should_be_ordered_by_cost);
+    RUN_TEST(plan_should_aggregate_and_project);
+    RUN_TEST(wide_data_range_should_not_use_bitmap);
+    RUN_TEST(equality_should_use_secondary_index_unless_key_range_is_cheaper);
+    RUN_TEST(invalid_predicate_should_not_plan);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
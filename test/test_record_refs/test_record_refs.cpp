@@ -0,0 +1,305 @@
+/******************************************************************************/
+/**
+ * @file        test_record_refs.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test reading records in place with embedDBNextRef, embedDBPrevRef, embedDBGetRef and table scans.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define VAR_TABLE_PATH "varTableFile.bin"
+#define VAR_DATA_PATH "varFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define VAR_TABLE_PATH "build/artifacts/varTableFile.bin"
+#define VAR_DATA_PATH "build/artifacts/varFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 3000
+
+embedDBState* state;
+embedDBSchema* schema;
+embedDBIterator it;
+embedDBIterator it2;
+
+/* Every key is also a key of another record, so records can be joined with the same table */
+uint32_t dataForKey(uint32_t key) {
+    return key * 7 % NUM_RECORDS;
+}
+
+int8_t isInPageBuffer(const void* ptr) {
+    return (const int8_t*)ptr >= (int8_t*)state->buffer && (const int8_t*)ptr < (int8_t*)state->buffer + 2 * state->pageSize;
+}
+
+void setUp(void) {
+    char dataPath[] = DATA_PATH;
+    state = createState(dataPath, 4, EMBEDDB_RESET_DATA);
+
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        uint32_t data = dataForKey(key);
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, &data), "embedDBPut failed.");
+    }
+
+    int8_t colSizes[] = {4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32};
+    schema = embedDBCreateSchema(2, colSizes, colSignedness, colTypes);
+
+    initFullIterator(state, &it);
+    initFullIterator(state, &it2);
+}
+
+void tearDown(void) {
+    embedDBCloseIterator(&it);
+    embedDBCloseIterator(&it2);
+    embedDBFreeSchema(&schema);
+    freeState(state);
+}
+
+void next_ref_should_return_records_in_place(void) {
+    const void *key, *data;
+    uint32_t count = 0;
+    while (embedDBNextRef(state, &it, &key, &data)) {
+        TEST_ASSERT_TRUE(isInPageBuffer(key));
+        TEST_ASSERT_TRUE((const int8_t*)data == (const int8_t*)key + state->keySize);
+        TEST_ASSERT_EQUAL_UINT32(count, *(const uint32_t*)key);
+        TEST_ASSERT_EQUAL_UINT32(dataForKey(count), *(const uint32_t*)data);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+}
+
+void prev_ref_should_return_records_newest_first(void) {
+    embedDBCloseIterator(&it);
+    embedDBInitReverseIterator(state, &it);
+    const void *key, *data;
+    uint32_t count = 0;
+    while (embedDBPrevRef(state, &it, &key, &data)) {
+        uint32_t expected = NUM_RECORDS - 1 - count;
+        TEST_ASSERT_TRUE(isInPageBuffer(key));
+        TEST_ASSERT_EQUAL_UINT32(expected, *(const uint32_t*)key);
+        TEST_ASSERT_EQUAL_UINT32(dataForKey(expected), *(const uint32_t*)data);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+}
+
+void get_ref_should_find_stored_and_buffered_keys(void) {
+    const void* data;
+    uint32_t keys[] = {0, 1234, 2000, NUM_RECORDS - 1};
+    for (uint32_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        TEST_ASSERT_EQUAL_INT8(0, embedDBGetRef(state, &keys[i], &data));
+        TEST_ASSERT_TRUE(isInPageBuffer(data));
+        TEST_ASSERT_EQUAL_UINT32(dataForKey(keys[i]), *(const uint32_t*)data);
+    }
+
+    uint32_t missing = NUM_RECORDS + 10;
+    TEST_ASSERT_TRUE(embedDBGetRef(state, &missing, &data) != 0);
+}
+
+void table_scan_should_not_copy_records(void) {
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    scanOp->init(scanOp);
+    uint32_t count = 0;
+    while (exec(scanOp)) {
+        TEST_ASSERT_TRUE(isInPageBuffer(scanOp->recordBuffer));
+        TEST_ASSERT_EQUAL_UINT32(count, ((uint32_t*)scanOp->recordBuffer)[0]);
+        TEST_ASSERT_EQUAL_UINT32(dataForKey(count), ((uint32_t*)scanOp->recordBuffer)[1]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+    scanOp->close(scanOp);
+    embedDBFreeOperatorRecursive(&scanOp);
+}
+
+void key_join_should_join_table_with_itself(void) {
+    // The filtered scan is pages ahead of the other one, and both read pages into the same read buffer
+    uint32_t maxData = 29;
+    embedDBCloseIterator(&it2);
+    it2.maxData = &maxData;
+    embedDBInitIterator(state, &it2);
+    embedDBOperator* scan1 = createTableScanOperator(state, &it, schema);
+    embedDBOperator* scan2 = createTableScanOperator(state, &it2, schema);
+    embedDBOperator* joinOp = createKeyJoinOperator(scan1, scan2);
+    joinOp->init(joinOp);
+
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)joinOp->recordBuffer;
+    while (exec(joinOp)) {
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[0], recordBuffer[2]);
+        TEST_ASSERT_EQUAL_UINT32(dataForKey(recordBuffer[0]), recordBuffer[1]);
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[1], recordBuffer[3]);
+        TEST_ASSERT_TRUE(recordBuffer[3] <= maxData);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(maxData + 1, count);
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+    free(scan2);
+}
+
+void index_join_should_look_up_same_table(void) {
+    // The lookups read pages of the table being scanned
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* joinOp = createIndexJoinOperator(scanOp, 1, state, schema);
+    joinOp->init(joinOp);
+
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)joinOp->recordBuffer;
+    while (exec(joinOp)) {
+        TEST_ASSERT_EQUAL_UINT32(count, recordBuffer[0]);
+        TEST_ASSERT_EQUAL_UINT32(dataForKey(count), recordBuffer[1]);
+        TEST_ASSERT_EQUAL_UINT32(recordBuffer[1], recordBuffer[2]);
+        TEST_ASSERT_EQUAL_UINT32(dataForKey(recordBuffer[2]), recordBuffer[3]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+
+    joinOp->close(joinOp);
+    embedDBFreeOperatorRecursive(&joinOp);
+}
+
+void batch_scan_should_copy_schema_records_of_var_data_table(void) {
+    // Records of a table with variable data end with a pointer to it, which is not part of the schema
+    embedDBState* varState = (embedDBState*)calloc(1, sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(varState, "Unable to allocate embedDBState.");
+    varState->keySize = 4;
+    varState->dataSize = 4;
+    varState->pageSize = 512;
+    varState->bufferSizeInBlocks = 4;
+    varState->buffer = malloc((size_t)varState->bufferSizeInBlocks * varState->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(varState->buffer, "Failed to allocate buffer for EmbedDB.");
+    varState->numSplinePoints = 20;
+    varState->numDataPages = 1000;
+    varState->numVarPages = 1000;
+    varState->eraseSizeInPages = 4;
+    char dataPath[] = VAR_TABLE_PATH, varDataPath[] = VAR_DATA_PATH;
+    varState->fileInterface = getFileInterface();
+    varState->dataFile = setupFile(dataPath);
+    varState->varFile = setupFile(varDataPath);
+    varState->parameters = EMBEDDB_USE_VDATA | EMBEDDB_RESET_DATA;
+    varState->compareKey = int32Comparator;
+    varState->compareData = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(varState, 1), "EmbedDB did not initialize correctly.");
+    varState->rules = NULL;
+    char varData[] = "variable";
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        uint32_t data = dataForKey(key);
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPutVar(varState, &key, &data, varData, sizeof(varData)), "embedDBPutVar failed.");
+    }
+
+    embedDBIterator varIt;
+    initFullIterator(varState, &varIt);
+    embedDBOperator* scanOp = createTableScanOperator(varState, &varIt, schema);
+    scanOp->init(scanOp);
+    embedDBBatch* batch = createBatchFromSchema(scanOp->schema, 64);
+    TEST_ASSERT_NOT_NULL(batch);
+    uint32_t count = 0;
+    while (execBatch(scanOp, batch) > 0) {
+        uint32_t* records = (uint32_t*)batch->records;
+        for (uint16_t i = 0; i < batch->count; i++, count++) {
+            TEST_ASSERT_EQUAL_UINT32(count, records[2 * i]);
+            TEST_ASSERT_EQUAL_UINT32(dataForKey(count), records[2 * i + 1]);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+
+    embedDBFreeBatch(&batch);
+    scanOp->close(scanOp);
+    embedDBFreeOperatorRecursive(&scanOp);
+    embedDBCloseIterator(&varIt);
+    embedDBClose(varState);
+    tearDownFile(varState->dataFile);
+    tearDownFile(varState->varFile);
+    free(varState->fileInterface);
+    free(varState->buffer);
+    free(varState);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(next_ref_should_return_records_in_place);
+    RUN_TEST(prev_ref_should_return_records_newest_first);
+    RUN_TEST(get_ref_should_find_stored_and_buffered_keys);
+    RUN_TEST(table_scan_should_not_copy_records);
+    RUN_TEST(key_join_should_join_table_with_itself);
+    RUN_TEST(index_join_should_look_up_same_table);
+    RUN_TEST(batch_scan_should_copy_schema_records_of_var_data_table);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
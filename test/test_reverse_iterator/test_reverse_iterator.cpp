@@ -0,0 +1,260 @@
+/******************************************************************************/
+/**
+ * @file        test_reverse_iterator.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test iterating newest first with embedDBPrev and embedDBPrevVar.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_FILE_PATH "dataFile.bin"
+#define INDEX_FILE_PATH "indexFile.bin"
+#define VAR_DATA_FILE_PATH "varFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_FILE_PATH "build/artifacts/dataFile.bin"
+#define INDEX_FILE_PATH "build/artifacts/indexFile.bin"
+#define VAR_DATA_FILE_PATH "build/artifacts/varFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 3000
+
+embedDBState *state;
+
+void setUp(void) {
+    state = (embedDBState *)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+    state->keySize = 4;
+    state->dataSize = 4;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 6;
+    state->numSplinePoints = 8;
+    state->buffer = calloc(1, state->pageSize * state->bufferSizeInBlocks);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate EmbedDB buffer.");
+    state->numDataPages = 1000;
+    state->numIndexPages = 48;
+    state->numVarPages = 1000;
+    state->eraseSizeInPages = 4;
+    char dataPath[] = DATA_FILE_PATH, indexPath[] = INDEX_FILE_PATH, varPath[] = VAR_DATA_FILE_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->indexFile = setupFile(indexPath);
+    state->varFile = setupFile(varPath);
+    state->parameters = EMBEDDB_USE_BMAP | EMBEDDB_USE_INDEX | EMBEDDB_USE_MAX_MIN | EMBEDDB_USE_VDATA | EMBEDDB_RESET_DATA;
+    state->bitmapSize = 1;
+    state->inBitmap = inBitmapInt8;
+    state->updateBitmap = updateBitmapInt8;
+    state->buildBitmapFromRange = buildBitmapInt8FromRange;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(state, 1), "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    // Data values come in runs so the bitmap can rule out pages. The last records stay in the write buffer.
+    char varData[] = "Record 0000";
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        uint32_t data = key / 100;
+        snprintf(varData, sizeof(varData), "Record %04u", (unsigned int)key);
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPutVar(state, &key, &data, varData, sizeof(varData)), "embedDBPutVar failed.");
+    }
+}
+
+void tearDown(void) {
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    tearDownFile(state->indexFile);
+    tearDownFile(state->varFile);
+    free(state->buffer);
+    free(state->fileInterface);
+    free(state);
+}
+
+void initIterator(embedDBIterator *it, void *minKey, void *maxKey, void *minData, void *maxData) {
+    it->minKey = minKey;
+    it->maxKey = maxKey;
+    it->minData = minData;
+    it->maxData = maxData;
+    embedDBInitReverseIterator(state, it);
+}
+
+void prev_should_return_records_newest_first(void) {
+    embedDBIterator it;
+    initIterator(&it, NULL, NULL, NULL, NULL);
+
+    uint32_t key, data, expectedKey = NUM_RECORDS;
+    while (embedDBPrev(state, &it, &key, &data)) {
+        expectedKey--;
+        TEST_ASSERT_EQUAL_UINT32(expectedKey, key);
+        TEST_ASSERT_EQUAL_UINT32(key / 100, data);
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, expectedKey, "Reverse iterator didn't return every record.");
+    TEST_ASSERT_FALSE(embedDBPrev(state, &it, &key, &data));
+    embedDBCloseIterator(&it);
+}
+
+void prev_should_only_read_recent_pages(void) {
+    embedDBIterator it;
+    initIterator(&it, NULL, NULL, NULL, NULL);
+
+    embedDBResetStats(state);
+    uint32_t key, data;
+    for (uint32_t i = 0; i < 50; i++) {
+        TEST_ASSERT_EQUAL_INT8(1, embedDBPrev(state, &it, &key, &data));
+        TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS - 1 - i, key);
+    }
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(2, state->numReads, "Reverse iterator read old pages.");
+    embedDBCloseIterator(&it);
+}
+
+void prev_should_start_at_max_key_and_stop_at_min_key(void) {
+    embedDBIterator it;
+    uint32_t minKey = 1000, maxKey = 1200;
+    embedDBResetStats(state);
+    initIterator(&it, &minKey, &maxKey, NULL, NULL);
+
+    uint32_t key, data, expectedKey = maxKey + 1;
+    while (embedDBPrev(state, &it, &key, &data)) {
+        expectedKey--;
+        TEST_ASSERT_EQUAL_UINT32(expectedKey, key);
+    }
+    TEST_ASSERT_EQUAL_UINT32(minKey, expectedKey);
+
+    // The pages holding the range, plus the pages read to find where it ends
+    uint32_t recordsPerPage = state->maxRecordsPerPage;
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE((maxKey - minKey) / recordsPerPage + 10, state->numReads, "Reverse iterator read pages outside of the key range.");
+    embedDBCloseIterator(&it);
+}
+
+void prev_should_apply_data_filters(void) {
+    embedDBIterator it;
+    uint32_t minData = 12, maxData = 13;
+    initIterator(&it, NULL, NULL, &minData, &maxData);
+
+    uint32_t key, data, expectedKey = 14 * 100;
+    while (embedDBPrev(state, &it, &key, &data)) {
+        expectedKey--;
+        TEST_ASSERT_EQUAL_UINT32(expectedKey, key);
+        TEST_ASSERT_TRUE(data >= minData && data <= maxData);
+    }
+    TEST_ASSERT_EQUAL_UINT32(12 * 100, expectedKey);
+    embedDBCloseIterator(&it);
+}
+
+void prev_ref_should_return_records_in_the_page_buffer(void) {
+    embedDBIterator it;
+    uint32_t minKey = NUM_RECORDS - 300;
+    initIterator(&it, &minKey, NULL, NULL, NULL);
+
+    const void *key, *data;
+    uint32_t expectedKey = NUM_RECORDS;
+    while (embedDBPrevRef(state, &it, &key, &data)) {
+        expectedKey--;
+        TEST_ASSERT_EQUAL_UINT32(expectedKey, *(const uint32_t *)key);
+        TEST_ASSERT_EQUAL_UINT32(expectedKey / 100, *(const uint32_t *)data);
+    }
+    TEST_ASSERT_EQUAL_UINT32(minKey, expectedKey);
+    embedDBCloseIterator(&it);
+}
+
+void prev_var_should_return_variable_data(void) {
+    embedDBIterator it;
+    uint32_t minKey = NUM_RECORDS - 100;
+    initIterator(&it, &minKey, NULL, NULL, NULL);
+
+    uint32_t key, data, expectedKey = NUM_RECORDS;
+    char expected[12], buf[12];
+    embedDBVarDataStream *varStream = NULL;
+    while (embedDBPrevVar(state, &it, &key, &data, &varStream)) {
+        expectedKey--;
+        TEST_ASSERT_EQUAL_UINT32(expectedKey, key);
+        TEST_ASSERT_NOT_NULL_MESSAGE(varStream, "Record has no variable data.");
+        TEST_ASSERT_EQUAL_UINT32(sizeof(buf), embedDBVarDataStreamRead(state, varStream, buf, sizeof(buf)));
+        snprintf(expected, sizeof(expected), "Record %04u", (unsigned int)key);
+        TEST_ASSERT_EQUAL_STRING(expected, buf);
+        free(varStream);
+        varStream = NULL;
+    }
+    TEST_ASSERT_EQUAL_UINT32(minKey, expectedKey);
+    embedDBCloseIterator(&it);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(prev_should_return_records_newest_first);
+    RUN_TEST(prev_should_only_read_recent_pages);
+    RUN_TEST(prev_should_start_at_max_key_and_stop_at_min_key);
+    RUN_TEST(prev_should_apply_data_filters);
+    RUN_TEST(prev_ref_should_return_records_in_the_page_buffer);
+    RUN_TEST(prev_var_should_return_variable_data);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
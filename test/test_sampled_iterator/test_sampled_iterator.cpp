@@ -0,0 +1,255 @@
+/******************************************************************************/
+/**
+ * @file        test_sampled_iterator.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test downsampled reads with embedDBNextSample.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define INDEX_PATH "indexFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define INDEX_PATH "build/artifacts/indexFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 6000
+#define KEY_STEP 3
+#define LAST_KEY ((NUM_RECORDS - 1) * KEY_STEP)
+
+embedDBState *state;
+embedDBIterator it;
+
+void setUp(void) {
+    state = (embedDBState *)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+    state->keySize = 4;
+    state->dataSize = 4;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 4;
+    state->buffer = calloc(1, (size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 8;
+    state->numDataPages = 1000;
+    state->numIndexPages = 48;
+    state->eraseSizeInPages = 4;
+    char dataPath[] = DATA_PATH, indexPath[] = INDEX_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->indexFile = setupFile(indexPath);
+    state->parameters = EMBEDDB_USE_BMAP | EMBEDDB_USE_INDEX | EMBEDDB_RESET_DATA;
+    state->bitmapSize = 1;
+    state->inBitmap = inBitmapInt8;
+    state->updateBitmap = updateBitmapInt8;
+    state->buildBitmapFromRange = buildBitmapInt8FromRange;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(state, 1), "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    // Keys step by 3. The data is the record number.
+    for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+        uint32_t key = i * KEY_STEP, data = i;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, &data), "embedDBPut failed.");
+    }
+
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+}
+
+void tearDown(void) {
+    embedDBCloseIterator(&it);
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    tearDownFile(state->indexFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+}
+
+/* Smallest stored key that is >= target */
+static uint32_t nextStoredKey(uint32_t target) {
+    return (target + KEY_STEP - 1) / KEY_STEP * KEY_STEP;
+}
+
+void sample_should_return_first_key_after_each_stride(void) {
+    embedDBInitIterator(state, &it);
+    uint32_t key, data, count = 0, expected = 0;
+    while (embedDBNextSample(state, &it, 100, &key, &data)) {
+        TEST_ASSERT_EQUAL_UINT32(expected, key);
+        TEST_ASSERT_EQUAL_UINT32(key / KEY_STEP, data);
+        expected = nextStoredKey(key + 100);
+        count++;
+    }
+    TEST_ASSERT_TRUE(expected > LAST_KEY);
+    TEST_ASSERT_TRUE(count > LAST_KEY / 102);
+}
+
+void sample_should_only_read_pages_with_samples(void) {
+    // The stride spans several pages, so each sample should cost about one page read
+    uint32_t stride = 1000, key, data, count = 0;
+    embedDBInitIterator(state, &it);
+    embedDBResetStats(state);
+    while (embedDBNextSample(state, &it, stride, &key, &data))
+        count++;
+    TEST_ASSERT_EQUAL_UINT32(LAST_KEY / 1002 + 1, count);
+    TEST_ASSERT_TRUE_MESSAGE(state->numReads <= 2 * count, "Sampled read should not scan pages between samples.");
+
+    uint32_t pages = state->nextDataPageId - state->minDataPageId;
+    TEST_ASSERT_TRUE(count < pages / 3);
+}
+
+void sample_should_respect_key_range(void) {
+    uint32_t minKey = 1000, maxKey = 2000;
+    it.minKey = &minKey;
+    it.maxKey = &maxKey;
+    embedDBInitIterator(state, &it);
+    uint32_t key, data, expected = nextStoredKey(minKey), count = 0;
+    while (embedDBNextSample(state, &it, 250, &key, &data)) {
+        TEST_ASSERT_EQUAL_UINT32(expected, key);
+        TEST_ASSERT_TRUE(key <= maxKey);
+        expected = nextStoredKey(key + 250);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(4, count);
+}
+
+void sample_with_small_stride_should_return_every_record(void) {
+    embedDBInitIterator(state, &it);
+    uint32_t key, data, count = 0;
+    while (embedDBNextSample(state, &it, 1, &key, &data)) {
+        TEST_ASSERT_EQUAL_UINT32(count * KEY_STEP, key);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+}
+
+void sample_with_zero_stride_should_return_every_record(void) {
+    embedDBInitIterator(state, &it);
+    uint32_t key, data, count = 0;
+    while (embedDBNextSample(state, &it, 0, &key, &data)) {
+        TEST_ASSERT_EQUAL_UINT32(count * KEY_STEP, key);
+        count++;
+        TEST_ASSERT_TRUE_MESSAGE(count <= NUM_RECORDS, "A stride of 0 returned a record twice.");
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, count);
+}
+
+void sample_should_end_when_target_key_wraps(void) {
+    // The last key plus the stride is 2^32, which would wrap around to key 0
+    uint32_t minKey = LAST_KEY, key, data;
+    it.minKey = &minKey;
+    embedDBInitIterator(state, &it);
+    uint64_t stride = ((uint64_t)1 << 32) - LAST_KEY;
+    TEST_ASSERT_TRUE(embedDBNextSample(state, &it, stride, &key, &data));
+    TEST_ASSERT_EQUAL_UINT32(LAST_KEY, key);
+    TEST_ASSERT_FALSE(embedDBNextSample(state, &it, stride, &key, &data));
+}
+
+void sample_should_downsample_to_point_count(void) {
+    // Pick the stride from the number of points wanted over the whole range
+    uint32_t numPoints = 50, stride = LAST_KEY / numPoints, key, data, count = 0, previous = 0;
+    embedDBInitIterator(state, &it);
+    while (embedDBNextSample(state, &it, stride, &key, &data)) {
+        if (count > 0)
+            TEST_ASSERT_TRUE(key - previous >= stride && key - previous < stride + KEY_STEP);
+        previous = key;
+        count++;
+    }
+    TEST_ASSERT_TRUE(count >= numPoints - 1 && count <= numPoints + 1);
+}
+
+void sample_should_end_when_stride_passes_last_key(void) {
+    uint32_t key, data;
+    embedDBInitIterator(state, &it);
+    TEST_ASSERT_TRUE(embedDBNextSample(state, &it, LAST_KEY + 1, &key, &data));
+    TEST_ASSERT_EQUAL_UINT32(0, key);
+    TEST_ASSERT_FALSE(embedDBNextSample(state, &it, LAST_KEY + 1, &key, &data));
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(sample_should_return_first_key_after_each_stride);
+    RUN_TEST(sample_should_only_read_pages_with_samples);
+    RUN_TEST(sample_should_respect_key_range);
+    RUN_TEST(sample_with_small_stride_should_return_every_record);
+    RUN_TEST(sample_with_zero_stride_should_return_every_record);
+    RUN_TEST(sample_should_end_when_target_key_wraps);
+    RUN_TEST(sample_should_downsample_to_point_count);
+    RUN_TEST(sample_should_end_when_stride_passes_last_key);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,279 @@
+/******************************************************************************/
+/**
+ * @file        test_secondary_index.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test the EmbedDB secondary index on a data column.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <math.h>
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define SECONDARY_INDEX_PATH "secondaryIndexFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define SECONDARY_INDEX_PATH "build/artifacts/secondaryIndexFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 6000
+
+embedDBState* state;
+
+int32_t temperatureForKey(uint32_t key) {
+    return 200 + (key / 10) % 50;
+}
+
+void insertTemperatureRecords(uint32_t numRecords) {
+    int32_t data[2];
+    for (uint32_t key = 0; key < numRecords; key++) {
+        data[0] = temperatureForKey(key);
+        data[1] = key % 97;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+}
+
+void initState(uint32_t numSecondaryIndexPages) {
+    state = (embedDBState*)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+
+    state->keySize = 4;
+    state->dataSize = 8;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 4;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 20;
+    state->numDataPages = 1000;
+    state->eraseSizeInPages = 4;
+
+    char dataPath[] = DATA_PATH, secondaryIndexPath[] = SECONDARY_INDEX_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->secondaryIndexFile = setupFile(secondaryIndexPath);
+
+    state->parameters = EMBEDDB_USE_SECONDARY_INDEX | EMBEDDB_RESET_DATA;
+    state->bitmapSize = 0;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+
+    /* Secondary index on the first data column (temperature) */
+    state->numSecondaryIndexPages = numSecondaryIndexPages;
+    state->secondaryIndexOffset = 0;
+    state->secondaryIndexSize = 4;
+    state->compareSecondaryIndex = int32Comparator;
+
+    int8_t result = embedDBInit(state, 1);
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, result, "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+}
+
+void setUp(void) {
+    initState(200);
+}
+
+void tearDown(void) {
+    void* secondaryIndexFile = state->secondaryIndexFile;
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    tearDownFile(secondaryIndexFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+    state = NULL;
+}
+
+uint32_t countSecondary(int32_t* minValue, int32_t* maxValue) {
+    embedDBSecondaryIterator it;
+    it.minValue = minValue;
+    it.maxValue = maxValue;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInitSecondaryIterator(state, &it), "Failed to initialize secondary iterator.");
+
+    uint32_t key = 0, count = 0, lastKey = 0;
+    int32_t data[2];
+    while (embedDBNextSecondary(state, &it, &key, data)) {
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(temperatureForKey(key), data[0], "Secondary iterator returned the wrong record for a key.");
+        if (minValue != NULL)
+            TEST_ASSERT_GREATER_OR_EQUAL_INT32(*minValue, data[0]);
+        if (maxValue != NULL)
+            TEST_ASSERT_LESS_OR_EQUAL_INT32(*maxValue, data[0]);
+        if (count > 0)
+            TEST_ASSERT_GREATER_THAN_UINT32_MESSAGE(lastKey, key, "Secondary iterator did not return records in key order.");
+        lastKey = key;
+        count++;
+    }
+    embedDBCloseSecondaryIterator(&it);
+    return count;
+}
+
+uint32_t expectedCount(uint32_t numRecords, int32_t minValue, int32_t maxValue) {
+    uint32_t count = 0;
+    for (uint32_t key = 0; key < numRecords; key++) {
+        int32_t value = temperatureForKey(key);
+        if (value >= minValue && value <= maxValue)
+            count++;
+    }
+    return count;
+}
+
+void embedDBInit_should_reject_secondary_index_outside_of_data(void) {
+    embedDBState* badState = (embedDBState*)malloc(sizeof(embedDBState));
+    memcpy(badState, state, sizeof(embedDBState));
+    badState->secondaryIndexOffset = 6;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(-1, embedDBInit(badState, 1), "EmbedDB should not allow a secondary index column outside of the record data.");
+    free(badState);
+}
+
+void embedDBNextSecondary_should_return_records_with_value_in_range(void) {
+    insertTemperatureRecords(NUM_RECORDS);
+
+    int32_t minValue = 230, maxValue = 231;
+    embedDBResetStats(state);
+    uint32_t count = countSecondary(&minValue, &maxValue);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(expectedCount(NUM_RECORDS, minValue, maxValue), count, "Secondary iterator did not return all records in range.");
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(state->nextDataPageId / 4, state->numReads, "Secondary index did not skip data pages.");
+}
+
+void embedDBNextSecondary_should_return_nothing_for_missing_value(void) {
+    insertTemperatureRecords(NUM_RECORDS);
+
+    int32_t value = 500;
+    embedDBResetStats(state);
+    TEST_ASSERT_EQUAL_UINT32(0, countSecondary(&value, &value));
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, state->numReads, "Secondary index read data pages for a value that was never inserted.");
+}
+
+void embedDBNextSecondary_should_find_records_in_write_buffer_and_after_flush(void) {
+    insertTemperatureRecords(NUM_RECORDS);
+
+    int32_t value = temperatureForKey(NUM_RECORDS - 1);
+    TEST_ASSERT_EQUAL_UINT32(expectedCount(NUM_RECORDS, value, value), countSecondary(&value, &value));
+
+    embedDBFlush(state);
+    TEST_ASSERT_EQUAL_UINT32(expectedCount(NUM_RECORDS, value, value), countSecondary(&value, &value));
+
+    /* Temperatures repeat every 500 keys */
+    uint32_t key = NUM_RECORDS - 1 + 500;
+    int32_t data[2] = {value, 0};
+    embedDBPut(state, &key, data);
+    TEST_ASSERT_EQUAL_UINT32(expectedCount(NUM_RECORDS, value, value) + 1, countSecondary(&value, &value));
+}
+
+void embedDBNextSecondary_should_be_correct_after_secondary_index_wraps(void) {
+    tearDown();
+    initState(8);
+    insertTemperatureRecords(NUM_RECORDS);
+
+    int32_t minValue = 210, maxValue = 215;
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(expectedCount(NUM_RECORDS, minValue, maxValue), countSecondary(&minValue, &maxValue), "Secondary iterator missed records that are no longer indexed.");
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, countSecondary(NULL, NULL));
+}
+
+int8_t (*fileWrite)(void* buffer, uint32_t pageNum, uint32_t pageSize, void* file);
+
+/* Writes to the secondary index file fail, the other files are written as usual */
+int8_t failingSecondaryIndexWrite(void* buffer, uint32_t pageNum, uint32_t pageSize, void* file) {
+    if (file == state->secondaryIndexFile)
+        return 0;
+    return fileWrite(buffer, pageNum, pageSize, file);
+}
+
+void writePage_should_fail_when_secondary_index_page_fails(void) {
+    /* Every record has its own temperature, so two data pages do not fit in one sorted run */
+    TEST_ASSERT_LESS_THAN_UINT32(2 * state->maxRecordsPerPage, state->maxSecondaryIndexRecordsPerPage);
+    int32_t data[2] = {0, 0};
+    for (uint32_t key = 0; key < 2u * state->maxRecordsPerPage; key++) {
+        data[0] = (int32_t)key;
+        TEST_ASSERT_EQUAL_INT8(0, embedDBPut(state, &key, data));
+    }
+
+    /* The full page in the write buffer does not fit in the run, so the run is written first */
+    fileWrite = state->fileInterface->write;
+    state->fileInterface->write = failingSecondaryIndexWrite;
+    id_t pageNum = writePage(state, state->buffer);
+    state->fileInterface->write = fileWrite;
+    TEST_ASSERT_TRUE_MESSAGE(pageNum == (id_t)-1, "writePage did not fail when the secondary index page could not be written.");
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(embedDBInit_should_reject_secondary_index_outside_of_data);
+    RUN_TEST(embedDBNextSecondary_should_return_records_with_value_in_range);
+    RUN_TEST(embedDBNextSecondary_should_return_nothing_for_missing_value);
+    RUN_TEST(embedDBNextSecondary_should_find_records_in_write_buffer_and_after_flush);
+    RUN_TEST(embedDBNextSecondary_should_be_correct_after_secondary_index_wraps);
+    RUN_TEST(writePage_should_fail_when_secondary_index_page_fails);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
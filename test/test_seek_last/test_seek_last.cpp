@@ -0,0 +1,251 @@
+/******************************************************************************/
+/**
+ * @file        test_seek_last.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test positioning an iterator on the last n records with embedDBIteratorSeekLast.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/activeRules.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_FILE_PATH "dataFile.bin"
+#define INDEX_FILE_PATH "indexFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_FILE_PATH "build/artifacts/dataFile.bin"
+#define INDEX_FILE_PATH "build/artifacts/indexFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 1000
+
+embedDBState *state;
+
+// Keys are sparse so a window of n records cannot be found from the key
+uint32_t keyOf(uint32_t record) {
+    return record * 10 + 3;
+}
+
+void setUp(void) {
+    state = (embedDBState *)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+    state->keySize = 4;
+    state->dataSize = 4;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 4;
+    state->numSplinePoints = 8;
+    state->buffer = calloc(1, state->pageSize * state->bufferSizeInBlocks);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate EmbedDB buffer.");
+    state->numDataPages = 1000;
+    state->numIndexPages = 48;
+    state->eraseSizeInPages = 4;
+    char dataPath[] = DATA_FILE_PATH, indexPath[] = INDEX_FILE_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->indexFile = setupFile(indexPath);
+    state->parameters = EMBEDDB_USE_BMAP | EMBEDDB_USE_INDEX | EMBEDDB_RESET_DATA;
+    state->bitmapSize = 1;
+    state->inBitmap = inBitmapInt8;
+    state->updateBitmap = updateBitmapInt8;
+    state->buildBitmapFromRange = buildBitmapInt8FromRange;
+    state->compareKey = int32Comparator;
+    state->compareData = int32Comparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(state, 1), "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+        uint32_t key = keyOf(i);
+        int32_t data = (int32_t)i;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, &data), "embedDBPut failed.");
+    }
+}
+
+void tearDown(void) {
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    tearDownFile(state->indexFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+}
+
+uint32_t writeBufferCount(void) {
+    return EMBEDDB_GET_COUNT((int8_t *)state->buffer + EMBEDDB_DATA_WRITE_BUFFER * state->pageSize);
+}
+
+void checkSeekLast(uint32_t n) {
+    embedDBIterator it;
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeekLast(state, &it, n));
+
+    uint32_t expected = n < NUM_RECORDS ? NUM_RECORDS - n : 0;
+    uint32_t key;
+    int32_t data;
+    while (embedDBNext(state, &it, &key, &data)) {
+        TEST_ASSERT_EQUAL_UINT32(keyOf(expected), key);
+        TEST_ASSERT_EQUAL_INT32((int32_t)expected, data);
+        expected++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS, expected);
+    embedDBCloseIterator(&it);
+}
+
+void seek_last_should_return_last_n_records(void) {
+    uint32_t bufferCount = writeBufferCount();
+    TEST_ASSERT_TRUE(bufferCount > 0);
+    checkSeekLast(0);
+    checkSeekLast(1);
+    checkSeekLast(bufferCount);
+    checkSeekLast(bufferCount + 1);
+    checkSeekLast(bufferCount + state->maxRecordsPerPage);
+    checkSeekLast(bufferCount + state->maxRecordsPerPage * 3 + 5);
+    checkSeekLast(NUM_RECORDS - 1);
+    checkSeekLast(NUM_RECORDS);
+    checkSeekLast(NUM_RECORDS * 5);
+}
+
+void seek_last_should_only_read_pages_in_window(void) {
+    uint32_t n = 300;
+    uint32_t pagesInWindow = (n - writeBufferCount() + state->maxRecordsPerPage - 1) / state->maxRecordsPerPage;
+
+    embedDBIterator it;
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+    state->numReads = 0;
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeekLast(state, &it, n));
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, state->numReads, "Seeking should not read storage.");
+
+    uint32_t key, count = 0;
+    int32_t data;
+    while (embedDBNext(state, &it, &key, &data)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(n, count);
+    TEST_ASSERT_EQUAL_UINT32(pagesInWindow, state->numReads);
+    embedDBCloseIterator(&it);
+}
+
+void seek_last_should_keep_data_filters(void) {
+    int32_t minData = NUM_RECORDS - 50;
+    embedDBIterator it;
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = &minData;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+    TEST_ASSERT_EQUAL_INT8(0, embedDBIteratorSeekLast(state, &it, 200));
+
+    uint32_t key, count = 0;
+    int32_t data;
+    while (embedDBNext(state, &it, &key, &data)) {
+        TEST_ASSERT_TRUE(data >= minData);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(50, count);
+    embedDBCloseIterator(&it);
+}
+
+void get_avg_should_use_last_records_with_sparse_keys(void) {
+    int8_t colSizes[] = {4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_SIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_INT32};
+    embedDBSchema *schema = embedDBCreateSchema(2, colSizes, colSignedness, colTypes);
+    TEST_ASSERT_NOT_NULL_MESSAGE(schema, "Failed to create schema.");
+
+    uint32_t numLast = 100;
+    activeRule *rule = createActiveRule(schema, NULL);
+    rule->IF(rule, 1, GET_AVG)->ofLast(rule, &numLast);
+
+    // The last 100 records hold the data values 900 to 999
+    uint32_t lastKey = keyOf(NUM_RECORDS - 1);
+    TEST_ASSERT_EQUAL_FLOAT(949.5f, GetAvg(state, rule, &lastKey));
+
+    freeActiveRule(&rule);
+    embedDBFreeSchema(&schema);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(seek_last_should_return_last_n_records);
+    RUN_TEST(seek_last_should_only_read_pages_in_window);
+    RUN_TEST(seek_last_should_keep_data_filters);
+    RUN_TEST(get_avg_should_use_last_records_with_sparse_keys);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
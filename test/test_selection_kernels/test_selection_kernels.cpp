@@ -0,0 +1,290 @@
+/******************************************************************************/
+/**
+ * @file        test_selection_kernels.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test the type-specialized predicates and multi-predicate selections.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#endif
+
+#include "unity.h"
+
+#define NUM_RECORDS 1000
+#define DATA_SIZE 18
+
+embedDBState* state;
+embedDBSchema* schema;
+
+void setUp(void) {
+    state = (embedDBState*)malloc(sizeof(embedDBState));
+    TEST_ASSERT_NOT_NULL_MESSAGE(state, "Unable to allocate embedDBState.");
+    state->keySize = 4;
+    state->dataSize = DATA_SIZE;
+    state->pageSize = 512;
+    state->bufferSizeInBlocks = 2;
+    state->buffer = malloc((size_t)state->bufferSizeInBlocks * state->pageSize);
+    TEST_ASSERT_NOT_NULL_MESSAGE(state->buffer, "Failed to allocate buffer for EmbedDB.");
+    state->numSplinePoints = 20;
+    state->numDataPages = 1000;
+    state->eraseSizeInPages = 4;
+    char dataPath[] = DATA_PATH;
+    state->fileInterface = getFileInterface();
+    state->dataFile = setupFile(dataPath);
+    state->parameters = EMBEDDB_RESET_DATA;
+    state->bitmapSize = 0;
+    state->compareKey = int32Comparator;
+    state->compareData = floatComparator;
+    TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBInit(state, 1), "EmbedDB did not initialize correctly.");
+    state->rules = NULL;
+
+    // Columns: float i - 500.5, double (i - 500) / 4, int16 i - 500, uint8 i % 256 and a 3 byte signed i - 500
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        int8_t data[DATA_SIZE];
+        float f = (float)key - 500.5f;
+        double d = ((double)key - 500) / 4;
+        int16_t i16 = (int16_t)(key - 500);
+        uint8_t u8 = (uint8_t)(key % 256);
+        int32_t i24 = (int32_t)key - 500;
+        memcpy(data, &f, 4);
+        memcpy(data + 4, &d, 8);
+        memcpy(data + 12, &i16, 2);
+        memcpy(data + 14, &u8, 1);
+        memcpy(data + 15, &i24, 3);
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+
+    int8_t colSizes[] = {4, 4, 8, 2, 1, 3};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_SIGNED, embedDB_COLUMN_SIGNED, embedDB_COLUMN_SIGNED, embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_SIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_FLOAT, embedDB_COLUMN_DOUBLE, embedDB_COLUMN_INT32, embedDB_COLUMN_UINT32, embedDB_COLUMN_INT32};
+    schema = embedDBCreateSchema(6, colSizes, colSignedness, colTypes);
+}
+
+void tearDown(void) {
+    embedDBFreeSchema(&schema);
+    embedDBClose(state);
+    tearDownFile(state->dataFile);
+    free(state->fileInterface);
+    free(state->buffer);
+    free(state);
+}
+
+int8_t singleGroup(const void* lastRecord, const void* record) {
+    return 1;
+}
+
+/* Counts the records selected by the predicates, one record at a time and again with a count aggregate that reads batches */
+uint32_t countSelected(embedDBPredicate* predicates, uint8_t numPredicates, int8_t combine) {
+    uint32_t counts[2] = {0, 0};
+    for (int8_t useAggregate = 0; useAggregate < 2; useAggregate++) {
+        embedDBIterator it;
+        it.minKey = NULL;
+        it.maxKey = NULL;
+        it.minData = NULL;
+        it.maxData = NULL;
+        embedDBInitIterator(state, &it);
+
+        embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+        embedDBOperator* selectOp = createPredicateSelectionOperator(scanOp, predicates, numPredicates, combine);
+        TEST_ASSERT_NOT_NULL(selectOp);
+        if (useAggregate) {
+            embedDBAggregateFunc* counter = createCountAggregate();
+            embedDBOperator* aggOp = createAggregateOperator(selectOp, singleGroup, counter, 1);
+            aggOp->init(aggOp);
+            if (exec(aggOp)) {
+                memcpy(&counts[1], aggOp->recordBuffer, sizeof(uint32_t));
+            }
+            aggOp->close(aggOp);
+            embedDBFreeOperatorRecursive(&aggOp);
+            free(counter->state);
+            free(counter);
+        } else {
+            selectOp->init(selectOp);
+            while (exec(selectOp)) {
+                counts[0]++;
+            }
+            selectOp->close(selectOp);
+        }
+        embedDBFreeOperatorRecursive(&selectOp);
+        embedDBCloseIterator(&it);
+    }
+    TEST_ASSERT_EQUAL_UINT32(counts[0], counts[1]);
+    return counts[0];
+}
+
+void float_selection_should_order_negative_values(void) {
+    float limit = -100.0f;
+    embedDBPredicate lessThan = {1, SELECT_LT, &limit};
+    TEST_ASSERT_EQUAL_UINT32(401, countSelected(&lessThan, 1, EMBEDDB_SELECT_AND));
+
+    float half = -0.5f;
+    embedDBPredicate atLeast = {1, SELECT_GTE, &half};
+    TEST_ASSERT_EQUAL_UINT32(500, countSelected(&atLeast, 1, EMBEDDB_SELECT_AND));
+}
+
+void double_selection_should_compare_values(void) {
+    double limit = -10.0;
+    embedDBPredicate atMost = {2, SELECT_LTE, &limit};
+    TEST_ASSERT_EQUAL_UINT32(461, countSelected(&atMost, 1, EMBEDDB_SELECT_AND));
+
+    // Negative zero has different bytes but is equal to zero
+    double zero = -0.0;
+    embedDBPredicate equal = {2, SELECT_EQ, &zero};
+    TEST_ASSERT_EQUAL_UINT32(1, countSelected(&equal, 1, EMBEDDB_SELECT_AND));
+    embedDBPredicate notEqual = {2, SELECT_NEQ, &zero};
+    TEST_ASSERT_EQUAL_UINT32(NUM_RECORDS - 1, countSelected(&notEqual, 1, EMBEDDB_SELECT_AND));
+}
+
+void integer_selection_should_use_column_width(void) {
+    int16_t i16 = -3;
+    embedDBPredicate greater = {3, SELECT_GT, &i16};
+    TEST_ASSERT_EQUAL_UINT32(502, countSelected(&greater, 1, EMBEDDB_SELECT_AND));
+
+    uint8_t u8 = 7;
+    embedDBPredicate equal = {4, SELECT_EQ, &u8};
+    TEST_ASSERT_EQUAL_UINT32(4, countSelected(&equal, 1, EMBEDDB_SELECT_AND));
+
+    // Three byte columns are compared byte by byte
+    int32_t i24 = -498;
+    embedDBPredicate atMost = {5, SELECT_LTE, &i24};
+    TEST_ASSERT_EQUAL_UINT32(3, countSelected(&atMost, 1, EMBEDDB_SELECT_AND));
+}
+
+void conjunction_should_select_records_meeting_every_predicate(void) {
+    int16_t zero = 0;
+    uint8_t u8 = 7;
+    embedDBPredicate predicates[] = {{3, SELECT_GTE, &zero}, {4, SELECT_EQ, &u8}};
+    TEST_ASSERT_EQUAL_UINT32(2, countSelected(predicates, 2, EMBEDDB_SELECT_AND));
+
+    // A key predicate is pushed down to the iterator
+    uint32_t minKey = 600;
+    embedDBPredicate withKey[] = {{0, SELECT_GTE, &minKey}, {4, SELECT_EQ, &u8}};
+    TEST_ASSERT_EQUAL_UINT32(1, countSelected(withKey, 2, EMBEDDB_SELECT_AND));
+}
+
+void disjunction_should_select_records_meeting_any_predicate(void) {
+    int16_t i16 = -495;
+    uint8_t u8 = 255;
+    embedDBPredicate predicates[] = {{3, SELECT_LT, &i16}, {4, SELECT_EQ, &u8}};
+    TEST_ASSERT_EQUAL_UINT32(8, countSelected(predicates, 2, EMBEDDB_SELECT_OR));
+
+    // Key predicates of a disjunction must not be pushed down to the iterator
+    uint32_t low = 10, high = 990;
+    embedDBPredicate keys[] = {{0, SELECT_LT, &low}, {0, SELECT_GT, &high}};
+    TEST_ASSERT_EQUAL_UINT32(19, countSelected(keys, 2, EMBEDDB_SELECT_OR));
+}
+
+void rebinding_should_change_one_predicate(void) {
+    embedDBIterator it;
+    it.minKey = NULL;
+    it.maxKey = NULL;
+    it.minData = NULL;
+    it.maxData = NULL;
+    embedDBInitIterator(state, &it);
+
+    float limit = 0.0f;
+    double other = 1000.0;
+    embedDBPredicate predicates[] = {{2, SELECT_LT, &other}, {1, SELECT_GT, &limit}};
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* selectOp = createPredicateSelectionOperator(scanOp, predicates, 2, EMBEDDB_SELECT_AND);
+    selectOp->init(selectOp);
+
+    float newLimit = 400.0f;
+    TEST_ASSERT_EQUAL_INT8(-1, embedDBRebindSelection(selectOp, 2, &newLimit));
+    TEST_ASSERT_EQUAL_INT8(0, embedDBRebindSelection(selectOp, 1, &newLimit));
+    TEST_ASSERT_EQUAL_INT8(0, embedDBResetOperator(selectOp));
+    uint32_t count = 0;
+    while (exec(selectOp)) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(99, count);
+
+    selectOp->close(selectOp);
+    embedDBFreeOperatorRecursive(&selectOp);
+    embedDBCloseIterator(&it);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(float_selection_should_order_negative_values);
+    RUN_TEST(double_selection_should_compare_values);
+    RUN_TEST(integer_selection_should_use_column_width);
+    RUN_TEST(conjunction_should_select_records_meeting_every_predicate);
+    RUN_TEST(disjunction_should_select_records_meeting_any_predicate);
+    RUN_TEST(rebinding_should_change_one_predicate);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
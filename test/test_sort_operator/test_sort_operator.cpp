@@ -0,0 +1,235 @@
+/******************************************************************************/
+/**
+ * @file        test_sort_operator.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test the external merge sort operator.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#define INDEX_PATH "indexFile.bin"
+#define SCRATCH_PATH "scratchFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#define INDEX_PATH "build/artifacts/indexFile.bin"
+#define SCRATCH_PATH "build/artifacts/scratchFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 3000
+
+embedDBState* state;
+embedDBSchema* baseSchema;
+embedDBIterator it;
+embedDBFileInterface* scratchInterface;
+void* scratchFile;
+uint32_t scratchWrites;
+int8_t (*fileWrite)(void* buffer, uint32_t pageNum, uint32_t pageSize, void* file);
+
+int32_t valueForKey(uint32_t key) {
+    return (int32_t)((key * 7919) % 10007) - 5000;
+}
+
+int8_t countingWrite(void* buffer, uint32_t pageNum, uint32_t pageSize, void* file) {
+    scratchWrites++;
+    return fileWrite(buffer, pageNum, pageSize, file);
+}
+
+void setUp(void) {
+    char dataPath[] = DATA_PATH;
+    state = createState(dataPath, 8, EMBEDDB_RESET_DATA);
+
+    int32_t data[2];
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        data[0] = valueForKey(key);
+        data[1] = key;
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+    embedDBFlush(state);
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_SIGNED, embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_INT32, embedDB_COLUMN_UINT32};
+    baseSchema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+
+    initFullIterator(state, &it);
+
+    char scratchPath[] = SCRATCH_PATH;
+    scratchInterface = getFileInterface();
+    fileWrite = scratchInterface->write;
+    scratchInterface->write = countingWrite;
+    scratchFile = setupFile(scratchPath);
+    scratchWrites = 0;
+}
+
+void tearDown(void) {
+    embedDBCloseIterator(&it);
+    embedDBFreeSchema(&baseSchema);
+    tearDownFile(scratchFile);
+    free(scratchInterface);
+    freeState(state);
+    state = NULL;
+}
+
+/**
+ * @brief	Reads every record of a sort operator on column 1 and checks that each record is output once and in order
+ */
+void checkSortedOutput(embedDBOperator* sortOp, int8_t direction) {
+    uint8_t* seen = (uint8_t*)calloc(NUM_RECORDS, 1);
+    uint32_t count = 0;
+    int32_t lastValue = 0;
+    uint32_t* recordBuffer = (uint32_t*)sortOp->recordBuffer;
+    while (exec(sortOp)) {
+        uint32_t key = recordBuffer[0];
+        int32_t value = (int32_t)recordBuffer[1];
+        TEST_ASSERT_LESS_THAN_UINT32(NUM_RECORDS, key);
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(0, seen[key], "Record was output more than once.");
+        seen[key] = 1;
+        TEST_ASSERT_EQUAL_INT32(valueForKey(key), value);
+        TEST_ASSERT_EQUAL_UINT32(key, recordBuffer[2]);
+        if (count > 0) {
+            TEST_ASSERT_TRUE_MESSAGE(direction == EMBEDDB_SORT_ASC ? lastValue <= value : lastValue >= value, "Records are not in order.");
+        }
+        lastValue = value;
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(NUM_RECORDS, count, "Sort didn't return every record.");
+    free(seen);
+}
+
+void sort_should_order_records_in_memory(void) {
+    uint32_t memorySize = NUM_RECORDS * 12;
+    int8_t* memory = (int8_t*)malloc(memorySize);
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* sortOp = createSortOperator(scanOp, 1, EMBEDDB_SORT_ASC, memory, memorySize, NULL, NULL, 0);
+    sortOp->init(sortOp);
+
+    checkSortedOutput(sortOp, EMBEDDB_SORT_ASC);
+
+    sortOp->close(sortOp);
+    embedDBFreeOperatorRecursive(&sortOp);
+    free(memory);
+}
+
+void sort_should_merge_runs_from_scratch_file(void) {
+    // Four pages only merge three runs at a time, so there are several merge passes
+    uint32_t pageSize = 128;
+    int8_t memory[4 * 128];
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* sortOp = createSortOperator(scanOp, 1, EMBEDDB_SORT_ASC, memory, sizeof(memory), scratchInterface, scratchFile, pageSize);
+    sortOp->init(sortOp);
+
+    checkSortedOutput(sortOp, EMBEDDB_SORT_ASC);
+    TEST_ASSERT_GREATER_THAN_UINT32_MESSAGE(2 * NUM_RECORDS * 12 / pageSize, scratchWrites, "Runs were not merged in several passes.");
+
+    sortOp->close(sortOp);
+    embedDBFreeOperatorRecursive(&sortOp);
+}
+
+void sort_should_order_descending(void) {
+    uint32_t pageSize = 256;
+    int8_t memory[8 * 256];
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* sortOp = createSortOperator(scanOp, 1, EMBEDDB_SORT_DESC, memory, sizeof(memory), scratchInterface, scratchFile, pageSize);
+    sortOp->init(sortOp);
+
+    checkSortedOutput(sortOp, EMBEDDB_SORT_DESC);
+
+    sortOp->close(sortOp);
+    embedDBFreeOperatorRecursive(&sortOp);
+}
+
+void sort_should_stop_when_full_without_scratch_file(void) {
+    int8_t memory[1024];
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, baseSchema);
+    embedDBOperator* sortOp = createSortOperator(scanOp, 1, EMBEDDB_SORT_ASC, memory, sizeof(memory), NULL, NULL, 0);
+    sortOp->init(sortOp);
+
+    TEST_ASSERT_FALSE_MESSAGE(exec(sortOp), "Sort returned records after running out of memory.");
+
+    sortOp->close(sortOp);
+    embedDBFreeOperatorRecursive(&sortOp);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(sort_should_order_records_in_memory);
+    RUN_TEST(sort_should_merge_runs_from_scratch_file);
+    RUN_TEST(sort_should_order_descending);
+    RUN_TEST(sort_should_stop_when_full_without_scratch_file);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,279 @@
+/******************************************************************************/
+/**
+ * @file        test_top_k.cpp
+ * @author      EmbedDB Team (See Authors.md)
+ * @brief       Test the limit and top-k operators.
+ * @copyright   Copyright 2024
+ *              EmbedDB Team
+ * @par Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ * @par 1.Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ * @par 2.Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * @par 3.Neither the name of the copyright holder nor the names of its contributors
+ *  may be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * @par THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+/*****************************************************************************/
+#include <string.h>
+
+#ifdef DIST
+#include "embedDB.h"
+#else
+#include "embedDB/embedDB.h"
+#include "embedDBUtility.h"
+#include "query-interface/advancedQueries.h"
+#endif
+
+#if defined(MEMBOARD)
+#include "memboardTestSetup.h"
+#endif
+
+#if defined(MEGA)
+#include "megaTestSetup.h"
+#endif
+
+#if defined(DUE)
+#include "dueTestSetup.h"
+#endif
+
+#ifdef ARDUINO
+#include "SDFileInterface.h"
+#define getFileInterface getSDInterface
+#define setupFile setupSDFile
+#define tearDownFile tearDownSDFile
+#define DATA_PATH "dataFile.bin"
+#else
+#include "desktopFileInterface.h"
+#define DATA_PATH "build/artifacts/dataFile.bin"
+#endif
+
+#include "unity.h"
+#include "../testState.h"
+
+#define NUM_RECORDS 10000
+#define HASH_PRIME 10007
+
+embedDBState* state;
+embedDBSchema* schema;
+embedDBIterator it;
+
+// Distinct values in a scrambled order
+uint32_t valueForKey(uint32_t key) {
+    return key * 7919 % HASH_PRIME;
+}
+
+void setUp(void) {
+    char dataPath[] = DATA_PATH;
+    state = createState(dataPath, 8, EMBEDDB_RESET_DATA);
+
+    // The last records stay in the write buffer
+    uint32_t data[2];
+    for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+        data[0] = key % 100;
+        data[1] = valueForKey(key);
+        TEST_ASSERT_EQUAL_INT8_MESSAGE(0, embedDBPut(state, &key, data), "embedDBPut failed.");
+    }
+
+    int8_t colSizes[] = {4, 4, 4};
+    int8_t colSignedness[] = {embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED, embedDB_COLUMN_UNSIGNED};
+    ColumnType colTypes[] = {embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32, embedDB_COLUMN_UINT32};
+    schema = embedDBCreateSchema(3, colSizes, colSignedness, colTypes);
+
+    initFullIterator(state, &it);
+}
+
+void tearDown(void) {
+    embedDBCloseIterator(&it);
+    embedDBFreeSchema(&schema);
+    freeState(state);
+}
+
+void limit_should_stop_reading_input(void) {
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* limitOp = createLimitOperator(scanOp, 5);
+    limitOp->init(limitOp);
+
+    embedDBResetStats(state);
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)limitOp->recordBuffer;
+    while (exec(limitOp)) {
+        TEST_ASSERT_EQUAL_UINT32(count, recordBuffer[0]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, count);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(1, state->numReads, "Limit read past the first page.");
+
+    limitOp->close(limitOp);
+    embedDBFreeOperatorRecursive(&limitOp);
+}
+
+void top_k_on_key_should_read_newest_pages(void) {
+    // The latest 10 readings with data[0] above 90
+    uint32_t threshold = 90;
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* selectOp = createSelectionOperator(scanOp, 1, SELECT_GT, &threshold);
+    embedDBOperator* topOp = createTopKOperator(selectOp, 0, 10, EMBEDDB_SORT_DESC);
+    topOp->init(topOp);
+
+    embedDBResetStats(state);
+    uint32_t count = 0, expectedKey = NUM_RECORDS;
+    uint32_t* recordBuffer = (uint32_t*)topOp->recordBuffer;
+    while (exec(topOp)) {
+        do {
+            expectedKey--;
+        } while (expectedKey % 100 <= threshold);
+        TEST_ASSERT_EQUAL_UINT32(expectedKey, recordBuffer[0]);
+        TEST_ASSERT_EQUAL_UINT32(valueForKey(expectedKey), recordBuffer[2]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(10, count);
+    TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(state->nextDataPageId / 10, state->numReads, "Top-k on the key read old pages.");
+
+    topOp->close(topOp);
+    embedDBFreeOperatorRecursive(&topOp);
+}
+
+void closing_top_k_should_restore_iterator_direction(void) {
+    embedDBOperator* topOp = createTopKOperator(createTableScanOperator(state, &it, schema), 0, 5, EMBEDDB_SORT_DESC);
+    topOp->init(topOp);
+    TEST_ASSERT_TRUE(it.isReverse);
+    while (exec(topOp)) {
+    }
+    topOp->close(topOp);
+    embedDBFreeOperatorRecursive(&topOp);
+    TEST_ASSERT_FALSE_MESSAGE(it.isReverse, "Closing the top-k left the caller's iterator reading backwards.");
+
+    // The iterator reads forwards from the oldest record again
+    uint32_t key, data[2];
+    TEST_ASSERT_TRUE(embedDBNext(state, &it, &key, data));
+    TEST_ASSERT_EQUAL_UINT32(0, key);
+
+    // Freeing a top-k that was not closed restores the direction too
+    topOp = createTopKOperator(createTableScanOperator(state, &it, schema), 0, 5, EMBEDDB_SORT_DESC);
+    topOp->init(topOp);
+    TEST_ASSERT_TRUE(it.isReverse);
+    embedDBFreeOperatorRecursive(&topOp);
+    TEST_ASSERT_FALSE(it.isReverse);
+    TEST_ASSERT_TRUE(embedDBNext(state, &it, &key, data));
+    TEST_ASSERT_EQUAL_UINT32(0, key);
+}
+
+void top_k_on_key_ascending_should_read_oldest_pages(void) {
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* topOp = createTopKOperator(scanOp, 0, 3, EMBEDDB_SORT_ASC);
+    topOp->init(topOp);
+
+    embedDBResetStats(state);
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)topOp->recordBuffer;
+    while (exec(topOp)) {
+        TEST_ASSERT_EQUAL_UINT32(count, recordBuffer[0]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, count);
+    TEST_ASSERT_EQUAL_UINT32(1, state->numReads);
+
+    topOp->close(topOp);
+    embedDBFreeOperatorRecursive(&topOp);
+}
+
+void checkTopKOnData(uint32_t k, int8_t direction) {
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* topOp = createTopKOperator(scanOp, 2, k, direction);
+    topOp->init(topOp);
+
+    // Values are distinct, so count how many are before each returned value
+    uint32_t count = 0;
+    uint32_t* recordBuffer = (uint32_t*)topOp->recordBuffer;
+    while (exec(topOp)) {
+        uint32_t before = 0;
+        for (uint32_t key = 0; key < NUM_RECORDS; key++) {
+            uint32_t value = valueForKey(key);
+            if (direction == EMBEDDB_SORT_DESC ? value > recordBuffer[2] : value < recordBuffer[2])
+                before++;
+        }
+        TEST_ASSERT_EQUAL_UINT32(count, before);
+        TEST_ASSERT_EQUAL_UINT32(valueForKey(recordBuffer[0]), recordBuffer[2]);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(k < NUM_RECORDS ? k : NUM_RECORDS, count);
+
+    topOp->close(topOp);
+    embedDBFreeOperatorRecursive(&topOp);
+}
+
+void top_k_should_order_any_column(void) {
+    checkTopKOnData(7, EMBEDDB_SORT_DESC);
+    embedDBIteratorUpdateBounds(state, &it);
+    checkTopKOnData(25, EMBEDDB_SORT_ASC);
+}
+
+void top_k_should_return_whole_input_when_smaller_than_k(void) {
+    uint32_t maxKey = 20;
+    it.maxKey = &maxKey;
+    embedDBIteratorUpdateBounds(state, &it);
+
+    embedDBOperator* scanOp = createTableScanOperator(state, &it, schema);
+    embedDBOperator* topOp = createTopKOperator(scanOp, 2, 100, EMBEDDB_SORT_ASC);
+    topOp->init(topOp);
+
+    uint32_t count = 0, lastValue = 0;
+    uint32_t* recordBuffer = (uint32_t*)topOp->recordBuffer;
+    while (exec(topOp)) {
+        TEST_ASSERT_TRUE(recordBuffer[0] <= maxKey);
+        TEST_ASSERT_TRUE(count == 0 || recordBuffer[2] > lastValue);
+        lastValue = recordBuffer[2];
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(maxKey + 1, count);
+
+    topOp->close(topOp);
+    embedDBFreeOperatorRecursive(&topOp);
+}
+
+int runUnityTests(void) {
+    UNITY_BEGIN();
+    RUN_TEST(limit_should_stop_reading_input);
+    RUN_TEST(top_k_on_key_should_read_newest_pages);
+    RUN_TEST(closing_top_k_should_restore_iterator_direction);
+    RUN_TEST(top_k_on_key_ascending_should_read_oldest_pages);
+    RUN_TEST(top_k_should_order_any_column);
+    RUN_TEST(top_k_should_return_whole_input_when_smaller_than_k);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(2000);
+    setupBoard();
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    return runUnityTests();
+}
+
+#endif